@@ -0,0 +1,222 @@
+#pragma once
+
+// Colour management for decoders whose libraries hand back samples in the
+// colour space the file declares, an embedded ICC profile or AVIF's CICP code
+// points, rather than in sRGB. The wrapper converts each RGBA8 row with skcms
+// as the library writes it, before the row is analysed or resized, so wide
+// gamut images come out right without another pass over the frame in JS.
+//
+// Usage:
+//
+//   jsquash::ColorConverter converter;
+//   if (!converter.Init(conversion, icc, icc_size)) {
+//     return val::null();  // `conversion` asked for an unusable profile
+//   }
+//   for (each decoded row) {
+//     converter.ConvertRow(row, width);
+//   }
+//
+// Needs skcms on the include path and linked in. libjxl vendors it, and the
+// JPEG, WebP and AVIF codec Makefiles build the same version of it.
+
+#include <emscripten/bind.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "skcms.h"
+
+namespace jsquash {
+
+struct ColorConversion {
+  // Whether to convert at all. When false, samples are returned as stored.
+  bool convert;
+  // ICC profile to convert to, such as the display's. Empty for sRGB.
+  std::string targetProfile;
+};
+
+// Safe to call from the bindings of every decoder in a module, see
+// RegisterDecodeResizeOptions().
+inline void RegisterColorConversion() {
+  static bool registered = false;
+  if (registered) {
+    return;
+  }
+  registered = true;
+  emscripten::value_object<ColorConversion>("ColorConversion")
+      .field("convert", &ColorConversion::convert)
+      .field("targetProfile", &ColorConversion::targetProfile);
+}
+
+// An ICC profile as skcms parsed it. skcms_ICCProfile points into the bytes it
+// was parsed from, so those are kept alongside.
+struct ParsedProfile {
+  std::vector<uint8_t> bytes;
+  skcms_ICCProfile profile;
+  // Close enough to sRGB that converting from it changes nothing.
+  bool is_srgb = false;
+};
+
+// Parses `size` bytes of ICC profile, or returns the already parsed copy of
+// the same bytes. Photos from one camera or one export preset all embed the
+// same profile, and parsing it and comparing it with sRGB costs more than
+// converting a small image. Profiles used as a conversion's target are made
+// usable as one, and cached apart from the others. Returns null for profiles
+// skcms can't read.
+inline std::shared_ptr<const ParsedProfile> ParseProfile(const uint8_t* data, size_t size,
+                                                         bool as_target) {
+  struct Entry {
+    uint64_t hash;
+    bool as_target;
+    std::shared_ptr<const ParsedProfile> parsed;
+  };
+  // Most recently used last.
+  static std::vector<Entry> cache;
+  constexpr size_t kCacheSize = 8;
+
+  // FNV-1a. Equal hashes still compare the bytes, so a collision only costs a
+  // parse.
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3ull;
+  }
+  for (size_t i = 0; i < cache.size(); i++) {
+    const Entry& entry = cache[i];
+    if (entry.hash == hash && entry.as_target == as_target &&
+        entry.parsed->bytes.size() == size &&
+        std::memcmp(entry.parsed->bytes.data(), data, size) == 0) {
+      Entry hit = entry;
+      cache.erase(cache.begin() + i);
+      cache.push_back(hit);
+      return hit.parsed;
+    }
+  }
+
+  auto parsed = std::make_shared<ParsedProfile>();
+  parsed->bytes.assign(data, data + size);
+  if (!skcms_Parse(parsed->bytes.data(), size, &parsed->profile)) {
+    return nullptr;
+  }
+  if (as_target) {
+    // Replaces the curves with a single parametric one that skcms can invert.
+    if (!skcms_MakeUsableAsDestinationWithSingleCurve(&parsed->profile)) {
+      return nullptr;
+    }
+  } else {
+    parsed->is_srgb = skcms_ApproximatelyEqualProfiles(&parsed->profile, skcms_sRGB_profile());
+  }
+
+  if (cache.size() == kCacheSize) {
+    cache.erase(cache.begin());
+  }
+  cache.push_back({hash, as_target, parsed});
+  return parsed;
+}
+
+// Converts unpremultiplied RGBA8 rows in place from an image's colour space to
+// the target of a ColorConversion. Does nothing when the two already match,
+// when conversion is off, or when the image's profile can't be used: a profile
+// skcms can't parse, or one for CMYK or grey samples, which the library has
+// already turned into RGB by the time the wrapper sees them. Browsers render
+// such images unconverted too.
+class ColorConverter {
+ public:
+  ColorConverter() = default;
+  ColorConverter(const ColorConverter&) = delete;
+  ColorConverter& operator=(const ColorConverter&) = delete;
+
+  // Converts from `icc`, the profile embedded in the image. Images without one
+  // (`icc_size` of 0) are taken to be sRGB. Returns false when the target
+  // profile of `conversion` can't be used.
+  bool Init(const ColorConversion& conversion, const uint8_t* icc, size_t icc_size) {
+    if (!conversion.convert) {
+      return true;
+    }
+    if (!InitTarget(conversion)) {
+      return false;
+    }
+    if (icc_size == 0) {
+      if (target_parsed_) {
+        source_ = skcms_sRGB_profile();
+      }
+      return true;
+    }
+    source_parsed_ = ParseProfile(icc, icc_size, false);
+    if (!source_parsed_ || source_parsed_->profile.data_color_space != skcms_Signature_RGB ||
+        (!target_parsed_ && source_parsed_->is_srgb)) {
+      return true;
+    }
+    source_ = &source_parsed_->profile;
+    return true;
+  }
+
+  // Converts from a profile the wrapper made, such as one for AVIF's CICP code
+  // points. Returns false when the target profile of `conversion` can't be
+  // used.
+  bool Init(const ColorConversion& conversion, const skcms_ICCProfile& source) {
+    if (!conversion.convert) {
+      return true;
+    }
+    if (!InitTarget(conversion)) {
+      return false;
+    }
+    if (!target_parsed_ && skcms_ApproximatelyEqualProfiles(&source, skcms_sRGB_profile())) {
+      return true;
+    }
+    made_source_ = source;
+    source_ = &made_source_;
+    return true;
+  }
+
+  bool active() const { return source_ != nullptr; }
+
+  void ConvertRow(uint8_t* rgba, uint32_t width) const { Convert(rgba, width); }
+
+  // Converts `count` rows that start `stride` bytes apart. Packed rows go
+  // through skcms in one call, which sets the transform up once.
+  void ConvertRows(uint8_t* rows, size_t stride, uint32_t width, uint32_t count) const {
+    if (stride == static_cast<size_t>(width) * 4) {
+      Convert(rows, static_cast<size_t>(width) * count);
+      return;
+    }
+    for (uint32_t y = 0; y < count; y++) {
+      Convert(rows + y * stride, width);
+    }
+  }
+
+ private:
+  bool InitTarget(const ColorConversion& conversion) {
+    if (conversion.targetProfile.empty()) {
+      return true;
+    }
+    target_parsed_ =
+        ParseProfile(reinterpret_cast<const uint8_t*>(conversion.targetProfile.data()),
+                     conversion.targetProfile.size(), true);
+    if (!target_parsed_) {
+      return false;
+    }
+    target_ = &target_parsed_->profile;
+    return true;
+  }
+
+  // skcms converts in place when both formats have the same size.
+  void Convert(uint8_t* rgba, size_t pixels) const {
+    if (!source_) {
+      return;
+    }
+    skcms_Transform(rgba, skcms_PixelFormat_RGBA_8888, skcms_AlphaFormat_Unpremul, source_, rgba,
+                    skcms_PixelFormat_RGBA_8888, skcms_AlphaFormat_Unpremul, target_, pixels);
+  }
+
+  std::shared_ptr<const ParsedProfile> source_parsed_;
+  std::shared_ptr<const ParsedProfile> target_parsed_;
+  skcms_ICCProfile made_source_;
+  const skcms_ICCProfile* source_ = nullptr;
+  const skcms_ICCProfile* target_ = skcms_sRGB_profile();
+};
+
+}  // namespace jsquash
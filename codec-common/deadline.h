@@ -0,0 +1,27 @@
+#pragma once
+
+// Wall clock limits for encodes. An encoder polls expired() from whatever
+// progress or scheduling hook its library offers and gives up once it
+// returns true, so a caller with a time budget can retry at a faster setting
+// instead of overrunning. Wrappers return `undefined` (rather than null) from
+// an encode that was stopped this way, which the JS side reports as a time
+// limit error.
+
+#include <emscripten/emscripten.h>
+
+namespace jsquash {
+
+class Deadline {
+ public:
+  // A limit of 0 or less never expires.
+  explicit Deadline(double limit_ms)
+      : end_ms_(limit_ms > 0 ? emscripten_get_now() + limit_ms : 0) {}
+
+  bool active() const { return end_ms_ > 0; }
+  bool expired() const { return active() && emscripten_get_now() >= end_ms_; }
+
+ private:
+  double end_ms_;
+};
+
+}  // namespace jsquash
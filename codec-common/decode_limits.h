@@ -0,0 +1,140 @@
+#pragma once
+
+// Limits on what one decode may cost, for wrappers that decode untrusted
+// input. A few bytes can declare a 65535 x 65535 canvas or be very slow to
+// decode, so the wrapper checks the size from the header before allocating
+// anything for the image, then polls the budget from whatever per-row,
+// per-group or progress hook its library offers. A decode stopped this way
+// returns the name of the limit it hit (a string, rather than null), which
+// the JS side reports as a DecodeLimitError.
+//
+// Usage:
+//
+//   jsquash::DecodeBudget budget(limits);
+//   // ...parse the header...
+//   if (!budget.CheckImage(width, height, frames, output_bytes)) {
+//     return budget.Abort();
+//   }
+//   for (each row) {
+//     if (!budget.Poll()) return budget.Abort();
+//   }
+
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+#include <malloc.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "deadline.h"
+
+namespace jsquash {
+
+// A limit of 0 or less is not checked.
+struct DecodeLimits {
+  // Largest width x height of the decoded image.
+  double maxPixels;
+  // Most frames an animation or image sequence may declare.
+  int maxFrames;
+  // Most bytes the wrapper and library may have allocated at once.
+  double maxMemory;
+  // Milliseconds before the decode is abandoned.
+  double timeLimit;
+};
+
+// Safe to call from the bindings of every decoder in a module, see
+// RegisterDecodeResizeOptions().
+inline void RegisterDecodeLimits() {
+  static bool registered = false;
+  if (registered) {
+    return;
+  }
+  registered = true;
+  emscripten::value_object<DecodeLimits>("DecodeLimits")
+      .field("maxPixels", &DecodeLimits::maxPixels)
+      .field("maxFrames", &DecodeLimits::maxFrames)
+      .field("maxMemory", &DecodeLimits::maxMemory)
+      .field("timeLimit", &DecodeLimits::timeLimit);
+}
+
+class DecodeBudget {
+ public:
+  explicit DecodeBudget(const DecodeLimits& limits)
+      : limits_(limits),
+        deadline_(limits.timeLimit),
+        baseline_(limits.maxMemory > 0 ? InUse() : 0) {}
+
+  // Checks the image the header describes, and the `bytes` the wrapper is
+  // about to allocate for it, before any pixels are decoded. `bytes` is a
+  // double so that sizes beyond size_t, which no allocation would survive
+  // anyway, still count as over the limit.
+  bool CheckImage(uint64_t width, uint64_t height, uint64_t frames, double bytes) {
+    if (limits_.maxPixels > 0 && static_cast<double>(width) * height > limits_.maxPixels) {
+      return Stop("maxPixels");
+    }
+    if (limits_.maxFrames > 0 && frames > static_cast<uint64_t>(limits_.maxFrames)) {
+      return Stop("maxFrames");
+    }
+    return CheckMemory(bytes) && CheckTime();
+  }
+
+  // Checks the memory the decode holds now and the time it has taken.
+  bool Check() { return CheckMemory(0) && CheckTime(); }
+
+  // Check() for hooks that run once per row or group. Reading the heap walks
+  // the allocator's chunks, so only every kPollInterval-th call does it.
+  bool Poll() {
+    if (exceeded()) {
+      return false;
+    }
+    if (++polls_ % kPollInterval != 0) {
+      return true;
+    }
+    return Check();
+  }
+
+  bool exceeded() const { return exceeded_ != nullptr; }
+
+  // What the wrapper returns for a decode stopped by a limit.
+  emscripten::val Abort() const { return emscripten::val(exceeded_); }
+
+ private:
+  static constexpr unsigned kPollInterval = 16;
+
+  static size_t InUse() { return static_cast<size_t>(mallinfo().uordblks); }
+
+  bool CheckMemory(double pending) {
+    if (exceeded()) {
+      return false;
+    }
+    if (limits_.maxMemory <= 0) {
+      return true;
+    }
+    const size_t in_use = InUse();
+    const uint64_t allocated = in_use > baseline_ ? in_use - baseline_ : 0;
+    if (static_cast<double>(allocated) + pending > limits_.maxMemory) {
+      return Stop("maxMemory");
+    }
+    return true;
+  }
+
+  bool CheckTime() {
+    if (exceeded()) {
+      return false;
+    }
+    return !deadline_.expired() || Stop("timeLimit");
+  }
+
+  bool Stop(const char* limit) {
+    exceeded_ = limit;
+    return false;
+  }
+
+  DecodeLimits limits_;
+  Deadline deadline_;
+  size_t baseline_;
+  unsigned polls_ = 0;
+  const char* exceeded_ = nullptr;
+};
+
+}  // namespace jsquash
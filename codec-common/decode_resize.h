@@ -0,0 +1,111 @@
+#pragma once
+
+// Resize-on-decode for the decoder wrappers. decode() takes a
+// DecodeResizeOptions object and hands every decoded RGBA8 row to a
+// DecodeResizer, which either copies it to the output or streams it through a
+// RowResampler. The full size frame therefore never has to leave the module,
+// and for row based decoders it is never stored at all.
+
+#include <emscripten/bind.h>
+
+#include <memory>
+#include <string>
+
+#include "resample.h"
+
+namespace jsquash {
+
+// Mirrors the @jsquash/resize options. A width or height of 0 keeps the source
+// size, or preserves the aspect ratio when only the other side is given.
+struct DecodeResizeOptions {
+  int width;
+  int height;
+  // "stretch" | "contain"
+  std::string fitMethod;
+  // ResampleFilter
+  int method;
+  bool premultiply;
+  bool linearRGB;
+};
+
+// Safe to call from the bindings of every decoder in a module. embind throws
+// on a second registration of a type, which the combined build would hit.
+inline void RegisterDecodeResizeOptions() {
+  static bool registered = false;
+  if (registered) {
+    return;
+  }
+  registered = true;
+  emscripten::value_object<DecodeResizeOptions>("DecodeResizeOptions")
+      .field("width", &DecodeResizeOptions::width)
+      .field("height", &DecodeResizeOptions::height)
+      .field("fitMethod", &DecodeResizeOptions::fitMethod)
+      .field("method", &DecodeResizeOptions::method)
+      .field("premultiply", &DecodeResizeOptions::premultiply)
+      .field("linearRGB", &DecodeResizeOptions::linearRGB);
+}
+
+class DecodeResizer {
+ public:
+  DecodeResizer(int src_width, int src_height, const DecodeResizeOptions& options)
+      : width_(options.width), height_(options.height) {
+    FitSize(src_width, src_height, &width_, &height_);
+    if (src_width <= 0 || src_height <= 0 || width_ <= 0 || height_ <= 0) {
+      valid_ = false;
+      return;
+    }
+
+    ResampleRect crop = {0, 0, src_width, src_height};
+    if (options.fitMethod == "contain") {
+      crop = ContainCrop(src_width, src_height, width_, height_);
+    }
+    if (width_ == src_width && height_ == src_height && crop.width == src_width &&
+        crop.height == src_height) {
+      return;
+    }
+
+    ResampleOptions resample_options;
+    resample_options.filter = options.method;
+    resample_options.premultiply = options.premultiply;
+    resample_options.linear_rgb = options.linearRGB;
+    resampler_ = std::make_unique<RowResampler>(crop, width_, height_, resample_options);
+  }
+
+  // False when the source or the output size is empty, which decoders treat
+  // as a failed decode. Nothing is written in that case.
+  bool valid() const { return valid_; }
+
+  // Output size.
+  int width() const { return width_; }
+  int height() const { return height_; }
+  size_t stride() const { return static_cast<size_t>(width_) * 4; }
+  size_t size() const { return stride() * height_; }
+
+  // False when the options ask for the source size, so the decoder can write
+  // straight into the output buffer.
+  bool active() const { return resampler_ != nullptr; }
+
+  // Takes the next decoded row and writes every output row it completes into
+  // `dst`, a tightly packed width() x height() RGBA8 buffer.
+  void PushRow(const uint8_t* row, uint8_t* dst) {
+    if (!valid_) {
+      return;
+    }
+    if (!resampler_) {
+      memcpy(dst + static_cast<size_t>(src_y_++) * stride(), row, stride());
+      return;
+    }
+    resampler_->PushRow(row, [this, dst](const uint8_t* out, int y) {
+      memcpy(dst + static_cast<size_t>(y) * stride(), out, stride());
+    });
+  }
+
+ private:
+  int width_;
+  int height_;
+  int src_y_ = 0;
+  bool valid_ = true;
+  std::unique_ptr<RowResampler> resampler_;
+};
+
+}  // namespace jsquash
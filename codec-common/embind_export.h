@@ -0,0 +1,18 @@
+#pragma once
+
+// Names for the functions a codec wrapper exports through embind.
+//
+// Each wrapper is normally linked into a module of its own and exports plain
+// names such as "encode". The combined build (packages/combined) links every
+// wrapper into one module and compiles each with JSQUASH_EXPORT_PREFIX set,
+// e.g. to "jpeg_enc_", so that embind sees "jpeg_enc_encode" and
+// "webp_enc_encode" rather than two functions called "encode".
+//
+// Wrappers keep their own functions and globals in an unnamed namespace and
+// give their EMSCRIPTEN_BINDINGS block a unique name for the same reason.
+
+#ifdef JSQUASH_EXPORT_PREFIX
+#define JSQUASH_EXPORT(name) JSQUASH_EXPORT_PREFIX name
+#else
+#define JSQUASH_EXPORT(name) name
+#endif
@@ -0,0 +1,770 @@
+#pragma once
+
+// Just enough of the HEIF item structure (ISO/IEC 23008-12) to give AVIF files
+// a thumbnail, and to build grids from separately encoded cells. libavif
+// neither writes 'thmb' items nor lets the decoder pick one, and encodes grid
+// cells one after another, so the AVIF wrappers work around it on the
+// container:
+//
+// - AddHeifThumbnail() merges the items of a second, small AVIF file into the
+//   main one and links its primary item to the main primary item with a
+//   'thmb' reference.
+// - PromoteHeifThumbnail() makes the thumbnail the primary item of the file,
+//   so the regular decoder returns it instead of the full image.
+// - AssembleHeifGrid() makes one 'grid' item of the primary items of several
+//   AVIF files, so the cells can be encoded side by side.
+//
+// Item data is gathered into a single 'mdat' on rewrite; data stored in 'idat'
+// (construction method 1) is moved there too. Everything else is kept as is.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jsquash {
+
+namespace heif_internal {
+
+constexpr uint32_t FourCC(const char (&s)[5]) {
+  return static_cast<uint32_t>(static_cast<uint8_t>(s[0])) << 24 |
+         static_cast<uint32_t>(static_cast<uint8_t>(s[1])) << 16 |
+         static_cast<uint32_t>(static_cast<uint8_t>(s[2])) << 8 |
+         static_cast<uint32_t>(static_cast<uint8_t>(s[3]));
+}
+
+// Big endian reader that turns every out of range read into a sticky failure.
+class Reader {
+ public:
+  Reader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint64_t Read(int bytes) {
+    if (!ok_ || size_ - pos_ < static_cast<size_t>(bytes)) {
+      ok_ = false;
+      return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+      value = value << 8 | data_[pos_++];
+    }
+    return value;
+  }
+  uint8_t U8() { return static_cast<uint8_t>(Read(1)); }
+  uint16_t U16() { return static_cast<uint16_t>(Read(2)); }
+  uint32_t U32() { return static_cast<uint32_t>(Read(4)); }
+
+  const uint8_t* current() const { return data_ + pos_; }
+  size_t remaining() const { return ok_ ? size_ - pos_ : 0; }
+  bool ok() const { return ok_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+struct Box {
+  uint32_t type;
+  // The whole box, header included.
+  const uint8_t* start;
+  size_t size;
+  const uint8_t* payload;
+  size_t payload_size;
+};
+
+inline bool ReadBoxes(const uint8_t* data, size_t size, std::vector<Box>* boxes) {
+  size_t pos = 0;
+  while (pos < size) {
+    Reader reader(data + pos, size - pos);
+    uint64_t box_size = reader.U32();
+    const uint32_t type = reader.U32();
+    if (box_size == 1) {
+      box_size = reader.Read(8);
+    } else if (box_size == 0) {
+      box_size = size - pos;
+    }
+    const size_t header = reader.current() - (data + pos);
+    if (!reader.ok() || box_size < header || box_size > size - pos) {
+      return false;
+    }
+    boxes->push_back({type, data + pos, static_cast<size_t>(box_size), data + pos + header,
+                      static_cast<size_t>(box_size) - header});
+    pos += box_size;
+  }
+  return true;
+}
+
+inline const Box* FindBox(const std::vector<Box>& boxes, uint32_t type) {
+  for (const auto& box : boxes) {
+    if (box.type == type) {
+      return &box;
+    }
+  }
+  return nullptr;
+}
+
+struct Item {
+  uint32_t id = 0;
+  uint32_t infe_flags = 0;
+  uint16_t protection_index = 0;
+  uint32_t type = 0;
+  // Whatever follows item_type in the 'infe' box: the name and, for some
+  // types, the content type or URI.
+  std::string infe_tail;
+  // The item's payload, its extents concatenated.
+  std::string data;
+  // ipma associations: bit 15 is the essential flag, the rest the 1-based
+  // index into the 'ipco' box.
+  std::vector<uint16_t> properties;
+};
+
+struct Reference {
+  uint32_t type;
+  uint32_t from;
+  std::vector<uint32_t> to;
+};
+
+struct File {
+  Box ftyp;
+  Box hdlr;
+  uint32_t primary = 0;
+  std::vector<Item> items;
+  // Index into `items` by id, filled by Parse() for the lookups that follow.
+  std::unordered_map<uint32_t, size_t> item_index;
+  std::vector<Reference> references;
+  std::vector<Box> properties;
+};
+
+inline Item* FindItem(File* file, uint32_t id) {
+  const auto found = file->item_index.find(id);
+  return found == file->item_index.end() ? nullptr : &file->items[found->second];
+}
+
+inline bool ParseInfe(const Box& box, Item* item) {
+  Reader reader(box.payload, box.payload_size);
+  const uint8_t version = reader.U8();
+  item->infe_flags = static_cast<uint32_t>(reader.Read(3));
+  if (version != 2 && version != 3) {
+    return false;
+  }
+  item->id = version == 2 ? reader.U16() : reader.U32();
+  item->protection_index = reader.U16();
+  item->type = reader.U32();
+  if (!reader.ok()) {
+    return false;
+  }
+  item->infe_tail.assign(reinterpret_cast<const char*>(reader.current()), reader.remaining());
+  return true;
+}
+
+// Reads 'iloc' and copies every item's extents out of `data` (the whole file)
+// or, for construction method 1, out of `idat`. Extents may overlap, so the
+// bytes copied from each source are capped at its size; otherwise a small file
+// could list the same extent over and over and expand to any size.
+inline bool ParseIloc(const Box& box, const uint8_t* data, size_t size, const Box* idat,
+                      File* file) {
+  Reader reader(box.payload, box.payload_size);
+  const uint8_t version = reader.U8();
+  reader.Read(3);
+  if (version > 2) {
+    return false;
+  }
+  const uint8_t sizes = reader.U8();
+  const int offset_size = sizes >> 4;
+  const int length_size = sizes & 15;
+  const uint8_t sizes2 = reader.U8();
+  const int base_offset_size = sizes2 >> 4;
+  const int index_size = version >= 1 ? sizes2 & 15 : 0;
+  const uint32_t item_count = version < 2 ? reader.U16() : reader.U32();
+  uint64_t copied[2] = {0, 0};
+  for (uint32_t i = 0; i < item_count && reader.ok(); i++) {
+    const uint32_t id = version < 2 ? reader.U16() : reader.U32();
+    const int construction_method = version >= 1 ? reader.U16() & 15 : 0;
+    const uint16_t data_reference_index = reader.U16();
+    const uint64_t base_offset = reader.Read(base_offset_size);
+    const uint16_t extent_count = reader.U16();
+    Item* item = FindItem(file, id);
+    if (item == nullptr || data_reference_index != 0 || construction_method > 1 ||
+        (construction_method == 1 && idat == nullptr)) {
+      return false;
+    }
+    const uint8_t* source = construction_method == 0 ? data : idat->payload;
+    const uint64_t source_size = construction_method == 0 ? size : idat->payload_size;
+    for (uint16_t e = 0; e < extent_count && reader.ok(); e++) {
+      reader.Read(index_size);
+      const uint64_t offset = base_offset + reader.Read(offset_size);
+      uint64_t length = reader.Read(length_size);
+      if (length == 0 && offset <= source_size) {
+        length = source_size - offset;
+      }
+      if (offset > source_size || length > source_size - offset ||
+          length > source_size - copied[construction_method]) {
+        return false;
+      }
+      copied[construction_method] += length;
+      item->data.append(reinterpret_cast<const char*>(source + offset), length);
+    }
+  }
+  return reader.ok();
+}
+
+inline bool ParseIref(const Box& box, File* file) {
+  Reader reader(box.payload, box.payload_size);
+  const uint8_t version = reader.U8();
+  reader.Read(3);
+  std::vector<Box> boxes;
+  if (!reader.ok() || version > 1 || !ReadBoxes(reader.current(), reader.remaining(), &boxes)) {
+    return false;
+  }
+  const int id_size = version == 0 ? 2 : 4;
+  for (const auto& child : boxes) {
+    Reader refs(child.payload, child.payload_size);
+    Reference reference = {child.type, static_cast<uint32_t>(refs.Read(id_size)), {}};
+    const uint16_t count = refs.U16();
+    for (uint16_t i = 0; i < count; i++) {
+      reference.to.push_back(static_cast<uint32_t>(refs.Read(id_size)));
+    }
+    if (!refs.ok()) {
+      return false;
+    }
+    file->references.push_back(std::move(reference));
+  }
+  return true;
+}
+
+inline bool ParseIprp(const Box& box, File* file) {
+  std::vector<Box> boxes;
+  if (!ReadBoxes(box.payload, box.payload_size, &boxes)) {
+    return false;
+  }
+  const Box* ipco = FindBox(boxes, FourCC("ipco"));
+  if (ipco == nullptr || !ReadBoxes(ipco->payload, ipco->payload_size, &file->properties)) {
+    return false;
+  }
+  for (const auto& ipma : boxes) {
+    if (ipma.type != FourCC("ipma")) {
+      continue;
+    }
+    Reader reader(ipma.payload, ipma.payload_size);
+    const uint8_t version = reader.U8();
+    const uint32_t flags = static_cast<uint32_t>(reader.Read(3));
+    const uint32_t entry_count = reader.U32();
+    for (uint32_t i = 0; i < entry_count && reader.ok(); i++) {
+      Item* item = FindItem(file, version < 1 ? reader.U16() : reader.U32());
+      const uint8_t association_count = reader.U8();
+      for (uint8_t a = 0; a < association_count && reader.ok(); a++) {
+        uint16_t association;
+        if (flags & 1) {
+          association = reader.U16();
+        } else {
+          const uint8_t value = reader.U8();
+          association = static_cast<uint16_t>((value & 0x80) << 8 | (value & 0x7F));
+        }
+        if (item == nullptr) {
+          return false;
+        }
+        item->properties.push_back(association);
+      }
+    }
+    if (!reader.ok()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool Parse(const uint8_t* data, size_t size, File* file) {
+  std::vector<Box> top;
+  if (!ReadBoxes(data, size, &top)) {
+    return false;
+  }
+  const Box* ftyp = FindBox(top, FourCC("ftyp"));
+  const Box* meta = FindBox(top, FourCC("meta"));
+  if (ftyp == nullptr || meta == nullptr || meta->payload_size < 4) {
+    return false;
+  }
+  file->ftyp = *ftyp;
+
+  std::vector<Box> boxes;
+  if (!ReadBoxes(meta->payload + 4, meta->payload_size - 4, &boxes)) {
+    return false;
+  }
+  const Box* hdlr = FindBox(boxes, FourCC("hdlr"));
+  const Box* pitm = FindBox(boxes, FourCC("pitm"));
+  const Box* iinf = FindBox(boxes, FourCC("iinf"));
+  const Box* iloc = FindBox(boxes, FourCC("iloc"));
+  const Box* iprp = FindBox(boxes, FourCC("iprp"));
+  const Box* iref = FindBox(boxes, FourCC("iref"));
+  if (hdlr == nullptr || pitm == nullptr || iinf == nullptr || iloc == nullptr ||
+      iprp == nullptr) {
+    return false;
+  }
+  file->hdlr = *hdlr;
+
+  Reader pitm_reader(pitm->payload, pitm->payload_size);
+  const uint8_t pitm_version = pitm_reader.U8();
+  pitm_reader.Read(3);
+  file->primary = pitm_version == 0 ? pitm_reader.U16() : pitm_reader.U32();
+
+  Reader iinf_reader(iinf->payload, iinf->payload_size);
+  const uint8_t iinf_version = iinf_reader.U8();
+  iinf_reader.Read(3);
+  iinf_reader.Read(iinf_version == 0 ? 2 : 4);
+  std::vector<Box> infes;
+  if (!pitm_reader.ok() || !iinf_reader.ok() ||
+      !ReadBoxes(iinf_reader.current(), iinf_reader.remaining(), &infes)) {
+    return false;
+  }
+  for (const auto& infe : infes) {
+    Item item;
+    if (infe.type != FourCC("infe") || !ParseInfe(infe, &item) ||
+        !file->item_index.emplace(item.id, file->items.size()).second) {
+      return false;
+    }
+    file->items.push_back(std::move(item));
+  }
+
+  return ParseIloc(*iloc, data, size, FindBox(boxes, FourCC("idat")), file) &&
+         (iref == nullptr || ParseIref(*iref, file)) && ParseIprp(*iprp, file);
+}
+
+class Writer {
+ public:
+  void Write(uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+      out_.push_back(static_cast<char>(value >> (i * 8)));
+    }
+  }
+  void Bytes(const void* data, size_t size) {
+    out_.append(static_cast<const char*>(data), size);
+  }
+
+  size_t BeginBox(uint32_t type) {
+    const size_t start = out_.size();
+    Write(0, 4);
+    Write(type, 4);
+    return start;
+  }
+  size_t BeginFullBox(uint32_t type, uint8_t version, uint32_t flags) {
+    const size_t start = BeginBox(type);
+    Write(version, 1);
+    Write(flags, 3);
+    return start;
+  }
+  void EndBox(size_t start) {
+    const uint32_t size = static_cast<uint32_t>(out_.size() - start);
+    for (int i = 0; i < 4; i++) {
+      out_[start + i] = static_cast<char>(size >> ((3 - i) * 8));
+    }
+  }
+
+  size_t size() const { return out_.size(); }
+  std::string& str() { return out_; }
+
+ private:
+  std::string out_;
+};
+
+// Writes 'meta'. Item data is placed back to back starting at file offset
+// `data_offset`, in item order.
+inline void WriteMeta(const File& file, uint64_t data_offset, Writer* w) {
+  uint32_t max_id = file.primary;
+  uint64_t data_size = 0;
+  size_t max_property = 0;
+  for (const auto& item : file.items) {
+    max_id = std::max(max_id, item.id);
+    data_size += item.data.size();
+    for (uint16_t property : item.properties) {
+      max_property = std::max<size_t>(max_property, property & 0x7FFF);
+    }
+  }
+  const bool wide_ids = max_id > 0xFFFF;
+  const int id_size = wide_ids ? 4 : 2;
+  const int offset_size = data_offset + data_size > 0xFFFFFFFFu ? 8 : 4;
+
+  const size_t meta = w->BeginFullBox(FourCC("meta"), 0, 0);
+  w->Bytes(file.hdlr.start, file.hdlr.size);
+
+  size_t box = w->BeginFullBox(FourCC("pitm"), wide_ids ? 1 : 0, 0);
+  w->Write(file.primary, id_size);
+  w->EndBox(box);
+
+  box = w->BeginFullBox(FourCC("iloc"), wide_ids ? 2 : 1, 0);
+  w->Write(offset_size << 4 | offset_size, 1);
+  w->Write(0, 1);
+  w->Write(file.items.size(), wide_ids ? 4 : 2);
+  uint64_t offset = data_offset;
+  for (const auto& item : file.items) {
+    w->Write(item.id, id_size);
+    w->Write(0, 2);  // construction_method
+    w->Write(0, 2);  // data_reference_index
+    w->Write(item.data.empty() ? 0 : 1, 2);
+    if (!item.data.empty()) {
+      w->Write(offset, offset_size);
+      w->Write(item.data.size(), offset_size);
+      offset += item.data.size();
+    }
+  }
+  w->EndBox(box);
+
+  box = w->BeginFullBox(FourCC("iinf"), file.items.size() > 0xFFFF ? 1 : 0, 0);
+  w->Write(file.items.size(), file.items.size() > 0xFFFF ? 4 : 2);
+  for (const auto& item : file.items) {
+    const size_t infe = w->BeginFullBox(FourCC("infe"), wide_ids ? 3 : 2, item.infe_flags);
+    w->Write(item.id, id_size);
+    w->Write(item.protection_index, 2);
+    w->Write(item.type, 4);
+    w->Bytes(item.infe_tail.data(), item.infe_tail.size());
+    w->EndBox(infe);
+  }
+  w->EndBox(box);
+
+  if (!file.references.empty()) {
+    box = w->BeginFullBox(FourCC("iref"), wide_ids ? 1 : 0, 0);
+    for (const auto& reference : file.references) {
+      const size_t ref = w->BeginBox(reference.type);
+      w->Write(reference.from, id_size);
+      w->Write(reference.to.size(), 2);
+      for (uint32_t to : reference.to) {
+        w->Write(to, id_size);
+      }
+      w->EndBox(ref);
+    }
+    w->EndBox(box);
+  }
+
+  const size_t iprp = w->BeginBox(FourCC("iprp"));
+  box = w->BeginBox(FourCC("ipco"));
+  for (const auto& property : file.properties) {
+    w->Bytes(property.start, property.size);
+  }
+  w->EndBox(box);
+  const bool wide_properties = max_property > 0x7F;
+  box = w->BeginFullBox(FourCC("ipma"), wide_ids ? 1 : 0, wide_properties ? 1 : 0);
+  uint32_t entry_count = 0;
+  for (const auto& item : file.items) {
+    entry_count += item.properties.empty() ? 0 : 1;
+  }
+  w->Write(entry_count, 4);
+  for (const auto& item : file.items) {
+    if (item.properties.empty()) {
+      continue;
+    }
+    w->Write(item.id, id_size);
+    w->Write(item.properties.size(), 1);
+    for (uint16_t property : item.properties) {
+      if (wide_properties) {
+        w->Write(property, 2);
+      } else {
+        w->Write((property & 0x8000) >> 8 | (property & 0x7F), 1);
+      }
+    }
+  }
+  w->EndBox(box);
+  w->EndBox(iprp);
+
+  w->EndBox(meta);
+}
+
+inline std::string Write(const File& file) {
+  uint64_t data_size = 0;
+  for (const auto& item : file.items) {
+    data_size += item.data.size();
+  }
+  const int mdat_header = data_size + 8 > 0xFFFFFFFFu ? 16 : 8;
+
+  // The item offsets don't change the size of 'meta', so measure it first.
+  Writer measure;
+  WriteMeta(file, 0, &measure);
+  const uint64_t data_offset = file.ftyp.size + measure.size() + mdat_header;
+
+  Writer w;
+  w.Bytes(file.ftyp.start, file.ftyp.size);
+  WriteMeta(file, data_offset, &w);
+  if (mdat_header == 16) {
+    w.Write(1, 4);
+    w.Write(FourCC("mdat"), 4);
+    w.Write(data_size + 16, 8);
+  } else {
+    w.Write(data_size + 8, 4);
+    w.Write(FourCC("mdat"), 4);
+  }
+  for (const auto& item : file.items) {
+    w.Bytes(item.data.data(), item.data.size());
+  }
+  return std::move(w.str());
+}
+
+// The auxC type that marks an auxiliary image as alpha.
+constexpr char kAlphaAuxType[] = "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha";
+
+// The properties of a file being assembled. Identical boxes are stored once,
+// as libavif does.
+class PropertyTable {
+ public:
+  explicit PropertyTable(File* file) : file_(file) {}
+
+  // Returns the 1-based index of `box`, or 0 when the table is full.
+  uint16_t Add(const Box& box) {
+    for (size_t i = 0; i < file_->properties.size(); i++) {
+      const Box& other = file_->properties[i];
+      if (other.size == box.size && memcmp(other.start, box.start, box.size) == 0) {
+        return static_cast<uint16_t>(i + 1);
+      }
+    }
+    if (file_->properties.size() >= 0x7FFF) {
+      return 0;
+    }
+    file_->properties.push_back(box);
+    return static_cast<uint16_t>(file_->properties.size());
+  }
+
+  // Adds a box of `type` built in `w`, which is kept for as long as the table.
+  uint16_t Add(uint32_t type, Writer* w) {
+    storage_.push_back(std::move(w->str()));
+    const auto* start = reinterpret_cast<const uint8_t*>(storage_.back().data());
+    const size_t size = storage_.back().size();
+    return Add({type, start, size, start + 8, size - 8});
+  }
+
+  // Adds the properties of `item` in `from` whose type passes `keep` to `to`,
+  // keeping their essential flags. Returns false when one is missing or the
+  // table is full.
+  template <typename Keep>
+  bool Copy(const File& from, const Item& item, Keep keep, std::vector<uint16_t>* to) {
+    for (uint16_t association : item.properties) {
+      const uint16_t index = association & 0x7FFF;
+      if (index == 0 || index > from.properties.size()) {
+        return false;
+      }
+      const Box& box = from.properties[index - 1];
+      if (!keep(box.type)) {
+        continue;
+      }
+      const uint16_t added = Add(box);
+      if (added == 0) {
+        return false;
+      }
+      to->push_back(static_cast<uint16_t>((association & 0x8000) | added));
+    }
+    return true;
+  }
+
+ private:
+  File* file_;
+  std::deque<std::string> storage_;
+};
+
+}  // namespace heif_internal
+
+// Adds the primary image of `thumbnail`, an AVIF file, to `image` as a 'thmb'
+// item of its primary item. Returns false if either file uses HEIF features
+// this can't rewrite, such as external data references.
+inline bool AddHeifThumbnail(const std::string& image,
+                             const std::string& thumbnail,
+                             std::string* out) {
+  using namespace heif_internal;
+  File file, thumb;
+  if (!Parse(reinterpret_cast<const uint8_t*>(image.data()), image.size(), &file) ||
+      !Parse(reinterpret_cast<const uint8_t*>(thumbnail.data()), thumbnail.size(), &thumb)) {
+    return false;
+  }
+
+  uint32_t id_offset = file.primary;
+  for (const auto& item : file.items) {
+    id_offset = std::max(id_offset, item.id);
+  }
+  const uint16_t property_offset = static_cast<uint16_t>(file.properties.size());
+  if (file.properties.size() + thumb.properties.size() > 0x7FFF) {
+    return false;
+  }
+
+  for (auto& item : thumb.items) {
+    item.id += id_offset;
+    for (auto& property : item.properties) {
+      if (property & 0x7FFF) {
+        property += property_offset;
+      }
+    }
+    file.items.push_back(std::move(item));
+  }
+  for (auto& reference : thumb.references) {
+    reference.from += id_offset;
+    for (auto& to : reference.to) {
+      to += id_offset;
+    }
+    file.references.push_back(std::move(reference));
+  }
+  file.references.push_back({FourCC("thmb"), thumb.primary + id_offset, {file.primary}});
+  file.properties.insert(file.properties.end(), thumb.properties.begin(),
+                         thumb.properties.end());
+
+  *out = Write(file);
+  return true;
+}
+
+// Builds an AVIF file whose primary item is a `columns` x `rows` grid of the
+// primary items of `colour`, AVIF files of equally sized cells in row order,
+// with an output size of `width` x `height`. `alpha` is either empty or holds
+// one AVIF file per cell whose primary item is the cell's alpha plane coded as
+// a monochrome frame; those become an alpha grid of the colour grid. The file
+// type and the colour properties of the grid are taken from the first cell.
+// Returns false if a cell has no AV1 primary item or the grid is larger than
+// an ImageGrid can describe.
+inline bool AssembleHeifGrid(const std::vector<std::string>& colour,
+                             const std::vector<std::string>& alpha,
+                             uint32_t columns,
+                             uint32_t rows,
+                             uint32_t width,
+                             uint32_t height,
+                             std::string* out) {
+  using namespace heif_internal;
+  const size_t cells = static_cast<size_t>(columns) * rows;
+  if (columns == 0 || rows == 0 || columns > 256 || rows > 256 || colour.size() != cells ||
+      (!alpha.empty() && alpha.size() != cells)) {
+    return false;
+  }
+  const bool has_alpha = !alpha.empty();
+  std::vector<File> files(colour.size() + alpha.size());
+  std::vector<Item*> primaries(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    const std::string& data = i < cells ? colour[i] : alpha[i - cells];
+    if (!Parse(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &files[i])) {
+      return false;
+    }
+    primaries[i] = FindItem(&files[i], files[i].primary);
+    if (primaries[i] == nullptr || primaries[i]->type != FourCC("av01")) {
+      return false;
+    }
+  }
+
+  File grid;
+  grid.ftyp = files[0].ftyp;
+  grid.hdlr = files[0].hdlr;
+  grid.primary = 1;
+  PropertyTable properties(&grid);
+
+  Writer image_grid;
+  const bool wide = width > 0xFFFF || height > 0xFFFF;
+  image_grid.Write(0, 1);
+  image_grid.Write(wide ? 1 : 0, 1);
+  image_grid.Write(rows - 1, 1);
+  image_grid.Write(columns - 1, 1);
+  image_grid.Write(width, wide ? 4 : 2);
+  image_grid.Write(height, wide ? 4 : 2);
+
+  Writer ispe;
+  size_t box = ispe.BeginFullBox(FourCC("ispe"), 0, 0);
+  ispe.Write(width, 4);
+  ispe.Write(height, 4);
+  ispe.EndBox(box);
+  const uint16_t ispe_index = properties.Add(FourCC("ispe"), &ispe);
+  if (ispe_index == 0) {
+    return false;
+  }
+
+  // The grid items come first, then the colour cells and the alpha cells, each
+  // in row order: some decoders take cells in item order, not 'dimg' order.
+  Item colour_grid;
+  colour_grid.id = grid.primary;
+  colour_grid.type = FourCC("grid");
+  colour_grid.infe_tail.assign("Color", 6);
+  colour_grid.data = image_grid.str();
+  colour_grid.properties.push_back(ispe_index);
+  // The grid shares the colour properties of its first cell.
+  if (!properties.Copy(files[0], *primaries[0],
+                       [](uint32_t type) {
+                         return type != FourCC("ispe") && type != FourCC("av1C");
+                       },
+                       &colour_grid.properties)) {
+    return false;
+  }
+  grid.items.push_back(std::move(colour_grid));
+
+  const uint32_t alpha_grid_id = 2;
+  if (has_alpha) {
+    Writer auxc;
+    box = auxc.BeginFullBox(FourCC("auxC"), 0, 0);
+    auxc.Bytes(kAlphaAuxType, sizeof(kAlphaAuxType));
+    auxc.EndBox(box);
+    Item alpha_grid;
+    alpha_grid.id = alpha_grid_id;
+    alpha_grid.type = FourCC("grid");
+    alpha_grid.infe_tail.assign("Alpha", 6);
+    alpha_grid.data = image_grid.str();
+    alpha_grid.properties.push_back(ispe_index);
+    if (!properties.Copy(files[cells], *primaries[cells],
+                         [](uint32_t type) { return type == FourCC("pixi"); },
+                         &alpha_grid.properties)) {
+      return false;
+    }
+    const uint16_t auxc_index = properties.Add(FourCC("auxC"), &auxc);
+    if (auxc_index == 0) {
+      return false;
+    }
+    alpha_grid.properties.push_back(auxc_index);
+    grid.items.push_back(std::move(alpha_grid));
+  }
+
+  Reference colour_cells = {FourCC("dimg"), grid.primary, {}};
+  Reference alpha_cells = {FourCC("dimg"), alpha_grid_id, {}};
+  for (size_t i = 0; i < files.size(); i++) {
+    const bool is_alpha = i >= cells;
+    Item cell;
+    cell.id = static_cast<uint32_t>(grid.items.size() + 1);
+    // Cells are only shown as part of the grid.
+    cell.infe_flags = 1;
+    cell.type = FourCC("av01");
+    cell.infe_tail.assign(is_alpha ? "Alpha" : "Color", 6);
+    cell.data = std::move(primaries[i]->data);
+    // Colour cells keep their properties. Alpha cells are coded as colour
+    // images, so only the ones that describe the frame are kept.
+    if (!properties.Copy(files[i], *primaries[i],
+                         [is_alpha](uint32_t type) {
+                           return !is_alpha || type == FourCC("ispe") ||
+                                  type == FourCC("pixi") || type == FourCC("av1C");
+                         },
+                         &cell.properties)) {
+      return false;
+    }
+    (is_alpha ? alpha_cells : colour_cells).to.push_back(cell.id);
+    grid.items.push_back(std::move(cell));
+  }
+
+  grid.references.push_back(std::move(colour_cells));
+  if (has_alpha) {
+    grid.references.push_back(std::move(alpha_cells));
+    grid.references.push_back({FourCC("auxl"), alpha_grid_id, {grid.primary}});
+  }
+
+  *out = Write(grid);
+  return true;
+}
+
+// Rewrites `image` so the thumbnail of its primary item becomes the primary
+// item. Returns false when there is no thumbnail.
+inline bool PromoteHeifThumbnail(std::string* image) {
+  using namespace heif_internal;
+  File file;
+  if (!Parse(reinterpret_cast<const uint8_t*>(image->data()), image->size(), &file)) {
+    return false;
+  }
+  for (auto it = file.references.begin(); it != file.references.end(); ++it) {
+    if (it->type == FourCC("thmb") &&
+        std::find(it->to.begin(), it->to.end(), file.primary) != it->to.end()) {
+      file.primary = it->from;
+      // Decoders skip items marked as thumbnails when they look for the
+      // primary image, so the reference itself has to go.
+      file.references.erase(it);
+      *image = Write(file);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace jsquash
@@ -0,0 +1,477 @@
+#pragma once
+
+// Statistics of a decoded RGBA8 image, gathered from its rows as the decoder
+// produces them, while they are still in cache. Callers that want a histogram,
+// the mean or dominant colour, a perceptual hash for deduplication or a
+// ThumbHash placeholder get them next to the pixels instead of walking the
+// whole frame again in JS.
+//
+// Each row updates the channel histograms, a 4096 bin colour count and a grid
+// of at most 32 x 32 cells holding the alpha weighted sums of their pixels.
+// Everything but the histograms is computed from that grid at the end, so the
+// per pixel work is a few counter increments and one SIMD multiply-add.
+//
+// Usage:
+//
+//   jsquash::ImageAnalyzer analyzer(width, height);
+//   for (each decoded row, top to bottom) {
+//     analyzer.AddRow(row);
+//   }
+//   return analyzer.Attach(result);
+
+#include <emscripten/val.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace jsquash {
+
+class ImageAnalyzer {
+ public:
+  ImageAnalyzer(uint32_t width, uint32_t height)
+      : width_(width),
+        height_(height),
+        grid_width_(std::min(width, kGridSize)),
+        grid_height_(std::min(height, kGridSize)),
+        columns_(width),
+        column_counts_(grid_width_),
+        row_sums_(grid_width_),
+        cells_(static_cast<size_t>(grid_width_) * grid_height_),
+        histogram_(4 * 256),
+        colors_(4096) {
+    for (uint32_t x = 0; x < width_; x++) {
+      columns_[x] = static_cast<uint64_t>(x) * grid_width_ / width_;
+      column_counts_[columns_[x]]++;
+    }
+  }
+
+  // Takes the next row of `width` tightly packed RGBA8 pixels. Rows must
+  // arrive top to bottom, as decoders produce them.
+  void AddRow(const uint8_t* row) {
+    if (y_ >= height_) {
+      return;
+    }
+    const uint32_t grid_y = static_cast<uint64_t>(y_) * grid_height_ / height_;
+    for (uint32_t start = 0; start < width_; start += kFlushPixels) {
+      AccumulateRow(row, start, std::min(width_, start + kFlushPixels));
+      FlushRow(grid_y);
+    }
+    Cell* cells = cells_.data() + static_cast<size_t>(grid_y) * grid_width_;
+    for (uint32_t x = 0; x < grid_width_; x++) {
+      cells[x].count += column_counts_[x];
+    }
+    y_++;
+  }
+
+  void AddRows(const uint8_t* rows, size_t stride, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      AddRow(rows + i * stride);
+    }
+  }
+
+  // Returns {image, analysis}, where `image` is what the decoder would have
+  // returned. Nulls and the names of decode limits are passed through.
+  // `orientation` is the EXIF orientation the decoder applied to the pixels
+  // after they were analysed, which the hashes have to follow.
+  emscripten::val Attach(emscripten::val image, int orientation = 1) const {
+    if (image.isNull() || image.isUndefined() || image.isString()) {
+      return image;
+    }
+    emscripten::val result = emscripten::val::object();
+    result.set("image", image);
+    result.set("analysis", Result(orientation));
+    return result;
+  }
+
+ private:
+  // Cells per side of the grid, as the perceptual hash needs.
+  static constexpr uint32_t kGridSize = 32;
+  // Pixels summed in 32 bits before the row sums are flushed to the grid.
+  // 65536 * 255 * 255 still fits.
+  static constexpr uint32_t kFlushPixels = 65536;
+  // Longest side of the image ThumbHash encodes.
+  static constexpr uint32_t kThumbSize = 32;
+
+  static constexpr double kPi = 3.14159265358979323846;
+
+  struct alignas(16) RowSums {
+    uint32_t v[4];
+  };
+
+  // Alpha weighted sums of a cell: r * a, g * a, b * a and a * 255.
+  struct Cell {
+    uint64_t sum[4];
+    uint64_t count;
+  };
+
+  struct Color {
+    double r, g, b, a;
+  };
+
+  void AccumulateRow(const uint8_t* row, uint32_t start, uint32_t end) {
+    uint32_t* histogram = histogram_.data();
+    for (uint32_t x = start; x < end; x++) {
+      const uint8_t* px = row + static_cast<size_t>(x) * 4;
+      histogram[px[0]]++;
+      histogram[256 + px[1]]++;
+      histogram[512 + px[2]]++;
+      histogram[768 + px[3]]++;
+      // Mostly transparent pixels don't count towards the dominant colour.
+      if (px[3] >= 128) {
+        colors_[ColorBin(px[0], px[1], px[2])]++;
+      }
+      RowSums& sums = row_sums_[columns_[x]];
+#if defined(__wasm_simd128__)
+      uint32_t packed;
+      memcpy(&packed, px, 4);
+      const v128_t rgba = wasm_u32x4_extend_low_u16x8(
+          wasm_u16x8_extend_low_u8x16(wasm_i32x4_splat(static_cast<int32_t>(packed))));
+      const v128_t weight = wasm_i32x4_replace_lane(wasm_i32x4_splat(px[3]), 3, 255);
+      wasm_v128_store(sums.v,
+                      wasm_i32x4_add(wasm_v128_load(sums.v), wasm_i32x4_mul(rgba, weight)));
+#else
+      sums.v[0] += px[0] * px[3];
+      sums.v[1] += px[1] * px[3];
+      sums.v[2] += px[2] * px[3];
+      sums.v[3] += px[3] * 255;
+#endif
+    }
+  }
+
+  void FlushRow(uint32_t grid_y) {
+    Cell* cells = cells_.data() + static_cast<size_t>(grid_y) * grid_width_;
+    for (uint32_t x = 0; x < grid_width_; x++) {
+      for (int c = 0; c < 4; c++) {
+        cells[x].sum[c] += row_sums_[x].v[c];
+      }
+      row_sums_[x] = {};
+    }
+  }
+
+  static size_t ColorBin(uint32_t r, uint32_t g, uint32_t b) {
+    return (r >> 4) << 8 | (g >> 4) << 4 | b >> 4;
+  }
+
+  static Color Unpremultiply(const uint64_t sum[4], uint64_t count) {
+    if (sum[3] == 0 || count == 0) {
+      return {0, 0, 0, 0};
+    }
+    const double alpha = static_cast<double>(sum[3]);
+    return {255.0 * sum[0] / alpha, 255.0 * sum[1] / alpha, 255.0 * sum[2] / alpha,
+            alpha / 255.0 / count};
+  }
+
+  static emscripten::val ToJS(const Color& color, bool with_alpha) {
+    emscripten::val result = emscripten::val::object();
+    result.set("r", static_cast<int>(std::lround(color.r)));
+    result.set("g", static_cast<int>(std::lround(color.g)));
+    result.set("b", static_cast<int>(std::lround(color.b)));
+    if (with_alpha) {
+      result.set("a", static_cast<int>(std::lround(color.a)));
+    }
+    return result;
+  }
+
+  // The grid as it appears after the decoder rotated or flipped the image by
+  // the EXIF `orientation`. Sets `*width` and `*height` to its size.
+  std::vector<Cell> OrientedCells(int orientation, uint32_t* width, uint32_t* height) const {
+    const uint32_t w = grid_width_;
+    const uint32_t h = grid_height_;
+    if (orientation <= 1 || orientation > 8) {
+      *width = w;
+      *height = h;
+      return cells_;
+    }
+    const bool swapped = orientation >= 5;
+    *width = swapped ? h : w;
+    *height = swapped ? w : h;
+    std::vector<Cell> oriented(cells_.size());
+    for (uint32_t dy = 0; dy < *height; dy++) {
+      for (uint32_t dx = 0; dx < *width; dx++) {
+        uint32_t sx = dx, sy = dy;
+        switch (orientation) {
+          case 2: sx = w - 1 - dx; break;
+          case 3: sx = w - 1 - dx; sy = h - 1 - dy; break;
+          case 4: sy = h - 1 - dy; break;
+          case 5: sx = dy; sy = dx; break;
+          case 6: sx = dy; sy = h - 1 - dx; break;
+          case 7: sx = w - 1 - dy; sy = h - 1 - dx; break;
+          case 8: sx = w - 1 - dy; sy = dx; break;
+        }
+        oriented[static_cast<size_t>(dy) * *width + dx] = cells_[static_cast<size_t>(sy) * w + sx];
+      }
+    }
+    return oriented;
+  }
+
+  // 64-bit DCT hash (pHash) of the luma of the grid composited over black,
+  // stretched to 32 x 32, as 16 hex digits. Each bit is whether one of the
+  // 8 x 8 lowest frequencies is above their median, so similar images differ
+  // in few bits.
+  static std::string PerceptualHash(const std::vector<Cell>& cells, uint32_t width,
+                                    uint32_t height) {
+    constexpr int N = kGridSize;
+    constexpr int K = 8;
+    double luma[N][N];
+    for (int y = 0; y < N; y++) {
+      for (int x = 0; x < N; x++) {
+        const Cell& cell = cells[static_cast<size_t>(y) * height / N * width +
+                                 static_cast<size_t>(x) * width / N];
+        luma[y][x] = cell.count == 0 ? 0
+                                     : (0.299 * cell.sum[0] + 0.587 * cell.sum[1] +
+                                        0.114 * cell.sum[2]) /
+                                           (255.0 * cell.count);
+      }
+    }
+    double basis[K][N];
+    for (int k = 0; k < K; k++) {
+      for (int n = 0; n < N; n++) {
+        basis[k][n] = std::cos(kPi * (2 * n + 1) * k / (2 * N));
+      }
+    }
+    // Rows first, keeping the K lowest frequencies of each, then columns.
+    double rows[N][K] = {};
+    for (int y = 0; y < N; y++) {
+      for (int k = 0; k < K; k++) {
+        for (int x = 0; x < N; x++) {
+          rows[y][k] += luma[y][x] * basis[k][x];
+        }
+      }
+    }
+    double coefficients[K * K] = {};
+    for (int l = 0; l < K; l++) {
+      for (int k = 0; k < K; k++) {
+        for (int y = 0; y < N; y++) {
+          coefficients[l * K + k] += rows[y][k] * basis[l][y];
+        }
+      }
+    }
+
+    double sorted[K * K];
+    std::copy(coefficients, coefficients + K * K, sorted);
+    std::sort(sorted, sorted + K * K);
+    const double median = (sorted[K * K / 2 - 1] + sorted[K * K / 2]) / 2;
+    uint64_t hash = 0;
+    for (int i = 0; i < K * K; i++) {
+      hash = hash << 1 | (coefficients[i] > median ? 1 : 0);
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return hex;
+  }
+
+  // ThumbHash of the grid, box filtered to at most kThumbSize on the longer
+  // side at the image's aspect ratio. Port of rgbaToThumbHash() from
+  // https://github.com/evanw/thumbhash (MIT).
+  std::vector<uint8_t> ThumbHash(const std::vector<Cell>& cells, uint32_t grid_width,
+                                 uint32_t grid_height, bool swapped) const {
+    const double image_width = swapped ? height_ : width_;
+    const double image_height = swapped ? width_ : height_;
+    const double scale = std::min(1.0, kThumbSize / std::max(image_width, image_height));
+    const uint32_t w = std::min<uint32_t>(
+        grid_width, std::max<uint32_t>(1, std::lround(image_width * scale)));
+    const uint32_t h = std::min<uint32_t>(
+        grid_height, std::max<uint32_t>(1, std::lround(image_height * scale)));
+
+    // Sums add up exactly, so merging cells is a box filter of the image.
+    std::vector<Cell> thumb(static_cast<size_t>(w) * h);
+    for (uint32_t y = 0; y < grid_height; y++) {
+      for (uint32_t x = 0; x < grid_width; x++) {
+        const Cell& cell = cells[static_cast<size_t>(y) * grid_width + x];
+        Cell& target = thumb[static_cast<size_t>(y) * h / grid_height * w +
+                             static_cast<size_t>(x) * w / grid_width];
+        for (int c = 0; c < 4; c++) {
+          target.sum[c] += cell.sum[c];
+        }
+        target.count += cell.count;
+      }
+    }
+    const size_t n = thumb.size();
+    std::vector<Color> rgba(n);
+    for (size_t i = 0; i < n; i++) {
+      rgba[i] = Unpremultiply(thumb[i].sum, thumb[i].count);
+    }
+
+    double avg_r = 0, avg_g = 0, avg_b = 0, avg_a = 0;
+    for (const Color& c : rgba) {
+      const double alpha = c.a / 255;
+      avg_r += alpha / 255 * c.r;
+      avg_g += alpha / 255 * c.g;
+      avg_b += alpha / 255 * c.b;
+      avg_a += alpha;
+    }
+    if (avg_a > 0) {
+      avg_r /= avg_a;
+      avg_g /= avg_a;
+      avg_b /= avg_a;
+    }
+
+    const bool has_alpha = avg_a < n;
+    const int l_limit = has_alpha ? 5 : 7;
+    const double longest = std::max(w, h);
+    const int lx = std::max(1L, std::lround(l_limit * w / longest));
+    const int ly = std::max(1L, std::lround(l_limit * h / longest));
+    std::vector<double> l(n), p(n), q(n), a(n);
+    for (size_t i = 0; i < n; i++) {
+      const double alpha = rgba[i].a / 255;
+      const double r = avg_r * (1 - alpha) + alpha / 255 * rgba[i].r;
+      const double g = avg_g * (1 - alpha) + alpha / 255 * rgba[i].g;
+      const double b = avg_b * (1 - alpha) + alpha / 255 * rgba[i].b;
+      l[i] = (r + g + b) / 3;
+      p[i] = (r + g) / 2 - b;
+      q[i] = r - g;
+      a[i] = alpha;
+    }
+
+    struct Channel {
+      double dc = 0;
+      std::vector<double> ac;
+      double scale = 0;
+    };
+    auto encode_channel = [&](const std::vector<double>& channel, int nx, int ny) {
+      Channel result;
+      std::vector<double> fx(w);
+      for (int cy = 0; cy < ny; cy++) {
+        for (int cx = 0; cx * ny < nx * (ny - cy); cx++) {
+          double f = 0;
+          for (uint32_t x = 0; x < w; x++) {
+            fx[x] = std::cos(kPi / w * cx * (x + 0.5));
+          }
+          for (uint32_t y = 0; y < h; y++) {
+            const double fy = std::cos(kPi / h * cy * (y + 0.5));
+            for (uint32_t x = 0; x < w; x++) {
+              f += channel[x + y * w] * fx[x] * fy;
+            }
+          }
+          f /= n;
+          if (cx || cy) {
+            result.ac.push_back(f);
+            result.scale = std::max(result.scale, std::abs(f));
+          } else {
+            result.dc = f;
+          }
+        }
+      }
+      if (result.scale > 0) {
+        for (double& f : result.ac) {
+          f = 0.5 + 0.5 / result.scale * f;
+        }
+      }
+      return result;
+    };
+    const Channel l_channel = encode_channel(l, std::max(3, lx), std::max(3, ly));
+    const Channel p_channel = encode_channel(p, 3, 3);
+    const Channel q_channel = encode_channel(q, 3, 3);
+    const Channel a_channel = has_alpha ? encode_channel(a, 5, 5) : Channel();
+
+    const bool is_landscape = w > h;
+    const uint32_t header24 = std::lround(63 * l_channel.dc) |
+                              std::lround(31.5 + 31.5 * p_channel.dc) << 6 |
+                              std::lround(31.5 + 31.5 * q_channel.dc) << 12 |
+                              std::lround(31 * l_channel.scale) << 18 | (has_alpha ? 1 : 0) << 23;
+    const uint32_t header16 = (is_landscape ? ly : lx) | std::lround(63 * p_channel.scale) << 3 |
+                              std::lround(63 * q_channel.scale) << 9 | (is_landscape ? 1 : 0) << 15;
+    std::vector<uint8_t> hash = {
+        static_cast<uint8_t>(header24 & 255), static_cast<uint8_t>(header24 >> 8 & 255),
+        static_cast<uint8_t>(header24 >> 16), static_cast<uint8_t>(header16 & 255),
+        static_cast<uint8_t>(header16 >> 8)};
+    if (has_alpha) {
+      hash.push_back(
+          static_cast<uint8_t>(std::lround(15 * a_channel.dc) | std::lround(15 * a_channel.scale) << 4));
+    }
+    const size_t ac_start = hash.size();
+    size_t ac_index = 0;
+    for (const Channel* channel : {&l_channel, &p_channel, &q_channel, &a_channel}) {
+      if (channel == &a_channel && !has_alpha) {
+        break;
+      }
+      for (double f : channel->ac) {
+        const size_t byte = ac_start + (ac_index >> 1);
+        if (byte >= hash.size()) {
+          hash.push_back(0);
+        }
+        hash[byte] |= std::lround(15 * f) << ((ac_index & 1) << 2);
+        ac_index++;
+      }
+    }
+    return hash;
+  }
+
+  emscripten::val Result(int orientation) const {
+    using emscripten::typed_memory_view;
+    using emscripten::val;
+    thread_local const val Uint8Array = val::global("Uint8Array");
+    thread_local const val Uint32Array = val::global("Uint32Array");
+
+    uint64_t total[4] = {};
+    uint64_t count = 0;
+    for (const Cell& cell : cells_) {
+      for (int c = 0; c < 4; c++) {
+        total[c] += cell.sum[c];
+      }
+      count += cell.count;
+    }
+    const Color mean = Unpremultiply(total, count);
+
+    // The most common colour at 4 bits per channel, refined to the alpha
+    // weighted mean of the grid cells of that colour.
+    const size_t bin = std::max_element(colors_.begin(), colors_.end()) - colors_.begin();
+    Color dominant = mean;
+    if (colors_[bin] > 0) {
+      dominant = {(bin >> 8) * 16 + 8.0, (bin >> 4 & 15) * 16 + 8.0, (bin & 15) * 16 + 8.0, 255};
+      uint64_t in_bin[4] = {};
+      for (const Cell& cell : cells_) {
+        const Color c = Unpremultiply(cell.sum, cell.count);
+        if (c.a >= 128 && ColorBin(c.r, c.g, c.b) == bin) {
+          for (int i = 0; i < 4; i++) {
+            in_bin[i] += cell.sum[i];
+          }
+        }
+      }
+      if (in_bin[3] > 0) {
+        dominant = Unpremultiply(in_bin, 1);
+      }
+    }
+
+    uint32_t grid_width, grid_height;
+    const std::vector<Cell> oriented = OrientedCells(orientation, &grid_width, &grid_height);
+    const std::vector<uint8_t> thumb_hash =
+        ThumbHash(oriented, grid_width, grid_height, orientation >= 5 && orientation <= 8);
+
+    val result = val::object();
+    result.set("histogram", Uint32Array.new_(typed_memory_view(histogram_.size(),
+                                                               histogram_.data())));
+    result.set("meanColor", ToJS(mean, true));
+    result.set("dominantColor", ToJS(dominant, false));
+    result.set("perceptualHash", PerceptualHash(oriented, grid_width, grid_height));
+    result.set("thumbHash", Uint8Array.new_(typed_memory_view(thumb_hash.size(),
+                                                              thumb_hash.data())));
+    return result;
+  }
+
+  uint32_t width_;
+  uint32_t height_;
+  uint32_t grid_width_;
+  uint32_t grid_height_;
+  uint32_t y_ = 0;
+  // Grid column of every pixel column, and pixel columns per grid column.
+  std::vector<uint32_t> columns_;
+  std::vector<uint32_t> column_counts_;
+  std::vector<RowSums> row_sums_;
+  std::vector<Cell> cells_;
+  // 256 bins each of R, G, B and A.
+  std::vector<uint32_t> histogram_;
+  // Opaque pixels per colour, 4 bits per channel.
+  std::vector<uint32_t> colors_;
+};
+
+}  // namespace jsquash
@@ -0,0 +1,61 @@
+#pragma once
+
+// Overflow-checked pixel buffer sizes. Wrappers take image dimensions from JS
+// or from a file header, and `width * height * 4` in int (or in a 32-bit
+// size_t) silently wraps for large images, leading to undersized buffers.
+// Every size that is used to allocate or index a pixel buffer should come from
+// here.
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace jsquash {
+
+// Sets `*size` to width * height * channels * bytes_per_sample and returns
+// true, or returns false if any factor is zero or the product does not fit in
+// size_t.
+inline bool ComputeImageSize(uint32_t width, uint32_t height, int channels,
+                             size_t bytes_per_sample, size_t* size) {
+  if (width == 0 || height == 0 || channels <= 0 || bytes_per_sample == 0) {
+    return false;
+  }
+
+  const size_t width_s = static_cast<size_t>(width);
+  const size_t height_s = static_cast<size_t>(height);
+  const size_t channels_s = static_cast<size_t>(channels);
+  const size_t max_size = std::numeric_limits<size_t>::max();
+
+  if (width_s > max_size / height_s) return false;
+  const size_t pixels = width_s * height_s;
+  if (pixels > max_size / channels_s) return false;
+  const size_t samples = pixels * channels_s;
+  if (samples > max_size / bytes_per_sample) return false;
+
+  *size = samples * bytes_per_sample;
+  return true;
+}
+
+// Byte size of a tightly packed RGBA8 image.
+inline bool ComputeRGBA8Size(uint32_t width, uint32_t height, size_t* size) {
+  return ComputeImageSize(width, height, 4, 1, size);
+}
+
+// Sets `*size` to the bytes spanned by `height` rows of `row_size` bytes that
+// start `stride` bytes apart, from the first byte of the first row to the last
+// byte of the last one. Returns false if the rows would overlap or the span
+// does not fit in size_t.
+inline bool ComputeStridedSize(uint32_t height, size_t row_size, size_t stride, size_t* size) {
+  if (height == 0 || row_size == 0 || stride < row_size) {
+    return false;
+  }
+  const size_t rows_before_last = static_cast<size_t>(height) - 1;
+  if (rows_before_last > 0 &&
+      stride > (std::numeric_limits<size_t>::max() - row_size) / rows_before_last) {
+    return false;
+  }
+  *size = rows_before_last * stride + row_size;
+  return true;
+}
+
+}  // namespace jsquash
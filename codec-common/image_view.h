@@ -0,0 +1,78 @@
+#pragma once
+
+// Strided pixel buffers shared with JS. Encoders take the rows of a crop of a
+// larger canvas, `stride` bytes apart, and decoders can write into a region of
+// a caller's buffer, such as a tile of an atlas, rather than a new ImageData.
+// Either way JS never has to copy the region into a tightly packed buffer.
+
+#include <emscripten/val.h>
+
+#include <cstring>
+#include <vector>
+
+#include "image_size.h"
+
+namespace jsquash {
+
+// Returns `rows` itself when its rows are already `row_size` bytes apart, or
+// otherwise copies them into `packed` and returns that, for libraries that
+// only take tightly packed images.
+inline const uint8_t* PackRows(const uint8_t* rows,
+                               size_t row_size,
+                               size_t stride,
+                               uint32_t height,
+                               std::vector<uint8_t>* packed) {
+  if (stride == row_size) {
+    return rows;
+  }
+  packed->resize(row_size * height);
+  for (uint32_t y = 0; y < height; y++) {
+    memcpy(packed->data() + y * row_size, rows + y * stride, row_size);
+  }
+  return packed->data();
+}
+
+// Returns a new ImageData holding the tightly packed RGBA8 `pixels` when
+// `output` is undefined. Otherwise `output` is {data, stride}: a typed array
+// that starts at the first pixel of the region to write to, and the distance
+// between its rows in bytes. The rows are copied straight into it and
+// {width, height} is returned, or null when the image does not fit.
+inline emscripten::val WriteImageData(const uint8_t* pixels,
+                                      uint32_t width,
+                                      uint32_t height,
+                                      const emscripten::val& output) {
+  using emscripten::typed_memory_view;
+  using emscripten::val;
+  size_t size;
+  if (!ComputeRGBA8Size(width, height, &size)) {
+    return val::null();
+  }
+  if (output.isUndefined()) {
+    thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
+    thread_local const val ImageData = val::global("ImageData");
+    return ImageData.new_(Uint8ClampedArray.new_(typed_memory_view(size, pixels)), width, height);
+  }
+
+  const val data = output["data"];
+  const size_t row_size = static_cast<size_t>(width) * 4;
+  // Read as a double so strides past 2^31 are not truncated.
+  const double stride = output["stride"].as<double>();
+  size_t span;
+  if (!(stride >= 0) || !ComputeStridedSize(height, row_size, static_cast<size_t>(stride), &span) ||
+      static_cast<double>(span) > data["length"].as<double>()) {
+    return val::null();
+  }
+  if (static_cast<size_t>(stride) == row_size) {
+    data.call<void>("set", typed_memory_view(size, pixels));
+  } else {
+    for (uint32_t y = 0; y < height; y++) {
+      data.call<void>("set", typed_memory_view(row_size, pixels + y * row_size), y * stride);
+    }
+  }
+  val result = val::object();
+  result.set("width", width);
+  result.set("height", height);
+  return result;
+}
+
+}  // namespace jsquash
@@ -0,0 +1,47 @@
+#pragma once
+
+// libjpeg error manager that hands control back to the wrapper instead of
+// calling exit(). jpeg_std_error() ends the process on any fatal error, which
+// in wasm tears down the whole module instance, so one corrupt upload would
+// force every later call to re-instantiate it.
+//
+// Usage:
+//
+//   jsquash::JpegErrorManager jerr;
+//   cinfo.err = jsquash::JpegStdError(&jerr);
+//   if (setjmp(jerr.jump)) {
+//     jpeg_destroy_decompress(&cinfo);
+//     return val::null();
+//   }
+//
+// longjmp() skips the destructors of every frame between the failing libjpeg
+// call and setjmp(), so those frames must not own heap memory. Buffers that
+// live across libjpeg calls belong to the frame that calls setjmp().
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include "jpeglib.h"
+
+namespace jsquash {
+
+struct JpegErrorManager {
+  // Must stay the first member, libjpeg only knows about this part.
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+inline void JpegErrorExit(j_common_ptr cinfo) {
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+// jpeg_std_error() with error_exit replaced. Warnings are still printed and
+// don't stop decoding, as before.
+inline jpeg_error_mgr* JpegStdError(JpegErrorManager* err) {
+  jpeg_std_error(&err->pub);
+  err->pub.error_exit = JpegErrorExit;
+  return &err->pub;
+}
+
+}  // namespace jsquash
@@ -0,0 +1,71 @@
+#pragma once
+
+// Conversion between straight and premultiplied alpha, for callers that
+// composite or resample in premultiplied form. Decoders premultiply the rows
+// they produce, while they are still in cache, when their library can't write
+// premultiplied output itself. Encoders whose library only takes straight
+// alpha unpremultiply premultiplied input into the packed copy they would
+// otherwise make with PackRows().
+//
+// Samples are uint8_t or uint16_t RGBA, the latter with `max_sample` as its
+// largest value (65535 for 16 bits, 1023 for 10, and so on). Products are
+// rounded to the nearest sample.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jsquash {
+
+// Premultiplies `count` rows of `width` pixels that start `stride` bytes
+// apart, in place.
+template <typename Sample>
+void PremultiplyRows(Sample* rows,
+                     size_t stride,
+                     uint32_t width,
+                     uint32_t count,
+                     uint32_t max_sample = sizeof(Sample) == 1 ? 255 : 65535) {
+  for (uint32_t y = 0; y < count; y++) {
+    Sample* px = reinterpret_cast<Sample*>(reinterpret_cast<uint8_t*>(rows) + y * stride);
+    for (uint32_t x = 0; x < width; x++, px += 4) {
+      const uint64_t a = px[3];
+      if (a == max_sample) {
+        continue;
+      }
+      for (int c = 0; c < 3; c++) {
+        px[c] = static_cast<Sample>((px[c] * a + max_sample / 2) / max_sample);
+      }
+    }
+  }
+}
+
+// Unpremultiplies `height` rows of `width` pixels that start `stride` bytes
+// apart into a packed copy in `out`, and returns its data. Colour of fully
+// transparent pixels is lost, and comes out black.
+template <typename Sample>
+const Sample* UnpremultiplyRows(const Sample* rows,
+                                uint32_t width,
+                                size_t stride,
+                                uint32_t height,
+                                std::vector<Sample>* out,
+                                uint32_t max_sample = sizeof(Sample) == 1 ? 255 : 65535) {
+  out->resize(static_cast<size_t>(width) * 4 * height);
+  Sample* dst = out->data();
+  for (uint32_t y = 0; y < height; y++) {
+    const Sample* px =
+        reinterpret_cast<const Sample*>(reinterpret_cast<const uint8_t*>(rows) + y * stride);
+    for (uint32_t x = 0; x < width; x++, px += 4, dst += 4) {
+      const uint64_t a = px[3];
+      for (int c = 0; c < 3; c++) {
+        dst[c] = a == 0 ? 0
+                        : static_cast<Sample>(
+                              std::min<uint64_t>((px[c] * max_sample + a / 2) / a, max_sample));
+      }
+      dst[3] = px[3];
+    }
+  }
+  return out->data();
+}
+
+}  // namespace jsquash
@@ -0,0 +1,456 @@
+#pragma once
+
+// Separable RGBA8 resampler shared by the codec wrappers.
+//
+// The filters, the coefficient layout and the premultiply / linear RGB handling
+// follow the `resize` crate used by @jsquash/resize (packages/resize/lib/resize),
+// so a resize done inside a codec module matches what the standalone resize
+// package would produce. Builds with -msimd128 get a wasm SIMD inner loop.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace jsquash {
+
+// Same order as `resizeMethods` in packages/resize/index.ts.
+enum ResampleFilter {
+  RESAMPLE_TRIANGLE = 0,
+  RESAMPLE_CATROM = 1,
+  RESAMPLE_MITCHELL = 2,
+  RESAMPLE_LANCZOS3 = 3,
+};
+
+struct ResampleRect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+namespace resample_internal {
+
+inline double CubicBC(double b, double c, double x) {
+  const double a = std::fabs(x);
+  double k = 0.0;
+  if (a < 1.0) {
+    k = (12.0 - 9.0 * b - 6.0 * c) * a * a * a + (-18.0 + 12.0 * b + 6.0 * c) * a * a +
+        (6.0 - 2.0 * b);
+  } else if (a < 2.0) {
+    k = (-b - 6.0 * c) * a * a * a + (6.0 * b + 30.0 * c) * a * a + (-12.0 * b - 48.0 * c) * a +
+        (8.0 * b + 24.0 * c);
+  }
+  return k / 6.0;
+}
+
+inline double Sinc(double x) {
+  if (x == 0.0) return 1.0;
+  const double px = x * M_PI;
+  return std::sin(px) / px;
+}
+
+inline double FilterSupport(int filter) {
+  switch (filter) {
+    case RESAMPLE_TRIANGLE:
+      return 1.0;
+    case RESAMPLE_CATROM:
+    case RESAMPLE_MITCHELL:
+      return 2.0;
+    default:
+      return 3.0;
+  }
+}
+
+inline double FilterKernel(int filter, double x) {
+  switch (filter) {
+    case RESAMPLE_TRIANGLE:
+      return std::max(0.0, 1.0 - std::fabs(x));
+    case RESAMPLE_CATROM:
+      return CubicBC(0.0, 0.5, x);
+    case RESAMPLE_MITCHELL:
+      return CubicBC(1.0 / 3.0, 1.0 / 3.0, x);
+    default:
+      return std::fabs(x) < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+  }
+}
+
+}  // namespace resample_internal
+
+// Normalised filter taps for every output coordinate along one axis.
+struct ResampleCoeffs {
+  std::vector<int> start;
+  std::vector<int> count;
+  // `taps` floats per output coordinate, zero padded past `count`.
+  std::vector<float> weights;
+  int taps = 0;
+
+  // Empty unless both sizes are positive, see RowResampler::valid().
+  ResampleCoeffs(int src_size, int dst_size, int filter) {
+    if (src_size <= 0 || dst_size <= 0) {
+      return;
+    }
+    const double ratio = static_cast<double>(src_size) / dst_size;
+    // Widen the filter when downscaling so every source pixel contributes.
+    const double scale = std::max(ratio, 1.0);
+    const double radius = std::ceil(resample_internal::FilterSupport(filter) * scale);
+    taps = static_cast<int>(radius) * 2 + 1;
+
+    start.resize(dst_size);
+    count.resize(dst_size);
+    weights.assign(static_cast<size_t>(dst_size) * taps, 0.0f);
+
+    for (int x = 0; x < dst_size; x++) {
+      const double center = (x + 0.5) * ratio - 0.5;
+      const int first = std::clamp(static_cast<int>(std::ceil(center - radius)), 0, src_size - 1);
+      const int last = std::clamp(static_cast<int>(std::floor(center + radius)), 0, src_size - 1);
+      const int n = std::min(last - first + 1, taps);
+
+      double sum = 0.0;
+      for (int i = 0; i < n; i++) {
+        sum += resample_internal::FilterKernel(filter, (first + i - center) / scale);
+      }
+      float* w = &weights[static_cast<size_t>(x) * taps];
+      for (int i = 0; i < n; i++) {
+        const double k = resample_internal::FilterKernel(filter, (first + i - center) / scale);
+        w[i] = static_cast<float>(sum != 0.0 ? k / sum : 1.0 / n);
+      }
+      start[x] = first;
+      count[x] = n;
+    }
+  }
+};
+
+struct ResampleOptions {
+  int filter = RESAMPLE_LANCZOS3;
+  // Weight colour channels by alpha while filtering to avoid dark fringes.
+  bool premultiply = true;
+  // Filter in linear light instead of on sRGB encoded values.
+  bool linear_rgb = false;
+};
+
+namespace resample_internal {
+
+// One RGBA float pixel, a single v128 when wasm SIMD is enabled.
+#if defined(__wasm_simd128__)
+struct Pixel {
+  v128_t v;
+
+  static Pixel Zero() { return {wasm_f32x4_splat(0.0f)}; }
+  static Pixel Load(const float* p) { return {wasm_v128_load(p)}; }
+  void Store(float* p) const { wasm_v128_store(p, v); }
+  void MulAdd(const Pixel& p, float w) {
+    v = wasm_f32x4_add(v, wasm_f32x4_mul(p.v, wasm_f32x4_splat(w)));
+  }
+};
+#else
+struct Pixel {
+  float c[4];
+
+  static Pixel Zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+  static Pixel Load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+  void Store(float* p) const { memcpy(p, c, sizeof(c)); }
+  void MulAdd(const Pixel& p, float w) {
+    for (int i = 0; i < 4; i++) {
+      c[i] += p.c[i] * w;
+    }
+  }
+};
+#endif
+
+// Same curves as packages/resize/lib/resize/src/srgb.rs.
+inline float SrgbToLinear(float v) {
+  return v < 0.04045f ? v / 12.92f
+                      : std::clamp(std::pow((v + 0.055f) / 1.055f, 2.4f), 0.0f, 1.0f);
+}
+
+inline float LinearToSrgb(float v) {
+  return v < 0.0031308f ? v * 12.92f
+                        : std::clamp(1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f, 0.0f, 1.0f);
+}
+
+// Lookup tables for both directions of the sRGB transfer function. The
+// linear -> sRGB table is fine enough that it stays within one code value of
+// evaluating the curve directly.
+struct SrgbTables {
+  static constexpr int kLinearSteps = 16384;
+
+  float to_linear[256];
+  uint8_t to_srgb[kLinearSteps];
+
+  SrgbTables() {
+    for (int i = 0; i < 256; i++) {
+      to_linear[i] = SrgbToLinear(i / 255.0f);
+    }
+    for (int i = 0; i < kLinearSteps; i++) {
+      to_srgb[i] = static_cast<uint8_t>(LinearToSrgb(static_cast<float>(i) / (kLinearSteps - 1)) *
+                                        255.0f);
+    }
+  }
+
+  uint8_t ToSrgb(float v) const {
+    const float index = std::clamp(v, 0.0f, 1.0f) * (kLinearSteps - 1) + 0.5f;
+    return to_srgb[static_cast<int>(index)];
+  }
+};
+
+inline const SrgbTables& GetSrgbTables() {
+  static const SrgbTables tables;
+  return tables;
+}
+
+}  // namespace resample_internal
+
+inline uint8_t ClampToByte(float v) {
+  return static_cast<uint8_t>(std::clamp(v * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+// Streaming resampler. Source rows are pushed one at a time and every output
+// row is emitted as soon as the source rows it depends on have been seen, so
+// only `ResampleCoeffs::taps` horizontally filtered rows are kept in memory.
+class RowResampler {
+ public:
+  RowResampler(ResampleRect crop,
+               int dst_width,
+               int dst_height,
+               const ResampleOptions& options = ResampleOptions())
+      : crop_(crop),
+        dst_width_(dst_width),
+        dst_height_(dst_height),
+        options_(options),
+        h_(crop.width, dst_width, options.filter),
+        v_(crop.height, dst_height, options.filter),
+        ring_rows_(v_.taps),
+        row_(valid() ? static_cast<size_t>(crop.width) * 4 : 0),
+        ring_(valid() ? static_cast<size_t>(ring_rows_) * dst_width * 4 : 0),
+        sum_(valid() ? static_cast<size_t>(dst_width) * 4 : 0),
+        window_(ring_rows_),
+        out_(valid() ? static_cast<size_t>(dst_width) * 4 : 0) {
+    if (options_.linear_rgb) {
+      tables_ = &resample_internal::GetSrgbTables();
+    }
+  }
+
+  // False when the crop or the output is empty. Such a resampler emits
+  // nothing, and callers treat it as a failed resize.
+  bool valid() const {
+    return crop_.x >= 0 && crop_.y >= 0 && crop_.width > 0 && crop_.height > 0 &&
+           dst_width_ > 0 && dst_height_ > 0;
+  }
+
+  // True once every output row has been emitted; later rows can be skipped.
+  bool done() const { return !valid() || next_dst_y_ >= dst_height_; }
+
+  // Feeds the next row of the full source image (rows outside the crop are
+  // ignored) and calls `emit(const uint8_t* rgba, int y)` for every output row
+  // that became complete.
+  template <typename Emit>
+  void PushRow(const uint8_t* src_row, Emit&& emit) {
+    const int y = src_y_++ - crop_.y;
+    if (y < 0 || y >= crop_.height || done()) {
+      return;
+    }
+    LoadRow(src_row + static_cast<size_t>(crop_.x) * 4);
+    FilterRow(RingRow(y));
+    while (!done() && v_.start[next_dst_y_] + v_.count[next_dst_y_] - 1 <= y) {
+      VerticalRow(next_dst_y_);
+      StoreRow();
+      emit(static_cast<const uint8_t*>(out_.data()), next_dst_y_);
+      next_dst_y_++;
+    }
+  }
+
+ private:
+  float* RingRow(int y) {
+    return &ring_[static_cast<size_t>(y % ring_rows_) * dst_width_ * 4];
+  }
+
+  // RGBA8 -> float, optionally linearised and premultiplied.
+  void LoadRow(const uint8_t* in) {
+    float* out = row_.data();
+    if (tables_) {
+      const float* to_linear = tables_->to_linear;
+      for (int x = 0; x < crop_.width; x++, in += 4, out += 4) {
+        const float a = in[3] / 255.0f;
+        const float m = options_.premultiply ? a : 1.0f;
+        out[0] = to_linear[in[0]] * m;
+        out[1] = to_linear[in[1]] * m;
+        out[2] = to_linear[in[2]] * m;
+        out[3] = a;
+      }
+      return;
+    }
+#if defined(__wasm_simd128__)
+    const v128_t scale = wasm_f32x4_splat(1.0f / 255.0f);
+    for (int x = 0; x < crop_.width; x++, in += 4, out += 4) {
+      uint32_t packed;
+      memcpy(&packed, in, 4);
+      const v128_t bytes = wasm_u32x4_extend_low_u16x8(
+          wasm_u16x8_extend_low_u8x16(wasm_i32x4_splat(static_cast<int32_t>(packed))));
+      v128_t px = wasm_f32x4_mul(wasm_f32x4_convert_u32x4(bytes), scale);
+      if (options_.premultiply) {
+        const float a = wasm_f32x4_extract_lane(px, 3);
+        px = wasm_f32x4_mul(px, wasm_f32x4_make(a, a, a, 1.0f));
+      }
+      wasm_v128_store(out, px);
+    }
+#else
+    for (int x = 0; x < crop_.width; x++, in += 4, out += 4) {
+      const float a = in[3] / 255.0f;
+      const float m = options_.premultiply ? a : 1.0f;
+      out[0] = in[0] / 255.0f * m;
+      out[1] = in[1] / 255.0f * m;
+      out[2] = in[2] / 255.0f * m;
+      out[3] = a;
+    }
+#endif
+  }
+
+  void FilterRow(float* out) {
+    using resample_internal::Pixel;
+    for (int x = 0; x < dst_width_; x++) {
+      const float* w = &h_.weights[static_cast<size_t>(x) * h_.taps];
+      const float* p = &row_[static_cast<size_t>(h_.start[x]) * 4];
+      Pixel acc = Pixel::Zero();
+      for (int i = 0; i < h_.count[x]; i++, p += 4) {
+        acc.MulAdd(Pixel::Load(p), w[i]);
+      }
+      acc.Store(out + x * 4);
+    }
+  }
+
+  void VerticalRow(int y) {
+    using resample_internal::Pixel;
+    const float* w = &v_.weights[static_cast<size_t>(y) * v_.taps];
+    const int count = v_.count[y];
+    for (int i = 0; i < count; i++) {
+      window_[i] = RingRow(v_.start[y] + i);
+    }
+    for (int x = 0; x < dst_width_; x++) {
+      Pixel acc = Pixel::Zero();
+      for (int i = 0; i < count; i++) {
+        acc.MulAdd(Pixel::Load(window_[i] + x * 4), w[i]);
+      }
+      acc.Store(&sum_[static_cast<size_t>(x) * 4]);
+    }
+  }
+
+  // Float -> RGBA8. Like the resize crate, colour is truncated and alpha
+  // rounded on the float path, and everything is rounded when neither
+  // premultiplication nor linear light is in use.
+  void StoreRow() {
+    const float* in = sum_.data();
+    uint8_t* out = out_.data();
+    const bool round_colour = !options_.premultiply && !tables_;
+    for (int x = 0; x < dst_width_; x++, in += 4, out += 4) {
+      float r = in[0], g = in[1], b = in[2];
+      const float a = in[3];
+      if (options_.premultiply) {
+        const float inv = a > 0.0f ? 1.0f / a : 0.0f;
+        r *= inv;
+        g *= inv;
+        b *= inv;
+      }
+      if (tables_) {
+        out[0] = tables_->ToSrgb(r);
+        out[1] = tables_->ToSrgb(g);
+        out[2] = tables_->ToSrgb(b);
+      } else if (round_colour) {
+        out[0] = ClampToByte(r);
+        out[1] = ClampToByte(g);
+        out[2] = ClampToByte(b);
+      } else {
+        out[0] = static_cast<uint8_t>(std::clamp(r * 255.0f, 0.0f, 255.0f));
+        out[1] = static_cast<uint8_t>(std::clamp(g * 255.0f, 0.0f, 255.0f));
+        out[2] = static_cast<uint8_t>(std::clamp(b * 255.0f, 0.0f, 255.0f));
+      }
+      out[3] = ClampToByte(a);
+    }
+  }
+
+  ResampleRect crop_;
+  int dst_width_;
+  int dst_height_;
+  ResampleOptions options_;
+  ResampleCoeffs h_;
+  ResampleCoeffs v_;
+  int ring_rows_;
+  std::vector<float> row_;
+  std::vector<float> ring_;
+  std::vector<float> sum_;
+  std::vector<const float*> window_;
+  std::vector<uint8_t> out_;
+  const resample_internal::SrgbTables* tables_ = nullptr;
+  int src_y_ = 0;
+  int next_dst_y_ = 0;
+};
+
+// Resamples `crop` of a RGBA8 image into a tightly packed `dst_width` x
+// `dst_height` RGBA8 buffer. `src_stride` is in bytes. Returns false, writing
+// nothing, when the crop or the output is empty.
+inline bool ResampleRGBA8(const uint8_t* src,
+                          size_t src_stride,
+                          ResampleRect crop,
+                          uint8_t* dst,
+                          int dst_width,
+                          int dst_height,
+                          const ResampleOptions& options = ResampleOptions()) {
+  RowResampler resampler(crop, dst_width, dst_height, options);
+  if (!resampler.valid()) {
+    return false;
+  }
+  const size_t dst_stride = static_cast<size_t>(dst_width) * 4;
+  for (int y = 0; y < crop.y + crop.height && !resampler.done(); y++) {
+    resampler.PushRow(src + y * src_stride, [&](const uint8_t* row, int dst_y) {
+      memcpy(dst + dst_y * dst_stride, row, dst_stride);
+    });
+  }
+  return true;
+}
+
+// Fills in a `width` or `height` of 0 from the source aspect ratio, the way
+// @jsquash/resize does when only one side is given. Both 0 keeps the source
+// size.
+inline void FitSize(int src_width, int src_height, int* width, int* height) {
+  if (*width <= 0 && *height <= 0) {
+    *width = src_width;
+    *height = src_height;
+  } else if (*width <= 0) {
+    *width = std::max(
+        1, static_cast<int>(std::lround(static_cast<double>(src_width) * *height / src_height)));
+  } else if (*height <= 0) {
+    *height = std::max(
+        1, static_cast<int>(std::lround(static_cast<double>(src_height) * *width / src_width)));
+  }
+}
+
+// Mirrors getContainOffsets() in packages/resize/util.ts: the largest centred
+// crop of the source that has the destination's aspect ratio. The crop keeps
+// at least one row and column, however extreme the aspect ratios.
+inline ResampleRect ContainCrop(int src_width, int src_height, int dst_width, int dst_height) {
+  if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) {
+    return {0, 0, src_width, src_height};
+  }
+  const double src_aspect = static_cast<double>(src_width) / src_height;
+  const double dst_aspect = static_cast<double>(dst_width) / dst_height;
+  if (dst_aspect > src_aspect) {
+    const double h = src_width / dst_aspect;
+    const int height = std::clamp(static_cast<int>(std::lround(h)), 1, src_height);
+    const int y = std::clamp(static_cast<int>(std::lround((src_height - h) / 2)), 0,
+                             src_height - height);
+    return {0, y, src_width, height};
+  }
+  const double w = src_height * dst_aspect;
+  const int width = std::clamp(static_cast<int>(std::lround(w)), 1, src_width);
+  const int x =
+      std::clamp(static_cast<int>(std::lround((src_width - w) / 2)), 0, src_width - width);
+  return {x, 0, width, src_height};
+}
+
+}  // namespace jsquash
@@ -0,0 +1,129 @@
+#pragma once
+
+// Resized copies of one RGBA8 image, for encoders that write the same image at
+// several sizes in one call (srcset variants). Each size is resampled from the
+// smallest copy made so far that is still at least twice as large, rather than
+// from the full size source every time. Asking for the sizes largest first
+// therefore reads the source once and every later size reads far fewer pixels.
+
+#include <emscripten/bind.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "resample.h"
+
+namespace jsquash {
+
+// Mirrors the @jsquash/resize options, minus the size, which every variant
+// sets on its own.
+struct ResizePyramidOptions {
+  // "stretch" | "contain"
+  std::string fitMethod;
+  // ResampleFilter
+  int method;
+  bool premultiply;
+  bool linearRGB;
+};
+
+// Only the first call registers the struct, so the AVIF and WebP encoders can
+// both call this when they are linked into one module.
+inline void RegisterResizePyramidOptions() {
+  static bool registered = false;
+  if (registered) {
+    return;
+  }
+  registered = true;
+  emscripten::value_object<ResizePyramidOptions>("ResizePyramidOptions")
+      .field("fitMethod", &ResizePyramidOptions::fitMethod)
+      .field("method", &ResizePyramidOptions::method)
+      .field("premultiply", &ResizePyramidOptions::premultiply)
+      .field("linearRGB", &ResizePyramidOptions::linearRGB);
+}
+
+class ResizePyramid {
+ public:
+  struct Level {
+    int width;
+    int height;
+    // Tightly packed width x height RGBA8, owned by the pyramid.
+    const uint8_t* data;
+  };
+
+  // `src` must outlive the pyramid, as the source size level points into it.
+  ResizePyramid(const uint8_t* src, int width, int height, const ResizePyramidOptions& options)
+      : source_({width, height, src}), contain_(options.fitMethod == "contain") {
+    options_.filter = options.method;
+    options_.premultiply = options.premultiply;
+    options_.linear_rgb = options.linearRGB;
+  }
+
+  // Returns the image at `width` x `height`, resampling it on the first call
+  // for that size. `data` is null when either size is 0 or less.
+  Level Get(int width, int height) {
+    if (width == source_.width && height == source_.height) {
+      return source_;
+    }
+    for (const auto& level : levels_) {
+      if (level->width == width && level->height == height) {
+        return {level->width, level->height, level->pixels.data()};
+      }
+    }
+
+    // "contain" crops every level to the target's aspect ratio, so only full
+    // frame levels can feed later sizes.
+    Level base = source_;
+    ResampleRect crop = Crop(base, width, height);
+    for (const auto& level : levels_) {
+      if (!level->full_frame) {
+        continue;
+      }
+      const Level candidate = {level->width, level->height, level->pixels.data()};
+      const ResampleRect candidate_crop = Crop(candidate, width, height);
+      if (candidate_crop.width >= width * 2 && candidate_crop.height >= height * 2 &&
+          static_cast<int64_t>(candidate.width) * candidate.height <
+              static_cast<int64_t>(base.width) * base.height) {
+        base = candidate;
+        crop = candidate_crop;
+      }
+    }
+
+    auto level = std::make_unique<Entry>();
+    level->width = width;
+    level->height = height;
+    level->full_frame = crop.width == base.width && crop.height == base.height;
+    if (width <= 0 || height <= 0) {
+      return {width, height, nullptr};
+    }
+    level->pixels.resize(static_cast<size_t>(width) * height * 4);
+    if (!ResampleRGBA8(base.data, static_cast<size_t>(base.width) * 4, crop, level->pixels.data(),
+                       width, height, options_)) {
+      return {width, height, nullptr};
+    }
+    levels_.push_back(std::move(level));
+    return {width, height, levels_.back()->pixels.data()};
+  }
+
+ private:
+  struct Entry {
+    int width;
+    int height;
+    bool full_frame;
+    std::vector<uint8_t> pixels;
+  };
+
+  ResampleRect Crop(const Level& base, int width, int height) const {
+    if (contain_) {
+      return ContainCrop(base.width, base.height, width, height);
+    }
+    return {0, 0, base.width, base.height};
+  }
+
+  Level source_;
+  bool contain_;
+  ResampleOptions options_;
+  std::vector<std::unique_ptr<Entry>> levels_;
+};
+
+}  // namespace jsquash
@@ -0,0 +1,276 @@
+#pragma once
+
+// HDR to SDR tone mapping for decoders of PQ, HLG and linear HDR images, so
+// they can return 8-bit SDR pixels directly instead of 16-bit or float frames
+// that JS would then have to tone map itself. The wrapper hands each decoded
+// row to a ToneMapper, which writes it out as RGBA8 in the target colour space.
+//
+// Highlights are compressed with the BT.2390 EETF, applied to the largest of
+// R, G and B so hues stay put. The transfer functions and the curve are lookup
+// tables built once per decode; gamut conversion, encoding and quantisation to
+// 8 bits are a single skcms transform per row. Builds with -msimd128 apply the
+// curve with wasm SIMD.
+//
+// Usage:
+//
+//   jsquash::ToneMapper tone_mapper;
+//   if (!tone_mapper.Init(transfer, primaries, peak, bit_depth, tone_mapping, conversion)) {
+//     return val::null();  // `conversion` asked for an unusable profile
+//   }
+//   for (each decoded row) {
+//     tone_mapper.MapRow(row, width, rgba8_row);
+//   }
+
+#include <emscripten/bind.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+#include "skcms.h"
+
+#include "color_profile.h"
+
+namespace jsquash {
+
+struct ToneMapping {
+  // Whether to tone map HDR images to SDR at all.
+  bool enabled;
+  // Luminance in cd/m² that SDR white stands for. The brightest highlights of
+  // the image are compressed to it, and anything darker keeps its luminance.
+  float peakLuminance;
+};
+
+// Safe to call from the bindings of every decoder in a module, see
+// RegisterDecodeResizeOptions().
+inline void RegisterToneMapping() {
+  static bool registered = false;
+  if (registered) {
+    return;
+  }
+  registered = true;
+  emscripten::value_object<ToneMapping>("ToneMapping")
+      .field("enabled", &ToneMapping::enabled)
+      .field("peakLuminance", &ToneMapping::peakLuminance);
+}
+
+enum class HdrTransfer {
+  // SMPTE ST 2084, absolute luminance up to 10000 cd/m².
+  kPQ,
+  // ARIB STD-B67, relative to the display's peak.
+  kHLG,
+  // Linear light, 1.0 being the image's peak luminance.
+  kLinear,
+};
+
+namespace tone_map_internal {
+
+constexpr float kPqMaxLuminance = 10000.0f;
+
+// BT.2100 PQ, between a signal and luminance relative to 10000 cd/m².
+inline float PqToLinear(float e) {
+  const float p = std::pow(std::max(e, 0.0f), 1.0f / 78.84375f);
+  return std::pow(std::max(p - 0.8359375f, 0.0f) / (18.8515625f - 18.6875f * p),
+                  1.0f / 0.1593017578125f);
+}
+
+inline float LinearToPq(float y) {
+  const float p = std::pow(std::max(y, 0.0f), 0.1593017578125f);
+  return std::pow((0.8359375f + 18.8515625f * p) / (1.0f + 18.6875f * p), 78.84375f);
+}
+
+// BT.2100 HLG inverse OETF, from a signal to scene linear light.
+inline float HlgToLinear(float e) {
+  constexpr float a = 0.17883277f, b = 0.28466892f, c = 0.55991073f;
+  e = std::clamp(e, 0.0f, 1.0f);
+  return e <= 0.5f ? e * e / 3.0f : (std::exp((e - c) / a) + b) / 12.0f;
+}
+
+}  // namespace tone_map_internal
+
+// Tone maps rows of RGBA samples to unpremultiplied RGBA8 in the target colour
+// space of a ColorConversion: sRGB by default, the target profile when there
+// is one, and the image's own primaries with the sRGB curve when conversion
+// is off.
+class ToneMapper {
+ public:
+  ToneMapper() = default;
+  ToneMapper(const ToneMapper&) = delete;
+  ToneMapper& operator=(const ToneMapper&) = delete;
+
+  // `to_xyzd50` maps linear RGB in the image's primaries to XYZ D50.
+  // `source_peak` is the luminance in cd/m² of the brightest highlight the
+  // image holds, such as its mastering display's peak or MaxCLL; for HLG it
+  // is the display peak the image is rendered for. Integer samples are
+  // `bit_depth` bits deep. Returns false when the target profile of
+  // `conversion` can't be used.
+  bool Init(HdrTransfer transfer, const skcms_Matrix3x3& to_xyzd50, float source_peak,
+            int bit_depth, const ToneMapping& tone_mapping, const ColorConversion& conversion) {
+    using namespace tone_map_internal;
+    transfer_ = transfer;
+    skcms_Init(&source_);
+    skcms_SetTransferFunction(&source_, skcms_Identity_TransferFunction());
+    skcms_SetXYZD50(&source_, &to_xyzd50);
+    if (!conversion.convert) {
+      skcms_Init(&own_target_);
+      skcms_SetTransferFunction(&own_target_, skcms_sRGB_TransferFunction());
+      skcms_SetXYZD50(&own_target_, &to_xyzd50);
+      target_ = &own_target_;
+    } else if (!conversion.targetProfile.empty()) {
+      target_parsed_ =
+          ParseProfile(reinterpret_cast<const uint8_t*>(conversion.targetProfile.data()),
+                       conversion.targetProfile.size(), true);
+      if (!target_parsed_) {
+        return false;
+      }
+      target_ = &target_parsed_->profile;
+    }
+
+    const float target_peak = tone_mapping.peakLuminance > 0 ? tone_mapping.peakLuminance : 203.0f;
+    source_peak = source_peak > 0 ? source_peak : 1000.0f;
+    // BT.2100's extended range system gamma for displays other than 1000 cd/m².
+    hlg_gamma_ = 1.2f + 0.42f * std::log10(source_peak / 1000.0f);
+
+    // Samples, and then the curve, are in linear light relative to the
+    // source peak. PQ samples above it are left for the curve to clamp.
+    const float max_code = static_cast<float>((1 << bit_depth) - 1);
+    const size_t sample_count = bit_depth > 0 ? (size_t{1} << bit_depth) : kSignalSize + 1;
+    const float sample_scale = bit_depth > 0 ? max_code : kSignalSize;
+    alpha_scale_ = bit_depth > 0 ? 1.0f / max_code : 1.0f;
+    samples_.resize(transfer == HdrTransfer::kLinear ? 0 : sample_count);
+    for (size_t i = 0; i < samples_.size(); i++) {
+      const float e = i / sample_scale;
+      samples_[i] = transfer == HdrTransfer::kPQ
+                        ? PqToLinear(e) * (kPqMaxLuminance / source_peak)
+                        : HlgToLinear(e);
+    }
+
+    // BT.2390 EETF, on PQ signals normalised to the source's range. Below the
+    // knee the luminance is kept; above it a Hermite spline compresses the
+    // rest of the range into what is left of the target's.
+    const float source_pq = LinearToPq(source_peak / kPqMaxLuminance);
+    const float max_lum = std::min(LinearToPq(target_peak / kPqMaxLuminance) / source_pq, 1.0f);
+    const float knee = std::max(1.5f * max_lum - 0.5f, 0.0f);
+    for (int i = 0; i <= kCurveSize; i++) {
+      // Indexed by the fourth root, which spends the entries on the shadows.
+      const float u = static_cast<float>(i) / kCurveSize;
+      const float m = u * u * u * u;
+      float e = LinearToPq(m * source_peak / kPqMaxLuminance) / source_pq;
+      if (e > knee && knee < 1.0f) {
+        const float t = (e - knee) / (1.0f - knee);
+        const float t2 = t * t, t3 = t2 * t;
+        e = (2 * t3 - 3 * t2 + 1) * knee + (t3 - 2 * t2 + t) * (1.0f - knee) +
+            (-2 * t3 + 3 * t2) * max_lum;
+      }
+      curve_[i] = PqToLinear(e * source_pq) * (kPqMaxLuminance / target_peak);
+    }
+    active_ = true;
+    return true;
+  }
+
+  // Whether Init() has set the mapper up.
+  bool active() const { return active_; }
+
+  // Integer samples of the Init() bit depth, as libavif writes them.
+  void MapRow(const uint16_t* in, uint32_t width, uint8_t* out) {
+    float* row = Row(width);
+    const uint16_t max_code = static_cast<uint16_t>(samples_.size() - 1);
+    for (uint32_t x = 0; x < width; x++, in += 4) {
+      row[x * 4 + 0] = samples_[std::min(in[0], max_code)];
+      row[x * 4 + 1] = samples_[std::min(in[1], max_code)];
+      row[x * 4 + 2] = samples_[std::min(in[2], max_code)];
+      row[x * 4 + 3] = in[3] * alpha_scale_;
+    }
+    Finish(row, width, skcms_AlphaFormat_Unpremul, out);
+  }
+
+  // Float samples as libjxl writes them, with Init()'s bit depth set to 0.
+  // `premultiplied` is for images whose colour is stored premultiplied.
+  void MapRow(const float* in, uint32_t width, bool premultiplied, uint8_t* out) {
+    float* row = Row(width);
+    for (uint32_t x = 0; x < width; x++, in += 4) {
+      for (int c = 0; c < 3; c++) {
+        row[x * 4 + c] = transfer_ == HdrTransfer::kLinear ? in[c] : Sample(in[c]);
+      }
+      row[x * 4 + 3] = in[3];
+    }
+    Finish(row, width,
+           premultiplied ? skcms_AlphaFormat_PremulAsEncoded : skcms_AlphaFormat_Unpremul, out);
+  }
+
+ private:
+  // Entries of the curve, and of the signal table for float samples.
+  static constexpr int kCurveSize = 1024;
+  static constexpr int kSignalSize = 4096;
+
+  float* Row(uint32_t width) {
+    row_.resize(static_cast<size_t>(width) * 4);
+    return row_.data();
+  }
+
+  // Float signals fall between the entries of the table.
+  float Sample(float e) const {
+    const float pos = std::clamp(e, 0.0f, 1.0f) * kSignalSize;
+    const int i = std::min(static_cast<int>(pos), kSignalSize - 1);
+    return samples_[i] + (samples_[i + 1] - samples_[i]) * (pos - i);
+  }
+
+  // Output of the curve over its input, for the largest of R, G and B.
+  float Gain(float m) const {
+    if (!(m > 0.0f)) {
+      return 0.0f;
+    }
+    const float pos = std::sqrt(std::sqrt(std::min(m, 1.0f))) * kCurveSize;
+    const int i = std::min(static_cast<int>(pos), kCurveSize - 1);
+    return (curve_[i] + (curve_[i + 1] - curve_[i]) * (pos - i)) / m;
+  }
+
+  // Applies the HLG OOTF and the curve to linear rows, then has skcms convert
+  // them to the target and quantise them.
+  void Finish(float* row, uint32_t width, skcms_AlphaFormat alpha_format, uint8_t* out) {
+    for (uint32_t x = 0; x < width; x++) {
+      float* px = row + x * 4;
+      float ootf = 1.0f;
+      if (transfer_ == HdrTransfer::kHLG) {
+        const float ys = 0.2627f * px[0] + 0.6780f * px[1] + 0.0593f * px[2];
+        ootf = ys > 0.0f ? std::pow(ys, hlg_gamma_ - 1.0f) : 0.0f;
+      }
+#if defined(__wasm_simd128__)
+      v128_t v = wasm_v128_load(px);
+      v128_t m = wasm_f32x4_max(v, wasm_i32x4_shuffle(v, v, 1, 2, 0, 3));
+      m = wasm_f32x4_max(m, wasm_i32x4_shuffle(v, v, 2, 0, 1, 3));
+      const float gain = Gain(wasm_f32x4_extract_lane(m, 0) * ootf) * ootf;
+      wasm_v128_store(px, wasm_f32x4_mul(v, wasm_f32x4_make(gain, gain, gain, 1.0f)));
+#else
+      const float gain = Gain(std::max({px[0], px[1], px[2]}) * ootf) * ootf;
+      px[0] *= gain;
+      px[1] *= gain;
+      px[2] *= gain;
+#endif
+    }
+    skcms_Transform(row, skcms_PixelFormat_RGBA_ffff, alpha_format, &source_, out,
+                    skcms_PixelFormat_RGBA_8888, skcms_AlphaFormat_Unpremul, target_, width);
+  }
+
+  bool active_ = false;
+  HdrTransfer transfer_ = HdrTransfer::kPQ;
+  float hlg_gamma_ = 1.2f;
+  float alpha_scale_ = 1.0f;
+  // Linear light of each code value, or of kSignalSize steps of a float signal.
+  std::vector<float> samples_;
+  float curve_[kCurveSize + 1];
+  std::vector<float> row_;
+  skcms_ICCProfile source_;
+  skcms_ICCProfile own_target_;
+  std::shared_ptr<const ParsedProfile> target_parsed_;
+  const skcms_ICCProfile* target_ = skcms_sRGB_profile();
+};
+
+}  // namespace jsquash
@@ -2,61 +2,370 @@
 #include <emscripten/val.h>
 #include "avif/avif.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "color_profile.h"
+#include "decode_limits.h"
+#include "decode_resize.h"
+#include "embind_export.h"
+#include "heif_items.h"
+#include "image_analysis.h"
+#include "image_view.h"
+#include "premultiply.h"
+#include "tone_map.h"
+
 using namespace emscripten;
 
-thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
+namespace {
+
 thread_local const val Uint16Array = val::global("Uint16Array");
-thread_local const val ImageData = val::global("ImageData");
 thread_local const val Object = val::global("Object");
 
-val decode(std::string avifimage, uint32_t bitDepth = 8) {
-  avifImage* image = avifImageCreateEmpty();
-  avifDecoder* decoder = avifDecoderCreate();
-  avifResult decodeResult =
-      avifDecoderReadMemory(decoder, image, (uint8_t*)avifimage.c_str(), avifimage.length());
+// Rows per YUV -> RGB conversion when resizing or analysing. Each strip is
+// converted with a chroma row of context above and below so the upsampled
+// chroma matches a whole frame conversion.
+constexpr uint32_t kStripRows = 16;
+constexpr uint32_t kStripContextRows = 2;
 
-  // image is an independent copy of decoded data, decoder may be destroyed here
-  avifDecoderDestroy(decoder);
+// Bit depth HDR strips are converted to RGB at for tone mapping. 8-bit PQ and
+// HLG images are widened too, as their shadows need more than 8 bits once
+// linearised.
+uint32_t HdrStripDepth(const avifImage* image) {
+  return std::max<uint32_t>(image->depth, 10);
+}
 
-  val result = val::null();
-  if (decodeResult == AVIF_RESULT_OK) {
-    avifRGBImage rgb;
-    avifRGBImageSetDefaults(&rgb, image);
+// The matrix from linear RGB in the CICP colour primaries of the image to XYZ
+// D50. Unspecified and unknown primaries come back as BT.709's.
+bool CicpToXYZD50(const avifImage* image, skcms_Matrix3x3* to_xyzd50) {
+  float primaries[8];
+  avifColorPrimariesGetValues(image->colorPrimaries, primaries);
+  return skcms_PrimariesToXYZD50(primaries[0], primaries[1], primaries[2], primaries[3],
+                                 primaries[4], primaries[5], primaries[6], primaries[7],
+                                 to_xyzd50);
+}
 
-    rgb.depth = bitDepth;
+// Builds a profile from the CICP code points of an image without an ICC
+// profile. Returns false for transfer characteristics that no profile
+// describes for SDR output, such as PQ and HLG.
+bool MakeCicpProfile(const avifImage* image, skcms_ICCProfile* profile) {
+  skcms_TransferFunction transfer;
+  switch (image->transferCharacteristics) {
+    case AVIF_TRANSFER_CHARACTERISTICS_LINEAR:
+      transfer = *skcms_Identity_TransferFunction();
+      break;
+    case AVIF_TRANSFER_CHARACTERISTICS_BT470M:
+      transfer = {2.2f, 1, 0, 0, 0, 0, 0};
+      break;
+    case AVIF_TRANSFER_CHARACTERISTICS_BT470BG:
+      transfer = {2.8f, 1, 0, 0, 0, 0, 0};
+      break;
+    case AVIF_TRANSFER_CHARACTERISTICS_LOG100:
+    case AVIF_TRANSFER_CHARACTERISTICS_LOG100_SQRT10:
+    case AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084:
+    case AVIF_TRANSFER_CHARACTERISTICS_SMPTE428:
+    case AVIF_TRANSFER_CHARACTERISTICS_HLG:
+      return false;
+    default:
+      // sRGB, unspecified, and BT.709 and the other camera curves, which
+      // encoders mostly write for images they mean as sRGB.
+      transfer = *skcms_sRGB_TransferFunction();
+      break;
+  }
 
-    avifRGBImageAllocatePixels(&rgb);
-    avifImageYUVToRGB(image, &rgb);
+  skcms_Matrix3x3 to_xyzd50;
+  if (!CicpToXYZD50(image, &to_xyzd50)) {
+    return false;
+  }
+  skcms_Init(profile);
+  skcms_SetTransferFunction(profile, &transfer);
+  skcms_SetXYZD50(profile, &to_xyzd50);
+  return true;
+}
 
-    if (bitDepth != 8) {
-      const size_t pixelCount = rgb.width * rgb.height;
-      const size_t channelCount = 4;
-      const size_t totalElements = pixelCount * channelCount;
+// Sets up `converter` from the image's ICC profile, or else from its CICP code
+// points. Returns false when the target profile of `color` can't be used.
+bool InitColorConverter(const avifImage* image, const jsquash::ColorConversion& color,
+                        jsquash::ColorConverter* converter) {
+  if (image->icc.size > 0) {
+    return converter->Init(color, image->icc.data, image->icc.size);
+  }
+  skcms_ICCProfile cicp;
+  if (MakeCicpProfile(image, &cicp)) {
+    return converter->Init(color, cicp);
+  }
+  return converter->Init(color, nullptr, 0);
+}
+
+// Sets up `tone_mapper` for PQ and HLG images when `tone_mapping` asks for
+// it, leaving it inactive for everything else. The peak of PQ images is their
+// MaxCLL, or 1000 cd/m² without one, as most HDR photos are graded for.
+// Returns false when the target profile of `color` can't be used.
+bool InitToneMapper(const avifImage* image, const jsquash::ToneMapping& tone_mapping,
+                    const jsquash::ColorConversion& color, jsquash::ToneMapper* tone_mapper) {
+  jsquash::HdrTransfer transfer;
+  float peak = 1000.0f;
+  if (image->transferCharacteristics == AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084) {
+    transfer = jsquash::HdrTransfer::kPQ;
+    if (image->clli.maxCLL > 0) {
+      peak = image->clli.maxCLL;
+    }
+  } else if (image->transferCharacteristics == AVIF_TRANSFER_CHARACTERISTICS_HLG) {
+    transfer = jsquash::HdrTransfer::kHLG;
+  } else {
+    return true;
+  }
+  skcms_Matrix3x3 to_xyzd50;
+  if (!tone_mapping.enabled || !CicpToXYZD50(image, &to_xyzd50)) {
+    return true;
+  }
+  return tone_mapper->Init(transfer, to_xyzd50, peak, HdrStripDepth(image), tone_mapping, color);
+}
 
-      auto pixelData = Uint16Array.new_(typed_memory_view(totalElements,
-                                        reinterpret_cast<uint16_t*>(rgb.pixels)));
+// Converts the image to RGBA8 in strips and streams them through `resizer`,
+// so only the resized frame and one strip of RGB pixels are ever allocated.
+// Each strip goes through `converter` and then, when it is set, `analyzer`
+// while it is still in cache. With an active `tone_mapper`, strips are
+// converted at HdrStripDepth() instead and tone mapped to RGBA8 in place of
+// `converter`. With `premultiply`, strips are premultiplied last, before they
+// reach `resizer`. Polls `budget` once per strip.
+bool DecodeInStrips(const avifImage* image,
+                    jsquash::DecodeResizer* resizer,
+                    uint8_t* dst,
+                    jsquash::DecodeBudget* budget,
+                    const jsquash::ColorConverter& converter,
+                    jsquash::ToneMapper* tone_mapper,
+                    jsquash::ImageAnalyzer* analyzer,
+                    bool premultiply) {
+  const size_t strip_stride = static_cast<size_t>(image->width) * 4;
+  const size_t strip_rows = kStripRows + kStripContextRows * 2;
+  std::vector<uint8_t> strip(strip_stride * strip_rows);
+  std::vector<uint16_t> hdr_strip(tone_mapper->active() ? strip_stride * strip_rows : 0);
+  avifImage* view = avifImageCreateEmpty();
+  bool ok = view != nullptr;
 
-      auto pixelArray = pixelData.call<val>("slice");
+  for (uint32_t y = 0; ok && y < image->height; y += kStripRows) {
+    if (!budget->Poll()) {
+      ok = false;
+      break;
+    }
+    const uint32_t rows = std::min(kStripRows, image->height - y);
+    const uint32_t top = y >= kStripContextRows ? y - kStripContextRows : 0;
+    const uint32_t bottom = std::min(image->height, y + rows + kStripContextRows);
+    const avifCropRect rect = {0, top, image->width, bottom - top};
+    ok = avifImageSetViewRect(view, image, &rect) == AVIF_RESULT_OK;
+    if (!ok) {
+      break;
+    }
 
-      result = Object.new_();
-      result.set("data", pixelArray);
-      result.set("width", rgb.width);
-      result.set("height", rgb.height);
+    avifRGBImage rgb;
+    avifRGBImageSetDefaults(&rgb, view);
+    if (tone_mapper->active()) {
+      rgb.depth = HdrStripDepth(image);
+      rgb.pixels = reinterpret_cast<uint8_t*>(hdr_strip.data());
+      rgb.rowBytes = strip_stride * sizeof(uint16_t);
     } else {
-      result = ImageData.new_(
-          Uint8ClampedArray.new_(typed_memory_view(rgb.rowBytes * rgb.height, rgb.pixels)),
-          rgb.width,
-          rgb.height);
+      rgb.depth = 8;
+      rgb.pixels = strip.data();
+      rgb.rowBytes = strip_stride;
     }
+    ok = avifImageYUVToRGB(view, &rgb) == AVIF_RESULT_OK;
 
-    // Now we can safely free the RGB pixels:
-    avifRGBImageFreePixels(&rgb);
+    uint8_t* strip_row_ptr = strip.data() + (y - top) * strip_stride;
+    if (ok && tone_mapper->active()) {
+      for (uint32_t row = y - top; row < y - top + rows; row++) {
+        tone_mapper->MapRow(hdr_strip.data() + row * strip_stride, image->width,
+                            strip.data() + row * strip_stride);
+      }
+    } else if (ok) {
+      converter.ConvertRows(strip_row_ptr, strip_stride, image->width, rows);
+    }
+    if (ok && analyzer) {
+      analyzer->AddRows(strip_row_ptr, strip_stride, rows);
+    }
+    if (ok && premultiply) {
+      jsquash::PremultiplyRows(strip_row_ptr, strip_stride, image->width, rows);
+    }
+    for (uint32_t row = y - top; ok && row < y - top + rows; row++) {
+      resizer->PushRow(strip.data() + row * strip_stride, dst);
+    }
+  }
+
+  if (view) {
+    avifImageDestroy(view);
   }
+  return ok;
+}
+
+// Upper bound of the bytes a decode allocates for the YUV planes libavif
+// decodes into and the RGBA pixels converted from them.
+double DecodedBytes(const avifImage* image, uint32_t bitDepth) {
+  const double pixels = static_cast<double>(image->width) * image->height;
+  const double yuv = pixels * 4 * (image->depth > 8 ? 2 : 1);
+  return yuv + pixels * 4 * (bitDepth > 8 ? 2 : 1);
+}
 
-  avifImageDestroy(image);
+// 8-bit decodes write into `output` instead of a new ImageData when it is set,
+// see jsquash::WriteImageData(). Returns the name of the limit as a string
+// when `budget` stops the decode. 8-bit decodes convert from the image's ICC
+// profile or CICP code points as `color` asks, see jsquash::ColorConverter,
+// and with `analyze` return {image, analysis}, see jsquash::ImageAnalyzer.
+// PQ and HLG images are tone mapped to SDR instead when `toneMapping` is
+// enabled, see jsquash::ToneMapper. With `premultiplied`, returns colour
+// premultiplied by alpha.
+val DecodeImage(std::string avifimage,
+                uint32_t bitDepth,
+                jsquash::DecodeResizeOptions resize,
+                jsquash::DecodeBudget* budget,
+                jsquash::ColorConversion color,
+                jsquash::ToneMapping toneMapping,
+                bool premultiplied,
+                bool analyze,
+                val output) {
+  std::unique_ptr<avifDecoder, decltype(&avifDecoderDestroy)> decoder(avifDecoderCreate(),
+                                                                      avifDecoderDestroy);
+
+  // Parsing reads the container only, which gives the size and the frame
+  // count of image sequences before any AV1 data is decoded. libaom has no
+  // progress hook, so the budget is otherwise checked between stages.
+  if (avifDecoderSetIOMemory(decoder.get(), (const uint8_t*)avifimage.c_str(),
+                             avifimage.length()) != AVIF_RESULT_OK ||
+      avifDecoderParse(decoder.get()) != AVIF_RESULT_OK) {
+    return val::null();
+  }
+  if (!budget->CheckImage(decoder->image->width, decoder->image->height, decoder->imageCount,
+                          DecodedBytes(decoder->image, bitDepth))) {
+    return budget->Abort();
+  }
+  if (avifDecoderNextImage(decoder.get()) != AVIF_RESULT_OK) {
+    return val::null();
+  }
+  if (!budget->Check()) {
+    return budget->Abort();
+  }
+  // Owned by the decoder, which must therefore outlive every use of it.
+  const avifImage* image = decoder->image;
+  // Opaque images are the same either way.
+  premultiplied = premultiplied && image->alphaPlane != nullptr;
+
+  val result = val::null();
+  if (bitDepth == 8) {
+    jsquash::ToneMapper tone_mapper;
+    if (!InitToneMapper(image, toneMapping, color, &tone_mapper)) {
+      return val::null();
+    }
+    jsquash::ColorConverter converter;
+    if (!tone_mapper.active() && !InitColorConverter(image, color, &converter)) {
+      return val::null();
+    }
+    // Colour conversion, tone mapping and analysis also take the strip path,
+    // so they read each strip while the YUV conversion has just written it
+    // rather than the whole frame afterwards.
+    jsquash::DecodeResizer resizer(image->width, image->height, resize);
+    if (!resizer.valid()) {
+      return val::null();
+    }
+    if (resizer.active() || converter.active() || tone_mapper.active() || analyze) {
+      std::unique_ptr<jsquash::ImageAnalyzer> analyzer;
+      if (analyze) {
+        analyzer = std::make_unique<jsquash::ImageAnalyzer>(image->width, image->height);
+      }
+      // The resizer reads straight alpha, so resized images are premultiplied
+      // after it, at their smaller size.
+      std::vector<uint8_t> pixels(resizer.size());
+      if (DecodeInStrips(image, &resizer, pixels.data(), budget, converter, &tone_mapper,
+                         analyzer.get(), premultiplied && !resizer.active())) {
+        if (premultiplied && resizer.active()) {
+          jsquash::PremultiplyRows(pixels.data(), static_cast<size_t>(resizer.width()) * 4,
+                                   resizer.width(), resizer.height());
+        }
+        result = jsquash::WriteImageData(pixels.data(), resizer.width(), resizer.height(), output);
+      }
+      if (budget->exceeded()) {
+        return budget->Abort();
+      }
+      return analyzer ? analyzer->Attach(result) : result;
+    }
+  }
+
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults(&rgb, image);
+
+  rgb.depth = bitDepth;
+  rgb.alphaPremultiplied = premultiplied;
+
+  avifRGBImageAllocatePixels(&rgb);
+  avifImageYUVToRGB(image, &rgb);
+
+  if (!budget->Check()) {
+    result = budget->Abort();
+  } else if (bitDepth != 8) {
+    const size_t pixelCount = rgb.width * rgb.height;
+    const size_t channelCount = 4;
+    const size_t totalElements = pixelCount * channelCount;
+
+    auto pixelData = Uint16Array.new_(typed_memory_view(totalElements,
+                                      reinterpret_cast<uint16_t*>(rgb.pixels)));
+
+    auto pixelArray = pixelData.call<val>("slice");
+
+    result = Object.new_();
+    result.set("data", pixelArray);
+    result.set("width", rgb.width);
+    result.set("height", rgb.height);
+  } else {
+    result = jsquash::WriteImageData(rgb.pixels, rgb.width, rgb.height, output);
+  }
+
+  // Now we can safely free the RGB pixels:
+  avifRGBImageFreePixels(&rgb);
   return result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
-  function("decode", &decode);
+// DecodeImage() within `limits`.
+val decode(std::string avifimage,
+           uint32_t bitDepth,
+           jsquash::DecodeResizeOptions resize,
+           jsquash::DecodeLimits limits,
+           jsquash::ColorConversion color,
+           jsquash::ToneMapping toneMapping,
+           bool premultiplied,
+           bool analyze,
+           val output) {
+  jsquash::DecodeBudget budget(limits);
+  return DecodeImage(std::move(avifimage), bitDepth, resize, &budget, color, toneMapping,
+                     premultiplied, analyze, output);
+}
+
+// Decodes the 'thmb' item of the primary image instead of the image itself.
+// libavif never picks thumbnails as the colour item, so the thumbnail is made
+// the primary item before decoding. Returns undefined when there is none.
+val decodePreview(std::string avifimage, jsquash::DecodeLimits limits) {
+  // Finding the thumbnail copies the item data out of the file and writes it
+  // back, so up to two more copies of the file are held before decoding.
+  jsquash::DecodeBudget budget(limits);
+  if (!budget.CheckImage(0, 0, 0, 2.0 * avifimage.size())) {
+    return budget.Abort();
+  }
+  if (!jsquash::PromoteHeifThumbnail(&avifimage)) {
+    return val::undefined();
+  }
+  if (!budget.Check()) {
+    return budget.Abort();
+  }
+  return DecodeImage(std::move(avifimage), 8,
+                     {0, 0, "stretch", jsquash::RESAMPLE_LANCZOS3, true, false}, &budget,
+                     {true, ""}, {false, 0}, false, false, val::undefined());
+}
+
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(avif_dec) {
+  jsquash::RegisterDecodeResizeOptions();
+  jsquash::RegisterDecodeLimits();
+  jsquash::RegisterColorConversion();
+  jsquash::RegisterToneMapping();
+  function(JSQUASH_EXPORT("decode"), &decode);
+  function(JSQUASH_EXPORT("decodePreview"), &decodePreview);
 }
\ No newline at end of file
@@ -1,7 +1,54 @@
+export interface DecodeResizeOptions {
+  width: number;
+  height: number;
+  fitMethod: 'stretch' | 'contain';
+  method: number;
+  premultiply: boolean;
+  linearRGB: boolean;
+}
+
+export interface DecodeLimits {
+  maxPixels: number;
+  maxFrames: number;
+  maxMemory: number;
+  timeLimit: number;
+}
+
+// What a decode stopped by its limits returns.
+export type DecodeLimit = keyof DecodeLimits;
+
+export interface ColorConversion {
+  convert: boolean;
+  // An ICC profile, or '' for sRGB.
+  targetProfile: Uint8Array | string;
+}
+
+export interface ToneMapping {
+  enabled: boolean;
+  // 0 for the default.
+  peakLuminance: number;
+}
+
+export interface ImageAnalysis {
+  histogram: Uint32Array;
+  meanColor: { r: number; g: number; b: number; a: number };
+  dominantColor: { r: number; g: number; b: number };
+  perceptualHash: string;
+  thumbHash: Uint8Array;
+}
+
+export interface DecodeOutput {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+}
+
 export interface AVIFModule extends EmscriptenWasm.Module {
-  decode(data: BufferSource, bitDepth: 10 | 12 | 16): { data: Uint16Array, height: number, width: number } | null;
-  decode(data: BufferSource, bitDepth: 8): ImageData | null;
-  decode(data: BufferSource, bitDepth: 8 | 10 | 12 | 16): { data: Uint16Array, height: number, width: number } | ImageData | null;
+  decode(data: BufferSource, bitDepth: 10 | 12 | 16, resize: DecodeResizeOptions, limits: DecodeLimits, color: ColorConversion, toneMapping: ToneMapping, premultiplied: boolean, analyze: false, output: undefined): { data: Uint16Array, height: number, width: number } | DecodeLimit | null;
+  decode(data: BufferSource, bitDepth: 8, resize: DecodeResizeOptions, limits: DecodeLimits, color: ColorConversion, toneMapping: ToneMapping, premultiplied: boolean, analyze: false, output: undefined): ImageData | DecodeLimit | null;
+  decode(data: BufferSource, bitDepth: 8, resize: DecodeResizeOptions, limits: DecodeLimits, color: ColorConversion, toneMapping: ToneMapping, premultiplied: boolean, analyze: true, output: undefined): { image: ImageData, analysis: ImageAnalysis } | DecodeLimit | null;
+  decode(data: BufferSource, bitDepth: 8 | 10 | 12 | 16, resize: DecodeResizeOptions, limits: DecodeLimits, color: ColorConversion, toneMapping: ToneMapping, premultiplied: boolean, analyze: false, output: undefined): { data: Uint16Array, height: number, width: number } | ImageData | DecodeLimit | null;
+  decode(data: BufferSource, bitDepth: 8, resize: DecodeResizeOptions, limits: DecodeLimits, color: ColorConversion, toneMapping: ToneMapping, premultiplied: boolean, analyze: false, output: DecodeOutput): { width: number, height: number } | DecodeLimit | null;
+  decodePreview(data: BufferSource, limits: DecodeLimits): ImageData | DecodeLimit | null | undefined;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<AVIFModule>;
@@ -3,8 +3,18 @@
 #include <emscripten/val.h>
 #include "avif/avif.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "embind_export.h"
+#include "heif_items.h"
+#include "image_size.h"
+#include "resize_pyramid.h"
 
 #define RETURN_NULL_IF(expression) \
   do {                             \
@@ -14,6 +24,8 @@
 
 using namespace emscripten;
 
+namespace {
+
 using AvifImagePtr = std::unique_ptr<avifImage, decltype(&avifImageDestroy)>;
 using AvifEncoderPtr = std::unique_ptr<avifEncoder, decltype(&avifEncoderDestroy)>;
 
@@ -51,46 +63,176 @@ struct AvifOptions {
   bool enableSharpYUV;
   // 8, 10, or 12 bit depth
   int bitDepth;
+  // 0 = only split images beyond the AV1 level 6 frame limits
+  // otherwise the maximum width and height of a grid cell
+  int gridCellSize;
+  // 0 = no thumbnail
+  // otherwise the longer side of a thumbnail item to embed
+  int thumbnailSize;
 };
 
-thread_local const val Uint8Array = val::global("Uint8Array");
+// AV1 level 6.x frame limits. Larger frames are valid AV1 but are rejected by
+// some decoders, so images beyond them are always encoded as a grid.
+constexpr uint32_t kMaxFrameWidth = 16384;
+constexpr uint32_t kMaxFrameHeight = 8704;
+constexpr uint64_t kMaxFrameArea = 35651584;
+constexpr uint32_t kDefaultGridCellSize = 4096;
+// MIAF 7.3.11.4.2: grid cells must be at least 64x64.
+constexpr uint32_t kMinGridCellSize = 64;
+// ImageGrid stores the number of rows and columns in 8 bits.
+constexpr uint32_t kMaxGridCells = 256;
 
-val encode(std::string buffer, int width, int height, AvifOptions options) {
-  avifResult status;  // To check the return status for avif API's
+struct GridAxis {
+  uint32_t cells;
+  uint32_t cellSize;
+};
 
-  int depth = options.bitDepth;
-  if (depth != 8 && depth != 10 && depth != 12) {
-    EM_ASM({
-      throw new Error("Invalid bit depth. Supported values are 8, 10, or 12.");
-    });
-    return val::null();
+// Splits `length` into cells of about `max_cell` pixels. Every cell but the
+// last has the same even size, so cell offsets stay aligned to the chroma
+// subsampling. The last cell takes the remainder.
+GridAxis SplitGridAxis(uint32_t length, uint32_t max_cell) {
+  uint32_t cells = (length + max_cell - 1) / max_cell;
+  while (cells > 1) {
+    const uint32_t cell_size = ((length + cells - 1) / cells + 1) & ~1u;
+    if ((cells - 1) * cell_size + kMinGridCellSize <= length) {
+      return {cells, cell_size};
+    }
+    --cells;
+  }
+  return {1, length};
+}
+
+struct GridLayout {
+  GridAxis columns;
+  GridAxis rows;
+};
+
+// How `image` is split into grid cells. Images within the AV1 frame limits
+// are one cell unless `options.gridCellSize` asks for smaller ones.
+GridLayout LayOutGrid(const avifImage* image, const AvifOptions& options) {
+  uint32_t cellSize = options.gridCellSize > 0
+                          ? std::max(kMinGridCellSize, static_cast<uint32_t>(options.gridCellSize))
+                          : kDefaultGridCellSize;
+  if (options.gridCellSize <= 0 && image->width <= kMaxFrameWidth &&
+      image->height <= kMaxFrameHeight &&
+      static_cast<uint64_t>(image->width) * image->height <= kMaxFrameArea) {
+    cellSize = std::max(image->width, image->height);
   }
+  return {SplitGridAxis(image->width, cellSize), SplitGridAxis(image->height, cellSize)};
+}
 
-  avifPixelFormat format;
-  switch (options.subsample) {
+// libaom instances a single frame encode of `image` opens: one for colour and
+// one for alpha.
+int EncoderInstances(const avifImage* image) {
+  return image->alphaPlane != nullptr ? 2 : 1;
+}
+
+// Calls `encode(i, max_threads)` for each of `instances.size()` encodes, where
+// encode i opens `instances[i]` libaom instances. Multithreaded builds run the
+// encodes side by side and share the cores between them.
+//
+// Every thread comes from Emscripten's worker pool, which has one worker per
+// logical core and cannot grow while the calling thread blocks. A thread that
+// is joined from another worker only goes back to the pool once the call
+// returns to JS. Each libaom instance starts max_threads - 1 threads, so
+// max_threads is chosen to keep the worker threads started here plus every
+// libaom thread within the pool; otherwise a thread waits for a worker that
+// never comes.
+template <typename Encode>
+void RunEncodes(const std::vector<int>& instances, const Encode& encode) {
+  const int cores = emscripten_num_logical_cores();
+#ifdef __EMSCRIPTEN_PTHREADS__
+  const int workers = std::max(1, std::min(static_cast<int>(instances.size()), cores));
+  int total_instances = 0;
+  for (int count : instances) {
+    total_instances += count;
+  }
+  const int max_threads =
+      std::min(cores, 1 + (cores - (workers - 1)) / std::max(1, total_instances));
+  std::atomic<size_t> next{0};
+  auto run = [&]() {
+    for (size_t i = next++; i < instances.size(); i = next++) {
+      encode(i, max_threads);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < workers; ++i) {
+    threads.emplace_back(run);
+  }
+  run();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+#else
+  for (size_t i = 0; i < instances.size(); ++i) {
+    encode(i, cores);
+  }
+#endif
+}
+
+// One output of encodeVariants(). A width or height of 0 keeps the source size,
+// or preserves the aspect ratio when only the other side is given.
+struct EncodeVariant {
+  int width;
+  int height;
+  AvifOptions options;
+};
+
+thread_local const val Uint8Array = val::global("Uint8Array");
+
+avifPixelFormat PixelFormat(int subsample) {
+  switch (subsample) {
     case 0:
-      format = AVIF_PIXEL_FORMAT_YUV400;
-      break;
-    case 1:
-      format = AVIF_PIXEL_FORMAT_YUV420;
-      break;
+      return AVIF_PIXEL_FORMAT_YUV400;
     case 2:
-      format = AVIF_PIXEL_FORMAT_YUV422;
-      break;
+      return AVIF_PIXEL_FORMAT_YUV422;
     case 3:
-      format = AVIF_PIXEL_FORMAT_YUV444;
-      break;
+      return AVIF_PIXEL_FORMAT_YUV444;
+    default:
+      return AVIF_PIXEL_FORMAT_YUV420;
   }
+}
 
-  bool lossless = options.quality == AVIF_QUALITY_LOSSLESS &&
-                  (options.qualityAlpha == -1 || options.qualityAlpha == AVIF_QUALITY_LOSSLESS) &&
-                  format == AVIF_PIXEL_FORMAT_YUV444;
+bool IsLossless(const AvifOptions& options) {
+  return options.quality == AVIF_QUALITY_LOSSLESS &&
+         (options.qualityAlpha == -1 || options.qualityAlpha == AVIF_QUALITY_LOSSLESS) &&
+         PixelFormat(options.subsample) == AVIF_PIXEL_FORMAT_YUV444;
+}
 
+bool IsValidDepth(int depth) {
+  if (depth != 8 && depth != 10 && depth != 12) {
+    EM_ASM({
+      throw new Error("Invalid bit depth. Supported values are 8, 10, or 12.");
+    });
+    return false;
+  }
+  return true;
+}
+
+// Bytes per RGBA pixel of the encoder input.
+size_t PixelSize(int rgb_depth) {
+  return rgb_depth > 8 ? 8 : 4;
+}
+
+// Converts RGBA (8 bit, or 16 bit samples when `rgb_depth` > 8) with rows
+// `stride` bytes apart into the YUV image that `options` asks for. AVIF stores
+// straight alpha, so libavif unpremultiplies `premultiplied` input as it
+// converts. Returns nullptr on failure.
+AvifImagePtr ConvertToYUV(const uint8_t* rgba,
+                          int width,
+                          int height,
+                          size_t stride,
+                          int rgb_depth,
+                          const AvifOptions& options,
+                          bool premultiplied) {
   // Smart pointer for the input image in YUV format
-  AvifImagePtr image(avifImageCreate(width, height, depth, format), avifImageDestroy);
-  RETURN_NULL_IF(image == nullptr);
+  AvifImagePtr image(avifImageCreate(width, height, options.bitDepth, PixelFormat(options.subsample)),
+                     avifImageDestroy);
+  if (image == nullptr) {
+    return image;
+  }
 
-  if (lossless) {
+  if (IsLossless(options)) {
     image->matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_IDENTITY;
   } else {
     image->matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_BT601;
@@ -98,35 +240,47 @@ val encode(std::string buffer, int width, int height, AvifOptions options) {
 
   avifRGBImage srcRGB;
   avifRGBImageSetDefaults(&srcRGB, image.get());
+  srcRGB.pixels = const_cast<uint8_t*>(rgba);
 
-  uint8_t* rgba = reinterpret_cast<uint8_t*>(const_cast<char*>(buffer.data()));
-  srcRGB.pixels = rgba;
-
-  if (depth > 8) {
-    srcRGB.depth = depth;
-    srcRGB.rowBytes = width * 8;
-  } else {
-    srcRGB.depth = 8;
-    srcRGB.rowBytes = width * 4;
-  }
+  srcRGB.depth = rgb_depth > 8 ? rgb_depth : 8;
+  srcRGB.rowBytes = stride;
+  srcRGB.alphaPremultiplied = premultiplied ? AVIF_TRUE : AVIF_FALSE;
 
   if (options.enableSharpYUV) {
     srcRGB.chromaDownsampling = AVIF_CHROMA_DOWNSAMPLING_SHARP_YUV;
   }
-  status = avifImageRGBToYUV(image.get(), &srcRGB);
-  RETURN_NULL_IF(status != AVIF_RESULT_OK);
+  if (avifImageRGBToYUV(image.get(), &srcRGB) != AVIF_RESULT_OK) {
+    image.reset();
+  }
+  return image;
+}
+
+// Encodes `image` as a single frame. `image` is only read, so several encodes
+// can share one conversion and run at the same time. `alpha` marks a
+// monochrome image that holds an alpha plane, which is coded the way libavif
+// codes alpha.
+avifResult EncodeImage(const avifImage* image,
+                       const AvifOptions& options,
+                       bool alpha,
+                       int max_threads,
+                       avifRWData* output) {
+  avifResult status;  // To check the return status for avif API's
 
   // Create a smart pointer for the encoder
   AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
-  RETURN_NULL_IF(encoder == nullptr);
+  if (encoder == nullptr) {
+    return AVIF_RESULT_OUT_OF_MEMORY;
+  }
 
-  if (lossless) {
+  if (IsLossless(options)) {
     encoder->quality = AVIF_QUALITY_LOSSLESS;
     encoder->qualityAlpha = AVIF_QUALITY_LOSSLESS;
   } else {
     status = avifEncoderSetCodecSpecificOption(encoder.get(), "sharpness",
                                                std::to_string(options.sharpness).c_str());
-    RETURN_NULL_IF(status != AVIF_RESULT_OK);
+    if (status != AVIF_RESULT_OK) {
+      return status;
+    }
 
     // Set base quality
     encoder->quality = options.quality;
@@ -136,31 +290,356 @@ val encode(std::string buffer, int width, int height, AvifOptions options) {
     } else {
       encoder->qualityAlpha = options.qualityAlpha;
     }
+    if (alpha) {
+      encoder->quality = encoder->qualityAlpha;
+    }
 
     if (options.tune == 2 || (options.tune == 0 && options.quality >= 50)) {
       status = avifEncoderSetCodecSpecificOption(encoder.get(), "tune", "ssim");
-      RETURN_NULL_IF(status != AVIF_RESULT_OK);
+      if (status != AVIF_RESULT_OK) {
+        return status;
+      }
     }
 
-    if (options.chromaDeltaQ) {
+    // The "color:" options only apply to the colour planes.
+    if (options.chromaDeltaQ && !alpha) {
       status = avifEncoderSetCodecSpecificOption(encoder.get(), "color:enable-chroma-deltaq", "1");
-      RETURN_NULL_IF(status != AVIF_RESULT_OK);
+      if (status != AVIF_RESULT_OK) {
+        return status;
+      }
     }
 
-    status = avifEncoderSetCodecSpecificOption(encoder.get(), "color:denoise-noise-level",
-                                               std::to_string(options.denoiseLevel).c_str());
-    RETURN_NULL_IF(status != AVIF_RESULT_OK);
+    if (!alpha) {
+      status = avifEncoderSetCodecSpecificOption(encoder.get(), "color:denoise-noise-level",
+                                                 std::to_string(options.denoiseLevel).c_str());
+      if (status != AVIF_RESULT_OK) {
+        return status;
+      }
+    }
   }
 
-  encoder->maxThreads = emscripten_num_logical_cores();
+  encoder->maxThreads = max_threads;
   encoder->tileRowsLog2 = options.tileRowsLog2;
   encoder->tileColsLog2 = options.tileColsLog2;
   encoder->speed = options.speed;
 
-  avifRWData output = AVIF_DATA_EMPTY;
-  avifResult encodeResult = avifEncoderWrite(encoder.get(), image.get(), &output);
+  return avifEncoderWrite(encoder.get(), image, output);
+}
+
+bool IsOpaque(const avifImage* image) {
+  if (image->alphaPlane == nullptr) {
+    return true;
+  }
+  const uint32_t max_value = (1u << image->depth) - 1;
+  for (uint32_t y = 0; y < image->height; ++y) {
+    const uint8_t* row = image->alphaPlane + static_cast<size_t>(y) * image->alphaRowBytes;
+    for (uint32_t x = 0; x < image->width; ++x) {
+      const uint32_t value =
+          image->depth > 8 ? reinterpret_cast<const uint16_t*>(row)[x] : row[x];
+      if (value != max_value) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Copies a plane of `width` x `height` samples into a larger one, repeating its
+// last column and row.
+void PadPlane(const uint8_t* src,
+              size_t src_stride,
+              uint32_t width,
+              uint32_t height,
+              size_t sample_size,
+              uint8_t* dst,
+              size_t dst_stride,
+              uint32_t padded_width,
+              uint32_t padded_height) {
+  for (uint32_t y = 0; y < padded_height; ++y) {
+    uint8_t* out = dst + y * dst_stride;
+    memcpy(out, src + std::min(y, height - 1) * src_stride, width * sample_size);
+    for (uint32_t x = width; x < padded_width; ++x) {
+      memcpy(out + x * sample_size, out + (width - 1) * sample_size, sample_size);
+    }
+  }
+}
+
+// The cell of `image` at `rect`. Every cell of a grid has the same size, so a
+// cell at the right or bottom edge that is smaller than `width` x `height` is
+// padded to it by repeating its last column and row, as libavif does; the
+// decoder crops the padding off. Other cells are views into `image`.
+AvifImagePtr CropCell(const avifImage* image,
+                      const avifCropRect& rect,
+                      uint32_t width,
+                      uint32_t height) {
+  AvifImagePtr view(avifImageCreateEmpty(), avifImageDestroy);
+  if (view == nullptr || avifImageSetViewRect(view.get(), image, &rect) != AVIF_RESULT_OK) {
+    return AvifImagePtr(nullptr, avifImageDestroy);
+  }
+  if (rect.width == width && rect.height == height) {
+    return view;
+  }
+  AvifImagePtr cell(avifImageCreateEmpty(), avifImageDestroy);
+  if (cell == nullptr || avifImageCopy(cell.get(), view.get(), 0) != AVIF_RESULT_OK) {
+    return AvifImagePtr(nullptr, avifImageDestroy);
+  }
+  cell->width = width;
+  cell->height = height;
+  if (avifImageAllocatePlanes(cell.get(), view->alphaPlane != nullptr ? AVIF_PLANES_ALL
+                                                                     : AVIF_PLANES_YUV) !=
+      AVIF_RESULT_OK) {
+    return AvifImagePtr(nullptr, avifImageDestroy);
+  }
+  avifPixelFormatInfo info;
+  avifGetPixelFormatInfo(view->yuvFormat, &info);
+  const size_t sample_size = view->depth > 8 ? 2 : 1;
+  for (int plane = 0; plane < (info.monochrome ? 1 : 3); ++plane) {
+    const int shift_x = plane == AVIF_CHAN_Y ? 0 : info.chromaShiftX;
+    const int shift_y = plane == AVIF_CHAN_Y ? 0 : info.chromaShiftY;
+    PadPlane(view->yuvPlanes[plane], view->yuvRowBytes[plane], (rect.width + shift_x) >> shift_x,
+             (rect.height + shift_y) >> shift_y, sample_size, cell->yuvPlanes[plane],
+             cell->yuvRowBytes[plane], (width + shift_x) >> shift_x, (height + shift_y) >> shift_y);
+  }
+  if (view->alphaPlane != nullptr) {
+    PadPlane(view->alphaPlane, view->alphaRowBytes, rect.width, rect.height, sample_size,
+             cell->alphaPlane, cell->alphaRowBytes, width, height);
+  }
+  return cell;
+}
+
+// `cell` without its alpha plane.
+AvifImagePtr ColourOf(const avifImage* cell) {
+  AvifImagePtr colour(avifImageCreateEmpty(), avifImageDestroy);
+  const avifCropRect rect = {0, 0, cell->width, cell->height};
+  if (colour == nullptr || avifImageSetViewRect(colour.get(), cell, &rect) != AVIF_RESULT_OK) {
+    return AvifImagePtr(nullptr, avifImageDestroy);
+  }
+  colour->alphaPlane = nullptr;
+  colour->alphaRowBytes = 0;
+  return colour;
+}
+
+// The alpha plane of `cell` as the luma of a monochrome image, which is how
+// libavif codes alpha. Only valid for as long as `cell`.
+AvifImagePtr AlphaOf(const avifImage* cell) {
+  AvifImagePtr alpha(
+      avifImageCreate(cell->width, cell->height, cell->depth, AVIF_PIXEL_FORMAT_YUV400),
+      avifImageDestroy);
+  if (alpha != nullptr) {
+    alpha->yuvRange = AVIF_RANGE_FULL;
+    alpha->yuvPlanes[AVIF_CHAN_Y] = cell->alphaPlane;
+    alpha->yuvRowBytes[AVIF_CHAN_Y] = cell->alphaRowBytes;
+    alpha->imageOwnsYUVPlanes = AVIF_FALSE;
+  }
+  return alpha;
+}
+
+// Encodes each of `images` with the matching `options` into `outputs`, which
+// the caller frees. Images larger than a grid cell are split into cells, and
+// the colour and the alpha of every cell are encoded as frames of their own,
+// since libavif encodes the cells of a grid one after another. The frames of
+// all images run through RunEncodes() together, and the cells of each image
+// are then assembled into a grid. Returns false if any encode failed.
+bool EncodeImages(const std::vector<const avifImage*>& images,
+                  const std::vector<AvifOptions>& options,
+                  std::vector<avifRWData>* outputs) {
+  struct Frame {
+    const avifImage* image;
+    const AvifOptions* options;
+    bool alpha;
+    avifRWData output;
+    avifResult result;
+  };
+  // The cell images that frames point into.
+  std::vector<AvifImagePtr> cells;
+  std::vector<Frame> frames;
+  std::vector<GridLayout> grids(images.size());
+  std::vector<size_t> first_frames(images.size());
+  std::vector<bool> alphas(images.size());
+  outputs->assign(images.size(), AVIF_DATA_EMPTY);
+  for (size_t i = 0; i < images.size(); ++i) {
+    const avifImage* image = images[i];
+    const GridLayout& grid = grids[i] = LayOutGrid(image, options[i]);
+    first_frames[i] = frames.size();
+    if (grid.columns.cells == 1 && grid.rows.cells == 1) {
+      frames.push_back({image, &options[i], false, AVIF_DATA_EMPTY, AVIF_RESULT_UNKNOWN_ERROR});
+      continue;
+    }
+    if (grid.columns.cells > kMaxGridCells || grid.rows.cells > kMaxGridCells) {
+      return false;
+    }
+    // As with libavif, an opaque image has no alpha, and otherwise every cell
+    // has alpha.
+    alphas[i] = !IsOpaque(image);
+    for (uint32_t row = 0; row < grid.rows.cells; ++row) {
+      for (uint32_t column = 0; column < grid.columns.cells; ++column) {
+        const uint32_t x = column * grid.columns.cellSize;
+        const uint32_t y = row * grid.rows.cellSize;
+        const avifCropRect rect = {x, y, std::min(grid.columns.cellSize, image->width - x),
+                                   std::min(grid.rows.cellSize, image->height - y)};
+        AvifImagePtr cell = CropCell(image, rect, grid.columns.cellSize, grid.rows.cellSize);
+        if (cell == nullptr) {
+          return false;
+        }
+        AvifImagePtr colour = ColourOf(cell.get());
+        AvifImagePtr alpha =
+            alphas[i] ? AlphaOf(cell.get()) : AvifImagePtr(nullptr, avifImageDestroy);
+        if (colour == nullptr || (alphas[i] && alpha == nullptr)) {
+          return false;
+        }
+        frames.push_back(
+            {colour.get(), &options[i], false, AVIF_DATA_EMPTY, AVIF_RESULT_UNKNOWN_ERROR});
+        if (alpha != nullptr) {
+          frames.push_back(
+              {alpha.get(), &options[i], true, AVIF_DATA_EMPTY, AVIF_RESULT_UNKNOWN_ERROR});
+        }
+        cells.push_back(std::move(cell));
+        cells.push_back(std::move(colour));
+        cells.push_back(std::move(alpha));
+      }
+    }
+  }
+
+  std::vector<int> instances(frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    instances[i] = EncoderInstances(frames[i].image);
+  }
+  RunEncodes(instances, [&](size_t i, int max_threads) {
+    Frame& frame = frames[i];
+    frame.result =
+        EncodeImage(frame.image, *frame.options, frame.alpha, max_threads, &frame.output);
+  });
+
+  bool ok = std::all_of(frames.begin(), frames.end(),
+                        [](const Frame& frame) { return frame.result == AVIF_RESULT_OK; });
+  for (size_t i = 0; i < images.size() && ok; ++i) {
+    const GridLayout& grid = grids[i];
+    Frame* frame = &frames[first_frames[i]];
+    if (grid.columns.cells == 1 && grid.rows.cells == 1) {
+      std::swap((*outputs)[i], frame->output);
+      continue;
+    }
+    std::vector<std::string> colour, alpha;
+    for (uint32_t cell = 0; cell < grid.columns.cells * grid.rows.cells; ++cell) {
+      colour.emplace_back(reinterpret_cast<const char*>(frame->output.data), frame->output.size);
+      avifRWDataFree(&frame->output);
+      ++frame;
+      if (alphas[i]) {
+        alpha.emplace_back(reinterpret_cast<const char*>(frame->output.data), frame->output.size);
+        avifRWDataFree(&frame->output);
+        ++frame;
+      }
+    }
+    std::string assembled;
+    ok = jsquash::AssembleHeifGrid(colour, alpha, grid.columns.cells, grid.rows.cells,
+                                   images[i]->width, images[i]->height, &assembled) &&
+         avifRWDataSet(&(*outputs)[i], reinterpret_cast<const uint8_t*>(assembled.data()),
+                       assembled.size()) == AVIF_RESULT_OK;
+  }
+  for (auto& frame : frames) {
+    avifRWDataFree(&frame.output);
+  }
+  return ok;
+}
+
+// Encodes a copy of the image whose longer side is `options.thumbnailSize` and
+// embeds it in `encoded` as a 'thmb' item of the primary image. The copy is
+// always 8 bit and never a grid. Rows are converted to 8 bit and resampled one
+// at a time, so no second full size buffer is needed.
+bool AddThumbnail(const uint8_t* rgba,
+                  int width,
+                  int height,
+                  size_t stride,
+                  int rgb_depth,
+                  const AvifOptions& options,
+                  bool premultiplied,
+                  const avifRWData& encoded,
+                  std::string* out) {
+  int thumb_width = 0;
+  int thumb_height = 0;
+  if (width >= height) {
+    thumb_width = std::min(options.thumbnailSize, width);
+  } else {
+    thumb_height = std::min(options.thumbnailSize, height);
+  }
+  jsquash::FitSize(width, height, &thumb_width, &thumb_height);
+
+  jsquash::ResampleOptions resample_options;
+  // Premultiplied input is already weighted by alpha, and its samples are no
+  // longer sRGB encoded values that could be linearized.
+  resample_options.premultiply = !premultiplied;
+  resample_options.linear_rgb = !premultiplied;
+  jsquash::RowResampler resampler({0, 0, width, height}, thumb_width, thumb_height,
+                                  resample_options);
+  const size_t thumb_stride = static_cast<size_t>(thumb_width) * 4;
+  std::vector<uint8_t> thumb(thumb_stride * thumb_height);
+  std::vector<uint8_t> row(rgb_depth > 8 ? static_cast<size_t>(width) * 4 : 0);
+  const uint32_t max_sample = (1u << rgb_depth) - 1;
+  for (int y = 0; y < height && !resampler.done(); y++) {
+    const uint8_t* src = rgba + y * stride;
+    if (rgb_depth > 8) {
+      const uint16_t* src_samples = reinterpret_cast<const uint16_t*>(src);
+      for (size_t i = 0; i < row.size(); i++) {
+        row[i] = static_cast<uint8_t>((src_samples[i] * 255u + max_sample / 2) / max_sample);
+      }
+      src = row.data();
+    }
+    resampler.PushRow(src, [&](const uint8_t* out_row, int out_y) {
+      memcpy(thumb.data() + out_y * thumb_stride, out_row, thumb_stride);
+    });
+  }
+
+  AvifOptions thumb_options = options;
+  thumb_options.bitDepth = 8;
+  thumb_options.gridCellSize = 0;
+  AvifImagePtr image = ConvertToYUV(thumb.data(), thumb_width, thumb_height, thumb_stride, 8,
+                                    thumb_options, premultiplied);
+  if (image == nullptr) {
+    return false;
+  }
+  std::vector<avifRWData> thumb_encoded;
+  const bool ok =
+      EncodeImages({image.get()}, {thumb_options}, &thumb_encoded) &&
+      jsquash::AddHeifThumbnail(
+          std::string(reinterpret_cast<const char*>(encoded.data), encoded.size),
+          std::string(reinterpret_cast<const char*>(thumb_encoded[0].data), thumb_encoded[0].size),
+          out);
+  for (auto& data : thumb_encoded) {
+    avifRWDataFree(&data);
+  }
+  return ok;
+}
+
+// `stride` is the distance between the starts of two rows of `buffer` in bytes.
+// `premultiplied` marks colour in `buffer` as premultiplied by alpha.
+val encode(std::string buffer,
+           int width,
+           int height,
+           uint32_t stride,
+           AvifOptions options,
+           bool premultiplied) {
+  RETURN_NULL_IF(!IsValidDepth(options.bitDepth));
+  size_t size;
+  RETURN_NULL_IF(width <= 0 || height <= 0 ||
+                 !jsquash::ComputeStridedSize(height, width * PixelSize(options.bitDepth), stride,
+                                              &size) ||
+                 buffer.size() < size);
+
+  const uint8_t* rgba = reinterpret_cast<const uint8_t*>(buffer.data());
+  AvifImagePtr image = ConvertToYUV(rgba, width, height, stride, options.bitDepth, options, premultiplied);
+  RETURN_NULL_IF(image == nullptr);
+
+  std::vector<avifRWData> outputs;
+  const bool encoded = EncodeImages({image.get()}, {options}, &outputs);
+  avifRWData& output = outputs[0];
   auto js_result = val::null();
-  if (encodeResult == AVIF_RESULT_OK) {
+  if (encoded && options.thumbnailSize > 0) {
+    std::string with_thumbnail;
+    if (AddThumbnail(rgba, width, height, stride, options.bitDepth, options, premultiplied,
+                     output, &with_thumbnail)) {
+      js_result = Uint8Array.new_(typed_memory_view(with_thumbnail.size(), with_thumbnail.data()));
+    }
+  } else if (encoded) {
     js_result = Uint8Array.new_(typed_memory_view(output.size, output.data));
   }
 
@@ -168,7 +647,102 @@ val encode(std::string buffer, int width, int height, AvifOptions options) {
   return js_result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
+// Encodes one 8 bit RGBA image at several sizes and settings. Every size is
+// resampled once, from the smallest larger size already made, and converted to
+// YUV once per distinct colour setting; variants that only differ in encoder
+// settings (quality, speed, ...) share that conversion. Multithreaded builds
+// encode the variants side by side, see RunEncodes().
+val encodeVariants(std::string buffer,
+                   int width,
+                   int height,
+                   val variants,
+                   jsquash::ResizePyramidOptions resize_options) {
+  size_t size;
+  RETURN_NULL_IF(width <= 0 || height <= 0 || !jsquash::ComputeRGBA8Size(width, height, &size) ||
+                 buffer.size() < size);
+  std::vector<EncodeVariant> list = vecFromJSArray<EncodeVariant>(variants);
+  for (auto& variant : list) {
+    RETURN_NULL_IF(!IsValidDepth(variant.options.bitDepth));
+    jsquash::FitSize(width, height, &variant.width, &variant.height);
+  }
+
+  // Largest first, so smaller sizes can be resampled from larger ones.
+  std::vector<size_t> order(list.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return static_cast<int64_t>(list[a].width) * list[a].height >
+           static_cast<int64_t>(list[b].width) * list[b].height;
+  });
+
+  struct Conversion {
+    int width;
+    int height;
+    AvifOptions options;
+    AvifImagePtr image;
+  };
+  std::vector<Conversion> conversions;
+  std::vector<const avifImage*> images(list.size());
+  std::vector<jsquash::ResizePyramid::Level> levels(list.size());
+  jsquash::ResizePyramid pyramid(reinterpret_cast<const uint8_t*>(buffer.data()), width, height,
+                                 resize_options);
+  for (size_t i : order) {
+    const EncodeVariant& variant = list[i];
+    auto same = [&](const Conversion& c) {
+      return c.width == variant.width && c.height == variant.height &&
+             c.options.bitDepth == variant.options.bitDepth &&
+             c.options.subsample == variant.options.subsample &&
+             c.options.enableSharpYUV == variant.options.enableSharpYUV &&
+             IsLossless(c.options) == IsLossless(variant.options);
+    };
+    levels[i] = pyramid.Get(variant.width, variant.height);
+    RETURN_NULL_IF(levels[i].data == nullptr);
+    auto found = std::find_if(conversions.begin(), conversions.end(), same);
+    if (found == conversions.end()) {
+      const auto& level = levels[i];
+      AvifImagePtr image = ConvertToYUV(level.data, level.width, level.height,
+                                        static_cast<size_t>(level.width) * 4, 8, variant.options,
+                                        false);
+      RETURN_NULL_IF(image == nullptr);
+      conversions.push_back({variant.width, variant.height, variant.options, std::move(image)});
+      found = conversions.end() - 1;
+    }
+    images[i] = found->image.get();
+  }
+
+  std::vector<AvifOptions> options(list.size());
+  for (size_t i = 0; i < list.size(); ++i) {
+    options[i] = list[i].options;
+  }
+  std::vector<avifRWData> outputs;
+  bool ok = EncodeImages(images, options, &outputs);
+  auto js_result = ok ? val::array() : val::null();
+  for (size_t i = 0; i < list.size(); ++i) {
+    std::string with_thumbnail;
+    if (ok && list[i].options.thumbnailSize > 0) {
+      const auto& level = levels[i];
+      if (AddThumbnail(level.data, level.width, level.height,
+                       static_cast<size_t>(level.width) * 4, 8, list[i].options, false,
+                       outputs[i], &with_thumbnail)) {
+        js_result.call<void>("push", Uint8Array.new_(typed_memory_view(with_thumbnail.size(),
+                                                                         with_thumbnail.data())));
+      } else {
+        js_result = val::null();
+        ok = false;
+      }
+    } else if (ok) {
+      js_result.call<void>("push", Uint8Array.new_(typed_memory_view(outputs[i].size,
+                                                                       outputs[i].data)));
+    }
+    avifRWDataFree(&outputs[i]);
+  }
+  return js_result;
+}
+
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(avif_enc) {
   value_object<AvifOptions>("AvifOptions")
       .field("quality", &AvifOptions::quality)
       .field("qualityAlpha", &AvifOptions::qualityAlpha)
@@ -181,7 +755,17 @@ EMSCRIPTEN_BINDINGS(my_module) {
       .field("denoiseLevel", &AvifOptions::denoiseLevel)
       .field("subsample", &AvifOptions::subsample)
       .field("enableSharpYUV", &AvifOptions::enableSharpYUV)
-      .field("bitDepth", &AvifOptions::bitDepth);
+      .field("bitDepth", &AvifOptions::bitDepth)
+      .field("gridCellSize", &AvifOptions::gridCellSize)
+      .field("thumbnailSize", &AvifOptions::thumbnailSize);
+
+  value_object<EncodeVariant>("EncodeVariant")
+      .field("width", &EncodeVariant::width)
+      .field("height", &EncodeVariant::height)
+      .field("options", &EncodeVariant::options);
+
+  jsquash::RegisterResizePyramidOptions();
 
-  function("encode", &encode);
+  function(JSQUASH_EXPORT("encode"), &encode);
+  function(JSQUASH_EXPORT("encodeVariants"), &encodeVariants);
 }
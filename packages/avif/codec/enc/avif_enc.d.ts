@@ -17,6 +17,21 @@ export interface EncodeOptions {
   enableSharpYUV: boolean;
   tune: AVIFTune;
   bitDepth: number;
+  gridCellSize: number;
+  thumbnailSize: number;
+}
+
+export interface EncodeVariant {
+  width: number;
+  height: number;
+  options: EncodeOptions;
+}
+
+export interface ResizePyramidOptions {
+  fitMethod: 'stretch' | 'contain';
+  method: number;
+  premultiply: boolean;
+  linearRGB: boolean;
 }
 
 export interface AVIFModule extends EmscriptenWasm.Module {
@@ -24,8 +39,17 @@ export interface AVIFModule extends EmscriptenWasm.Module {
     data: BufferSource,
     width: number,
     height: number,
+    stride: number,
     options: EncodeOptions,
+    premultiplied: boolean,
   ): Uint8Array | null;
+  encodeVariants(
+    data: BufferSource,
+    width: number,
+    height: number,
+    variants: EncodeVariant[],
+    resize: ResizePyramidOptions,
+  ): Uint8Array[] | null;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<AVIFModule>;
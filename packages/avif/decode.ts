@@ -16,52 +16,118 @@
  * and modified it to decode JPEG images.
  */
 
-import type { AVIFModule } from './codec/dec/avif_dec.js';
-import { initEmscriptenModule } from './utils.js';
+import type {
+  AVIFModule,
+  ColorConversion,
+  DecodeResizeOptions,
+  ToneMapping,
+} from './codec/dec/avif_dec.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 
 import avif_dec from './codec/dec/avif_dec.js';
-import { ImageData16bit } from 'meta.js';
+import {
+  DecodeLimits,
+  DecodeOptions,
+  DecodeTarget,
+  ImageAnalysis,
+  ImageData16bit,
+  defaultDecodeResizeOptions,
+  resizeMethods,
+} from './meta.js';
 
 let emscriptenModule: Promise<AVIFModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: AVIFModule) => Promise<AVIFModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<AVIFModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
+
+function getResizeOptions(
+  options: Omit<DecodeOptions, 'bitDepth'>,
+): DecodeResizeOptions {
+  const resize = { ...defaultDecodeResizeOptions, ...options };
+  return {
+    width: resize.width ?? 0,
+    height: resize.height ?? 0,
+    fitMethod: resize.fitMethod,
+    method: resizeMethods.indexOf(resize.method),
+    premultiply: resize.premultiply,
+    linearRGB: resize.linearRGB,
+  };
+}
+
+function getColorConversion(
+  options: Pick<DecodeOptions, 'ignoreColorProfile' | 'targetColorProfile'>,
+): ColorConversion {
+  return {
+    convert: !options.ignoreColorProfile,
+    targetProfile: options.targetColorProfile ?? '',
+  };
+}
+
+function getToneMapping({
+  sdrTarget,
+}: Pick<DecodeOptions, 'sdrTarget'>): ToneMapping {
+  return {
+    enabled: !!sdrTarget,
+    peakLuminance:
+      (typeof sdrTarget === 'object' && sdrTarget.peakLuminance) || 0,
+  };
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  emscriptenModule = initEmscriptenModule(
-    avif_dec,
-    actualModule,
-    actualOptions,
-  );
+  const load = () =>
+    initEmscriptenModule(avif_dec, actualModule, emscriptenOptions);
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
 }
 
-type DecodeOptions = {
-  bitDepth?: 8 | 10 | 12 | 16;
-};
-
 export default async function decode(
   buffer: ArrayBuffer,
 ): Promise<ImageData | null>;
 export default async function decode(
   buffer: ArrayBuffer,
-  options: { bitDepth?: 8 },
+  options: Omit<DecodeOptions, 'bitDepth'> & { bitDepth?: 8 },
 ): Promise<ImageData | null>;
 export default async function decode(
   buffer: ArrayBuffer,
-  options: { bitDepth: 10 | 12 | 16 },
+  options: {
+    bitDepth: 10 | 12 | 16;
+    limits?: DecodeLimits;
+    premultipliedAlpha?: boolean;
+  },
 ): Promise<ImageData16bit | null>;
 export default async function decode(
   buffer: ArrayBuffer,
@@ -73,7 +139,111 @@ export default async function decode(
 
   const module = await emscriptenModule;
   const bitDepth = options?.bitDepth ?? 8;
-  const result = module.decode(buffer, bitDepth);
+  if (bitDepth !== 8 && (options?.width || options?.height)) {
+    throw new Error('Resizing is only supported for 8-bit decodes');
+  }
+  if (bitDepth !== 8 && options?.sdrTarget) {
+    throw new Error('Tone mapping is only supported for 8-bit decodes');
+  }
+  const result = module.decode(
+    buffer,
+    bitDepth,
+    getResizeOptions(options ?? {}),
+    getDecodeLimits(options?.limits),
+    getColorConversion(options ?? {}),
+    getToneMapping(options ?? {}),
+    !!options?.premultipliedAlpha,
+    false,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes to 8-bit RGBA like `decode`, and also returns statistics gathered
+ * from the decoded rows while they are still in cache: the histogram, the
+ * mean and dominant colour, a perceptual hash and a ThumbHash placeholder.
+ * This saves walking the whole image again in JS.
+ */
+export async function decodeAndAnalyze(
+  buffer: ArrayBuffer,
+  options: Omit<DecodeOptions, 'bitDepth'> = {},
+): Promise<{ image: ImageData; analysis: ImageAnalysis }> {
+  if (!emscriptenModule) {
+    init();
+  }
+
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    8,
+    getResizeOptions(options),
+    getDecodeLimits(options.limits),
+    getColorConversion(options),
+    getToneMapping(options),
+    !!options.premultipliedAlpha,
+    true,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes to 8-bit RGBA straight into a region of a larger buffer, such as a
+ * tile of an atlas, instead of a new ImageData. Resolves to the size of the
+ * decoded image, which must fit in the region.
+ */
+export async function decodeInto(
+  buffer: ArrayBuffer,
+  target: DecodeTarget,
+  options: Omit<DecodeOptions, 'bitDepth'> = {},
+): Promise<{ width: number; height: number }> {
+  if (!emscriptenModule) {
+    init();
+  }
+
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    8,
+    getResizeOptions(options),
+    getDecodeLimits(options.limits),
+    getColorConversion(options),
+    getToneMapping(options),
+    !!options.premultipliedAlpha,
+    false,
+    { data: target.data.subarray(target.offset ?? 0), stride: target.stride },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes the thumbnail embedded with the `thumbnailSize` encode option (the
+ * 'thmb' item of the primary image) without decoding the image itself.
+ * Resolves to `null` when the file has no thumbnail.
+ */
+export async function decodePreview(
+  buffer: ArrayBuffer,
+  options: { limits?: DecodeLimits } = {},
+): Promise<ImageData | null> {
+  if (!emscriptenModule) {
+    init();
+  }
+
+  const module = await emscriptenModule;
+  const result = module.decodePreview(buffer, getDecodeLimits(options.limits));
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (result === undefined) return null;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
   return result;
 }
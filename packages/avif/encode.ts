@@ -16,14 +16,45 @@
  * Updated to support a partial subset of Avif encoding options to be provided.
  * The avif options are defaulted to defaults from the meta.ts file.
  */
-import type { EncodeOptions, ImageData16bit } from './meta.js';
+import type {
+  EncodeInputOptions,
+  EncodeOptions,
+  EncodeVariant,
+  ImageData16bit,
+  ImageDataView,
+  VariantResizeOptions,
+} from './meta.js';
 import type { AVIFModule } from './codec/enc/avif_enc.js';
 
-import { defaultOptions } from './meta.js';
-import { initEmscriptenModule } from './utils.js';
+import {
+  defaultDecodeResizeOptions,
+  defaultOptions,
+  resizeMethods,
+} from './meta.js';
+import {
+  getImageRows,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 import { threads } from 'wasm-feature-detect';
 
 let emscriptenModule: Promise<AVIFModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: AVIFModule) => Promise<AVIFModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own builds.
+ */
+export function useModule(module: Promise<AVIFModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 const isRunningInNode = () =>
   typeof process !== 'undefined' &&
@@ -32,59 +63,48 @@ const isRunningInNode = () =>
 const isRunningInCloudflareWorker = () =>
   (globalThis.caches as any)?.default !== undefined;
 
+// The 8-bit builds from the codec Makefile are not loaded yet, so every
+// encode uses the full build until they are shipped alongside it.
+async function loadEncoder(
+  module?: WebAssembly.Module,
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+): Promise<AVIFModule> {
+  const avifEncoder =
+    !isRunningInNode() && !isRunningInCloudflareWorker() && (await threads())
+      ? await import('./codec/enc/avif_enc_mt.js')
+      : await import('./codec/enc/avif_enc.js');
+  return initEmscriptenModule(
+    avifEncoder.default,
+    module,
+    moduleOptionOverrides,
+  );
+}
+
 export async function init(
-  moduleOptionOverride?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverride?: InitOptions,
 ): Promise<any>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ) {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  if (
-    !isRunningInNode() &&
-    !isRunningInCloudflareWorker() &&
-    (await threads())
-  ) {
-    const avifEncoder = await import('./codec/enc/avif_enc_mt.js');
-    emscriptenModule = initEmscriptenModule(
-      avifEncoder.default,
-      actualModule,
-      actualOptions,
-    );
-    return emscriptenModule;
-  }
-  const avifEncoder = await import('./codec/enc/avif_enc.js');
-  emscriptenModule = initEmscriptenModule(
-    avifEncoder.default,
-    actualModule,
-    actualOptions,
-  );
+  const load = () => loadEncoder(actualModule, emscriptenOptions);
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
   return emscriptenModule;
 }
 
-export default async function encode(data: ImageData): Promise<ArrayBuffer>;
-export default async function encode(
-  data: ImageData,
-  options: Partial<EncodeOptions> & { bitDepth?: 8 },
-): Promise<ArrayBuffer>;
-export default async function encode(
-  data: ImageData16bit,
-  options: Partial<EncodeOptions> & { bitDepth: 10 | 12 },
-): Promise<ArrayBuffer>;
-export default async function encode(
-  data: ImageData | ImageData16bit,
-  options: Partial<EncodeOptions> = {},
-): Promise<ArrayBuffer> {
-  if (!emscriptenModule) emscriptenModule = init();
+// Applies the defaults and the settings that lossless encoding requires.
+function resolveOptions(options: Partial<EncodeOptions>): EncodeOptions {
   const _options = { ...defaultOptions, ...options };
 
   if (
@@ -95,12 +115,6 @@ export default async function encode(
     throw new Error('Invalid bit depth. Supported values are 8, 10, or 12.');
   }
 
-  if (!(data.data instanceof Uint16Array) && _options.bitDepth !== 8) {
-    throw new Error(
-      'Invalid image data for bit depth. Must use Uint16Array for bit depths greater than 8.',
-    );
-  }
-
   if (_options.lossless) {
     if (options.quality !== undefined && options.quality !== 100) {
       console.warn(
@@ -127,13 +141,45 @@ export default async function encode(
     _options.subsample = 3;
   }
 
+  return _options;
+}
+
+export default async function encode(
+  data: ImageData | ImageDataView,
+): Promise<ArrayBuffer>;
+export default async function encode(
+  data: ImageData | ImageDataView,
+  options: Partial<EncodeOptions> & EncodeInputOptions & { bitDepth?: 8 },
+): Promise<ArrayBuffer>;
+export default async function encode(
+  data: ImageData16bit | ImageDataView,
+  options: Partial<EncodeOptions> & EncodeInputOptions & { bitDepth: 10 | 12 },
+): Promise<ArrayBuffer>;
+export default async function encode(
+  data: ImageData | ImageData16bit | ImageDataView,
+  options: Partial<EncodeOptions> & EncodeInputOptions = {},
+): Promise<ArrayBuffer> {
+  if (!emscriptenModule) emscriptenModule = init();
+  const { premultipliedAlpha = false, ...encodeOptions } = options;
+  const _options = resolveOptions(encodeOptions);
+
+  if (!(data.data instanceof Uint16Array) && _options.bitDepth !== 8) {
+    throw new Error(
+      'Invalid image data for bit depth. Must use Uint16Array for bit depths greater than 8.',
+    );
+  }
+
   const module = await emscriptenModule;
+  const { rows, stride } = getImageRows(data);
   const output = module.encode(
-    new Uint8Array(data.data.buffer),
+    new Uint8Array(rows.buffer, rows.byteOffset, rows.byteLength),
     data.width,
     data.height,
+    stride,
     _options,
+    premultipliedAlpha,
   );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
 
   if (!output) {
     throw new Error('Encoding error.');
@@ -141,3 +187,49 @@ export default async function encode(
 
   return output.buffer;
 }
+
+/**
+ * Encodes one 8 bit image at several sizes and settings, e.g. the widths of a
+ * srcset. Each size is resized and converted to YUV once, and variants that
+ * only differ in encoder settings share that work. The multithreaded build
+ * encodes the variants in parallel. Resolves to one buffer per variant, in
+ * order.
+ */
+export async function encodeVariants(
+  data: ImageData,
+  variants: EncodeVariant[],
+  resizeOptions: Partial<VariantResizeOptions> = {},
+): Promise<ArrayBuffer[]> {
+  if (!emscriptenModule) emscriptenModule = init();
+
+  const _resizeOptions = { ...defaultDecodeResizeOptions, ...resizeOptions };
+  const _variants = variants.map(({ width = 0, height = 0, ...options }) => ({
+    width,
+    height,
+    options: resolveOptions(options),
+  }));
+  const module = await emscriptenModule;
+  const output = module.encodeVariants(
+    new Uint8Array(
+      data.data.buffer,
+      data.data.byteOffset,
+      data.data.byteLength,
+    ),
+    data.width,
+    data.height,
+    _variants,
+    {
+      fitMethod: _resizeOptions.fitMethod,
+      method: resizeMethods.indexOf(_resizeOptions.method),
+      premultiply: _resizeOptions.premultiply,
+      linearRGB: _resizeOptions.linearRGB,
+    },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+
+  if (!output) {
+    throw new Error('Encoding error.');
+  }
+
+  return output.map((variant) => variant.buffer);
+}
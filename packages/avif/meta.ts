@@ -21,12 +21,128 @@ export type EncodeOptions = RawEncodeOptions & {
   lossless: boolean;
 };
 
+export type EncodeInputOptions = {
+  // Colour of the input is premultiplied by alpha, as in a canvas or a GPU
+  // texture. AVIF stores straight alpha, so libavif unpremultiplies it while
+  // converting to YUV.
+  premultipliedAlpha?: boolean;
+};
+
+export type EncodeVariant = Partial<EncodeOptions> & {
+  // Output size. Set only one of them to keep the aspect ratio, or neither to
+  // keep the source size.
+  width?: number;
+  height?: number;
+};
+
 export type ImageData16bit = {
   data: Uint16Array;
   width: number;
   height: number;
 };
 
+export type ResizeMethod = 'triangle' | 'catrom' | 'mitchell' | 'lanczos3';
+
+/** Resize methods by index, as in @jsquash/resize */
+export const resizeMethods: ResizeMethod[] = [
+  'triangle',
+  'catrom',
+  'mitchell',
+  'lanczos3',
+];
+
+export type DecodeResizeOptions = {
+  // Output size. Set only one of them to keep the aspect ratio.
+  width?: number;
+  height?: number;
+  method: ResizeMethod;
+  fitMethod: 'stretch' | 'contain';
+  premultiply: boolean;
+  linearRGB: boolean;
+};
+
+export type DecodeOptions = {
+  bitDepth?: 8 | 10 | 12 | 16;
+  limits?: DecodeLimits;
+  // 8-bit decodes only.
+  // Keep the samples as stored instead of converting them from the image's
+  // colour profile to sRGB.
+  ignoreColorProfile?: boolean;
+  // ICC profile to convert to instead of sRGB, such as the display's.
+  targetColorProfile?: Uint8Array;
+  // Tone map PQ, HLG and linear HDR images to 8-bit SDR while decoding.
+  // `peakLuminance` is the luminance in cd/m² that SDR white stands for
+  // (default 203, BT.2408's HDR reference white).
+  sdrTarget?: boolean | { peakLuminance?: number };
+  // Return colour premultiplied by alpha, ready to composite or to upload as a
+  // premultiplied texture.
+  premultipliedAlpha?: boolean;
+} & Partial<DecodeResizeOptions>;
+
+// How encodeVariants() resizes the source for each variant.
+export type VariantResizeOptions = Omit<DecodeResizeOptions, 'width' | 'height'>;
+
+/**
+ * RGBA pixels stored as a region of a larger buffer, such as a crop of a
+ * canvas. `offset` is the index in `data` of the region's first sample and
+ * `stride` the number of samples between the starts of two rows. They default
+ * to `0` and `width * 4`, so an `ImageData` is a valid `ImageDataView`.
+ * `data` is a `Uint16Array` for bit depths above 8.
+ */
+export type ImageDataView = {
+  data: Uint8ClampedArray | Uint16Array;
+  width: number;
+  height: number;
+  stride?: number;
+  offset?: number;
+};
+
+/**
+ * Limits on what one decode may cost, for untrusted input. Each is checked
+ * against the header before any pixels are decoded, then again as the decode
+ * runs, and a decode over one rejects with a `DecodeLimitError` naming it.
+ * Unset or 0 means no limit.
+ */
+export type DecodeLimits = {
+  // Largest width * height of the image.
+  maxPixels?: number;
+  // Most frames an animation or image sequence may declare.
+  maxFrames?: number;
+  // Most bytes the decode may have allocated at once.
+  maxMemory?: number;
+  // Milliseconds the decode may take.
+  timeLimit?: number;
+};
+
+/**
+ * Statistics of the decoded image that `decodeAndAnalyze()` gathers from its
+ * rows as they are decoded, before any resize.
+ */
+export type ImageAnalysis = {
+  // 1024 bins: 256 each for R, G, B and A.
+  histogram: Uint32Array;
+  // Alpha weighted mean colour, and the mean alpha.
+  meanColor: { r: number; g: number; b: number; a: number };
+  // Most common colour of the mostly opaque pixels.
+  dominantColor: { r: number; g: number; b: number };
+  // 64-bit DCT hash as 16 hex digits. Similar images differ in few bits.
+  perceptualHash: string;
+  // ThumbHash placeholder, see https://github.com/evanw/thumbhash.
+  thumbHash: Uint8Array;
+};
+
+/**
+ * Where `decodeInto()` writes the decoded pixels: a region of a larger RGBA
+ * buffer, such as a tile of an atlas. The region is as large as the decoded
+ * (and resized) image; `offset` is the index of its first sample and `stride`
+ * the number of samples between the starts of two rows.
+ */
+export type DecodeTarget = {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+  offset?: number;
+};
+
 export const label = 'AVIF';
 export const mimeType = 'image/avif';
 export const extension = 'avif';
@@ -43,5 +159,15 @@ export const defaultOptions: EncodeOptions = {
   tune: AVIFTune.auto,
   enableSharpYUV: false,
   bitDepth: 8,
+  gridCellSize: 0,
+  thumbnailSize: 0,
   lossless: false,
 };
+
+// Same defaults as @jsquash/resize.
+export const defaultDecodeResizeOptions: DecodeResizeOptions = {
+  method: 'lanczos3',
+  fitMethod: 'stretch',
+  premultiply: true,
+  linearRGB: true,
+};
@@ -0,0 +1,127 @@
+import { createCacheKey } from './hash.js';
+import type { PixelSource } from './hash.js';
+import { DiskStore, MemoryStore } from './store.js';
+
+export interface EncodeCacheOptions {
+  /** Upper bound for the summed size of the results kept in memory. */
+  maxBytes: number;
+  /**
+   * Node only. Directory to persist results in, so they survive restarts and
+   * can be shared between processes. Memory misses fall back to it.
+   */
+  directory?: string;
+}
+
+export interface EncodeCacheStats {
+  /** Results served from memory, including calls that joined an in-flight encode. */
+  hits: number;
+  /** Results served from the on-disk store. */
+  diskHits: number;
+  /** Calls that ran the encoder. */
+  misses: number;
+  /** Entries dropped from memory to stay within `maxBytes`. */
+  evictions: number;
+  /** Entries currently held in memory. */
+  entries: number;
+  /** Bytes currently held in memory. */
+  bytes: number;
+}
+
+export type EncodeFunction<D extends PixelSource, O> = (
+  data: D,
+  options?: O,
+) => Promise<ArrayBuffer>;
+
+export const defaultCacheOptions: EncodeCacheOptions = {
+  maxBytes: 64 * 1024 * 1024,
+};
+
+export class EncodeCache {
+  private memory: MemoryStore;
+  private disk?: DiskStore;
+  private pending = new Map<string, Promise<ArrayBuffer>>();
+  private counters = { hits: 0, diskHits: 0, misses: 0 };
+
+  constructor(options: Partial<EncodeCacheOptions> = {}) {
+    const _options = { ...defaultCacheOptions, ...options };
+    this.memory = new MemoryStore(_options.maxBytes);
+    if (_options.directory) {
+      this.disk = new DiskStore(_options.directory);
+    }
+  }
+
+  /**
+   * Returns an `encode` with the same signature that answers repeated calls
+   * from the cache. `codec` namespaces the keys, so one cache can sit in
+   * front of several encoders.
+   */
+  wrap<D extends PixelSource, O>(
+    codec: string,
+    encode: EncodeFunction<D, O>,
+  ): EncodeFunction<D, O> {
+    return async (data, options) => {
+      const key = await createCacheKey(codec, data, options ?? {});
+      // Every caller gets its own copy, so transferring or detaching the
+      // returned buffer can't corrupt the cached one.
+      const result = await this.lookup(key, () => encode(data, options));
+      return result.slice(0);
+    };
+  }
+
+  private lookup(
+    key: string,
+    encode: () => Promise<ArrayBuffer>,
+  ): Promise<ArrayBuffer> {
+    const cached = this.memory.get(key);
+    if (cached) {
+      this.counters.hits++;
+      return Promise.resolve(cached);
+    }
+    const pending = this.pending.get(key);
+    if (pending) {
+      this.counters.hits++;
+      return pending;
+    }
+
+    const result = (async () => {
+      const stored = await this.disk?.get(key);
+      if (stored) {
+        this.counters.diskHits++;
+        this.memory.set(key, stored);
+        return stored;
+      }
+      this.counters.misses++;
+      const encoded = (await encode()).slice(0);
+      this.memory.set(key, encoded);
+      await this.disk?.set(key, encoded);
+      return encoded;
+    })();
+    this.pending.set(key, result);
+    result.then(
+      () => this.pending.delete(key),
+      () => this.pending.delete(key),
+    );
+    return result;
+  }
+
+  stats(): EncodeCacheStats {
+    return {
+      ...this.counters,
+      evictions: this.memory.evictions,
+      entries: this.memory.size,
+      bytes: this.memory.bytes,
+    };
+  }
+
+  /** Empties memory and the on-disk store. Counters are kept. */
+  async clear(): Promise<void> {
+    this.memory.clear();
+    await this.disk?.clear();
+  }
+}
+
+export function createEncodeCache(
+  options?: Partial<EncodeCacheOptions>,
+): EncodeCache {
+  return new EncodeCache(options);
+}
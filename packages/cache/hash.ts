@@ -0,0 +1,87 @@
+/**
+ * Cache keys are a SHA-256 digest of the codec name, the image dimensions,
+ * the pixel buffer type, the canonicalised encode options and a digest of the
+ * pixel bytes. WebCrypto digests run natively (and use the CPU's SHA
+ * extensions where available), so hashing a large RGBA buffer costs far less
+ * than any of the encoders it sits in front of.
+ */
+
+export interface PixelSource {
+  data: ArrayBufferView;
+  width: number;
+  height: number;
+}
+
+let subtleCrypto: Promise<SubtleCrypto> | undefined;
+
+export function getSubtleCrypto(): Promise<SubtleCrypto> {
+  if (!subtleCrypto) {
+    subtleCrypto = globalThis.crypto?.subtle
+      ? Promise.resolve(globalThis.crypto.subtle)
+      : // Node 18 only exposes WebCrypto on the crypto module.
+        import('node:crypto').then(
+          (crypto) => crypto.webcrypto.subtle as SubtleCrypto,
+        );
+  }
+  return subtleCrypto;
+}
+
+export function toHex(buffer: ArrayBuffer): string {
+  let hex = '';
+  for (const byte of new Uint8Array(buffer)) {
+    hex += byte.toString(16).padStart(2, '0');
+  }
+  return hex;
+}
+
+/**
+ * Serialises options with sorted object keys, so `{ a: 1, b: 2 }` and
+ * `{ b: 2, a: 1 }` produce the same key. `undefined` values are dropped, as
+ * in JSON.
+ */
+export function canonicalise(value: unknown): string {
+  if (Array.isArray(value)) {
+    return `[${value.map((item) => canonicalise(item ?? null)).join(',')}]`;
+  }
+  if (value && typeof value === 'object') {
+    const entries = Object.keys(value)
+      .sort()
+      .filter((key) => (value as Record<string, unknown>)[key] !== undefined)
+      .map(
+        (key) =>
+          `${JSON.stringify(key)}:${canonicalise(
+            (value as Record<string, unknown>)[key],
+          )}`,
+      );
+    return `{${entries.join(',')}}`;
+  }
+  return JSON.stringify(value ?? null);
+}
+
+export async function createCacheKey(
+  codec: string,
+  image: PixelSource,
+  options: unknown,
+): Promise<string> {
+  const subtle = await getSubtleCrypto();
+  const pixels = new Uint8Array(
+    image.data.buffer,
+    image.data.byteOffset,
+    image.data.byteLength,
+  );
+  const pixelDigest = toHex(await subtle.digest('SHA-256', pixels));
+  const header = [
+    codec,
+    image.width,
+    image.height,
+    image.data.constructor.name,
+    canonicalise(options),
+    pixelDigest,
+  ].join('\n');
+  // Hashed as UTF-16 code units so simpler runtimes without TextEncoder work.
+  const headerUnits = new Uint16Array(header.length);
+  for (let i = 0; i < header.length; i++) {
+    headerUnits[i] = header.charCodeAt(i);
+  }
+  return toHex(await subtle.digest('SHA-256', headerUnits));
+}
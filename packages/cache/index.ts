@@ -0,0 +1,14 @@
+export { EncodeCache, createEncodeCache, defaultCacheOptions } from './cache.js';
+export type {
+  EncodeCacheOptions,
+  EncodeCacheStats,
+  EncodeFunction,
+} from './cache.js';
+export { canonicalise, createCacheKey } from './hash.js';
+export type { PixelSource } from './hash.js';
+export {
+  clearModuleCache,
+  loadWasmModule,
+  moduleCacheStats,
+} from './module-cache.js';
+export type { ModuleCacheStats, WasmSource } from './module-cache.js';
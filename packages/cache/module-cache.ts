@@ -0,0 +1,110 @@
+/**
+ * Compiled WebAssembly modules, shared by every caller in the process. Each
+ * wasm binary is read and compiled once; later loads of the same file, or of
+ * the same bytes from another path, resolve to the module compiled first.
+ * Passing that module to a codec's `init()` only instantiates it.
+ *
+ * The cache is in memory only. Engines have no API to store a compiled module
+ * outside the process: `v8.serialize()` accepts a WebAssembly.Module, but the
+ * result only deserializes in the process that wrote it.
+ */
+
+import { getSubtleCrypto, toHex } from './hash.js';
+
+export type WasmSource = string | URL | ArrayBuffer | ArrayBufferView;
+
+export interface ModuleCacheStats {
+  /** Loads served by an already compiled module */
+  hits: number;
+  /** Loads that compiled a module */
+  compiles: number;
+  /** Compiled modules held by the cache */
+  modules: number;
+}
+
+const byLocation = new Map<string, Promise<WebAssembly.Module>>();
+const byDigest = new Map<string, Promise<WebAssembly.Module>>();
+let loads = 0;
+let compiles = 0;
+
+function isNode(): boolean {
+  return typeof process !== 'undefined' && !!process.versions?.node;
+}
+
+async function readWasmFile(location: string): Promise<ArrayBuffer> {
+  if (isNode() && !/^(https?|data|blob):/.test(location)) {
+    const fs = await import('node:fs/promises');
+    const file = await fs.readFile(
+      location.startsWith('file:') ? new URL(location) : location,
+    );
+    return file.buffer.slice(
+      file.byteOffset,
+      file.byteOffset + file.byteLength,
+    ) as ArrayBuffer;
+  }
+  const response = await fetch(location);
+  if (!response.ok) {
+    throw new Error(`Failed to load ${location}: ${response.status}`);
+  }
+  return response.arrayBuffer();
+}
+
+function remember(
+  cache: Map<string, Promise<WebAssembly.Module>>,
+  key: string,
+  load: () => Promise<WebAssembly.Module>,
+): Promise<WebAssembly.Module> {
+  let module = cache.get(key);
+  if (!module) {
+    module = load();
+    cache.set(key, module);
+    // A failed read or compile is retried by the next load.
+    module.catch(() => cache.delete(key));
+  }
+  return module;
+}
+
+async function compileBytes(bytes: Uint8Array): Promise<WebAssembly.Module> {
+  const subtle = await getSubtleCrypto();
+  const digest = toHex(await subtle.digest('SHA-256', bytes));
+  return remember(byDigest, digest, () => {
+    compiles++;
+    return WebAssembly.compile(bytes);
+  });
+}
+
+/**
+ * Resolves to the compiled module for a wasm file path, URL or binary,
+ * compiling it only if no load in this process has done so yet.
+ *
+ * @example
+ * import { init } from '@jsquash/jpeg/decode.js';
+ * await init(await loadWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'));
+ */
+export function loadWasmModule(
+  source: WasmSource,
+): Promise<WebAssembly.Module> {
+  loads++;
+  if (typeof source === 'string' || source instanceof URL) {
+    const location = String(source);
+    return remember(byLocation, location, async () =>
+      compileBytes(new Uint8Array(await readWasmFile(location))),
+    );
+  }
+  const bytes = ArrayBuffer.isView(source)
+    ? new Uint8Array(source.buffer, source.byteOffset, source.byteLength)
+    : new Uint8Array(source);
+  return compileBytes(bytes);
+}
+
+export function moduleCacheStats(): ModuleCacheStats {
+  return { hits: loads - compiles, compiles, modules: byDigest.size };
+}
+
+/** Drops every compiled module, so the next load of each file compiles it. */
+export function clearModuleCache(): void {
+  byLocation.clear();
+  byDigest.clear();
+  loads = 0;
+  compiles = 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * Storage backends for the encode cache: an in-memory LRU bounded by the
+ * total size of the cached results, and a directory of files for Node.
+ */
+
+export class MemoryStore {
+  // Map iteration follows insertion order, so the first entry is always the
+  // least recently used one.
+  private entries = new Map<string, ArrayBuffer>();
+  bytes = 0;
+  evictions = 0;
+
+  constructor(private maxBytes: number) {}
+
+  get size(): number {
+    return this.entries.size;
+  }
+
+  get(key: string): ArrayBuffer | undefined {
+    const value = this.entries.get(key);
+    if (value) {
+      this.entries.delete(key);
+      this.entries.set(key, value);
+    }
+    return value;
+  }
+
+  set(key: string, value: ArrayBuffer): void {
+    if (value.byteLength > this.maxBytes) return;
+    this.delete(key);
+    this.entries.set(key, value);
+    this.bytes += value.byteLength;
+    for (const [oldestKey] of this.entries) {
+      if (this.bytes <= this.maxBytes) break;
+      this.delete(oldestKey);
+      this.evictions++;
+    }
+  }
+
+  delete(key: string): void {
+    const value = this.entries.get(key);
+    if (value) {
+      this.entries.delete(key);
+      this.bytes -= value.byteLength;
+    }
+  }
+
+  clear(): void {
+    this.entries.clear();
+    this.bytes = 0;
+  }
+}
+
+/**
+ * One file per entry, named after the key. Files are written to a temporary
+ * name and renamed into place so concurrent processes never read a partial
+ * result. The directory is not size limited.
+ */
+export class DiskStore {
+  private fs = import('node:fs/promises');
+  private ready: Promise<unknown>;
+
+  constructor(private directory: string) {
+    this.ready = this.fs.then((fs) => fs.mkdir(directory, { recursive: true }));
+  }
+
+  private path(key: string): string {
+    return `${this.directory}/${key}`;
+  }
+
+  async get(key: string): Promise<ArrayBuffer | undefined> {
+    const fs = await this.fs;
+    try {
+      const file = await fs.readFile(this.path(key));
+      return file.buffer.slice(
+        file.byteOffset,
+        file.byteOffset + file.byteLength,
+      ) as ArrayBuffer;
+    } catch {
+      return undefined;
+    }
+  }
+
+  async set(key: string, value: ArrayBuffer): Promise<void> {
+    const fs = await this.fs;
+    await this.ready;
+    const temporaryPath = `${this.path(key)}.${Math.random()
+      .toString(36)
+      .slice(2)}.tmp`;
+    await fs.writeFile(temporaryPath, new Uint8Array(value));
+    await fs.rename(temporaryPath, this.path(key));
+  }
+
+  async clear(): Promise<void> {
+    const fs = await this.fs;
+    await fs.rm(this.directory, { recursive: true, force: true });
+    this.ready = fs.mkdir(this.directory, { recursive: true });
+  }
+}
@@ -0,0 +1,9 @@
+// Every codec's embind functions, each under its wrapper's prefix, e.g.
+// `jpeg_enc_encode` or `webp_dec_decode`. See `Codec` in combined.ts.
+export interface CombinedModule extends EmscriptenWasm.Module {
+  [exportName: string]: any;
+}
+
+declare var moduleFactory: EmscriptenWasm.ModuleFactory<CombinedModule>;
+
+export default moduleFactory;
@@ -0,0 +1,80 @@
+import type { CombinedModule } from './codec/combined.js';
+
+import { initEmscriptenModule } from './utils.js';
+import { threads } from 'wasm-feature-detect';
+
+/** The codec wrappers linked into the module, named by their export prefix. */
+export type Codec =
+  | 'avif_enc'
+  | 'avif_dec'
+  | 'jpeg_enc'
+  | 'jpeg_dec'
+  | 'jxl_enc'
+  | 'jxl_dec'
+  | 'qoi_enc'
+  | 'qoi_dec'
+  | 'webp_enc'
+  | 'webp_dec';
+
+const isRunningInNode = () =>
+  typeof process !== 'undefined' &&
+  process.release &&
+  process.release.name === 'node';
+const isRunningInCloudflareWorker = () =>
+  (globalThis.caches as any)?.default !== undefined;
+
+/**
+ * Instantiates the combined module, once per call. Pass the result to
+ * `getCodec` for each encoder and decoder the app uses.
+ */
+export async function init(
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+): Promise<CombinedModule>;
+export async function init(
+  module?: WebAssembly.Module,
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+) {
+  let actualModule: WebAssembly.Module | undefined = module;
+  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
+    moduleOptionOverrides;
+
+  // If only one argument is provided and it's not a WebAssembly.Module
+  if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
+    actualModule = undefined;
+    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+  }
+
+  const useThreads =
+    !isRunningInNode() && !isRunningInCloudflareWorker() && (await threads());
+  const combined = useThreads
+    ? await import('./codec/combined_mt.js')
+    : await import('./codec/combined.js');
+  return initEmscriptenModule(combined.default, actualModule, actualOptions);
+}
+
+/**
+ * One codec's view of the combined module, to hand to the `useModule`
+ * function of its package: the codec's functions under their plain names, and
+ * everything else (heap, runtime, threads) shared with the other codecs.
+ *
+ * @example
+ * import { init, getCodec } from '@jsquash/combined';
+ * import { useModule } from '@jsquash/jpeg/encode';
+ *
+ * const combined = init();
+ * useModule(getCodec(combined, 'jpeg_enc'));
+ */
+export async function getCodec(
+  module: Promise<CombinedModule>,
+  codec: Codec,
+): Promise<any> {
+  const combined = await module;
+  const prefix = `${codec}_`;
+  const view = Object.create(combined);
+  for (const name of Object.keys(combined)) {
+    if (name.startsWith(prefix)) {
+      view[name.slice(prefix.length)] = combined[name];
+    }
+  }
+  return view;
+}
@@ -0,0 +1,3 @@
+export { init, getCodec } from './combined.js';
+export type { Codec } from './combined.js';
+export type { CombinedModule } from './codec/combined.js';
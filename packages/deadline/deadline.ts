@@ -0,0 +1,179 @@
+import { EffortModel } from './model.js';
+import { defaultDeadlineEncoderOptions, effortProfiles } from './meta.js';
+import type {
+  DeadlineCodec,
+  DeadlineEncoderOptions,
+  EffortProfile,
+} from './meta.js';
+
+export interface PixelSource {
+  data: ArrayBufferView;
+  width: number;
+  height: number;
+}
+
+export type EncodeFunction<D extends PixelSource, O> = (
+  data: D,
+  options?: O,
+) => Promise<ArrayBuffer>;
+
+export interface DeadlineAttempt {
+  /** Value of the codec's effort option, e.g. `method` for WebP. */
+  effort: number;
+  /** Predicted milliseconds when the effort was picked. */
+  estimate: number;
+  elapsed: number;
+  /** True when the encoder hit its time limit and a faster effort followed. */
+  aborted: boolean;
+}
+
+export interface DeadlineEncodeResult {
+  buffer: ArrayBuffer;
+  /** Value of the codec's effort option that produced `buffer`. */
+  effort: number;
+  /** Milliseconds from the call to the result, across all attempts. */
+  elapsed: number;
+  attempts: DeadlineAttempt[];
+}
+
+const TIME_LIMIT_ERROR = 'Encoding time limit exceeded.';
+const CALIBRATION_SIZE = 256;
+
+const now = () => globalThis.performance.now();
+
+/**
+ * Picks the slowest effort expected to finish within a time budget.
+ *
+ * Codecs that accept a `timeLimit` (WebP and JPEG XL) are stopped once the
+ * budget, minus the expected time of the fastest effort, has passed, and the
+ * fastest effort that still fits is tried instead. AVIF encodes can't be
+ * interrupted, so for AVIF the budget only steers the initial choice.
+ */
+export class DeadlineEncoder<D extends PixelSource, O> {
+  readonly model: EffortModel;
+  private profile: EffortProfile;
+  private options: DeadlineEncoderOptions;
+
+  constructor(
+    codec: DeadlineCodec,
+    private encoder: EncodeFunction<D, O>,
+    options: Partial<DeadlineEncoderOptions> = {},
+  ) {
+    this.profile = effortProfiles[codec];
+    this.options = { ...defaultDeadlineEncoderOptions, ...options };
+    this.model = new EffortModel(this.profile, this.options.model);
+  }
+
+  /**
+   * Encodes `data` with `options`, overriding the codec's effort option, and
+   * aims to finish within `budget` milliseconds. The fastest effort always
+   * runs to completion, so a result is returned even when the budget is too
+   * small for any of them.
+   */
+  async encode(
+    data: D,
+    budget: number,
+    options?: O,
+  ): Promise<DeadlineEncodeResult> {
+    const start = now();
+    const pixels = data.width * data.height;
+    const fastest = this.profile.values.length - 1;
+    const attempts: DeadlineAttempt[] = [];
+    let level = this.pickLevel(pixels, budget * this.options.safety, 0);
+
+    while (true) {
+      const remaining = budget - (now() - start);
+      // Stop early enough to still run the fastest effort in time.
+      const timeLimit =
+        this.profile.abortable && level !== fastest
+          ? Math.max(remaining - this.model.estimate(fastest, pixels), 1)
+          : 0;
+      const attempt: DeadlineAttempt = {
+        effort: this.profile.values[level],
+        estimate: this.model.estimate(level, pixels),
+        elapsed: 0,
+        aborted: false,
+      };
+      attempts.push(attempt);
+
+      const attemptStart = now();
+      let buffer: ArrayBuffer | undefined;
+      try {
+        buffer = await this.encoder(
+          data,
+          this.withEffort(options, level, timeLimit),
+        );
+      } catch (error) {
+        if ((error as Error)?.message !== TIME_LIMIT_ERROR) throw error;
+        attempt.aborted = true;
+      }
+      attempt.elapsed = now() - attemptStart;
+      this.model.observe(level, pixels, attempt.elapsed);
+
+      if (buffer) {
+        return {
+          buffer,
+          effort: attempt.effort,
+          elapsed: now() - start,
+          attempts,
+        };
+      }
+      level = this.pickLevel(pixels, budget - (now() - start), level + 1);
+    }
+  }
+
+  /**
+   * Seeds the model with timings from this machine by encoding a small noise
+   * image at the fastest and the middle effort. Without it the first few
+   * encodes rely on the reference timings.
+   */
+  async calibrate(): Promise<void> {
+    const size = CALIBRATION_SIZE;
+    const pixels = new Uint8ClampedArray(size * size * 4);
+    let seed = 1;
+    for (let i = 0; i < pixels.length; i++) {
+      // Gradients with xorshift noise, so no effort level finds a shortcut.
+      seed ^= seed << 13;
+      seed ^= seed >>> 17;
+      seed ^= seed << 5;
+      pixels[i] = i % 4 === 3 ? 255 : ((i >> 2) % size) ^ (seed & 0x1f);
+    }
+    const image = { data: pixels, width: size, height: size } as unknown as D;
+    const levels = [
+      this.profile.values.length - 1,
+      this.profile.values.length >> 1,
+    ];
+    for (const level of levels) {
+      const start = now();
+      await this.encoder(image, this.withEffort(undefined, level, 0));
+      this.model.observe(level, size * size, now() - start);
+    }
+  }
+
+  private pickLevel(pixels: number, available: number, from: number): number {
+    const reserve = this.profile.abortable
+      ? this.model.estimate(this.profile.values.length - 1, pixels)
+      : 0;
+    return this.model.pick(pixels, available - reserve, from);
+  }
+
+  private withEffort(
+    options: O | undefined,
+    level: number,
+    timeLimit: number,
+  ): O {
+    return {
+      ...options,
+      [this.profile.option]: this.profile.values[level],
+      ...(timeLimit > 0 ? { timeLimit } : {}),
+    } as O;
+  }
+}
+
+export function createDeadlineEncoder<D extends PixelSource, O>(
+  codec: DeadlineCodec,
+  encode: EncodeFunction<D, O>,
+  options?: Partial<DeadlineEncoderOptions>,
+): DeadlineEncoder<D, O> {
+  return new DeadlineEncoder(codec, encode, options);
+}
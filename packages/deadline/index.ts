@@ -0,0 +1,15 @@
+export { DeadlineEncoder, createDeadlineEncoder } from './deadline.js';
+export type {
+  DeadlineAttempt,
+  DeadlineEncodeResult,
+  EncodeFunction,
+  PixelSource,
+} from './deadline.js';
+export { EffortModel } from './model.js';
+export { defaultDeadlineEncoderOptions, effortProfiles } from './meta.js';
+export type {
+  DeadlineCodec,
+  DeadlineEncoderOptions,
+  EffortModelState,
+  EffortProfile,
+} from './meta.js';
@@ -0,0 +1,58 @@
+export type DeadlineCodec = 'webp' | 'jxl' | 'avif';
+
+export interface EffortProfile {
+  /** The encode option that trades time for compression. */
+  option: string;
+  /** Values of `option`, from the slowest (best compression) to the fastest. */
+  values: number[];
+  /**
+   * Starting estimates in milliseconds per megapixel for each value, measured
+   * with the single threaded builds on a mid range laptop. They only seed the
+   * model; observed encodes replace them.
+   */
+  msPerMegapixel: number[];
+  /** Whether the encoder accepts a `timeLimit` option and stops at it. */
+  abortable: boolean;
+}
+
+export const effortProfiles: Record<DeadlineCodec, EffortProfile> = {
+  webp: {
+    option: 'method',
+    values: [6, 5, 4, 3, 2, 1, 0],
+    msPerMegapixel: [900, 600, 350, 250, 150, 120, 80],
+    abortable: true,
+  },
+  jxl: {
+    option: 'effort',
+    values: [9, 8, 7, 6, 5, 4, 3, 2, 1],
+    msPerMegapixel: [30000, 8000, 2000, 1300, 900, 500, 200, 150, 60],
+    abortable: true,
+  },
+  avif: {
+    option: 'speed',
+    values: [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10],
+    msPerMegapixel: [
+      120000, 60000, 25000, 12000, 7000, 4500, 2500, 1800, 1200, 700, 500,
+    ],
+    abortable: false,
+  },
+};
+
+export interface DeadlineEncoderOptions {
+  /**
+   * Fraction of the budget the chosen effort is expected to use. Values below
+   * 1 leave headroom for estimates that turn out too low.
+   */
+  safety: number;
+  /** A model saved earlier with `model.toJSON()`, to skip re-learning. */
+  model?: EffortModelState;
+}
+
+export interface EffortModelState {
+  machineFactor: number;
+  msPerMegapixel: (number | null)[];
+}
+
+export const defaultDeadlineEncoderOptions: DeadlineEncoderOptions = {
+  safety: 0.8,
+};
@@ -0,0 +1,72 @@
+import type { EffortModelState, EffortProfile } from './meta.js';
+
+// Weight of the newest observation in the moving averages.
+const SMOOTHING = 0.3;
+// Images below this size cost about the same as one this size, since fixed
+// per-encode work dominates.
+const MIN_MEGAPIXELS = 0.05;
+
+/**
+ * Predicts encode times for every effort level of a codec as
+ * `ms per megapixel * megapixels`.
+ *
+ * Each observed encode updates the rate of its own level, and a machine factor
+ * shared by all levels. Levels that have not been observed yet are predicted
+ * from the profile's reference rate scaled by the machine factor, so timing a
+ * single level is enough to calibrate the rest.
+ */
+export class EffortModel {
+  private machineFactor: number;
+  private rates: (number | null)[];
+
+  constructor(private profile: EffortProfile, state?: EffortModelState) {
+    this.machineFactor = state?.machineFactor ?? 1;
+    this.rates =
+      state?.msPerMegapixel.length === profile.values.length
+        ? [...state.msPerMegapixel]
+        : profile.values.map(() => null);
+  }
+
+  /** Expected milliseconds to encode `pixels` pixels at level `level`. */
+  estimate(level: number, pixels: number): number {
+    const rate =
+      this.rates[level] ??
+      this.profile.msPerMegapixel[level] * this.machineFactor;
+    return rate * Math.max(pixels / 1e6, MIN_MEGAPIXELS);
+  }
+
+  /**
+   * The slowest level, starting at `from`, expected to finish within
+   * `available` milliseconds. Falls back to the fastest level.
+   */
+  pick(pixels: number, available: number, from = 0): number {
+    for (let level = from; level < this.profile.values.length - 1; level++) {
+      if (this.estimate(level, pixels) <= available) return level;
+    }
+    return this.profile.values.length - 1;
+  }
+
+  /**
+   * Records an encode. For an aborted encode `elapsed` is a lower bound, which
+   * still moves a too optimistic estimate in the right direction.
+   */
+  observe(level: number, pixels: number, elapsed: number): void {
+    const megapixels = Math.max(pixels / 1e6, MIN_MEGAPIXELS);
+    const rate = elapsed / megapixels;
+    const factor = rate / this.profile.msPerMegapixel[level];
+    // The first observation replaces the reference machine outright.
+    this.machineFactor = this.rates.every((previous) => previous === null)
+      ? factor
+      : this.machineFactor + (factor - this.machineFactor) * SMOOTHING;
+    const previous = this.rates[level];
+    this.rates[level] =
+      previous === null ? rate : previous + (rate - previous) * SMOOTHING;
+  }
+
+  toJSON(): EffortModelState {
+    return {
+      machineFactor: this.machineFactor,
+      msPerMegapixel: [...this.rates],
+    };
+  }
+}
@@ -0,0 +1,125 @@
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+
+#include <memory>
+#include <vector>
+
+#include "fpng.h"
+#include "spng.h"
+
+#include "decode_limits.h"
+#include "embind_export.h"
+#include "image_view.h"
+#include "premultiply.h"
+
+using namespace emscripten;
+
+namespace {
+
+thread_local const val Uint16Array = val::global("Uint16Array");
+thread_local const val Object = val::global("Object");
+
+// fpng_init() only picks the CRC-32 and Adler-32 routines for the CPU. As a
+// static constructor it is evaluated at link time, see EVAL_CTORS_FLAGS.
+const bool fpng_initialized = (fpng::fpng_init(), true);
+
+using SpngContext = std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)>;
+
+// Premultiplies `pixels` first when `premultiplied` is set.
+val ToResult(std::vector<uint8_t>& pixels,
+             uint32_t width,
+             uint32_t height,
+             int bitDepth,
+             bool premultiplied) {
+  if (premultiplied && bitDepth == 8) {
+    jsquash::PremultiplyRows(pixels.data(), static_cast<size_t>(width) * 4, width, height);
+  } else if (premultiplied) {
+    jsquash::PremultiplyRows(reinterpret_cast<uint16_t*>(pixels.data()),
+                             static_cast<size_t>(width) * 8, width, height);
+  }
+  if (bitDepth == 8) {
+    return jsquash::WriteImageData(pixels.data(), width, height, val::undefined());
+  }
+  val result = Object.new_();
+  result.set("data", Uint16Array.new_(typed_memory_view(
+                         pixels.size() / 2, reinterpret_cast<const uint16_t*>(pixels.data()))));
+  result.set("width", width);
+  result.set("height", height);
+  return result;
+}
+
+// Decodes to RGBA of `bitDepth` bits, as ImageData for 8 and as
+// {data: Uint16Array, width, height} for 16. Returns the name of the limit as a
+// string when `limits` stop the decode. With `premultiplied`, returns colour
+// premultiplied by alpha; PNG itself only stores straight alpha.
+val decode(std::string png, int bitDepth, jsquash::DecodeLimits limits, bool premultiplied) {
+  if (bitDepth != 8 && bitDepth != 16) {
+    return val::null();
+  }
+  const size_t bytes_per_sample = bitDepth / 8;
+
+  SpngContext ctx(spng_ctx_new(0), spng_ctx_free);
+  if (!ctx) {
+    return val::null();
+  }
+  // Like the Rust PNG decoder, ignore broken CRCs of ancillary chunks such as
+  // iCCP rather than rejecting the whole file.
+  spng_set_crc_action(ctx.get(), SPNG_CRC_ERROR, SPNG_CRC_DISCARD);
+  spng_ihdr ihdr;
+  if (spng_set_png_buffer(ctx.get(), png.data(), png.size()) ||
+      spng_get_ihdr(ctx.get(), &ihdr)) {
+    return val::null();
+  }
+
+  jsquash::DecodeBudget budget(limits);
+  if (!budget.CheckImage(ihdr.width, ihdr.height, 1,
+                         4.0 * bytes_per_sample * ihdr.width * ihdr.height)) {
+    return budget.Abort();
+  }
+
+  std::vector<uint8_t> pixels;
+  // Files written by fpng carry a private chunk that marks their single
+  // block layout, which fpng inflates in one pass much faster than zlib. It
+  // returns FPNG_DECODE_NOT_FPNG for every other file, which libspng decodes.
+  uint32_t width, height, channels;
+  if (bitDepth == 8 &&
+      fpng::fpng_decode_memory(png.data(), png.size(), pixels, width, height, channels, 4) ==
+          fpng::FPNG_DECODE_SUCCESS) {
+    return ToResult(pixels, width, height, bitDepth, premultiplied && channels == 4);
+  }
+
+  const int fmt = bitDepth == 16 ? SPNG_FMT_RGBA16 : SPNG_FMT_RGBA8;
+  size_t size;
+  if (spng_decoded_image_size(ctx.get(), fmt, &size)) {
+    return val::null();
+  }
+  pixels.resize(size);
+
+  // Decoded a row at a time so the budget is polled as it goes. Interlaced
+  // rows are written to their place in the image, pass by pass.
+  const size_t row_size = size / ihdr.height;
+  int err = spng_decode_image(ctx.get(), nullptr, 0, fmt,
+                              SPNG_DECODE_TRNS | SPNG_DECODE_PROGRESSIVE);
+  spng_row_info row_info;
+  while (!err) {
+    err = spng_get_row_info(ctx.get(), &row_info);
+    if (!err) {
+      err = spng_decode_row(ctx.get(), pixels.data() + row_info.row_num * row_size, row_size);
+    }
+    if (!budget.Poll()) {
+      return budget.Abort();
+    }
+  }
+  if (err != SPNG_EOI) {
+    return val::null();
+  }
+
+  return ToResult(pixels, ihdr.width, ihdr.height, bitDepth, premultiplied);
+}
+
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(fpng_dec) {
+  jsquash::RegisterDecodeLimits();
+  function(JSQUASH_EXPORT("decode"), &decode);
+}
@@ -0,0 +1,38 @@
+export interface DecodeLimits {
+  maxPixels: number;
+  maxFrames: number;
+  maxMemory: number;
+  timeLimit: number;
+}
+
+// What a decode stopped by its limits returns.
+export type DecodeLimit = keyof DecodeLimits;
+
+export interface FPNGModule extends EmscriptenWasm.Module {
+  decode(
+    data: BufferSource,
+    bitDepth: 8,
+    limits: DecodeLimits,
+    premultiplied: boolean,
+  ): ImageData | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    bitDepth: 16,
+    limits: DecodeLimits,
+    premultiplied: boolean,
+  ): { data: Uint16Array; width: number; height: number } | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    bitDepth: 8 | 16,
+    limits: DecodeLimits,
+    premultiplied: boolean,
+  ):
+    | { data: Uint16Array; width: number; height: number }
+    | ImageData
+    | DecodeLimit
+    | null;
+}
+
+declare var moduleFactory: EmscriptenWasm.ModuleFactory<FPNGModule>;
+
+export default moduleFactory;
@@ -0,0 +1,130 @@
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+
+#include <memory>
+#include <vector>
+
+#include "fpng.h"
+#include "spng.h"
+
+#include "embind_export.h"
+#include "image_size.h"
+#include "image_view.h"
+#include "premultiply.h"
+
+using namespace emscripten;
+
+namespace {
+
+thread_local const val Uint8Array = val::global("Uint8Array");
+
+// fpng_init() only picks the CRC-32 and Adler-32 routines for the CPU. As a
+// static constructor it is evaluated at link time, see EVAL_CTORS_FLAGS.
+const bool fpng_initialized = (fpng::fpng_init(), true);
+
+using SpngContext = std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)>;
+
+// fpng writes one dynamic Huffman block per image with a fixed filter and a
+// greedy match finder over the previous pixel and row, so files are somewhat
+// larger than zlib's but encode many times faster.
+val EncodeRGBA8(const uint8_t* rows,
+                uint32_t width,
+                uint32_t height,
+                size_t stride,
+                bool premultiplied) {
+  std::vector<uint8_t> packed;
+  const uint8_t* pixels =
+      premultiplied
+          ? jsquash::UnpremultiplyRows(rows, width, stride, height, &packed)
+          : jsquash::PackRows(rows, static_cast<size_t>(width) * 4, stride, height, &packed);
+  std::vector<uint8_t> png;
+  if (!fpng::fpng_encode_image_to_memory(pixels, width, height, 4, png)) {
+    return val::null();
+  }
+  return Uint8Array.new_(typed_memory_view(png.size(), png.data()));
+}
+
+// fpng only writes 8-bit images. 16-bit ones go through libspng at the fastest
+// zlib level with a single filter, which skips the per row filter search, and
+// are fed row by row so a strided image is never packed, unless it has to be
+// unpremultiplied. Samples are in host (little endian) order, as in a
+// Uint16Array.
+val EncodeRGBA16(const uint8_t* rows,
+                 uint32_t width,
+                 uint32_t height,
+                 size_t stride,
+                 bool premultiplied) {
+  SpngContext ctx(spng_ctx_new(SPNG_CTX_ENCODER), spng_ctx_free);
+  if (!ctx) {
+    return val::null();
+  }
+
+  spng_ihdr ihdr = {};
+  ihdr.width = width;
+  ihdr.height = height;
+  ihdr.bit_depth = 16;
+  ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+
+  const size_t row_size = static_cast<size_t>(width) * 8;
+  std::vector<uint16_t> straight;
+  if (premultiplied) {
+    rows = reinterpret_cast<const uint8_t*>(jsquash::UnpremultiplyRows(
+        reinterpret_cast<const uint16_t*>(rows), width, stride, height, &straight));
+    stride = row_size;
+  }
+  int err = spng_set_option(ctx.get(), SPNG_ENCODE_TO_BUFFER, 1);
+  if (!err) err = spng_set_ihdr(ctx.get(), &ihdr);
+  if (!err) err = spng_set_option(ctx.get(), SPNG_IMG_COMPRESSION_LEVEL, 1);
+  if (!err) err = spng_set_option(ctx.get(), SPNG_FILTER_CHOICE, SPNG_FILTER_CHOICE_UP);
+  if (!err) {
+    err = spng_encode_image(ctx.get(), nullptr, 0, SPNG_FMT_PNG,
+                            SPNG_ENCODE_PROGRESSIVE | SPNG_ENCODE_FINALIZE);
+  }
+  for (uint32_t y = 0; !err && y < height; y++) {
+    err = spng_encode_row(ctx.get(), rows + y * stride, row_size);
+  }
+  // The last row returns SPNG_EOI once the file has been finalized.
+  if (err != SPNG_EOI) {
+    return val::null();
+  }
+
+  size_t size;
+  uint8_t* png = static_cast<uint8_t*>(spng_get_png_buffer(ctx.get(), &size, &err));
+  if (png == nullptr) {
+    return val::null();
+  }
+  val result = Uint8Array.new_(typed_memory_view(size, png));
+  free(png);
+  return result;
+}
+
+// `buffer` holds RGBA samples of `bitDepth` bits, and `stride` is the distance
+// between the starts of two of its rows in bytes. `premultiplied` marks colour in
+// `buffer` as premultiplied by alpha, which PNG can't store.
+val encode(std::string buffer,
+           int width,
+           int height,
+           uint32_t stride,
+           int bitDepth,
+           bool premultiplied) {
+  if (bitDepth != 8 && bitDepth != 16) {
+    return val::null();
+  }
+  const size_t row_size = static_cast<size_t>(width) * 4 * (bitDepth / 8);
+  size_t size;
+  if (width <= 0 || height <= 0 || !jsquash::ComputeStridedSize(height, row_size, stride, &size) ||
+      buffer.size() < size)
+    return val::null();
+
+  const uint8_t* rows = reinterpret_cast<const uint8_t*>(buffer.data());
+  if (bitDepth == 16) {
+    return EncodeRGBA16(rows, width, height, stride, premultiplied);
+  }
+  return EncodeRGBA8(rows, width, height, stride, premultiplied);
+}
+
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(fpng_enc) {
+  function(JSQUASH_EXPORT("encode"), &encode);
+}
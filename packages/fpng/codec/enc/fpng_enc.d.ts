@@ -0,0 +1,14 @@
+export interface FPNGModule extends EmscriptenWasm.Module {
+  encode(
+    data: BufferSource,
+    width: number,
+    height: number,
+    stride: number,
+    bitDepth: 8 | 16,
+    premultiplied: boolean,
+  ): Uint8Array | null;
+}
+
+declare var moduleFactory: EmscriptenWasm.ModuleFactory<FPNGModule>;
+
+export default moduleFactory;
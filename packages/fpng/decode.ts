@@ -0,0 +1,91 @@
+import type { FPNGModule } from './codec/dec/fpng_dec.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
+
+import type { DecodeLimits, DecodeOptions, ImageDataRGBA16 } from './meta.js';
+import { simd } from 'wasm-feature-detect';
+
+let emscriptenModule: Promise<FPNGModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: FPNGModule) => Promise<FPNGModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module instead of loading this package's own
+ * build.
+ */
+export function useModule(module: Promise<FPNGModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
+
+export async function init(
+  moduleOptionOverrides?: InitOptions,
+): Promise<void>;
+export async function init(
+  module?: WebAssembly.Module,
+  moduleOptionOverrides?: InitOptions,
+): Promise<void> {
+  let actualModule: WebAssembly.Module | undefined = module;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
+
+  // If only one argument is provided and it's not a WebAssembly.Module
+  if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
+    actualModule = undefined;
+    actualOptions = module as unknown as InitOptions;
+  }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
+
+  const load = async () => {
+    const fpngDecoder = (await simd())
+      ? await import('./codec/dec/fpng_dec_simd.js')
+      : await import('./codec/dec/fpng_dec.js');
+    return initEmscriptenModule(
+      fpngDecoder.default,
+      actualModule,
+      emscriptenOptions,
+    );
+  };
+  // Assigned synchronously so a decode() straight after init() reuses it.
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
+}
+
+export default async function decode(
+  buffer: ArrayBuffer,
+  options: DecodeOptions & { bitDepth: 16 },
+): Promise<ImageDataRGBA16>;
+export default async function decode(
+  buffer: ArrayBuffer,
+  options?: DecodeOptions & { bitDepth?: 8 },
+): Promise<ImageData>;
+export default async function decode(
+  buffer: ArrayBuffer,
+  options: DecodeOptions = {},
+): Promise<ImageData | ImageDataRGBA16> {
+  if (!emscriptenModule) await init();
+
+  const bitDepth = options.bitDepth ?? 8;
+  if (bitDepth !== 8 && bitDepth !== 16) {
+    throw new Error('Invalid bit depth. Must be either 8 or 16.');
+  }
+
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    bitDepth,
+    getDecodeLimits(options.limits),
+    !!options.premultipliedAlpha,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
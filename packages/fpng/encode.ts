@@ -0,0 +1,98 @@
+import type { FPNGModule } from './codec/enc/fpng_enc.js';
+
+import type { EncodeOptions, ImageDataRGBA16, ImageDataView } from './meta.js';
+import {
+  getImageRows,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
+import { simd } from 'wasm-feature-detect';
+
+let emscriptenModule: Promise<FPNGModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: FPNGModule) => Promise<FPNGModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module instead of loading this package's own
+ * build.
+ */
+export function useModule(module: Promise<FPNGModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
+
+export async function init(
+  moduleOptionOverrides?: InitOptions,
+): Promise<void>;
+export async function init(
+  module?: WebAssembly.Module,
+  moduleOptionOverrides?: InitOptions,
+): Promise<void> {
+  let actualModule: WebAssembly.Module | undefined = module;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
+
+  // If only one argument is provided and it's not a WebAssembly.Module
+  if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
+    actualModule = undefined;
+    actualOptions = module as unknown as InitOptions;
+  }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
+
+  const load = async () => {
+    const fpngEncoder = (await simd())
+      ? await import('./codec/enc/fpng_enc_simd.js')
+      : await import('./codec/enc/fpng_enc.js');
+    return initEmscriptenModule(
+      fpngEncoder.default,
+      actualModule,
+      emscriptenOptions,
+    );
+  };
+  // Assigned synchronously so an encode() straight after init() reuses it.
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
+}
+
+export default async function encode(
+  data: ImageDataRGBA16,
+  options: EncodeOptions & { bitDepth: 16 },
+): Promise<ArrayBuffer>;
+export default async function encode(
+  data: ImageData | ImageDataView,
+  options?: EncodeOptions & { bitDepth?: 8 },
+): Promise<ArrayBuffer>;
+export default async function encode(
+  data: ImageData | ImageDataView | ImageDataRGBA16,
+  options: EncodeOptions = {},
+): Promise<ArrayBuffer> {
+  if (!emscriptenModule) await init();
+
+  const bitDepth = options.bitDepth ?? 8;
+  if (bitDepth !== 8 && bitDepth !== 16) {
+    throw new Error('Invalid bit depth. Must be either 8 or 16.');
+  }
+  if ((data.data instanceof Uint16Array) !== (bitDepth === 16)) {
+    throw new Error(
+      'Invalid bit depth, must be 16 for Uint16Array and 8 for Uint8ClampedArray.',
+    );
+  }
+
+  const module = await emscriptenModule;
+  const { rows, stride } = getImageRows(data);
+  const resultView = module.encode(
+    new Uint8Array(rows.buffer, rows.byteOffset, rows.byteLength),
+    data.width,
+    data.height,
+    stride,
+    bitDepth,
+    !!options.premultipliedAlpha,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (!resultView) throw new Error('Encoding error.');
+  // wasm can't run on SharedArrayBuffers, so we hard-cast to ArrayBuffer.
+  return resultView.buffer as ArrayBuffer;
+}
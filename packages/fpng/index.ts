@@ -0,0 +1,11 @@
+export { default as encode } from './encode.js';
+export { default as decode } from './decode.js';
+export type {
+  DecodeLimits,
+  DecodeOptions,
+  EncodeOptions,
+  ImageDataRGBA16,
+  ImageDataView,
+} from './meta.js';
+export { DecodeLimitError, getRecycleStats } from './utils.js';
+export type { InitOptions, RecycleStats } from './utils.js';
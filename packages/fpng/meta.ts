@@ -0,0 +1,61 @@
+/**
+ * RGBA pixels stored as a region of a larger buffer, such as a crop of a
+ * canvas. `offset` is the index in `data` of the region's first sample and
+ * `stride` the number of samples between the starts of two rows. They default
+ * to `0` and `width * 4`, so an `ImageData` is a valid `ImageDataView`.
+ */
+export type ImageDataView = {
+  data: Uint8ClampedArray;
+  width: number;
+  height: number;
+  stride?: number;
+  offset?: number;
+};
+
+/**
+ * 16-bit RGBA pixels, with the same optional `stride` and `offset` as
+ * `ImageDataView`, counted in samples.
+ */
+export type ImageDataRGBA16 = {
+  data: Uint16Array;
+  width: number;
+  height: number;
+  stride?: number;
+  offset?: number;
+};
+
+/**
+ * Limits on what one decode may cost, for untrusted input. Each is checked
+ * against the header before any pixels are decoded, then again as the decode
+ * runs, and a decode over one rejects with a `DecodeLimitError` naming it.
+ * Unset or 0 means no limit.
+ */
+export type DecodeLimits = {
+  // Largest width * height of the image.
+  maxPixels?: number;
+  // Most frames an animation or image sequence may declare.
+  maxFrames?: number;
+  // Most bytes the decode may have allocated at once.
+  maxMemory?: number;
+  // Milliseconds the decode may take.
+  timeLimit?: number;
+};
+
+export interface EncodeOptions {
+  bitDepth?: 8 | 16;
+  // Colour of the input is premultiplied by alpha, as in a canvas or a GPU
+  // texture. PNG stores straight alpha, so it is unpremultiplied first.
+  premultipliedAlpha?: boolean;
+}
+
+export interface DecodeOptions {
+  bitDepth?: 8 | 16;
+  limits?: DecodeLimits;
+  // Return colour premultiplied by alpha, ready to composite or to upload as a
+  // premultiplied texture.
+  premultipliedAlpha?: boolean;
+}
+
+export const label = 'PNG';
+export const mimeType = 'image/png';
+export const extension = 'png';
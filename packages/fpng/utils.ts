@@ -0,0 +1,164 @@
+/**
+ * Copyright 2020 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Notice: I (Jamie Sinclair) have modified this file to allow manual instantiation of the Wasm Module.
+ */
+
+import type { DecodeLimits } from './meta.js';
+
+export function initEmscriptenModule<T extends EmscriptenWasm.Module>(
+  moduleFactory: EmscriptenWasm.ModuleFactory<T>,
+  wasmModule?: WebAssembly.Module,
+  moduleOptionOverrides: Partial<EmscriptenWasm.ModuleOpts> = {},
+): Promise<T> {
+  let instantiateWasm;
+
+  if (wasmModule) {
+    instantiateWasm = (
+      imports: WebAssembly.Imports,
+      callback: (instance: WebAssembly.Instance) => void,
+    ) => {
+      const instance = new WebAssembly.Instance(wasmModule, imports);
+      callback(instance);
+      return instance.exports;
+    };
+  }
+
+  return moduleFactory({
+    // Just to be safe, don't automatically invoke any wasm functions
+    noInitialRun: true,
+    instantiateWasm,
+    ...moduleOptionOverrides,
+  });
+}
+
+export type InitOptions = Partial<EmscriptenWasm.ModuleOpts> & {
+  /**
+   * Heap size in bytes past which the module is replaced by a fresh instance
+   * between calls, see recycleModule(). Unset by default.
+   */
+  maxHeapSize?: number;
+};
+
+export interface RecycleStats {
+  /** Modules swapped for a fresh instance because their heap grew too large */
+  recycles: number;
+  /** Heap bytes released by those swaps */
+  reclaimedBytes: number;
+}
+
+const recycleStats: RecycleStats = { recycles: 0, reclaimedBytes: 0 };
+
+/** Recycle counters of every encoder and decoder in this package. */
+export function getRecycleStats(): RecycleStats {
+  return { ...recycleStats };
+}
+
+// Instances recycleModule() has already replaced.
+const recycledModules = new WeakSet<EmscriptenWasm.Module>();
+
+/**
+ * Called after each call into `module`. Wasm memory never shrinks, so once a
+ * call has grown the heap past `maxHeapSize` this starts a fresh instance
+ * from `load` for the next call, and returns it. The old instance is left to
+ * the garbage collector. When init() was given a compiled module the fresh
+ * instance reuses it, so a recycle only costs an instantiation.
+ *
+ * Concurrent calls that finish on the same instance each call this. Only the
+ * first starts a fresh instance; the rest return undefined and pick up the
+ * fresh one from the caller's shared promise.
+ *
+ * Multithreaded builds are never recycled, their workers can't be stopped.
+ */
+export function recycleModule<T extends EmscriptenWasm.Module>(
+  module: T,
+  maxHeapSize: number | undefined,
+  load: () => Promise<T>,
+): Promise<T> | undefined {
+  const heapSize = module.HEAPU8.byteLength;
+  if (maxHeapSize === undefined || heapSize <= maxHeapSize) return;
+  if (
+    typeof SharedArrayBuffer !== 'undefined' &&
+    module.HEAPU8.buffer instanceof SharedArrayBuffer
+  ) {
+    return;
+  }
+
+  if (recycledModules.has(module)) return;
+  recycledModules.add(module);
+
+  const fresh = load();
+  fresh.then(
+    (freshModule) => {
+      recycleStats.recycles++;
+      recycleStats.reclaimedBytes += heapSize - freshModule.HEAPU8.byteLength;
+    },
+    () => {},
+  );
+  return fresh;
+}
+
+/** Thrown by a decode that went over one of its `DecodeLimits`. */
+export class DecodeLimitError extends Error {
+  /** The limit the decode went over */
+  readonly limit: keyof DecodeLimits;
+
+  constructor(limit: keyof DecodeLimits) {
+    super(`Decode limit exceeded: ${limit}`);
+    this.name = 'DecodeLimitError';
+    this.limit = limit;
+  }
+}
+
+/** The limits as the decoders take them, with 0 for every unset limit. */
+export function getDecodeLimits(
+  limits: DecodeLimits = {},
+): Required<DecodeLimits> {
+  return {
+    maxPixels: limits.maxPixels ?? 0,
+    maxFrames: limits.maxFrames ?? 0,
+    maxMemory: limits.maxMemory ?? 0,
+    timeLimit: limits.timeLimit ?? 0,
+  };
+}
+
+/**
+ * The samples of `image.data` from its first pixel to its last one, as a view
+ * rather than a copy, and the distance between the starts of its rows in
+ * bytes. Lets encoders read a crop of a larger buffer without packing it.
+ */
+export function getImageRows<
+  T extends Uint8ClampedArray | Uint8Array | Uint16Array | Float32Array,
+>(
+  image: {
+    data: T;
+    width: number;
+    height: number;
+    stride?: number;
+    offset?: number;
+  },
+  channels = 4,
+): { rows: T; stride: number } {
+  const rowLength = image.width * channels;
+  const stride = image.stride ?? rowLength;
+  const offset = image.offset ?? 0;
+  const end = offset + stride * (image.height - 1) + rowLength;
+  if (stride < rowLength || offset < 0 || end > image.data.length) {
+    throw new Error('The image does not fit in its data buffer.');
+  }
+  return {
+    rows: image.data.subarray(offset, end) as T,
+    stride: stride * image.data.BYTES_PER_ELEMENT,
+  };
+}
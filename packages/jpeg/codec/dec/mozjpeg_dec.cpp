@@ -2,9 +2,21 @@
 #include <emscripten/val.h>
 #include "config.h"
 #include "jpeglib.h"
+#include <setjmp.h>
 #include <string.h>
+#include <algorithm>
+#include <memory>
 #include <vector>
 
+#include "color_profile.h"
+#include "decode_limits.h"
+#include "decode_resize.h"
+#include "embind_export.h"
+#include "image_analysis.h"
+#include "image_size.h"
+#include "image_view.h"
+#include "jpeg_error.h"
+
 extern "C" {
 #include "cdjpeg.h"
 #include "jerror.h"
@@ -12,8 +24,7 @@ extern "C" {
 
 using namespace emscripten;
 
-thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
-thread_local const val ImageData = val::global("ImageData");
+namespace {
 
 constexpr uint16_t EXIF_ORIENTATION_TAG = 0x0112;
 
@@ -73,6 +84,121 @@ int parse_exif_orientation(const uint8_t *exif_data, unsigned int data_length)
   return 0;
 }
 
+constexpr uint16_t EXIF_JPEG_INTERCHANGE_FORMAT_TAG = 0x0201;
+constexpr uint16_t EXIF_JPEG_INTERCHANGE_FORMAT_LENGTH_TAG = 0x0202;
+
+// Finds the JPEG thumbnail that cameras store in IFD1, the IFD linked from the
+// end of IFD0. Sets `offset` (from the start of `exif_data`) and `length` and
+// returns true when one is present and lies inside the APP1 segment.
+bool parse_exif_thumbnail(const uint8_t *exif_data, unsigned int data_length,
+                          uint32_t *offset, uint32_t *length)
+{
+  if (data_length < 14)
+    return false;
+
+  constexpr int tiff_header_offset = 6; // Skip "Exif\0\0" header
+  const uint32_t tiff_length = data_length - tiff_header_offset;
+  const uint8_t *tiff = exif_data + tiff_header_offset;
+
+  bool is_motorola = (tiff[0] == 'M' && tiff[1] == 'M');
+  if (!is_motorola && (tiff[0] != 'I' || tiff[1] != 'I'))
+    return false;
+  if (get_exif_short(tiff, 2, is_motorola) != 0x002A)
+    return false;
+
+  // Skip IFD0 to reach the offset of IFD1.
+  uint32_t ifd = get_exif_long(tiff, 4, is_motorola);
+  if (ifd < 8 || ifd > tiff_length - 2)
+    return false;
+  const uint32_t ifd0_tags = get_exif_short(tiff, ifd, is_motorola);
+  const uint64_t next_ifd_offset = static_cast<uint64_t>(ifd) + 2 + ifd0_tags * 12;
+  if (next_ifd_offset + 4 > tiff_length)
+    return false;
+  ifd = get_exif_long(tiff, next_ifd_offset, is_motorola);
+  if (ifd < 8 || ifd > tiff_length - 2)
+    return false;
+
+  const uint16_t number_of_tags = get_exif_short(tiff, ifd, is_motorola);
+  uint32_t thumbnail_offset = 0;
+  uint32_t thumbnail_length = 0;
+  uint32_t entry = ifd + 2;
+  for (uint16_t i = 0; i < number_of_tags && entry + 12 <= tiff_length; i++, entry += 12)
+  {
+    const uint16_t tag = get_exif_short(tiff, entry, is_motorola);
+    if (tag == EXIF_JPEG_INTERCHANGE_FORMAT_TAG)
+      thumbnail_offset = get_exif_long(tiff, entry + 8, is_motorola);
+    else if (tag == EXIF_JPEG_INTERCHANGE_FORMAT_LENGTH_TAG)
+      thumbnail_length = get_exif_long(tiff, entry + 8, is_motorola);
+  }
+
+  if (thumbnail_offset == 0 || thumbnail_length < 4 ||
+      static_cast<uint64_t>(thumbnail_offset) + thumbnail_length > tiff_length)
+    return false;
+  // Must start with an SOI marker.
+  if (tiff[thumbnail_offset] != 0xFF || tiff[thumbnail_offset + 1] != 0xD8)
+    return false;
+
+  *offset = thumbnail_offset + tiff_header_offset;
+  *length = thumbnail_length;
+  return true;
+}
+
+// Copies the embedded EXIF thumbnail out of the saved APP1 markers. Returns an
+// empty vector when there is none.
+std::vector<uint8_t> extract_thumbnail(struct jpeg_decompress_struct *cinfo)
+{
+  for (jpeg_saved_marker_ptr marker = cinfo->marker_list; marker != nullptr; marker = marker->next)
+  {
+    uint32_t offset, length;
+    if (marker->marker == JPEG_APP0 + 1 &&
+        marker->data_length >= 6 &&
+        memcmp(marker->data, "Exif\0\0", 6) == 0 &&
+        parse_exif_thumbnail(marker->data, marker->data_length, &offset, &length))
+    {
+      return std::vector<uint8_t>(marker->data + offset, marker->data + offset + length);
+    }
+  }
+  return {};
+}
+
+// Reassembles the ICC profile from the saved APP2 markers, which carry it in
+// numbered chunks of up to 64 KB. Returns an empty vector when there is none,
+// or when its chunks are missing or repeated.
+std::vector<uint8_t> extract_icc_profile(struct jpeg_decompress_struct *cinfo)
+{
+  constexpr unsigned int header_length = 14; // "ICC_PROFILE\0", chunk number, chunk count
+  jpeg_saved_marker_ptr chunks[256] = {};
+  int chunk_count = 0;
+  size_t size = 0;
+  for (jpeg_saved_marker_ptr marker = cinfo->marker_list; marker != nullptr; marker = marker->next)
+  {
+    if (marker->marker != JPEG_APP0 + 2 ||
+        marker->data_length < header_length ||
+        memcmp(marker->data, "ICC_PROFILE\0", 12) != 0)
+      continue;
+
+    const int number = marker->data[12];
+    const int count = marker->data[13];
+    if (count == 0 || (chunk_count != 0 && count != chunk_count) ||
+        number == 0 || number > count || chunks[number] != nullptr)
+      return {};
+    chunk_count = count;
+    chunks[number] = marker;
+    size += marker->data_length - header_length;
+  }
+
+  std::vector<uint8_t> profile;
+  profile.reserve(size);
+  for (int number = 1; number <= chunk_count; number++)
+  {
+    if (chunks[number] == nullptr)
+      return {};
+    profile.insert(profile.end(), chunks[number]->data + header_length,
+                   chunks[number]->data + chunks[number]->data_length);
+  }
+  return profile;
+}
+
 int extract_orientation(struct jpeg_decompress_struct *cinfo)
 {
   for (jpeg_saved_marker_ptr marker = cinfo->marker_list; marker != nullptr; marker = marker->next)
@@ -104,10 +230,9 @@ void apply_orientation(uint8_t *buffer, int width, int height, int orientation)
   const int dst_width = dimensions_swapped ? height : width;
   const int dst_height = dimensions_swapped ? width : height;
 
-  std::vector<uint8_t> temp(width * height * 4);
-  std::memcpy(temp.data(), buffer, width * height * 4);
-
-  std::vector<uint8_t> rotated(dst_width * dst_height * 4, 0);
+  const size_t size = static_cast<size_t>(width) * height * 4;
+  std::vector<uint8_t> temp(buffer, buffer + size);
+  std::vector<uint8_t> rotated(size, 0);
 
   for (int dst_y = 0; dst_y < dst_height; dst_y++)
   {
@@ -150,64 +275,323 @@ void apply_orientation(uint8_t *buffer, int width, int height, int orientation)
       // Check bounds and copy pixel
       if (src_x >= 0 && src_x < width && src_y >= 0 && src_y < height)
       {
-        const int dst_offset = (dst_y * dst_width + dst_x) * 4;
-        const int src_offset = (src_y * width + src_x) * 4;
+        const size_t dst_offset = (static_cast<size_t>(dst_y) * dst_width + dst_x) * 4;
+        const size_t src_offset = (static_cast<size_t>(src_y) * width + src_x) * 4;
         std::memcpy(rotated.data() + dst_offset, temp.data() + src_offset, 4);
       }
     }
   }
 
-  std::memcpy(buffer, rotated.data(), dst_width * dst_height * 4);
+  std::memcpy(buffer, rotated.data(), size);
 }
 
-val decode(std::string image_in, bool preserve_orientation)
+// RGBA pixels produced by read_image(), and everything it allocates while
+// libjpeg runs. Owned by the frame that calls setjmp(), see jpeg_error.h.
+struct DecodedImage
+{
+  std::vector<uint8_t> pixels;
+  std::vector<uint8_t> row;
+  std::unique_ptr<jsquash::DecodeResizer> resizer;
+  // Converts from the embedded ICC profile once initialised, see read_image().
+  jsquash::ColorConverter converter;
+  // Set when the caller asked for the analysis, see read_image().
+  std::unique_ptr<jsquash::ImageAnalyzer> analyzer;
+  int width = 0;
+  int height = 0;
+};
+
+const jsquash::DecodeResizeOptions NO_RESIZE = {0, 0, "stretch", jsquash::RESAMPLE_LANCZOS3, true, false};
+
+// libjpeg calls the progress monitor for every iMCU row it reads and every
+// jpeg_read_scanlines() call, so it is where the decode budget is polled. A
+// decode over budget leaves through the error manager's longjmp, like any
+// other libjpeg error.
+struct BudgetProgress
+{
+  // Must stay the first member, libjpeg only knows about this part.
+  jpeg_progress_mgr pub;
+  jsquash::DecodeBudget *budget;
+};
+
+void poll_budget(j_common_ptr cinfo)
+{
+  auto *progress = reinterpret_cast<BudgetProgress *>(cinfo->progress);
+  if (!progress->budget->Poll())
+  {
+    longjmp(reinterpret_cast<jsquash::JpegErrorManager *>(cinfo->err)->jump, 1);
+  }
+}
+
+// Checks the size in the header read by `cinfo` against the budget, counting
+// the RGBA output and, for progressive files, the coefficients libjpeg keeps
+// for the whole image while it reads every scan.
+bool check_header(const jpeg_decompress_struct &cinfo, jsquash::DecodeBudget *budget)
+{
+  const double pixels = static_cast<double>(cinfo.image_width) * cinfo.image_height;
+  double bytes = pixels * 4;
+  if (cinfo.progressive_mode)
+  {
+    bytes += pixels * cinfo.num_components * sizeof(JCOEF);
+  }
+  return budget->CheckImage(cinfo.image_width, cinfo.image_height, 1, bytes);
+}
+
+// Decompresses the image `cinfo` has read the header of into `image`, resized
+// by `resize` and then rotated by `orientation`. Every decoded row is first
+// converted by image->converter and then, with `analyze`, goes through
+// image->analyzer as it comes out of libjpeg. Returns false when the output
+// size overflows.
+bool read_image(jpeg_decompress_struct *cinfo, int orientation,
+                const jsquash::DecodeResizeOptions &resize, bool analyze, DecodedImage *image)
+{
+  const bool dimensions_swapped = orientation >= 5 && orientation <= 8;
+
+  cinfo->out_color_space = JCS_EXT_RGBA;
+  jpeg_start_decompress(cinfo);
+
+  {
+    // The requested size is for the oriented image, so resize to the
+    // transposed size before rotating.
+    jsquash::DecodeResizeOptions oriented_resize = resize;
+    if (dimensions_swapped)
+    {
+      std::swap(oriented_resize.width, oriented_resize.height);
+    }
+    image->resizer = std::make_unique<jsquash::DecodeResizer>(
+        cinfo->output_width, cinfo->output_height, oriented_resize);
+  }
+  jsquash::DecodeResizer &resizer = *image->resizer;
+  if (analyze)
+  {
+    image->analyzer = std::make_unique<jsquash::ImageAnalyzer>(cinfo->output_width,
+                                                               cinfo->output_height);
+  }
+  jsquash::ImageAnalyzer *analyzer = image->analyzer.get();
+  const jsquash::ColorConverter &converter = image->converter;
+
+  const int width = resizer.width();
+  const int height = resizer.height();
+
+  size_t buffer_size;
+  if (!resizer.valid() || !jsquash::ComputeRGBA8Size(width, height, &buffer_size))
+  {
+    jpeg_abort_decompress(cinfo);
+    return false;
+  }
+  image->pixels.assign(buffer_size, 0);
+
+  if (resizer.active())
+  {
+    // Decoded rows are resampled as they arrive, the full size image is never stored.
+    image->row.resize(static_cast<size_t>(cinfo->output_width) * 4);
+    uint8_t *scanline = image->row.data();
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+      jpeg_read_scanlines(cinfo, &scanline, 1);
+      converter.ConvertRow(scanline, cinfo->output_width);
+      if (analyzer)
+        analyzer->AddRow(scanline);
+      resizer.PushRow(scanline, image->pixels.data());
+    }
+  }
+  else
+  {
+    while (cinfo->output_scanline < cinfo->output_height)
+    {
+      uint8_t *scanline = &image->pixels[static_cast<size_t>(cinfo->output_width) * 4 * cinfo->output_scanline];
+      jpeg_read_scanlines(cinfo, &scanline, 1);
+      converter.ConvertRow(scanline, cinfo->output_width);
+      if (analyzer)
+        analyzer->AddRow(scanline);
+    }
+  }
+
+  jpeg_finish_decompress(cinfo);
+
+  if (orientation > 1)
+  {
+    apply_orientation(image->pixels.data(), width, height, orientation);
+  }
+
+  // Determine final dimensions based on orientation
+  image->width = dimensions_swapped ? height : width;
+  image->height = dimensions_swapped ? width : height;
+  return true;
+}
+
+val to_image_data(const DecodedImage &image, const val &output = val::undefined())
+{
+  return jsquash::WriteImageData(image.pixels.data(), image.width, image.height, output);
+}
+
+// Writes into `output` instead of a new ImageData when it is set, see
+// jsquash::WriteImageData(). Returns the name of the limit as a string when
+// `limits` stop the decode. Converts from the embedded ICC profile as `color`
+// asks, see jsquash::ColorConverter. With `analyze`, returns {image, analysis},
+// see jsquash::ImageAnalyzer.
+val decode(std::string image_in, bool preserve_orientation, jsquash::DecodeResizeOptions resize,
+           jsquash::DecodeLimits limits, jsquash::ColorConversion color, bool analyze, val output)
 {
   const uint8_t *image_buffer = reinterpret_cast<const uint8_t *>(image_in.c_str());
 
   jpeg_decompress_struct cinfo;
-  jpeg_error_mgr jerr;
-  cinfo.err = jpeg_std_error(&jerr);
+  jsquash::JpegErrorManager jerr;
+  cinfo.err = jsquash::JpegStdError(&jerr);
+  DecodedImage image;
+  jsquash::DecodeBudget budget(limits);
+  BudgetProgress progress = {{poll_budget, 0, 0, 0, 0}, &budget};
+  if (setjmp(jerr.jump))
+  {
+    // Corrupt or unsupported data, or over budget. The module stays usable
+    // for the next call.
+    jpeg_destroy_decompress(&cinfo);
+    return budget.exceeded() ? budget.Abort() : val::null();
+  }
   jpeg_create_decompress(&cinfo);
+  cinfo.progress = &progress.pub;
 
   jpeg_mem_src(&cinfo, image_buffer, image_in.length());
   jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+  jpeg_save_markers(&cinfo, JPEG_APP0 + 2, 0xFFFF);
   jpeg_read_header(&cinfo, TRUE);
+  if (!check_header(cinfo, &budget))
+  {
+    jpeg_destroy_decompress(&cinfo);
+    return budget.Abort();
+  }
+
+  // Scoped so that the profile is freed before libjpeg can longjmp past it.
+  {
+    const std::vector<uint8_t> icc = extract_icc_profile(&cinfo);
+    if (!image.converter.Init(color, icc.data(), icc.size()))
+    {
+      jpeg_destroy_decompress(&cinfo);
+      return val::null();
+    }
+  }
 
   int orientation = preserve_orientation ? extract_orientation(&cinfo) : 1;
+  const bool ok = read_image(&cinfo, orientation, resize, analyze, &image);
+  jpeg_destroy_decompress(&cinfo);
+
+  if (!ok)
+  {
+    return val::null();
+  }
+  if (!budget.Check())
+  {
+    return budget.Abort();
+  }
+  val result = to_image_data(image, output);
+  return image.analyzer ? image.analyzer->Attach(result, orientation) : result;
+}
 
-  cinfo.out_color_space = JCS_EXT_RGBA;
-  jpeg_start_decompress(&cinfo);
+// Decodes an EXIF thumbnail whose longer side is at least `min_size`. A broken
+// thumbnail only means the caller decodes the main image instead, so it gets
+// its own error manager rather than failing the whole call. The thumbnail's
+// header is as untrusted as the main one, so it is checked against `budget`
+// too; the caller tells an exceeded budget from a broken thumbnail by it.
+bool read_thumbnail(const std::vector<uint8_t> &thumbnail, int orientation, int min_size,
+                    jsquash::DecodeBudget *budget, DecodedImage *image)
+{
+  jpeg_decompress_struct cinfo;
+  jsquash::JpegErrorManager jerr;
+  cinfo.err = jsquash::JpegStdError(&jerr);
+  BudgetProgress progress = {{poll_budget, 0, 0, 0, 0}, budget};
+  if (setjmp(jerr.jump))
+  {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  cinfo.progress = &progress.pub;
 
-  const int width = cinfo.output_width;
-  const int height = cinfo.output_height;
+  jpeg_mem_src(&cinfo, thumbnail.data(), thumbnail.size());
+  const bool ok = jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK &&
+                  static_cast<int>(std::max(cinfo.image_width, cinfo.image_height)) >= min_size &&
+                  check_header(cinfo, budget) &&
+                  read_image(&cinfo, orientation, NO_RESIZE, false, image);
+  jpeg_destroy_decompress(&cinfo);
+  return ok;
+}
 
-  // Determine final dimensions based on orientation
-  const int final_width = (orientation >= 5 && orientation <= 8) ? height : width;
-  const int final_height = (orientation >= 5 && orientation <= 8) ? width : height;
+// Largest DCT scale denominator libjpeg supports; decoding at 1/8 only runs
+// the DC coefficient of every block.
+constexpr int MAX_SCALE_DENOM = 8;
+
+// Returns the EXIF thumbnail of a JPEG without decoding the main image. Files
+// without one, or whose thumbnail has a longer side below `min_size`, are
+// decoded at the smallest DCT scale (1/2 to 1/8) whose longer side still
+// reaches `min_size`. The main image's orientation is applied either way, as
+// thumbnails carry no orientation of their own. `limits` apply to the main
+// image's header either way, and to whichever image is then decoded.
+val decodeThumbnail(std::string image_in, bool preserve_orientation, int min_size,
+                    jsquash::DecodeLimits limits)
+{
+  const uint8_t *image_buffer = reinterpret_cast<const uint8_t *>(image_in.c_str());
 
-  const size_t buffer_size = width * height * 4;
-  std::vector<uint8_t> buffer(buffer_size);
+  jpeg_decompress_struct cinfo;
+  jsquash::JpegErrorManager jerr;
+  cinfo.err = jsquash::JpegStdError(&jerr);
+  DecodedImage image;
+  std::vector<uint8_t> thumbnail;
+  jsquash::DecodeBudget budget(limits);
+  BudgetProgress progress = {{poll_budget, 0, 0, 0, 0}, &budget};
+  if (setjmp(jerr.jump))
+  {
+    jpeg_destroy_decompress(&cinfo);
+    return budget.exceeded() ? budget.Abort() : val::null();
+  }
+  jpeg_create_decompress(&cinfo);
+  cinfo.progress = &progress.pub;
 
-  while (cinfo.output_scanline < cinfo.output_height)
+  jpeg_mem_src(&cinfo, image_buffer, image_in.length());
+  jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+  jpeg_read_header(&cinfo, TRUE);
+  if (!check_header(cinfo, &budget))
   {
-    uint8_t *scanline = &buffer[cinfo.output_width * 4 * cinfo.output_scanline];
-    jpeg_read_scanlines(&cinfo, &scanline, 1);
+    jpeg_destroy_decompress(&cinfo);
+    return budget.Abort();
   }
 
-  jpeg_finish_decompress(&cinfo);
-  jpeg_destroy_decompress(&cinfo);
+  const int orientation = preserve_orientation ? extract_orientation(&cinfo) : 1;
+  thumbnail = extract_thumbnail(&cinfo);
 
-  if (orientation > 1)
+  if (!thumbnail.empty() && read_thumbnail(thumbnail, orientation, min_size, &budget, &image))
   {
-    apply_orientation(buffer.data(), width, height, orientation);
+    jpeg_destroy_decompress(&cinfo);
+    return budget.Check() ? to_image_data(image) : budget.Abort();
+  }
+  if (budget.exceeded())
+  {
+    jpeg_destroy_decompress(&cinfo);
+    return budget.Abort();
   }
 
-  auto data = Uint8ClampedArray.new_(typed_memory_view(buffer_size, buffer.data()));
-  auto result = ImageData.new_(data, final_width, final_height);
+  const int long_side = std::max(cinfo.image_width, cinfo.image_height);
+  int scale_denom = MAX_SCALE_DENOM;
+  while (scale_denom > 1 && (long_side + scale_denom - 1) / scale_denom < min_size)
+  {
+    scale_denom /= 2;
+  }
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = scale_denom;
+  const bool ok = read_image(&cinfo, orientation, NO_RESIZE, false, &image);
+  jpeg_destroy_decompress(&cinfo);
 
-  return result;
+  if (!ok)
+  {
+    return val::null();
+  }
+  return budget.Check() ? to_image_data(image) : budget.Abort();
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
-  function("decode", &decode);
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(mozjpeg_dec) {
+  jsquash::RegisterDecodeResizeOptions();
+  jsquash::RegisterDecodeLimits();
+  jsquash::RegisterColorConversion();
+  function(JSQUASH_EXPORT("decode"), &decode);
+  function(JSQUASH_EXPORT("decodeThumbnail"), &decodeThumbnail);
 }
@@ -1,5 +1,75 @@
+export interface DecodeResizeOptions {
+  width: number;
+  height: number;
+  fitMethod: 'stretch' | 'contain';
+  method: number;
+  premultiply: boolean;
+  linearRGB: boolean;
+}
+
+export interface DecodeLimits {
+  maxPixels: number;
+  maxFrames: number;
+  maxMemory: number;
+  timeLimit: number;
+}
+
+// What a decode stopped by its limits returns.
+export type DecodeLimit = keyof DecodeLimits;
+
+export interface ColorConversion {
+  convert: boolean;
+  // An ICC profile, or '' for sRGB.
+  targetProfile: Uint8Array | string;
+}
+
+export interface ImageAnalysis {
+  histogram: Uint32Array;
+  meanColor: { r: number; g: number; b: number; a: number };
+  dominantColor: { r: number; g: number; b: number };
+  perceptualHash: string;
+  thumbHash: Uint8Array;
+}
+
+export interface DecodeOutput {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+}
+
 export interface MozJPEGModule extends EmscriptenWasm.Module {
-  decode(data: BufferSource, preserveOrientation: boolean): ImageData | null;
+  decode(
+    data: BufferSource,
+    preserveOrientation: boolean,
+    resize: DecodeResizeOptions,
+    limits: DecodeLimits,
+    color: ColorConversion,
+    analyze: false,
+    output: undefined,
+  ): ImageData | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    preserveOrientation: boolean,
+    resize: DecodeResizeOptions,
+    limits: DecodeLimits,
+    color: ColorConversion,
+    analyze: true,
+    output: undefined,
+  ): { image: ImageData; analysis: ImageAnalysis } | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    preserveOrientation: boolean,
+    resize: DecodeResizeOptions,
+    limits: DecodeLimits,
+    color: ColorConversion,
+    analyze: false,
+    output: DecodeOutput,
+  ): { width: number; height: number } | DecodeLimit | null;
+  decodeThumbnail(
+    data: BufferSource,
+    preserveOrientation: boolean,
+    minSize: number,
+    limits: DecodeLimits,
+  ): ImageData | DecodeLimit | null;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<MozJPEGModule>;
@@ -12,8 +12,14 @@ extern "C" {
 #include "cdjpeg.h"
 }
 
+#include "embind_export.h"
+#include "image_size.h"
+#include "jpeg_error.h"
+
 using namespace emscripten;
 
+namespace {
+
 // MozJPEG doesn’t expose a numeric version, so I have to do some fun C macro
 // hackery to turn it into a string. More details here:
 // https://gcc.gnu.org/onlinedocs/cpp/Stringizing.html
@@ -57,9 +63,32 @@ int version() {
 
 thread_local const val Uint8Array = val::global("Uint8Array");
 
-val encode(std::string image_in, int image_width, int image_height, MozJpegOptions opts) {
+// `stride` is the distance between the starts of two rows of `image_in` in
+// bytes, so it can hold a crop of a larger image.
+val encode(std::string image_in,
+           int image_width,
+           int image_height,
+           uint32_t stride,
+           MozJpegOptions opts) {
   uint8_t* image_buffer = (uint8_t*)image_in.c_str();
 
+  size_t image_size;
+  if (image_width <= 0 || image_height <= 0 ||
+      !jsquash::ComputeStridedSize(image_height, static_cast<size_t>(image_width) * 4, stride,
+                                   &image_size) ||
+      image_in.size() < image_size) {
+    return val::null();
+  }
+
+  // A little hacky to build a string for this, but it means we can use
+  // set_quality_ratings which does some useful heuristic stuff. Built before
+  // setjmp() below, as a longjmp back to it would not free the string.
+  std::string quality_str = std::to_string(opts.quality);
+
+  if (opts.separate_chroma_quality && opts.color_space == JCS_YCbCr) {
+    quality_str += "," + std::to_string(opts.chroma_quality);
+  }
+
   // The code below is basically the `write_JPEG_file` function from
   // https://github.com/mozilla/mozjpeg/blob/master/example.c
   // I just write to memory instead of a file.
@@ -75,19 +104,31 @@ val encode(std::string image_in, int image_width, int image_height, MozJpegOptio
   jpeg_compress_struct cinfo;
   /* This struct represents a JPEG error handler.  It is declared separately
    * because applications often want to supply a specialized error handler
-   * (see the second half of this file for an example).  But here we just
-   * take the easy way out and use the standard error handler, which will
-   * print a message on stderr and call exit() if compression fails.
+   * (see the second half of this file for an example).  We use one that
+   * prints a message on stderr and jumps back here if compression fails,
+   * rather than the standard one, which calls exit().
    * Note that this struct must live as long as the main JPEG parameter
    * struct, to avoid dangling-pointer problems.
    */
-  jpeg_error_mgr jerr;
+  jsquash::JpegErrorManager jerr;
   /* We have to set up the error handler first, in case the initialization
    * step fails.  (Unlikely, but it could happen if you are out of memory.)
    * This routine fills in the contents of struct jerr, and returns jerr's
    * address which we place into the link field in cinfo.
    */
-  cinfo.err = jpeg_std_error(&jerr);
+  cinfo.err = jsquash::JpegStdError(&jerr);
+  uint8_t* output = nullptr;
+  unsigned long size = 0;
+  /* Establish the setjmp return context for JpegErrorExit to use. */
+  if (setjmp(jerr.jump)) {
+    /* If we get here, the JPEG code has signaled an error, for example
+     * because of unsupported options. Clean up and return an error instead
+     * of exiting, so the module can be used again.
+     */
+    jpeg_destroy_compress(&cinfo);
+    free(output);
+    return val::null();
+  }
   /* Now we can initialize the JPEG compression object. */
   jpeg_create_compress(&cinfo);
 
@@ -103,8 +144,6 @@ val encode(std::string image_in, int image_width, int image_height, MozJpegOptio
   //   fprintf(stderr, "can't open %s\n", filename);
   //   exit(1);
   // }
-  uint8_t* output = nullptr;
-  unsigned long size = 0;
   jpeg_mem_dest(&cinfo, &output, &size);
 
   /* Step 3: set parameters for compression */
@@ -143,14 +182,6 @@ val encode(std::string image_in, int image_width, int image_height, MozJpegOptio
   jpeg_c_set_int_param(&cinfo, JINT_TRELLIS_NUM_LOOPS, opts.trellis_loops);
   jpeg_c_set_int_param(&cinfo, JINT_DC_SCAN_OPT_MODE, 0);
 
-  // A little hacky to build a string for this, but it means we can use
-  // set_quality_ratings which does some useful heuristic stuff.
-  std::string quality_str = std::to_string(opts.quality);
-
-  if (opts.separate_chroma_quality && opts.color_space == JCS_YCbCr) {
-    quality_str += "," + std::to_string(opts.chroma_quality);
-  }
-
   char const* pqual = quality_str.c_str();
 
   set_quality_ratings(&cinfo, (char*)pqual, opts.baseline);
@@ -186,7 +217,7 @@ val encode(std::string image_in, int image_width, int image_height, MozJpegOptio
    * To keep things simple, we pass one scanline per call; you can pass
    * more if you wish, though.
    */
-  int row_stride = image_width * 4; /* JSAMPLEs per row in image_buffer */
+  size_t row_stride = stride; /* JSAMPLEs per row in image_buffer */
 
   while (cinfo.next_scanline < cinfo.image_height) {
     /* jpeg_write_scanlines expects an array of pointers to scanlines.
@@ -215,7 +246,9 @@ val encode(std::string image_in, int image_width, int image_height, MozJpegOptio
   return js_result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(mozjpeg_enc) {
   value_object<MozJpegOptions>("MozJpegOptions")
       .field("quality", &MozJpegOptions::quality)
       .field("baseline", &MozJpegOptions::baseline)
@@ -234,6 +267,6 @@ EMSCRIPTEN_BINDINGS(my_module) {
       .field("separate_chroma_quality", &MozJpegOptions::separate_chroma_quality)
       .field("chroma_quality", &MozJpegOptions::chroma_quality);
 
-  function("version", &version);
-  function("encode", &encode);
+  function(JSQUASH_EXPORT("version"), &version);
+  function(JSQUASH_EXPORT("encode"), &encode);
 }
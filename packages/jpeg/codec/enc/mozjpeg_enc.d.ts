@@ -28,8 +28,9 @@ export interface MozJPEGModule extends EmscriptenWasm.Module {
     data: BufferSource,
     width: number,
     height: number,
+    stride: number,
     options: EncodeOptions,
-  ): Uint8Array;
+  ): Uint8Array | null;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<MozJPEGModule>;
@@ -16,36 +16,96 @@
  * and modified it to decode JPEG images.
  */
 
-import type { MozJPEGModule } from './codec/dec/mozjpeg_dec.js';
-import { initEmscriptenModule } from './utils.js';
+import type {
+  ColorConversion,
+  DecodeResizeOptions,
+  MozJPEGModule,
+} from './codec/dec/mozjpeg_dec.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 
 import mozjpeg_dec from './codec/dec/mozjpeg_dec.js';
-import { DecodeOptions, defaultDecodeOptions } from './meta.js';
+import {
+  DecodeOptions,
+  DecodeTarget,
+  DecodeThumbnailOptions,
+  ImageAnalysis,
+  defaultDecodeOptions,
+  defaultDecodeThumbnailOptions,
+} from './meta.js';
 
 let emscriptenModule: Promise<MozJPEGModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: MozJPEGModule) => Promise<MozJPEGModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<MozJPEGModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
+
+/** Resize methods by index, as in @jsquash/resize */
+const resizeMethods: DecodeOptions['method'][] = [
+  'triangle',
+  'catrom',
+  'mitchell',
+  'lanczos3',
+];
+
+function getResizeOptions(options: DecodeOptions): DecodeResizeOptions {
+  return {
+    width: options.width ?? 0,
+    height: options.height ?? 0,
+    fitMethod: options.fitMethod,
+    method: resizeMethods.indexOf(options.method),
+    premultiply: options.premultiply,
+    linearRGB: options.linearRGB,
+  };
+}
+
+function getColorConversion(
+  options: Pick<DecodeOptions, 'ignoreColorProfile' | 'targetColorProfile'>,
+): ColorConversion {
+  return {
+    convert: !options.ignoreColorProfile,
+    targetProfile: options.targetColorProfile ?? '',
+  };
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  emscriptenModule = initEmscriptenModule(
-    mozjpeg_dec,
-    actualModule,
-    actualOptions,
-  );
+  const load = () =>
+    initEmscriptenModule(mozjpeg_dec, actualModule, emscriptenOptions);
+  // Assigned synchronously so a decode() straight after init() reuses it.
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
 }
 
 export default async function decode(
@@ -56,7 +116,100 @@ export default async function decode(
 
   const _options = { ...defaultDecodeOptions, ...options };
   const module = await emscriptenModule;
-  const result = module.decode(buffer, _options.preserveOrientation);
+  const result = module.decode(
+    buffer,
+    _options.preserveOrientation,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getColorConversion(_options),
+    false,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes like `decode`, and also returns statistics gathered from the
+ * decoded rows while they are still in cache: the histogram, the mean and
+ * dominant colour, a perceptual hash and a ThumbHash placeholder. This saves
+ * walking the whole image again in JS.
+ */
+export async function decodeAndAnalyze(
+  buffer: ArrayBuffer,
+  options: Partial<DecodeOptions> = {},
+): Promise<{ image: ImageData; analysis: ImageAnalysis }> {
+  if (!emscriptenModule) init();
+
+  const _options = { ...defaultDecodeOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    _options.preserveOrientation,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getColorConversion(_options),
+    true,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes straight into a region of a larger buffer, such as a tile of an
+ * atlas, instead of a new ImageData. Resolves to the size of the decoded
+ * image, which must fit in the region.
+ */
+export async function decodeInto(
+  buffer: ArrayBuffer,
+  target: DecodeTarget,
+  options: Partial<DecodeOptions> = {},
+): Promise<{ width: number; height: number }> {
+  if (!emscriptenModule) init();
+
+  const _options = { ...defaultDecodeOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    _options.preserveOrientation,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getColorConversion(_options),
+    false,
+    { data: target.data.subarray(target.offset ?? 0), stride: target.stride },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes the thumbnail embedded in the EXIF data of camera JPEGs, without
+ * decoding the full image. Falls back to a DCT scaled decode of the full
+ * image when there is no usable thumbnail.
+ */
+export async function decodeThumbnail(
+  buffer: ArrayBuffer,
+  options: Partial<DecodeThumbnailOptions> = {},
+): Promise<ImageData> {
+  if (!emscriptenModule) init();
+
+  const _options = { ...defaultDecodeThumbnailOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decodeThumbnail(
+    buffer,
+    _options.preserveOrientation,
+    _options.minSize,
+    getDecodeLimits(_options.limits),
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
   return result;
 }
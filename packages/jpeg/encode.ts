@@ -16,53 +16,77 @@
  * Updated to support a partial subset of Jpeg encoding options to be provided.
  * The jpeg options are defaulted to defaults from the meta.ts file.
  */
-import type { EncodeOptions } from './meta.js';
+import type { EncodeOptions, ImageDataView } from './meta.js';
 import type { MozJPEGModule } from './codec/enc/mozjpeg_enc.js';
 
 import mozjpeg_enc from './codec/enc/mozjpeg_enc.js';
 import { defaultOptions } from './meta.js';
-import { initEmscriptenModule } from './utils.js';
+import {
+  getImageRows,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 
 let emscriptenModule: Promise<MozJPEGModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: MozJPEGModule) => Promise<MozJPEGModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<MozJPEGModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  emscriptenModule = initEmscriptenModule(
-    mozjpeg_enc,
-    actualModule,
-    actualOptions,
-  );
+  const load = () =>
+    initEmscriptenModule(mozjpeg_enc, actualModule, emscriptenOptions);
+  // Assigned synchronously so an encode() straight after init() reuses it.
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
 }
 
 export default async function encode(
-  data: ImageData,
+  data: ImageData | ImageDataView,
   options: Partial<EncodeOptions> = {},
 ): Promise<ArrayBuffer> {
   if (!emscriptenModule) init();
 
   const module = await emscriptenModule;
   const _options = { ...defaultOptions, ...options };
+  const { rows, stride } = getImageRows(data);
   const resultView = module.encode(
-    data.data,
+    rows,
     data.width,
     data.height,
+    stride,
     _options,
   );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (!resultView) throw new Error('Encoding error.');
   // wasm can't run on SharedArrayBuffers, so we hard-cast to ArrayBuffer.
   return resultView.buffer as ArrayBuffer;
 }
@@ -13,8 +13,94 @@
 import { EncodeOptions, MozJpegColorSpace } from './codec/enc/mozjpeg_enc.js';
 export { EncodeOptions, MozJpegColorSpace };
 
+export type ResizeMethod = 'triangle' | 'catrom' | 'mitchell' | 'lanczos3';
+
+export type DecodeResizeOptions = {
+  // Output size. Set only one of them to keep the aspect ratio.
+  width?: number;
+  height?: number;
+  method: ResizeMethod;
+  fitMethod: 'stretch' | 'contain';
+  premultiply: boolean;
+  linearRGB: boolean;
+};
+
 export type DecodeOptions = {
   preserveOrientation: boolean;
+  limits?: DecodeLimits;
+  // Keep the samples as stored instead of converting them from the image's
+  // colour profile to sRGB.
+  ignoreColorProfile?: boolean;
+  // ICC profile to convert to instead of sRGB, such as the display's.
+  targetColorProfile?: Uint8Array;
+} & DecodeResizeOptions;
+
+export type DecodeThumbnailOptions = {
+  preserveOrientation: boolean;
+  // Smallest longer side to accept. Smaller embedded thumbnails are skipped
+  // and the fallback decode uses a DCT scale that still reaches it.
+  minSize: number;
+  limits?: DecodeLimits;
+};
+
+/**
+ * RGBA pixels stored as a region of a larger buffer, such as a crop of a
+ * canvas. `offset` is the index in `data` of the region's first sample and
+ * `stride` the number of samples between the starts of two rows. They default
+ * to `0` and `width * 4`, so an `ImageData` is a valid `ImageDataView`.
+ */
+export type ImageDataView = {
+  data: Uint8ClampedArray;
+  width: number;
+  height: number;
+  stride?: number;
+  offset?: number;
+};
+
+/**
+ * Limits on what one decode may cost, for untrusted input. Each is checked
+ * against the header before any pixels are decoded, then again as the decode
+ * runs, and a decode over one rejects with a `DecodeLimitError` naming it.
+ * Unset or 0 means no limit.
+ */
+export type DecodeLimits = {
+  // Largest width * height of the image.
+  maxPixels?: number;
+  // Most frames an animation or image sequence may declare.
+  maxFrames?: number;
+  // Most bytes the decode may have allocated at once.
+  maxMemory?: number;
+  // Milliseconds the decode may take.
+  timeLimit?: number;
+};
+
+/**
+ * Statistics of the decoded image that `decodeAndAnalyze()` gathers from its
+ * rows as they are decoded, before any resize.
+ */
+export type ImageAnalysis = {
+  // 1024 bins: 256 each for R, G, B and A.
+  histogram: Uint32Array;
+  // Alpha weighted mean colour, and the mean alpha.
+  meanColor: { r: number; g: number; b: number; a: number };
+  // Most common colour of the mostly opaque pixels.
+  dominantColor: { r: number; g: number; b: number };
+  // 64-bit DCT hash as 16 hex digits. Similar images differ in few bits.
+  perceptualHash: string;
+  // ThumbHash placeholder, see https://github.com/evanw/thumbhash.
+  thumbHash: Uint8Array;
+};
+
+/**
+ * Where `decodeInto()` writes the decoded pixels: a region of a larger RGBA
+ * buffer, such as a tile of an atlas. The region is as large as the decoded
+ * (and resized) image; `offset` is the index of its first sample and `stride`
+ * the number of samples between the starts of two rows.
+ */
+export type DecodeTarget = {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+  offset?: number;
 };
 
 export const label = 'MozJPEG';
@@ -41,6 +127,20 @@ export const defaultOptions: EncodeOptions = {
 
 export const defaultEncodeOptions = defaultOptions;
 
+// Same defaults as @jsquash/resize.
+export const defaultDecodeResizeOptions: DecodeResizeOptions = {
+  method: 'lanczos3',
+  fitMethod: 'stretch',
+  premultiply: true,
+  linearRGB: true,
+};
+
 export const defaultDecodeOptions: DecodeOptions = {
   preserveOrientation: false,
+  ...defaultDecodeResizeOptions,
+};
+
+export const defaultDecodeThumbnailOptions: DecodeThumbnailOptions = {
+  preserveOrientation: true,
+  minSize: 0,
 };
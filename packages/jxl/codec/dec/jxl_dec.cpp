@@ -6,8 +6,19 @@
 
 #include "skcms.h"
 
+#include "decode_limits.h"
+#include "decode_resize.h"
+#include "embind_export.h"
+#include "image_analysis.h"
+#include "image_size.h"
+#include "image_view.h"
+#include "premultiply.h"
+#include "tone_map.h"
+
 using namespace emscripten;
 
+namespace {
+
 thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
 thread_local const val Uint8Array = val::global("Uint8Array");
 thread_local const val Uint16Array = val::global("Uint16Array");
@@ -22,11 +33,15 @@ thread_local const val Object = val::global("Object");
 #define JXL_DEBUG_ON_ALL_ERROR 0
 #endif
 
+// Every decode function has a DecodeBudget named `budget`. A libjxl call that
+// failed because the budget stopped it returns the limit instead of null.
+#define FAIL_DECODE() return budget.exceeded() ? budget.Abort() : val::null()
+
 #if JXL_DEBUG_ON_ALL_ERROR
 #define EXPECT_TRUE(a)                                             \
   if (!(a)) {                                                      \
     fprintf(stderr, "Assertion failure (%d): %s\n", __LINE__, #a); \
-    return val::null();                                            \
+    FAIL_DECODE();                                                 \
   }
 #define EXPECT_EQ(a, b)                                                                          \
   {                                                                                              \
@@ -34,26 +49,144 @@ thread_local const val Object = val::global("Object");
     int b_ = b;                                                                                  \
     if (a_ != b_) {                                                                              \
       fprintf(stderr, "Assertion failure (%d): %s (%d) != %s (%d)\n", __LINE__, #a, a_, #b, b_); \
-      return val::null();                                                                        \
+      FAIL_DECODE();                                                                             \
     }                                                                                            \
   }
 #else
-#define EXPECT_TRUE(a)  \
-  if (!(a)) {           \
-    return val::null(); \
+#define EXPECT_TRUE(a) \
+  if (!(a)) {          \
+    FAIL_DECODE();     \
   }
 
 #define EXPECT_EQ(a, b) EXPECT_TRUE((a) == (b));
 #endif
 
+// libjxl runs every parallel stage of a decode through the parallel runner,
+// and fails the decode when the runner returns an error. Running the jobs
+// inline from here therefore polls the budget once per group.
+JxlParallelRetCode RunWithBudget(void* runner_opaque, void* jpegxl_opaque,
+                                 JxlParallelRunInit init, JxlParallelRunFunction func,
+                                 uint32_t start_range, uint32_t end_range) {
+  auto* budget = static_cast<jsquash::DecodeBudget*>(runner_opaque);
+  const JxlParallelRetCode init_result = init(jpegxl_opaque, 1);
+  if (init_result != 0) {
+    return init_result;
+  }
+  for (uint32_t i = start_range; i < end_range; ++i) {
+    if (!budget->Poll()) {
+      return -1;
+    }
+    func(jpegxl_opaque, i, 0);
+  }
+  return 0;
+}
+
+// Upper bound of the bytes a decode of a `width` x `height` frame allocates:
+// libjxl's own float planes, the RGBA float buffer it writes out, and
+// `output_bytes_per_pixel` for the wrapper's converted copy.
+double DecodedBytes(uint32_t width, uint32_t height, int output_bytes_per_pixel) {
+  const double pixels = static_cast<double>(width) * height;
+  return pixels * (3 * sizeof(float) + COMPONENTS_PER_PIXEL * sizeof(float) +
+                   output_bytes_per_pixel);
+}
+
+// The matrix from linear RGB in the primaries of `encoding` to XYZ D50.
+bool EncodingToXYZD50(const JxlColorEncoding& encoding, skcms_Matrix3x3* to_xyzd50) {
+  float white[2];
+  switch (encoding.white_point) {
+    case JXL_WHITE_POINT_D65:
+      white[0] = 0.3127f, white[1] = 0.3290f;
+      break;
+    case JXL_WHITE_POINT_DCI:
+      white[0] = 0.314f, white[1] = 0.351f;
+      break;
+    case JXL_WHITE_POINT_E:
+      white[0] = white[1] = 1.0f / 3;
+      break;
+    default:
+      white[0] = encoding.white_point_xy[0], white[1] = encoding.white_point_xy[1];
+      break;
+  }
+  static constexpr float kSrgb[6] = {0.64f, 0.33f, 0.30f, 0.60f, 0.15f, 0.06f};
+  static constexpr float k2100[6] = {0.708f, 0.292f, 0.170f, 0.797f, 0.131f, 0.046f};
+  static constexpr float kP3[6] = {0.680f, 0.320f, 0.265f, 0.690f, 0.150f, 0.060f};
+  float rgb[6];
+  switch (encoding.primaries) {
+    case JXL_PRIMARIES_SRGB:
+      std::copy_n(kSrgb, 6, rgb);
+      break;
+    case JXL_PRIMARIES_2100:
+      std::copy_n(k2100, 6, rgb);
+      break;
+    case JXL_PRIMARIES_P3:
+      std::copy_n(kP3, 6, rgb);
+      break;
+    default:
+      for (int i = 0; i < 2; i++) {
+        rgb[i] = encoding.primaries_red_xy[i];
+        rgb[2 + i] = encoding.primaries_green_xy[i];
+        rgb[4 + i] = encoding.primaries_blue_xy[i];
+      }
+      break;
+  }
+  return skcms_PrimariesToXYZD50(rgb[0], rgb[1], rgb[2], rgb[3], rgb[4], rgb[5], white[0],
+                                 white[1], to_xyzd50);
+}
+
+// Sets up `tone_mapper` for PQ and HLG images, and for linear ones brighter
+// than SDR, leaving it inactive for everything else and for images described
+// by an ICC profile only. libjxl's intensity target is the peak of PQ images
+// and the luminance of 1.0 in linear ones.
+void InitToneMapper(JxlDecoder* dec, const JxlPixelFormat& format, const JxlBasicInfo& info,
+                    const jsquash::ToneMapping& tone_mapping, jsquash::ToneMapper* tone_mapper) {
+  JxlColorEncoding encoding;
+  if (!tone_mapping.enabled ||
+      JxlDecoderGetColorAsEncodedProfile(dec, &format, JXL_COLOR_PROFILE_TARGET_DATA,
+                                         &encoding) != JXL_DEC_SUCCESS ||
+      encoding.color_space != JXL_COLOR_SPACE_RGB) {
+    return;
+  }
+  jsquash::HdrTransfer transfer;
+  if (encoding.transfer_function == JXL_TRANSFER_FUNCTION_PQ) {
+    transfer = jsquash::HdrTransfer::kPQ;
+  } else if (encoding.transfer_function == JXL_TRANSFER_FUNCTION_HLG) {
+    transfer = jsquash::HdrTransfer::kHLG;
+  } else if (encoding.transfer_function == JXL_TRANSFER_FUNCTION_LINEAR &&
+             info.intensity_target > 255) {
+    transfer = jsquash::HdrTransfer::kLinear;
+  } else {
+    return;
+  }
+  skcms_Matrix3x3 to_xyzd50;
+  if (EncodingToXYZD50(encoding, &to_xyzd50)) {
+    // Always converts to sRGB, like the rest of decode().
+    tone_mapper->Init(transfer, to_xyzd50, info.intensity_target, 0, tone_mapping, {true, ""});
+  }
+}
+
 /**
  * Original decode function - returns 8-bit ImageData for backward compatibility.
- * This converts all images to 8-bit sRGB RGBA.
+ * This converts all images to 8-bit sRGB RGBA, optionally resized. Rows are
+ * converted one at a time and handed to the resizer, so no full size 8-bit
+ * frame is allocated. Writes into `output` instead of a new ImageData when it
+ * is set, see jsquash::WriteImageData(). With `analyze`, every converted row
+ * also goes through a jsquash::ImageAnalyzer and {image, analysis} is
+ * returned. With `toneMapping` enabled, PQ, HLG and linear HDR rows are tone
+ * mapped to SDR as they are converted, see jsquash::ToneMapper. With
+ * `premultiplied`, returns colour premultiplied by alpha.
  */
-val decode(std::string data) {
+val decode(std::string data,
+           jsquash::DecodeResizeOptions resize,
+           jsquash::DecodeLimits limits,
+           jsquash::ToneMapping toneMapping,
+           bool premultiplied,
+           bool analyze,
+           val output) {
   std::unique_ptr<JxlDecoder,
                   std::integral_constant<decltype(&JxlDecoderDestroy), JxlDecoderDestroy>>
       dec(JxlDecoderCreate(nullptr));
+  jsquash::DecodeBudget budget(limits);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetParallelRunner(dec.get(), RunWithBudget, &budget));
   EXPECT_EQ(JXL_DEC_SUCCESS,
             JxlDecoderSubscribeEvents(
                 dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING | JXL_DEC_FULL_IMAGE));
@@ -64,8 +197,14 @@ val decode(std::string data) {
   EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec.get()));
   JxlBasicInfo info;
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec.get(), &info));
-  size_t pixel_count = info.xsize * info.ysize;
-  size_t component_count = pixel_count * COMPONENTS_PER_PIXEL;
+  // Animations stop at the first frame, so there is only ever one.
+  if (!budget.CheckImage(info.xsize, info.ysize, 1, DecodedBytes(info.xsize, info.ysize, 4))) {
+    return budget.Abort();
+  }
+  size_t float_size;
+  EXPECT_TRUE(jsquash::ComputeImageSize(info.xsize, info.ysize, COMPONENTS_PER_PIXEL,
+                                        sizeof(float), &float_size));
+  size_t component_count = float_size / sizeof(float);
 
   EXPECT_EQ(JXL_DEC_COLOR_ENCODING, JxlDecoderProcessInput(dec.get()));
   static const JxlPixelFormat format = {COMPONENTS_PER_PIXEL, JXL_TYPE_FLOAT, JXL_LITTLE_ENDIAN, 0};
@@ -76,30 +215,69 @@ val decode(std::string data) {
   EXPECT_EQ(JXL_DEC_SUCCESS,
             JxlDecoderGetColorAsICCProfile(dec.get(), &format, JXL_COLOR_PROFILE_TARGET_DATA,
                                            icc_profile.data(), icc_profile.size()));
+  jsquash::ToneMapper tone_mapper;
+  InitToneMapper(dec.get(), format, info, toneMapping, &tone_mapper);
 
   EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
   size_t buffer_size;
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderImageOutBufferSize(dec.get(), &format, &buffer_size));
-  EXPECT_EQ(buffer_size, component_count * sizeof(float));
+  EXPECT_EQ(buffer_size, float_size);
 
   auto float_pixels = std::make_unique<float[]>(component_count);
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(dec.get(), &format, float_pixels.get(),
-                                                         component_count * sizeof(float)));
+                                                         float_size));
   EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
-
-  auto byte_pixels = std::make_unique<uint8_t[]>(component_count);
+  EXPECT_TRUE(budget.Check());
+
+  jsquash::DecodeResizer resizer(info.xsize, info.ysize, resize);
+  EXPECT_TRUE(resizer.valid());
+  size_t byte_size;
+  EXPECT_TRUE(jsquash::ComputeRGBA8Size(resizer.width(), resizer.height(), &byte_size));
+  auto byte_pixels = std::make_unique<uint8_t[]>(byte_size);
+  auto byte_row = std::make_unique<uint8_t[]>(static_cast<size_t>(info.xsize) * COMPONENTS_PER_PIXEL);
+  const size_t float_stride = static_cast<size_t>(info.xsize) * COMPONENTS_PER_PIXEL;
   // Convert to sRGB.
   skcms_ICCProfile jxl_profile;
   EXPECT_TRUE(skcms_Parse(icc_profile.data(), icc_profile.size(), &jxl_profile));
-  EXPECT_TRUE(skcms_Transform(
-      float_pixels.get(), skcms_PixelFormat_RGBA_ffff,
-      info.alpha_premultiplied ? skcms_AlphaFormat_PremulAsEncoded : skcms_AlphaFormat_Unpremul,
-      &jxl_profile, byte_pixels.get(), skcms_PixelFormat_RGBA_8888, skcms_AlphaFormat_Unpremul,
-      skcms_sRGB_profile(), pixel_count));
+  std::unique_ptr<jsquash::ImageAnalyzer> analyzer;
+  if (analyze) {
+    analyzer = std::make_unique<jsquash::ImageAnalyzer>(info.xsize, info.ysize);
+  }
+  // skcms premultiplies as it converts, unless the row is read straight by
+  // the analyzer or the resizer first. Resized images are premultiplied at
+  // their smaller size.
+  premultiplied = premultiplied && info.alpha_bits > 0;
+  const bool premultiply_rows = premultiplied && !resizer.active();
+  const bool premultiply_in_skcms = premultiply_rows && !analyzer && !tone_mapper.active();
+  for (uint32_t y = 0; y < info.ysize; y++) {
+    if (tone_mapper.active()) {
+      tone_mapper.MapRow(float_pixels.get() + y * float_stride, info.xsize,
+                         info.alpha_premultiplied, byte_row.get());
+    } else {
+      EXPECT_TRUE(skcms_Transform(
+          float_pixels.get() + y * float_stride, skcms_PixelFormat_RGBA_ffff,
+          info.alpha_premultiplied ? skcms_AlphaFormat_PremulAsEncoded : skcms_AlphaFormat_Unpremul,
+          &jxl_profile, byte_row.get(), skcms_PixelFormat_RGBA_8888,
+          premultiply_in_skcms ? skcms_AlphaFormat_PremulAsEncoded : skcms_AlphaFormat_Unpremul,
+          skcms_sRGB_profile(), info.xsize));
+    }
+    if (analyzer) {
+      analyzer->AddRow(byte_row.get());
+    }
+    if (premultiply_rows && !premultiply_in_skcms) {
+      jsquash::PremultiplyRows(byte_row.get(), 0, info.xsize, 1);
+    }
+    resizer.PushRow(byte_row.get(), byte_pixels.get());
+    EXPECT_TRUE(budget.Poll());
+  }
+  if (premultiplied && resizer.active()) {
+    jsquash::PremultiplyRows(byte_pixels.get(), static_cast<size_t>(resizer.width()) * 4,
+                             resizer.width(), resizer.height());
+  }
 
-  return ImageData.new_(
-      Uint8ClampedArray.new_(typed_memory_view(component_count, byte_pixels.get())), info.xsize,
-      info.ysize);
+  val result =
+      jsquash::WriteImageData(byte_pixels.get(), resizer.width(), resizer.height(), output);
+  return analyzer ? analyzer->Attach(result) : result;
 }
 
 /**
@@ -117,10 +295,12 @@ val decode(std::string data) {
  * For 8-bit images, still converts to sRGB for compatibility.
  * For high bit depth, returns the native pixel values in the original color space.
  */
-val decodeHighBitDepth(std::string data) {
+val decodeHighBitDepth(std::string data, jsquash::DecodeLimits limits) {
   std::unique_ptr<JxlDecoder,
                   std::integral_constant<decltype(&JxlDecoderDestroy), JxlDecoderDestroy>>
       dec(JxlDecoderCreate(nullptr));
+  jsquash::DecodeBudget budget(limits);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetParallelRunner(dec.get(), RunWithBudget, &budget));
   EXPECT_EQ(JXL_DEC_SUCCESS,
             JxlDecoderSubscribeEvents(
                 dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING | JXL_DEC_FULL_IMAGE));
@@ -131,9 +311,15 @@ val decodeHighBitDepth(std::string data) {
   EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec.get()));
   JxlBasicInfo info;
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec.get(), &info));
+  if (!budget.CheckImage(info.xsize, info.ysize, 1, DecodedBytes(info.xsize, info.ysize, 8))) {
+    return budget.Abort();
+  }
   
-  size_t pixel_count = info.xsize * info.ysize;
-  size_t component_count = pixel_count * COMPONENTS_PER_PIXEL;
+  size_t float_size;
+  EXPECT_TRUE(jsquash::ComputeImageSize(info.xsize, info.ysize, COMPONENTS_PER_PIXEL,
+                                        sizeof(float), &float_size));
+  size_t component_count = float_size / sizeof(float);
+  size_t pixel_count = component_count / COMPONENTS_PER_PIXEL;
   uint32_t bits_per_sample = info.bits_per_sample;
   uint32_t exponent_bits = info.exponent_bits_per_sample;
 
@@ -170,12 +356,13 @@ val decodeHighBitDepth(std::string data) {
   EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
   size_t buffer_size;
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderImageOutBufferSize(dec.get(), &float_format, &buffer_size));
-  EXPECT_EQ(buffer_size, component_count * sizeof(float));
+  EXPECT_EQ(buffer_size, float_size);
 
   auto float_pixels = std::make_unique<float[]>(component_count);
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(dec.get(), &float_format, float_pixels.get(),
-                                                         component_count * sizeof(float)));
+                                                         float_size));
   EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+  EXPECT_TRUE(budget.Check());
 
   // Determine color space string from ICC profile
   // Note: skcms in this version doesn't expose transfer function detection
@@ -267,10 +454,12 @@ val decodeHighBitDepth(std::string data) {
  *   - colorSpace: string
  *   - iccProfile: Uint8Array
  */
-val decodeLinearFloat(std::string data) {
+val decodeLinearFloat(std::string data, jsquash::DecodeLimits limits) {
   std::unique_ptr<JxlDecoder,
                   std::integral_constant<decltype(&JxlDecoderDestroy), JxlDecoderDestroy>>
       dec(JxlDecoderCreate(nullptr));
+  jsquash::DecodeBudget budget(limits);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetParallelRunner(dec.get(), RunWithBudget, &budget));
   EXPECT_EQ(JXL_DEC_SUCCESS,
             JxlDecoderSubscribeEvents(
                 dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING | JXL_DEC_FULL_IMAGE));
@@ -281,9 +470,14 @@ val decodeLinearFloat(std::string data) {
   EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec.get()));
   JxlBasicInfo info;
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec.get(), &info));
+  if (!budget.CheckImage(info.xsize, info.ysize, 1, DecodedBytes(info.xsize, info.ysize, 0))) {
+    return budget.Abort();
+  }
   
-  size_t pixel_count = info.xsize * info.ysize;
-  size_t component_count = pixel_count * COMPONENTS_PER_PIXEL;
+  size_t float_size;
+  EXPECT_TRUE(jsquash::ComputeImageSize(info.xsize, info.ysize, COMPONENTS_PER_PIXEL,
+                                        sizeof(float), &float_size));
+  size_t component_count = float_size / sizeof(float);
 
   EXPECT_EQ(JXL_DEC_COLOR_ENCODING, JxlDecoderProcessInput(dec.get()));
   
@@ -302,12 +496,13 @@ val decodeLinearFloat(std::string data) {
   EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
   size_t buffer_size;
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderImageOutBufferSize(dec.get(), &float_format, &buffer_size));
-  EXPECT_EQ(buffer_size, component_count * sizeof(float));
+  EXPECT_EQ(buffer_size, float_size);
 
   auto float_pixels = std::make_unique<float[]>(component_count);
   EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(dec.get(), &float_format, float_pixels.get(),
-                                                         component_count * sizeof(float)));
+                                                         float_size));
   EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+  EXPECT_TRUE(budget.Check());
 
   // Build result object
   val result = Object.new_();
@@ -339,8 +534,84 @@ val decodeLinearFloat(std::string data) {
   return result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
-  function("decode", &decode);
-  function("decodeHighBitDepth", &decodeHighBitDepth);
-  function("decodeLinearFloat", &decodeLinearFloat);
+/**
+ * Decodes only the preview frame, as 8-bit sRGB RGBA. The decoder stops
+ * right after it, so none of the main image is read or decoded.
+ * Returns undefined when the image has no preview.
+ */
+val decodePreview(std::string data, jsquash::DecodeLimits limits) {
+  std::unique_ptr<JxlDecoder,
+                  std::integral_constant<decltype(&JxlDecoderDestroy), JxlDecoderDestroy>>
+      dec(JxlDecoderCreate(nullptr));
+  jsquash::DecodeBudget budget(limits);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetParallelRunner(dec.get(), RunWithBudget, &budget));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_COLOR_ENCODING | JXL_DEC_PREVIEW_IMAGE));
+
+  auto next_in = (const uint8_t*)data.c_str();
+  auto avail_in = data.size();
+  JxlDecoderSetInput(dec.get(), next_in, avail_in);
+  EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec.get()));
+  JxlBasicInfo info;
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec.get(), &info));
+  if (!info.have_preview) {
+    return val::undefined();
+  }
+  const uint32_t width = info.preview.xsize;
+  const uint32_t height = info.preview.ysize;
+  if (!budget.CheckImage(width, height, 1, DecodedBytes(width, height, 4))) {
+    return budget.Abort();
+  }
+  size_t float_size;
+  EXPECT_TRUE(jsquash::ComputeImageSize(width, height, COMPONENTS_PER_PIXEL, sizeof(float),
+                                        &float_size));
+  size_t component_count = float_size / sizeof(float);
+
+  EXPECT_EQ(JXL_DEC_COLOR_ENCODING, JxlDecoderProcessInput(dec.get()));
+  static const JxlPixelFormat format = {COMPONENTS_PER_PIXEL, JXL_TYPE_FLOAT, JXL_LITTLE_ENDIAN, 0};
+  size_t icc_size;
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetICCProfileSize(dec.get(), &format,
+                                                         JXL_COLOR_PROFILE_TARGET_DATA, &icc_size));
+  std::vector<uint8_t> icc_profile(icc_size);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderGetColorAsICCProfile(dec.get(), &format, JXL_COLOR_PROFILE_TARGET_DATA,
+                                           icc_profile.data(), icc_profile.size()));
+
+  EXPECT_EQ(JXL_DEC_NEED_PREVIEW_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+  size_t buffer_size;
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderPreviewOutBufferSize(dec.get(), &format, &buffer_size));
+  EXPECT_EQ(buffer_size, float_size);
+
+  auto float_pixels = std::make_unique<float[]>(component_count);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetPreviewOutBuffer(dec.get(), &format, float_pixels.get(),
+                                                           float_size));
+  EXPECT_EQ(JXL_DEC_PREVIEW_IMAGE, JxlDecoderProcessInput(dec.get()));
+  EXPECT_TRUE(budget.Check());
+
+  auto byte_pixels = std::make_unique<uint8_t[]>(component_count);
+  // Convert to sRGB.
+  skcms_ICCProfile jxl_profile;
+  EXPECT_TRUE(skcms_Parse(icc_profile.data(), icc_profile.size(), &jxl_profile));
+  EXPECT_TRUE(skcms_Transform(
+      float_pixels.get(), skcms_PixelFormat_RGBA_ffff,
+      info.alpha_premultiplied ? skcms_AlphaFormat_PremulAsEncoded : skcms_AlphaFormat_Unpremul,
+      &jxl_profile, byte_pixels.get(), skcms_PixelFormat_RGBA_8888, skcms_AlphaFormat_Unpremul,
+      skcms_sRGB_profile(), component_count / COMPONENTS_PER_PIXEL));
+
+  return ImageData.new_(
+      Uint8ClampedArray.new_(typed_memory_view(component_count, byte_pixels.get())), width,
+      height);
+}
+
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(jxl_dec) {
+  jsquash::RegisterDecodeResizeOptions();
+  jsquash::RegisterDecodeLimits();
+  jsquash::RegisterToneMapping();
+  function(JSQUASH_EXPORT("decode"), &decode);
+  function(JSQUASH_EXPORT("decodeHighBitDepth"), &decodeHighBitDepth);
+  function(JSQUASH_EXPORT("decodeLinearFloat"), &decodeLinearFloat);
+  function(JSQUASH_EXPORT("decodePreview"), &decodePreview);
 }
\ No newline at end of file
@@ -1,6 +1,70 @@
+export interface DecodeResizeOptions {
+  width: number;
+  height: number;
+  fitMethod: 'stretch' | 'contain';
+  method: number;
+  premultiply: boolean;
+  linearRGB: boolean;
+}
+
+export interface DecodeLimits {
+  maxPixels: number;
+  maxFrames: number;
+  maxMemory: number;
+  timeLimit: number;
+}
+
+// What a decode stopped by its limits returns.
+export type DecodeLimit = keyof DecodeLimits;
+
+export interface ToneMapping {
+  enabled: boolean;
+  // 0 for the default.
+  peakLuminance: number;
+}
+
+export interface ImageAnalysis {
+  histogram: Uint32Array;
+  meanColor: { r: number; g: number; b: number; a: number };
+  dominantColor: { r: number; g: number; b: number };
+  perceptualHash: string;
+  thumbHash: Uint8Array;
+}
+
+export interface DecodeOutput {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+}
+
 export interface JXLModule extends EmscriptenWasm.Module {
-  decode(data: BufferSource): ImageData | null;
-  decodeHighBitDepth(data: BufferSource): {
+  decode(
+    data: BufferSource,
+    resize: DecodeResizeOptions,
+    limits: DecodeLimits,
+    toneMapping: ToneMapping,
+    premultiplied: boolean,
+    analyze: false,
+    output: undefined,
+  ): ImageData | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    resize: DecodeResizeOptions,
+    limits: DecodeLimits,
+    toneMapping: ToneMapping,
+    premultiplied: boolean,
+    analyze: true,
+    output: undefined,
+  ): { image: ImageData; analysis: ImageAnalysis } | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    resize: DecodeResizeOptions,
+    limits: DecodeLimits,
+    toneMapping: ToneMapping,
+    premultiplied: boolean,
+    analyze: false,
+    output: DecodeOutput,
+  ): { width: number; height: number } | DecodeLimit | null;
+  decodeHighBitDepth(data: BufferSource, limits: DecodeLimits): {
     data: Uint8ClampedArray | Uint16Array | Float32Array;
     width: number;
     height: number;
@@ -8,15 +72,19 @@ export interface JXLModule extends EmscriptenWasm.Module {
     colorSpace: string;
     hasAlpha: boolean;
     iccProfile: Uint8Array;
-  } | null;
-  decodeLinearFloat(data: BufferSource): {
+  } | DecodeLimit | null;
+  decodeLinearFloat(data: BufferSource, limits: DecodeLimits): {
     data: Float32Array;
     width: number;
     height: number;
     sourceBitDepth: number;
     colorSpace: string;
     iccProfile: Uint8Array;
-  } | null;
+  } | DecodeLimit | null;
+  decodePreview(
+    data: BufferSource,
+    limits: DecodeLimits,
+  ): ImageData | DecodeLimit | null | undefined;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<JXLModule>;
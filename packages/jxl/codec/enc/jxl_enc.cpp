@@ -15,9 +15,17 @@
 #endif
 
 #include "jxl/encode.h"
+#include "jxl/parallel_runner.h"
+
+#include "deadline.h"
+#include "embind_export.h"
+#include "image_size.h"
+#include "image_view.h"
 
 using namespace emscripten;
 
+namespace {
+
 thread_local const val Uint8Array = val::global("Uint8Array");
 
 struct JXLOptions {
@@ -30,32 +38,49 @@ struct JXLOptions {
   float photonNoiseIso;
   bool lossyModular;
   bool lossless;
+  // Lossless at effort 1, which libjxl hands to its fast lossless encoder
+  bool fastLossless;
   int bitDepth;  // 8 | 10 | 12 | 16 | 32
   int inputType;  // 0=u8 | 1=u16 | 2=f32
   int numChannels;  // 3=RGB | 4=RGBA
   int colorSpace;  // 0=sRGB | 1=Display-P3 | 2=Rec2020-PQ | 3=Rec2020-HLG
   bool premultipliedAlpha;
+  // Milliseconds before the encode is abandoned, 0 = no limit
+  double timeLimit;
 };
 
-bool ComputeExpectedSize(uint32_t width, uint32_t height, int num_channels,
-                         size_t bytes_per_sample, size_t* expected_size) {
-  if (width == 0 || height == 0 || num_channels <= 0 || bytes_per_sample == 0) {
-    return false;
-  }
-
-  const size_t width_s = static_cast<size_t>(width);
-  const size_t height_s = static_cast<size_t>(height);
-  const size_t channels_s = static_cast<size_t>(num_channels);
-  const size_t max_size = std::numeric_limits<size_t>::max();
-
-  if (width_s > max_size / height_s) return false;
-  const size_t pixels = width_s * height_s;
-  if (pixels > max_size / channels_s) return false;
-  const size_t samples = pixels * channels_s;
-  if (samples > max_size / bytes_per_sample) return false;
+// libjxl runs every parallel stage of the encode through the parallel runner,
+// and fails the encode when the runner returns an error. Wrapping the runner
+// is therefore the one place a time limit can stop an encode part way.
+struct DeadlineRunner {
+  jsquash::Deadline deadline;
+  // The thread pool on pthread builds, otherwise null to run jobs inline.
+  JxlParallelRunner runner;
+  void* runner_opaque;
+};
 
-  *expected_size = samples * bytes_per_sample;
-  return true;
+JxlParallelRetCode RunWithDeadline(void* runner_opaque, void* jpegxl_opaque,
+                                   JxlParallelRunInit init, JxlParallelRunFunction func,
+                                   uint32_t start_range, uint32_t end_range) {
+  auto* self = static_cast<DeadlineRunner*>(runner_opaque);
+  if (self->deadline.expired()) {
+    return -1;
+  }
+  if (self->runner) {
+    return self->runner(self->runner_opaque, jpegxl_opaque, init, func, start_range,
+                        end_range);
+  }
+  const JxlParallelRetCode init_result = init(jpegxl_opaque, 1);
+  if (init_result != 0) {
+    return init_result;
+  }
+  for (uint32_t i = start_range; i < end_range; ++i) {
+    if (self->deadline.expired()) {
+      return -1;
+    }
+    func(jpegxl_opaque, i, 0);
+  }
+  return 0;
 }
 
 bool IsSupportedCombination(int input_type, int bit_depth) {
@@ -108,7 +133,8 @@ bool SetFrameOption(JxlEncoderFrameSettings* frame_settings,
          JXL_ENC_SUCCESS;
 }
 
-val encode(std::string image, int width, int height, JXLOptions options) {
+// `stride` is the distance between the starts of two rows of `image` in bytes.
+val encode(std::string image, int width, int height, uint32_t stride, JXLOptions options) {
   if (width <= 0 || height <= 0) {
     return val::null();
   }
@@ -121,6 +147,12 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     return val::null();
   }
 
+  // libjxl only takes its fast lossless path for integer samples of up to
+  // 16 bits, and otherwise would quietly run the much slower modular encoder.
+  if (options.fastLossless && options.inputType == 2) {
+    return val::null();
+  }
+
   JxlDataType data_type = JXL_TYPE_UINT8;
   size_t bytes_per_sample = 1;
   if (options.inputType == 1) {
@@ -132,12 +164,14 @@ val encode(std::string image, int width, int height, JXLOptions options) {
   }
 
   size_t expected_size = 0;
-  if (!ComputeExpectedSize(static_cast<uint32_t>(width), static_cast<uint32_t>(height),
-                           options.numChannels, bytes_per_sample, &expected_size)) {
+  if (!jsquash::ComputeImageSize(static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+                                 options.numChannels, bytes_per_sample, &expected_size)) {
     return val::null();
   }
-
-  if (expected_size != image.size()) {
+  const size_t row_size = expected_size / height;
+  size_t strided_size = 0;
+  if (!jsquash::ComputeStridedSize(height, row_size, stride, &strided_size) ||
+      strided_size != image.size()) {
     return val::null();
   }
 
@@ -147,6 +181,8 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     return val::null();
   }
 
+  DeadlineRunner deadline_runner = {jsquash::Deadline(options.timeLimit), nullptr, nullptr};
+
 #ifdef __EMSCRIPTEN_PTHREADS__
   std::unique_ptr<void, decltype(&JxlThreadParallelRunnerDestroy)> runner(
       JxlThreadParallelRunnerCreate(nullptr, emscripten_num_logical_cores()),
@@ -154,12 +190,20 @@ val encode(std::string image, int width, int height, JXLOptions options) {
   if (!runner) {
     return val::null();
   }
+  deadline_runner.runner = JxlThreadParallelRunner;
+  deadline_runner.runner_opaque = runner.get();
+#endif
 
-  if (JxlEncoderSetParallelRunner(encoder.get(), JxlThreadParallelRunner,
-                                  runner.get()) != JXL_ENC_SUCCESS) {
+  if (deadline_runner.deadline.active()) {
+    if (JxlEncoderSetParallelRunner(encoder.get(), RunWithDeadline, &deadline_runner) !=
+        JXL_ENC_SUCCESS) {
+      return val::null();
+    }
+  } else if (deadline_runner.runner &&
+             JxlEncoderSetParallelRunner(encoder.get(), deadline_runner.runner,
+                                         deadline_runner.runner_opaque) != JXL_ENC_SUCCESS) {
     return val::null();
   }
-#endif
 
   JxlBasicInfo basic_info;
   JxlEncoderInitBasicInfo(&basic_info);
@@ -216,8 +260,11 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     return val::null();
   }
 
+  // At effort 1 ("lightning") libjxl encodes lossless frames with fjxl rather
+  // than the general modular encoder: one fixed predictor and a fast entropy
+  // coder per group, with the groups spread over the parallel runner.
   if (!SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_EFFORT,
-                      std::clamp(options.effort, 1, 9))) {
+                      options.fastLossless ? 1 : std::clamp(options.effort, 1, 9))) {
     return val::null();
   }
 
@@ -233,13 +280,13 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     return val::null();
   }
 
-  if (options.photonNoiseIso > 0.0f &&
+  if (!options.fastLossless && options.photonNoiseIso > 0.0f &&
       !SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_PHOTON_NOISE,
                       static_cast<int32_t>(std::round(options.photonNoiseIso)))) {
     return val::null();
   }
 
-  if (options.lossyPalette) {
+  if (!options.fastLossless && options.lossyPalette) {
     if (!SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_LOSSY_PALETTE, 1) ||
         !SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_PALETTE_COLORS, 0) ||
         !SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_MODULAR, 1)) {
@@ -247,12 +294,12 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     }
   }
 
-  if (options.lossyModular &&
+  if (!options.fastLossless && options.lossyModular &&
       !SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_MODULAR, 1)) {
     return val::null();
   }
 
-  if (options.progressive) {
+  if (!options.fastLossless && options.progressive) {
     if (!SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_QPROGRESSIVE_AC, 1) ||
         !SetFrameOption(frame_settings, JXL_ENC_FRAME_SETTING_RESPONSIVE, 1)) {
       return val::null();
@@ -263,7 +310,7 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     }
   }
 
-  if (options.lossless) {
+  if (options.lossless || options.fastLossless) {
     if (JxlEncoderSetFrameLossless(frame_settings, JXL_TRUE) != JXL_ENC_SUCCESS) {
       return val::null();
     }
@@ -292,9 +339,14 @@ val encode(std::string image, int width, int height, JXLOptions options) {
   const JxlPixelFormat pixel_format = {
       static_cast<uint32_t>(options.numChannels), data_type, JXL_NATIVE_ENDIAN, 0};
 
-  if (JxlEncoderAddImageFrame(frame_settings, &pixel_format, image.data(),
-                              image.size()) != JXL_ENC_SUCCESS) {
-    return val::null();
+  // JxlPixelFormat::align only rounds rows up to a multiple, so other strides
+  // are packed here, inside the module.
+  std::vector<uint8_t> packed;
+  const uint8_t* pixels = jsquash::PackRows(reinterpret_cast<const uint8_t*>(image.data()),
+                                            row_size, stride, height, &packed);
+  if (JxlEncoderAddImageFrame(frame_settings, &pixel_format, pixels, expected_size) !=
+      JXL_ENC_SUCCESS) {
+    return deadline_runner.deadline.expired() ? val::undefined() : val::null();
   }
 
   JxlEncoderCloseInput(encoder.get());
@@ -316,7 +368,7 @@ val encode(std::string image, int width, int height, JXLOptions options) {
     }
 
     if (process_result != JXL_ENC_SUCCESS) {
-      return val::null();
+      return deadline_runner.deadline.expired() ? val::undefined() : val::null();
     }
 
     compressed.resize(static_cast<size_t>(next_out - compressed.data()));
@@ -326,7 +378,9 @@ val encode(std::string image, int width, int height, JXLOptions options) {
   return Uint8Array.new_(typed_memory_view(compressed.size(), compressed.data()));
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(jxl_enc) {
   value_object<JXLOptions>("JXLOptions")
       .field("effort", &JXLOptions::effort)
       .field("quality", &JXLOptions::quality)
@@ -336,12 +390,14 @@ EMSCRIPTEN_BINDINGS(my_module) {
       .field("photonNoiseIso", &JXLOptions::photonNoiseIso)
       .field("lossyModular", &JXLOptions::lossyModular)
       .field("lossless", &JXLOptions::lossless)
+      .field("fastLossless", &JXLOptions::fastLossless)
       .field("epf", &JXLOptions::epf)
       .field("bitDepth", &JXLOptions::bitDepth)
       .field("inputType", &JXLOptions::inputType)
       .field("numChannels", &JXLOptions::numChannels)
       .field("colorSpace", &JXLOptions::colorSpace)
-      .field("premultipliedAlpha", &JXLOptions::premultipliedAlpha);
+      .field("premultipliedAlpha", &JXLOptions::premultipliedAlpha)
+      .field("timeLimit", &JXLOptions::timeLimit);
 
-  function("encode", &encode);
+  function(JSQUASH_EXPORT("encode"), &encode);
 }
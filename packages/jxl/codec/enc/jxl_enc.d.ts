@@ -8,11 +8,13 @@ export interface EncodeOptions {
   photonNoiseIso: number;
   lossyModular: boolean;
   lossless: boolean;
+  fastLossless: boolean;
   bitDepth: number;
   inputType: number;
   colorSpace: number;
   premultipliedAlpha: boolean;
   numChannels: number;
+  timeLimit: number;
 }
 
 export interface JXLModule extends EmscriptenWasm.Module {
@@ -20,8 +22,9 @@ export interface JXLModule extends EmscriptenWasm.Module {
     data: BufferSource,
     width: number,
     height: number,
+    stride: number,
     options: EncodeOptions,
-  ): Uint8Array | null;
+  ): Uint8Array | null | undefined;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<JXLModule>;
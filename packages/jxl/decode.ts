@@ -18,8 +18,21 @@
  * Extended with high bit depth decode support for 10/12/16-bit and float32 output.
  */
 
-import jxlDecoder, { JXLModule } from './codec/dec/jxl_dec.js';
-import { initEmscriptenModule } from './utils.js';
+import jxlDecoder, { JXLModule, ToneMapping } from './codec/dec/jxl_dec.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
+import {
+  DecodeLimits,
+  DecodeOptions,
+  DecodeTarget,
+  ImageAnalysis,
+  defaultDecodeOptions,
+} from './meta.js';
 
 /**
  * Decoded image with high bit depth support
@@ -66,29 +79,73 @@ export interface JxlLinearFloatImage {
 }
 
 let emscriptenModule: Promise<JXLModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: JXLModule) => Promise<JXLModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<JXLModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
+
+/** Resize methods by index, as in @jsquash/resize */
+const resizeMethods: DecodeOptions['method'][] = [
+  'triangle',
+  'catrom',
+  'mitchell',
+  'lanczos3',
+];
+
+function getResizeOptions(options: DecodeOptions) {
+  return {
+    width: options.width ?? 0,
+    height: options.height ?? 0,
+    fitMethod: options.fitMethod,
+    method: resizeMethods.indexOf(options.method),
+    premultiply: options.premultiply,
+    linearRGB: options.linearRGB,
+  };
+}
+
+function getToneMapping({
+  sdrTarget,
+}: Pick<DecodeOptions, 'sdrTarget'>): ToneMapping {
+  return {
+    enabled: !!sdrTarget,
+    peakLuminance:
+      (typeof sdrTarget === 'object' && sdrTarget.peakLuminance) || 0,
+  };
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<JXLModule>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<JXLModule> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  emscriptenModule = initEmscriptenModule(
-    jxlDecoder,
-    actualModule,
-    actualOptions,
-  );
+  const load = () =>
+    initEmscriptenModule(jxlDecoder, actualModule, emscriptenOptions);
+  // Assigned synchronously so a decode() straight after init() reuses it.
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
   return emscriptenModule;
 }
 
@@ -97,13 +154,90 @@ export async function init(
  * All images are converted to 8-bit sRGB RGBA.
  *
  * @param buffer - JXL encoded data
+ * @param options - Optional size to resize to while decoding
  * @returns ImageData with 8-bit RGBA pixels
  */
-export default async function decode(buffer: ArrayBuffer): Promise<ImageData> {
+export default async function decode(
+  buffer: ArrayBuffer,
+  options: Partial<DecodeOptions> = {},
+): Promise<ImageData> {
+  if (!emscriptenModule) emscriptenModule = init();
+
+  const _options = { ...defaultDecodeOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getToneMapping(_options),
+    !!_options.premultipliedAlpha,
+    false,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes like `decode`, and also returns statistics gathered from the
+ * decoded rows while they are still in cache: the histogram, the mean and
+ * dominant colour, a perceptual hash and a ThumbHash placeholder. This saves
+ * walking the whole image again in JS.
+ */
+export async function decodeAndAnalyze(
+  buffer: ArrayBuffer,
+  options: Partial<DecodeOptions> = {},
+): Promise<{ image: ImageData; analysis: ImageAnalysis }> {
   if (!emscriptenModule) emscriptenModule = init();
 
+  const _options = { ...defaultDecodeOptions, ...options };
   const module = await emscriptenModule;
-  const result = module.decode(buffer);
+  const result = module.decode(
+    buffer,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getToneMapping(_options),
+    !!_options.premultipliedAlpha,
+    true,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decode a JXL image as 8-bit sRGB RGBA straight into a region of a larger
+ * buffer, such as a tile of an atlas, instead of a new ImageData.
+ *
+ * @param buffer - JXL encoded data
+ * @param target - Buffer region to write to, must fit the decoded image
+ * @param options - Optional size to resize to while decoding
+ * @returns The size of the decoded image
+ */
+export async function decodeInto(
+  buffer: ArrayBuffer,
+  target: DecodeTarget,
+  options: Partial<DecodeOptions> = {},
+): Promise<{ width: number; height: number }> {
+  if (!emscriptenModule) emscriptenModule = init();
+
+  const _options = { ...defaultDecodeOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getToneMapping(_options),
+    !!_options.premultipliedAlpha,
+    false,
+    { data: target.data.subarray(target.offset ?? 0), stride: target.stride },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
   return result;
 }
@@ -117,15 +251,22 @@ export default async function decode(buffer: ArrayBuffer): Promise<ImageData> {
  * - Float images: Float32Array, PQ/HLG/linear
  *
  * @param buffer - JXL encoded data
+ * @param options - Optional limits on what the decode may cost
  * @returns Decoded image with metadata
  */
 export async function decodeHighBitDepth(
   buffer: ArrayBuffer,
+  options: { limits?: DecodeLimits } = {},
 ): Promise<JxlDecodedImage> {
   if (!emscriptenModule) emscriptenModule = init();
 
   const module = await emscriptenModule;
-  const result = module.decodeHighBitDepth(buffer);
+  const result = module.decodeHighBitDepth(
+    buffer,
+    getDecodeLimits(options.limits),
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
 
   return {
@@ -146,15 +287,22 @@ export async function decodeHighBitDepth(
  * The pixel values are in the [0, 1] range for SDR, or may exceed 1.0 for HDR.
  *
  * @param buffer - JXL encoded data
+ * @param options - Optional limits on what the decode may cost
  * @returns Decoded image with linear float pixels
  */
 export async function decodeLinearFloat(
   buffer: ArrayBuffer,
+  options: { limits?: DecodeLimits } = {},
 ): Promise<JxlLinearFloatImage> {
   if (!emscriptenModule) emscriptenModule = init();
 
   const module = await emscriptenModule;
-  const result = module.decodeLinearFloat(buffer);
+  const result = module.decodeLinearFloat(
+    buffer,
+    getDecodeLimits(options.limits),
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
 
   return {
@@ -166,3 +314,28 @@ export async function decodeLinearFloat(
     iccProfile: result.iccProfile as Uint8Array,
   };
 }
+
+/**
+ * Decode only the preview frame of a JXL image, if it has one.
+ *
+ * The preview is stored before the main image, so this reads and decodes
+ * a small fraction of the file.
+ *
+ * @param buffer - JXL encoded data
+ * @param options - Optional limits on what the decode may cost
+ * @returns ImageData with 8-bit sRGB RGBA pixels, or null without a preview
+ */
+export async function decodePreview(
+  buffer: ArrayBuffer,
+  options: { limits?: DecodeLimits } = {},
+): Promise<ImageData | null> {
+  if (!emscriptenModule) emscriptenModule = init();
+
+  const module = await emscriptenModule;
+  const result = module.decodePreview(buffer, getDecodeLimits(options.limits));
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (result === undefined) return null;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
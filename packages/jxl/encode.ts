@@ -28,9 +28,29 @@ import type {
 
 import { defaultOptions } from './meta.js';
 import { simd, threads } from 'wasm-feature-detect';
-import { initEmscriptenModule } from './utils.js';
+import {
+  getImageRows,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 
 let emscriptenModule: Promise<JXLModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: JXLModule) => Promise<JXLModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<JXLModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 type JxlInputArray = JxlInputBuffer;
 type JxlEncodeInput = ImageData | JxlImageDataLike<JxlInputArray>;
@@ -56,50 +76,39 @@ const isRunningInCloudflareWorker = () =>
   (globalThis.caches as any)?.default !== undefined;
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<JXLModule>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ) {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
+  let jxlEncoder;
   if (
     !isRunningInNode() &&
     !isRunningInCloudflareWorker() &&
     (await threads())
   ) {
-    if (await simd()) {
-      const jxlEncoder = await import('./codec/enc/jxl_enc_mt_simd.js');
-      emscriptenModule = initEmscriptenModule(
-        jxlEncoder.default,
-        actualModule,
-        actualOptions,
-      );
-      return emscriptenModule;
-    }
-    const jxlEncoder = await import('./codec/enc/jxl_enc_mt.js');
-    emscriptenModule = initEmscriptenModule(
-      jxlEncoder.default,
-      actualModule,
-      actualOptions,
-    );
-    return emscriptenModule;
+    jxlEncoder = (await simd())
+      ? await import('./codec/enc/jxl_enc_mt_simd.js')
+      : await import('./codec/enc/jxl_enc_mt.js');
+  } else {
+    jxlEncoder = await import('./codec/enc/jxl_enc.js');
   }
-  const jxlEncoder = await import('./codec/enc/jxl_enc.js');
-  emscriptenModule = initEmscriptenModule(
-    jxlEncoder.default,
-    actualModule,
-    actualOptions,
-  );
+  const moduleFactory = jxlEncoder.default;
+  const load = () =>
+    initEmscriptenModule(moduleFactory, actualModule, emscriptenOptions);
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
   return emscriptenModule;
 }
 
@@ -133,12 +142,15 @@ export default async function encode(
   const normalized = normalizeInput(data);
   const inputType = resolveInputType(normalized.data, options.inputType);
   const bitDepth = resolveBitDepth(inputType, options.bitDepth);
-  const numChannels = resolveNumChannels(
-    normalized.data.length,
-    normalized.width,
-    normalized.height,
-    options.numChannels,
-  );
+  const numChannels =
+    normalized.stride !== undefined || normalized.offset !== undefined
+      ? (options.numChannels ?? 4)
+      : resolveNumChannels(
+          normalized.data.length,
+          normalized.width,
+          normalized.height,
+          options.numChannels,
+        );
   const colorSpace =
     options.colorSpace ??
     mapImageColorSpace(normalized.colorSpace) ??
@@ -148,6 +160,12 @@ export default async function encode(
 
   validateInputCombination(inputType, bitDepth);
 
+  if (options.fastLossless && inputType === 'f32') {
+    throw new Error(
+      'Unsupported combination: fastLossless only supports inputType "u8" and "u16".',
+    );
+  }
+
   const merged: EncodeOptions = {
     ...defaultOptions,
     ...options,
@@ -158,7 +176,7 @@ export default async function encode(
     premultipliedAlpha,
   };
 
-  if (merged.lossless) {
+  if (merged.lossless || merged.fastLossless) {
     if (options.quality !== undefined && options.quality !== 100) {
       console.warn(
         'JXL lossless: Quality setting is ignored when lossless is enabled (quality must be 100).',
@@ -192,25 +210,29 @@ export default async function encode(
     photonNoiseIso: merged.photonNoiseIso,
     lossyModular: merged.lossyModular,
     lossless: merged.lossless,
+    fastLossless: merged.fastLossless,
     bitDepth: merged.bitDepth,
     inputType: INPUT_TYPE_TO_WASM[merged.inputType],
     colorSpace: COLOR_SPACE_TO_WASM[merged.colorSpace],
     premultipliedAlpha: merged.premultipliedAlpha,
     numChannels: merged.numChannels,
+    timeLimit: merged.timeLimit,
   };
 
   const module = await emscriptenModule;
-  const bytes = new Uint8Array(
-    normalized.data.buffer,
-    normalized.data.byteOffset,
-    normalized.data.byteLength,
-  );
+  const { rows, stride } = getImageRows(normalized, numChannels);
+  const bytes = new Uint8Array(rows.buffer, rows.byteOffset, rows.byteLength);
   const resultView = module.encode(
     bytes,
     normalized.width,
     normalized.height,
+    stride,
     wasmOptions,
   );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (resultView === undefined) {
+    throw new Error('Encoding time limit exceeded.');
+  }
   if (!resultView) {
     throw new Error(
       `Encoding error for combination inputType=${merged.inputType}, bitDepth=${merged.bitDepth}.`,
@@ -227,6 +249,8 @@ function normalizeInput(data: JxlEncodeInput): JxlImageDataLike<JxlInputArray> {
       width: data.width,
       height: data.height,
       colorSpace: 'colorSpace' in data ? data.colorSpace : undefined,
+      stride: 'stride' in data ? data.stride : undefined,
+      offset: 'offset' in data ? data.offset : undefined,
     };
   }
 
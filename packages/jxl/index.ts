@@ -1,11 +1,17 @@
 export { default as encode } from './encode.js';
 export {
   default as decode,
+  decodeAndAnalyze,
   decodeHighBitDepth,
+  decodeInto,
   decodeLinearFloat,
+  decodePreview,
 } from './decode.js';
 export type {
+  DecodeLimits,
+  DecodeTarget,
   EncodeOptions,
+  ImageAnalysis,
   JxlBitDepth,
   JxlColorSpace,
   JxlInputBuffer,
@@ -13,3 +19,5 @@ export type {
   JxlImageDataLike,
 } from './meta.js';
 export type { JxlDecodedImage, JxlLinearFloatImage } from './decode.js';
+export { DecodeLimitError, getRecycleStats } from './utils.js';
+export type { InitOptions, RecycleStats } from './utils.js';
@@ -35,6 +35,14 @@ export interface EncodeOptions {
   photonNoiseIso: number;
   lossyModular: boolean;
   lossless: boolean;
+  /**
+   * Lossless encoding through libjxl's fast lossless encoder, for
+   * intermediates that are written and read back within a pipeline. Many
+   * times faster than `lossless`, for somewhat larger files. Ignores
+   * `effort`, `quality`, `progressive` and the lossy options, and needs
+   * `u8` or `u16` input.
+   */
+  fastLossless: boolean;
   /**
    * Input bit depth.
    *
@@ -47,6 +55,11 @@ export interface EncodeOptions {
   colorSpace: JxlColorSpace;
   premultipliedAlpha: boolean;
   numChannels: 3 | 4;
+  /**
+   * Milliseconds the encode may take before it is aborted with an
+   * `'Encoding time limit exceeded.'` error. `0` means no limit.
+   */
+  timeLimit: number;
 }
 
 export interface JxlImageDataLike<T extends JxlInputBuffer = JxlInputBuffer> {
@@ -54,8 +67,83 @@ export interface JxlImageDataLike<T extends JxlInputBuffer = JxlInputBuffer> {
   width: number;
   height: number;
   colorSpace?: PredefinedColorSpace;
+  /**
+   * Samples between the starts of two rows, for images stored as a region of
+   * a larger buffer such as a crop of a canvas. Defaults to
+   * `width * numChannels`. Images with a `stride` or `offset` are RGBA unless
+   * `numChannels` says otherwise.
+   */
+  stride?: number;
+  /** Index in `data` of the first sample of the image. Defaults to `0`. */
+  offset?: number;
 }
 
+/**
+ * Limits on what one decode may cost, for untrusted input. Each is checked
+ * against the header before any pixels are decoded, then again as the decode
+ * runs, and a decode over one rejects with a `DecodeLimitError` naming it.
+ * Unset or 0 means no limit.
+ */
+export type DecodeLimits = {
+  // Largest width * height of the image.
+  maxPixels?: number;
+  // Most frames an animation or image sequence may declare.
+  maxFrames?: number;
+  // Most bytes the decode may have allocated at once.
+  maxMemory?: number;
+  // Milliseconds the decode may take.
+  timeLimit?: number;
+};
+
+/**
+ * Statistics of the decoded image that `decodeAndAnalyze()` gathers from its
+ * rows as they are decoded, before any resize.
+ */
+export type ImageAnalysis = {
+  // 1024 bins: 256 each for R, G, B and A.
+  histogram: Uint32Array;
+  // Alpha weighted mean colour, and the mean alpha.
+  meanColor: { r: number; g: number; b: number; a: number };
+  // Most common colour of the mostly opaque pixels.
+  dominantColor: { r: number; g: number; b: number };
+  // 64-bit DCT hash as 16 hex digits. Similar images differ in few bits.
+  perceptualHash: string;
+  // ThumbHash placeholder, see https://github.com/evanw/thumbhash.
+  thumbHash: Uint8Array;
+};
+
+/**
+ * Where `decodeInto()` writes the decoded pixels: a region of a larger RGBA
+ * buffer, such as a tile of an atlas. The region is as large as the decoded
+ * (and resized) image; `offset` is the index of its first sample and `stride`
+ * the number of samples between the starts of two rows.
+ */
+export type DecodeTarget = {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+  offset?: number;
+};
+
+export type ResizeMethod = 'triangle' | 'catrom' | 'mitchell' | 'lanczos3';
+
+export type DecodeOptions = {
+  // Output size. Set only one of them to keep the aspect ratio.
+  width?: number;
+  height?: number;
+  method: ResizeMethod;
+  fitMethod: 'stretch' | 'contain';
+  premultiply: boolean;
+  linearRGB: boolean;
+  limits?: DecodeLimits;
+  // Tone map PQ, HLG and linear HDR images to 8-bit SDR while decoding.
+  // `peakLuminance` is the luminance in cd/m² that SDR white stands for
+  // (default 203, BT.2408's HDR reference white).
+  sdrTarget?: boolean | { peakLuminance?: number };
+  // Return colour premultiplied by alpha, ready to composite or to upload as a
+  // premultiplied texture.
+  premultipliedAlpha?: boolean;
+};
+
 export const label = 'JPEG XL (beta)';
 export const mimeType = 'image/jxl';
 export const extension = 'jxl';
@@ -69,9 +157,19 @@ export const defaultOptions: EncodeOptions = {
   photonNoiseIso: 0,
   lossyModular: false,
   lossless: false,
+  fastLossless: false,
   bitDepth: 8,
   inputType: 'u8',
   colorSpace: 'srgb',
   premultipliedAlpha: false,
   numChannels: 4,
+  timeLimit: 0,
+};
+
+// Same defaults as @jsquash/resize.
+export const defaultDecodeOptions: DecodeOptions = {
+  method: 'lanczos3',
+  fitMethod: 'stretch',
+  premultiply: true,
+  linearRGB: true,
 };
@@ -0,0 +1,121 @@
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/image.h"
+#include "lib/jxl/image_bundle.h"
+#include "lib/jxl/image_metadata.h"
+#include "tools/ssimulacra2.h"
+
+#include "image_size.h"
+#include "resample.h"
+#include "ssim.h"
+
+using namespace emscripten;
+
+thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
+
+// Backgrounds the ssimulacra2 tool composites transparent images onto. The
+// lower of the two scores is used, so errors hidden by one background still
+// count.
+constexpr float kDarkBackground = 0.1f;
+constexpr float kLightBackground = 0.9f;
+
+bool ValidPair(const std::string& a, const std::string& b, int width, int height) {
+  size_t size;
+  return width > 0 && height > 0 && jsquash::ComputeRGBA8Size(width, height, &size) &&
+         a.size() == size && b.size() == size;
+}
+
+// Converts RGBA8 to an sRGB ImageBundle with alpha composited over a grey
+// `background` in [0, 1].
+jxl::ImageBundle ToImageBundle(const std::string& rgba,
+                               uint32_t width,
+                               uint32_t height,
+                               float background,
+                               const jxl::ImageMetadata* metadata) {
+  jxl::Image3F color(width, height);
+  const uint8_t* pixels = reinterpret_cast<const uint8_t*>(rgba.data());
+  for (uint32_t y = 0; y < height; y++) {
+    const uint8_t* row = pixels + static_cast<size_t>(y) * width * 4;
+    float* planes[3] = {color.PlaneRow(0, y), color.PlaneRow(1, y), color.PlaneRow(2, y)};
+    for (uint32_t x = 0; x < width; x++) {
+      const float alpha = row[x * 4 + 3] * (1.0f / 255);
+      for (int c = 0; c < 3; c++) {
+        planes[c][x] = row[x * 4 + c] * (1.0f / 255) * alpha + background * (1 - alpha);
+      }
+    }
+  }
+  jxl::ImageBundle bundle(metadata);
+  bundle.SetFromImage(std::move(color), jxl::ColorEncoding::SRGB());
+  return bundle;
+}
+
+bool HasAlpha(const std::string& rgba) {
+  for (size_t i = 3; i < rgba.size(); i += 4) {
+    if (static_cast<uint8_t>(rgba[i]) != 255) {
+      return true;
+    }
+  }
+  return false;
+}
+
+val ssim(std::string reference, std::string distorted, int width, int height) {
+  if (!ValidPair(reference, distorted, width, height)) {
+    return val::null();
+  }
+  const double score =
+      ComputeSsim(reinterpret_cast<const uint8_t*>(reference.data()),
+                  reinterpret_cast<const uint8_t*>(distorted.data()), width, height);
+  return std::isnan(score) ? val::null() : val(score);
+}
+
+val ssimulacra2(std::string reference, std::string distorted, int width, int height) {
+  // SSIMULACRA2 downscales six times, so smaller images have no coarse scales.
+  if (!ValidPair(reference, distorted, width, height) || width < 8 || height < 8) {
+    return val::null();
+  }
+  jxl::ImageMetadata metadata;
+  const bool alpha = HasAlpha(reference) || HasAlpha(distorted);
+  double score = 100;
+  for (float background : {kDarkBackground, kLightBackground}) {
+    const jxl::ImageBundle a = ToImageBundle(reference, width, height, background, &metadata);
+    const jxl::ImageBundle b = ToImageBundle(distorted, width, height, background, &metadata);
+    score = std::min(score, ComputeSSIMULACRA2(a, b).Score());
+    if (!alpha) {
+      break;
+    }
+  }
+  return val(score);
+}
+
+// Resizes with a triangle filter in linear light, for the low resolution
+// proxies the quality search scores candidates on.
+val downscale(std::string rgba, int width, int height, int dst_width, int dst_height) {
+  size_t src_size, dst_size;
+  if (width <= 0 || height <= 0 || dst_width <= 0 || dst_height <= 0 ||
+      !jsquash::ComputeRGBA8Size(width, height, &src_size) || rgba.size() != src_size ||
+      !jsquash::ComputeRGBA8Size(dst_width, dst_height, &dst_size)) {
+    return val::null();
+  }
+  std::vector<uint8_t> output(dst_size);
+  jsquash::ResampleOptions options;
+  options.filter = jsquash::RESAMPLE_TRIANGLE;
+  options.linear_rgb = true;
+  if (!jsquash::ResampleRGBA8(reinterpret_cast<const uint8_t*>(rgba.data()),
+                              static_cast<size_t>(width) * 4, {0, 0, width, height},
+                              output.data(), dst_width, dst_height, options)) {
+    return val::null();
+  }
+  return Uint8ClampedArray.new_(typed_memory_view(output.size(), output.data()));
+}
+
+EMSCRIPTEN_BINDINGS(my_module) {
+  function("ssim", &ssim);
+  function("ssimulacra2", &ssimulacra2);
+  function("downscale", &downscale);
+}
@@ -0,0 +1,25 @@
+export interface MetricsModule extends EmscriptenWasm.Module {
+  ssim(
+    reference: BufferSource,
+    distorted: BufferSource,
+    width: number,
+    height: number,
+  ): number | null;
+  ssimulacra2(
+    reference: BufferSource,
+    distorted: BufferSource,
+    width: number,
+    height: number,
+  ): number | null;
+  downscale(
+    data: BufferSource,
+    width: number,
+    height: number,
+    dstWidth: number,
+    dstHeight: number,
+  ): Uint8ClampedArray | null;
+}
+
+declare var moduleFactory: EmscriptenWasm.ModuleFactory<MetricsModule>;
+
+export default moduleFactory;
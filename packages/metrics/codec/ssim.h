@@ -0,0 +1,173 @@
+#pragma once
+
+// SSIM (Wang et al. 2004) on BT.709 luma, following the reference MATLAB
+// implementation: an 11x11 Gaussian window with sigma 1.5, K1 = 0.01,
+// K2 = 0.03, dynamic range 255 and a 'valid' filter, so the SSIM map is 10
+// pixels smaller than the image in both directions.
+//
+// The window is separable. Each output row blurs the five statistics (a, b,
+// a^2, b^2, ab) vertically into row buffers and then horizontally, so besides
+// the two luma planes only five rows are ever stored. Builds with -msimd128
+// process four pixels per step.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace ssim_internal {
+
+constexpr int kTaps = 11;
+constexpr float kC1 = (0.01f * 255) * (0.01f * 255);
+constexpr float kC2 = (0.03f * 255) * (0.03f * 255);
+
+struct Window {
+  float w[kTaps];
+  Window() {
+    float sum = 0;
+    for (int i = 0; i < kTaps; i++) {
+      const float d = static_cast<float>(i - kTaps / 2);
+      w[i] = std::exp(-d * d / (2 * 1.5f * 1.5f));
+      sum += w[i];
+    }
+    for (float& weight : w) {
+      weight /= sum;
+    }
+  }
+};
+
+inline void ToLuma(const uint8_t* rgba, size_t pixels, float* luma) {
+  for (size_t i = 0; i < pixels; i++) {
+    luma[i] = 0.2126f * rgba[i * 4] + 0.7152f * rgba[i * 4 + 1] + 0.0722f * rgba[i * 4 + 2];
+  }
+}
+
+inline float SsimValue(float mu_a, float mu_b, float aa, float bb, float ab) {
+  const float var_a = aa - mu_a * mu_a;
+  const float var_b = bb - mu_b * mu_b;
+  const float cov = ab - mu_a * mu_b;
+  return ((2 * mu_a * mu_b + kC1) * (2 * cov + kC2)) /
+         ((mu_a * mu_a + mu_b * mu_b + kC1) * (var_a + var_b + kC2));
+}
+
+}  // namespace ssim_internal
+
+// Mean SSIM of two tightly packed RGBA8 images of the same size. Alpha is
+// ignored. Returns NaN for images smaller than the 11x11 window.
+inline double ComputeSsim(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height) {
+  using namespace ssim_internal;
+  if (width < kTaps || height < kTaps) {
+    return NAN;
+  }
+  static const Window window;
+  const size_t w = width;
+  const size_t out_width = w - (kTaps - 1);
+  const size_t out_height = height - (kTaps - 1);
+
+  std::vector<float> luma_a(w * height), luma_b(w * height);
+  ToLuma(a, w * height, luma_a.data());
+  ToLuma(b, w * height, luma_b.data());
+
+  // Vertically blurred a, b, a^2, b^2 and ab for the current output row.
+  std::vector<float> rows(w * 5);
+  float* va = rows.data();
+  float* vb = va + w;
+  float* vaa = vb + w;
+  float* vbb = vaa + w;
+  float* vab = vbb + w;
+
+  double total = 0;
+  for (size_t y = 0; y < out_height; y++) {
+    size_t x = 0;
+#if defined(__wasm_simd128__)
+    for (; x + 4 <= w; x += 4) {
+      v128_t sa = wasm_f32x4_splat(0), sb = sa, saa = sa, sbb = sa, sab = sa;
+      for (int k = 0; k < kTaps; k++) {
+        const v128_t weight = wasm_f32x4_splat(window.w[k]);
+        const v128_t pa = wasm_v128_load(&luma_a[(y + k) * w + x]);
+        const v128_t pb = wasm_v128_load(&luma_b[(y + k) * w + x]);
+        const v128_t wa = wasm_f32x4_mul(weight, pa);
+        const v128_t wb = wasm_f32x4_mul(weight, pb);
+        sa = wasm_f32x4_add(sa, wa);
+        sb = wasm_f32x4_add(sb, wb);
+        saa = wasm_f32x4_add(saa, wasm_f32x4_mul(wa, pa));
+        sbb = wasm_f32x4_add(sbb, wasm_f32x4_mul(wb, pb));
+        sab = wasm_f32x4_add(sab, wasm_f32x4_mul(wa, pb));
+      }
+      wasm_v128_store(&va[x], sa);
+      wasm_v128_store(&vb[x], sb);
+      wasm_v128_store(&vaa[x], saa);
+      wasm_v128_store(&vbb[x], sbb);
+      wasm_v128_store(&vab[x], sab);
+    }
+#endif
+    for (; x < w; x++) {
+      float sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+      for (int k = 0; k < kTaps; k++) {
+        const float pa = luma_a[(y + k) * w + x];
+        const float pb = luma_b[(y + k) * w + x];
+        sa += window.w[k] * pa;
+        sb += window.w[k] * pb;
+        saa += window.w[k] * pa * pa;
+        sbb += window.w[k] * pb * pb;
+        sab += window.w[k] * pa * pb;
+      }
+      va[x] = sa;
+      vb[x] = sb;
+      vaa[x] = saa;
+      vbb[x] = sbb;
+      vab[x] = sab;
+    }
+
+    float row_total = 0;
+    x = 0;
+#if defined(__wasm_simd128__)
+    v128_t row_sum = wasm_f32x4_splat(0);
+    const v128_t c1 = wasm_f32x4_splat(kC1);
+    const v128_t c2 = wasm_f32x4_splat(kC2);
+    const v128_t two = wasm_f32x4_splat(2);
+    for (; x + 4 <= out_width; x += 4) {
+      v128_t mu_a = wasm_f32x4_splat(0), mu_b = mu_a, aa = mu_a, bb = mu_a, ab = mu_a;
+      for (int k = 0; k < kTaps; k++) {
+        const v128_t weight = wasm_f32x4_splat(window.w[k]);
+        mu_a = wasm_f32x4_add(mu_a, wasm_f32x4_mul(weight, wasm_v128_load(&va[x + k])));
+        mu_b = wasm_f32x4_add(mu_b, wasm_f32x4_mul(weight, wasm_v128_load(&vb[x + k])));
+        aa = wasm_f32x4_add(aa, wasm_f32x4_mul(weight, wasm_v128_load(&vaa[x + k])));
+        bb = wasm_f32x4_add(bb, wasm_f32x4_mul(weight, wasm_v128_load(&vbb[x + k])));
+        ab = wasm_f32x4_add(ab, wasm_f32x4_mul(weight, wasm_v128_load(&vab[x + k])));
+      }
+      const v128_t mu_aa = wasm_f32x4_mul(mu_a, mu_a);
+      const v128_t mu_bb = wasm_f32x4_mul(mu_b, mu_b);
+      const v128_t mu_ab = wasm_f32x4_mul(mu_a, mu_b);
+      const v128_t numerator = wasm_f32x4_mul(
+          wasm_f32x4_add(wasm_f32x4_mul(two, mu_ab), c1),
+          wasm_f32x4_add(wasm_f32x4_mul(two, wasm_f32x4_sub(ab, mu_ab)), c2));
+      const v128_t denominator = wasm_f32x4_mul(
+          wasm_f32x4_add(wasm_f32x4_add(mu_aa, mu_bb), c1),
+          wasm_f32x4_add(wasm_f32x4_add(wasm_f32x4_sub(aa, mu_aa), wasm_f32x4_sub(bb, mu_bb)),
+                         c2));
+      row_sum = wasm_f32x4_add(row_sum, wasm_f32x4_div(numerator, denominator));
+    }
+    row_total = wasm_f32x4_extract_lane(row_sum, 0) + wasm_f32x4_extract_lane(row_sum, 1) +
+                wasm_f32x4_extract_lane(row_sum, 2) + wasm_f32x4_extract_lane(row_sum, 3);
+#endif
+    for (; x < out_width; x++) {
+      float mu_a = 0, mu_b = 0, aa = 0, bb = 0, ab = 0;
+      for (int k = 0; k < kTaps; k++) {
+        mu_a += window.w[k] * va[x + k];
+        mu_b += window.w[k] * vb[x + k];
+        aa += window.w[k] * vaa[x + k];
+        bb += window.w[k] * vbb[x + k];
+        ab += window.w[k] * vab[x + k];
+      }
+      row_total += SsimValue(mu_a, mu_b, aa, bb, ab);
+    }
+    // Rows are summed in double so large images don't lose precision.
+    total += row_total;
+  }
+  return total / (static_cast<double>(out_width) * out_height);
+}
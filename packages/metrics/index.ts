@@ -0,0 +1,10 @@
+export { init, ssim, ssimulacra2, downscale } from './metrics.js';
+export type { Image } from './metrics.js';
+export { default as encodeToTarget } from './search.js';
+export type {
+  DecodeFunction,
+  EncodeFunction,
+  TargetQualityResult,
+} from './search.js';
+export { defaultTargetQualityOptions } from './meta.js';
+export type { Metric, TargetQualityOptions } from './meta.js';
@@ -0,0 +1,37 @@
+export type Metric = 'ssimulacra2' | 'ssim';
+
+export interface TargetQualityOptions {
+  /** Metric the target is expressed in. */
+  metric: Metric;
+  /**
+   * Lowest acceptable score. SSIMULACRA2 scores run up to 100, where 90 is
+   * visually lossless and 70 is high quality. SSIM scores run up to 1.
+   */
+  target: number;
+  /** Range of the encoder's quality option to search. */
+  minQuality: number;
+  maxQuality: number;
+  /** Name of the encoder option to search, `quality` for every jSquash codec. */
+  option: string;
+  /**
+   * Longest side of the downscaled proxy the first search runs on. Images
+   * that already fit skip the proxy. 0 disables proxies.
+   */
+  proxySize: number;
+  /**
+   * How far either side of the proxy's answer the full resolution search
+   * looks. The search bisects that range, so the default of 5 costs at most
+   * 4 full resolution encodes.
+   */
+  refineRange: number;
+}
+
+export const defaultTargetQualityOptions: TargetQualityOptions = {
+  metric: 'ssimulacra2',
+  target: 80,
+  minQuality: 0,
+  maxQuality: 100,
+  option: 'quality',
+  proxySize: 512,
+  refineRange: 5,
+};
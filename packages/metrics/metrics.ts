@@ -0,0 +1,110 @@
+import type { MetricsModule } from './codec/metrics.js';
+
+import metrics_wasm from './codec/metrics.js';
+import { initEmscriptenModule } from './utils.js';
+
+export interface Image {
+  data: Uint8Array | Uint8ClampedArray;
+  width: number;
+  height: number;
+}
+
+let emscriptenModule: Promise<MetricsModule>;
+
+export async function init(
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+): Promise<void>;
+export async function init(
+  module?: WebAssembly.Module,
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+): Promise<void> {
+  let actualModule: WebAssembly.Module | undefined = module;
+  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
+    moduleOptionOverrides;
+
+  // If only one argument is provided and it's not a WebAssembly.Module
+  if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
+    actualModule = undefined;
+    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+  }
+
+  emscriptenModule = initEmscriptenModule(
+    metrics_wasm,
+    actualModule,
+    actualOptions,
+  );
+}
+
+async function getModule(): Promise<MetricsModule> {
+  if (!emscriptenModule) init();
+  return emscriptenModule;
+}
+
+function assertSameSize(reference: Image, distorted: Image) {
+  if (
+    reference.width !== distorted.width ||
+    reference.height !== distorted.height
+  ) {
+    throw new Error('Images must have the same dimensions.');
+  }
+}
+
+/**
+ * Mean SSIM of the luma of two RGBA images. 1 means identical. Images must be
+ * at least 11x11.
+ */
+export async function ssim(
+  reference: Image,
+  distorted: Image,
+): Promise<number> {
+  assertSameSize(reference, distorted);
+  const module = await getModule();
+  const score = module.ssim(
+    reference.data,
+    distorted.data,
+    reference.width,
+    reference.height,
+  );
+  if (score === null) throw new Error('Scoring error.');
+  return score;
+}
+
+/**
+ * SSIMULACRA2 score of `distorted` against `reference`, using the libjxl
+ * implementation. 100 means identical, 90 is visually lossless, and scores
+ * can go below 0. Transparent images are scored on a dark and a light
+ * background, and the lower score is returned. Images must be at least 8x8.
+ */
+export async function ssimulacra2(
+  reference: Image,
+  distorted: Image,
+): Promise<number> {
+  assertSameSize(reference, distorted);
+  const module = await getModule();
+  const score = module.ssimulacra2(
+    reference.data,
+    distorted.data,
+    reference.width,
+    reference.height,
+  );
+  if (score === null) throw new Error('Scoring error.');
+  return score;
+}
+
+/** Shrinks an image with a triangle filter in linear light. */
+export async function downscale(
+  image: Image,
+  width: number,
+  height: number,
+): Promise<ImageData> {
+  const module = await getModule();
+  const data = module.downscale(
+    image.data,
+    image.width,
+    image.height,
+    width,
+    height,
+  );
+  if (!data) throw new Error('Resizing error.');
+  return new ImageData(data, width, height);
+}
@@ -0,0 +1,126 @@
+import { downscale, ssim, ssimulacra2 } from './metrics.js';
+import type { Image } from './metrics.js';
+import { defaultTargetQualityOptions } from './meta.js';
+import type { TargetQualityOptions } from './meta.js';
+
+export type EncodeFunction<O> = (
+  data: ImageData,
+  options?: O,
+) => Promise<ArrayBuffer>;
+export type DecodeFunction = (data: ArrayBuffer) => Promise<ImageData>;
+
+export interface TargetQualityResult {
+  buffer: ArrayBuffer;
+  /** Value of the quality option that produced `buffer`. */
+  quality: number;
+  /** Score of `buffer` against the original image. */
+  score: number;
+  /** Encodes run in total, on the proxy and at full resolution. */
+  iterations: number;
+  /** Encodes run at full resolution. */
+  fullResolutionIterations: number;
+}
+
+interface Candidate {
+  quality: number;
+  score: number;
+  buffer: ArrayBuffer;
+}
+
+const metrics = { ssim, ssimulacra2 };
+
+/**
+ * Finds the lowest quality whose encode scores at least `options.target`
+ * against `image`, and returns that encode.
+ *
+ * Scores are assumed to rise with quality, so the search is a bisection. A
+ * large image is first searched on a downscaled proxy, which is far cheaper to
+ * encode and score. The full resolution search then only bisects a small
+ * range around the proxy's answer, and widens to the top of the range if
+ * nothing there reaches the target. If even the highest quality falls short,
+ * that encode is returned with its score.
+ */
+export default async function encodeToTarget<O>(
+  image: ImageData,
+  encode: EncodeFunction<O>,
+  decode: DecodeFunction,
+  encodeOptions?: O,
+  options: Partial<TargetQualityOptions> = {},
+): Promise<TargetQualityResult> {
+  const _options = { ...defaultTargetQualityOptions, ...options };
+  const score = metrics[_options.metric];
+  let iterations = 0;
+  let fullResolutionIterations = 0;
+
+  const evaluate = async (source: ImageData, quality: number) => {
+    iterations++;
+    const buffer = await encode(source, {
+      ...encodeOptions,
+      [_options.option]: quality,
+    } as O);
+    const decoded = await decode(buffer);
+    return { quality, score: await score(source, decoded), buffer };
+  };
+
+  // Smallest passing quality in [low, high], or undefined if none pass.
+  const bisect = async (
+    evaluateAt: (quality: number) => Promise<Candidate>,
+    low: number,
+    high: number,
+  ) => {
+    let best: Candidate | undefined;
+    while (low <= high) {
+      const candidate = await evaluateAt((low + high) >> 1);
+      if (candidate.score >= _options.target) {
+        best = candidate;
+        high = candidate.quality - 1;
+      } else {
+        low = candidate.quality + 1;
+      }
+    }
+    return best;
+  };
+
+  const evaluateFull = (quality: number) => {
+    fullResolutionIterations++;
+    return evaluate(image, quality);
+  };
+
+  let low = _options.minQuality;
+  let high = _options.maxQuality;
+  const proxy = await createProxy(image, _options.proxySize);
+  if (proxy) {
+    const estimate = await bisect(
+      (quality) => evaluate(proxy, quality),
+      low,
+      high,
+    );
+    const center = estimate?.quality ?? high;
+    low = Math.max(low, center - _options.refineRange);
+    high = Math.min(high, center + _options.refineRange);
+  }
+
+  let best = await bisect(evaluateFull, low, high);
+  if (!best && high < _options.maxQuality) {
+    best = await bisect(evaluateFull, high + 1, _options.maxQuality);
+  }
+  if (!best) {
+    best = await evaluateFull(_options.maxQuality);
+  }
+
+  return { ...best, iterations, fullResolutionIterations };
+}
+
+async function createProxy(
+  image: Image,
+  proxySize: number,
+): Promise<ImageData | undefined> {
+  const longestSide = Math.max(image.width, image.height);
+  if (proxySize <= 0 || longestSide <= proxySize) return undefined;
+  const scale = proxySize / longestSide;
+  return downscale(
+    image,
+    Math.max(1, Math.round(image.width * scale)),
+    Math.max(1, Math.round(image.height * scale)),
+  );
+}
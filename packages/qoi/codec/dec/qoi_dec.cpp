@@ -1,30 +1,67 @@
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
 
+// The combined build links both QOI wrappers into one module, and takes the
+// implementation from the encoder.
+#ifndef JSQUASH_COMBINED_BUILD
 #define QOI_IMPLEMENTATION
+#endif
 #include "qoi.h"
 
+#include "decode_limits.h"
+#include "embind_export.h"
+#include "image_view.h"
+#include "premultiply.h"
+
 using namespace emscripten;
 
-thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
-thread_local const val ImageData = val::global("ImageData");
+namespace {
+
+// "qoif", width, height, channels, colorspace.
+constexpr size_t kHeaderSize = 14;
+
+uint32_t ReadBigEndian32(const uint8_t* bytes) {
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) |
+         bytes[3];
+}
+
+// Writes into `output` instead of a new ImageData when it is set, see
+// jsquash::WriteImageData(). Returns the name of the limit as a string when
+// `limits` stop the decode. With `premultiplied`, returns colour premultiplied
+// by alpha.
+val decode(std::string qoiimage, jsquash::DecodeLimits limits, bool premultiplied, val output) {
+  // qoi_decode() reads the header and decodes in one call, so the size is
+  // checked from the header first. The decode itself is a single pass over
+  // the pixels, with no point to poll from.
+  jsquash::DecodeBudget budget(limits);
+  if (qoiimage.size() >= kHeaderSize) {
+    const uint8_t* header = reinterpret_cast<const uint8_t*>(qoiimage.data());
+    const uint32_t width = ReadBigEndian32(header + 4);
+    const uint32_t height = ReadBigEndian32(header + 8);
+    if (!budget.CheckImage(width, height, 1, 4.0 * width * height)) {
+      return budget.Abort();
+    }
+  }
 
-val decode(std::string qoiimage) {
   qoi_desc desc;
   uint8_t* rgba = (uint8_t*)qoi_decode(qoiimage.c_str(), qoiimage.length(), &desc, 4);
+  if (rgba == NULL)
+    return val::null();
+  // QOI has no premultiplied mode, and 3 channel files are opaque.
+  if (premultiplied && desc.channels == 4) {
+    jsquash::PremultiplyRows(rgba, static_cast<size_t>(desc.width) * 4, desc.width, desc.height);
+  }
 
   // Resultant width and height stored in descriptor
-  int decodedWidth = desc.width;
-  int decodedHeight = desc.height;
-
-  val result = ImageData.new_(
-      Uint8ClampedArray.new_(typed_memory_view(4 * decodedWidth * decodedHeight, rgba)),
-      decodedWidth, decodedHeight);
+  val result = jsquash::WriteImageData(rgba, desc.width, desc.height, output);
   free(rgba);
 
   return result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
-  function("decode", &decode);
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(qoi_dec) {
+  jsquash::RegisterDecodeLimits();
+  function(JSQUASH_EXPORT("decode"), &decode);
 }
@@ -1,5 +1,31 @@
+export interface DecodeLimits {
+  maxPixels: number;
+  maxFrames: number;
+  maxMemory: number;
+  timeLimit: number;
+}
+
+// What a decode stopped by its limits returns.
+export type DecodeLimit = keyof DecodeLimits;
+
+export interface DecodeOutput {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+}
+
 export interface QOIModule extends EmscriptenWasm.Module {
-  decode(data: BufferSource): ImageData | null;
+  decode(
+    data: BufferSource,
+    limits: DecodeLimits,
+    premultiplied: boolean,
+    output: undefined,
+  ): ImageData | DecodeLimit | null;
+  decode(
+    data: BufferSource,
+    limits: DecodeLimits,
+    premultiplied: boolean,
+    output: DecodeOutput,
+  ): { width: number; height: number } | DecodeLimit | null;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<QOIModule>;
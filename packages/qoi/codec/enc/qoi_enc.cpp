@@ -4,11 +4,33 @@
 #define QOI_IMPLEMENTATION
 #include "qoi.h"
 
+#include "embind_export.h"
+#include "image_size.h"
+#include "image_view.h"
+#include "premultiply.h"
+
 using namespace emscripten;
 
+namespace {
+
 thread_local const val Uint8Array = val::global("Uint8Array");
 
-val encode(std::string buffer, int width, int height) {
+// `stride` is the distance between the starts of two rows of `buffer` in bytes.
+// `premultiplied` marks colour in `buffer` as premultiplied by alpha.
+val encode(std::string buffer, int width, int height, uint32_t stride, bool premultiplied) {
+  const size_t row_size = static_cast<size_t>(width) * 4;
+  size_t size;
+  if (width <= 0 || height <= 0 || !jsquash::ComputeStridedSize(height, row_size, stride, &size) ||
+      buffer.size() < size)
+    return val::null();
+
+  // qoi_encode only takes tightly packed pixels with straight alpha.
+  std::vector<uint8_t> packed;
+  const uint8_t* rows = reinterpret_cast<const uint8_t*>(buffer.data());
+  const uint8_t* pixels =
+      premultiplied ? jsquash::UnpremultiplyRows(rows, width, stride, height, &packed)
+                    : jsquash::PackRows(rows, row_size, stride, height, &packed);
+
   int compressedSizeInBytes;
   qoi_desc desc;
   desc.width = width;
@@ -16,7 +38,7 @@ val encode(std::string buffer, int width, int height) {
   desc.channels = 4;
   desc.colorspace = QOI_SRGB;
 
-  uint8_t* encodedData = (uint8_t*)qoi_encode(buffer.c_str(), &desc, &compressedSizeInBytes);
+  uint8_t* encodedData = (uint8_t*)qoi_encode(pixels, &desc, &compressedSizeInBytes);
   if (encodedData == NULL)
     return val::null();
 
@@ -27,6 +49,8 @@ val encode(std::string buffer, int width, int height) {
   return js_result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
-  function("encode", &encode);
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(qoi_enc) {
+  function(JSQUASH_EXPORT("encode"), &encode);
 }
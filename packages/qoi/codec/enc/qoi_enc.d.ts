@@ -2,8 +2,10 @@ export interface QOIModule extends EmscriptenWasm.Module {
     encode(
         data: BufferSource,
         width: number,
-        height: number
-    ): Uint8Array;
+        height: number,
+        stride: number,
+        premultiplied: boolean
+    ): Uint8Array | null;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<QOIModule>;
@@ -17,37 +17,97 @@
  */
 
 import type { QOIModule } from './codec/dec/qoi_dec.js';
-import { initEmscriptenModule } from './utils.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 
 import qoi_dec from './codec/dec/qoi_dec.js';
+import type { DecodeOptions, DecodeTarget } from './meta.js';
 
 let emscriptenModule: Promise<QOIModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: QOIModule) => Promise<QOIModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<QOIModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  emscriptenModule = initEmscriptenModule(qoi_dec, actualModule, actualOptions);
+  const load = () =>
+    initEmscriptenModule(qoi_dec, actualModule, emscriptenOptions);
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
 }
 
-export default async function decode(buffer: ArrayBuffer): Promise<ImageData> {
+export default async function decode(
+  buffer: ArrayBuffer,
+  options: DecodeOptions = {},
+): Promise<ImageData> {
+  if (!emscriptenModule) await init();
+
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    getDecodeLimits(options.limits),
+    !!options.premultipliedAlpha,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes straight into a region of a larger buffer, such as a tile of an
+ * atlas, instead of a new ImageData. Resolves to the size of the decoded
+ * image, which must fit in the region.
+ */
+export async function decodeInto(
+  buffer: ArrayBuffer,
+  target: DecodeTarget,
+  options: DecodeOptions = {},
+): Promise<{ width: number; height: number }> {
   if (!emscriptenModule) await init();
 
   const module = await emscriptenModule;
-  const result = module.decode(buffer);
+  const result = module.decode(
+    buffer,
+    getDecodeLimits(options.limits),
+    !!options.premultipliedAlpha,
+    { data: target.data.subarray(target.offset ?? 0), stride: target.stride },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
   return result;
 }
@@ -18,35 +18,71 @@
 import type { QOIModule } from './codec/enc/qoi_enc.js';
 
 import qoi_enc from './codec/enc/qoi_enc.js';
-import { initEmscriptenModule } from './utils.js';
+import type { EncodeOptions, ImageDataView } from './meta.js';
+import {
+  getImageRows,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 
 let emscriptenModule: Promise<QOIModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: QOIModule) => Promise<QOIModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<QOIModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
-  emscriptenModule = initEmscriptenModule(qoi_enc, actualModule, actualOptions);
+  const load = () =>
+    initEmscriptenModule(qoi_enc, actualModule, emscriptenOptions);
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
 }
 
-export default async function encode(data: ImageData): Promise<ArrayBuffer> {
+export default async function encode(
+  data: ImageData | ImageDataView,
+  options: EncodeOptions = {},
+): Promise<ArrayBuffer> {
   if (!emscriptenModule) await init();
 
   const module = await emscriptenModule;
-  const resultView = module.encode(data.data, data.width, data.height);
+  const { rows, stride } = getImageRows(data);
+  const resultView = module.encode(
+    rows,
+    data.width,
+    data.height,
+    stride,
+    !!options.premultipliedAlpha,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (!resultView) throw new Error('Encoding error.');
   // wasm can't run on SharedArrayBuffers, so we hard-cast to ArrayBuffer.
   return resultView.buffer as ArrayBuffer;
 }
@@ -1,2 +1,5 @@
 export { default as encode } from './encode.js';
-export { default as decode } from './decode.js';
+export { default as decode, decodeInto } from './decode.js';
+export type { DecodeLimits, DecodeTarget, ImageDataView } from './meta.js';
+export { DecodeLimitError, getRecycleStats } from './utils.js';
+export type { InitOptions, RecycleStats } from './utils.js';
@@ -0,0 +1,767 @@
+#include <emscripten/bind.h>
+#include <emscripten/val.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "avif/avif.h"
+#include "config.h"
+#include "jpeglib.h"
+#include "src/webp/decode.h"
+#include "src/webp/encode.h"
+
+extern "C" {
+#include "cdjpeg.h"
+}
+
+#define QOI_IMPLEMENTATION
+#include "qoi.h"
+
+#include "decode_limits.h"
+#include "jpeg_error.h"
+#include "resample.h"
+
+using namespace emscripten;
+
+// Decode, resize and encode in a single call. Every stage works on one RGBA
+// buffer that lives in this module's heap, so pixels never cross the JS
+// boundary between stages.
+
+thread_local const val Uint8Array = val::global("Uint8Array");
+
+// The three encoder option structs mirror the ones bound by the jpeg, webp and
+// avif packages so the same JS option objects can be passed straight through.
+struct MozJpegOptions {
+  int quality;
+  bool baseline;
+  bool arithmetic;
+  bool progressive;
+  bool optimize_coding;
+  int smoothing;
+  int color_space;
+  int quant_table;
+  bool trellis_multipass;
+  bool trellis_opt_zero;
+  bool trellis_opt_table;
+  int trellis_loops;
+  bool auto_subsample;
+  int chroma_subsample;
+  bool separate_chroma_quality;
+  int chroma_quality;
+};
+
+struct AvifOptions {
+  int quality;
+  int qualityAlpha;
+  int tileRowsLog2;
+  int tileColsLog2;
+  int speed;
+  int subsample;
+  bool chromaDeltaQ;
+  int sharpness;
+  int tune;
+  int denoiseLevel;
+};
+
+struct TranscodeOptions {
+  // "jpeg" | "webp" | "avif" | "qoi"
+  std::string format;
+  // Target size, 0 keeps the source size or preserves the aspect ratio when
+  // only one side is given.
+  int width;
+  int height;
+  // "stretch" | "contain"
+  std::string fitMethod;
+  // jsquash::ResampleFilter
+  int method;
+  bool premultiply;
+  MozJpegOptions jpeg;
+  WebPConfig webp;
+  AvifOptions avif;
+};
+
+using AvifImagePtr = std::unique_ptr<avifImage, decltype(&avifImageDestroy)>;
+using AvifDecoderPtr = std::unique_ptr<avifDecoder, decltype(&avifDecoderDestroy)>;
+using AvifEncoderPtr = std::unique_ptr<avifEncoder, decltype(&avifEncoderDestroy)>;
+
+// A tightly packed RGBA8 image owned by the module heap.
+struct Frame {
+  std::unique_ptr<uint8_t, decltype(&free)> pixels{nullptr, free};
+  int width = 0;
+  int height = 0;
+
+  bool Allocate(int w, int h) {
+    if (w <= 0 || h <= 0 ||
+        static_cast<size_t>(w) > std::numeric_limits<size_t>::max() / 4 / static_cast<size_t>(h)) {
+      return false;
+    }
+    pixels.reset(static_cast<uint8_t*>(malloc(static_cast<size_t>(w) * h * 4)));
+    width = w;
+    height = h;
+    return pixels != nullptr;
+  }
+
+  size_t stride() const { return static_cast<size_t>(width) * 4; }
+  size_t size() const { return stride() * height; }
+};
+
+enum class InputFormat { Unknown, Jpeg, Webp, Avif, Qoi };
+
+InputFormat SniffFormat(const uint8_t* data, size_t size) {
+  if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+    return InputFormat::Jpeg;
+  }
+  if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0) {
+    return InputFormat::Webp;
+  }
+  if (size >= 12 && memcmp(data + 4, "ftyp", 4) == 0) {
+    return InputFormat::Avif;
+  }
+  if (size >= 4 && memcmp(data, "qoif", 4) == 0) {
+    return InputFormat::Qoi;
+  }
+  return InputFormat::Unknown;
+}
+
+// libjpeg calls the progress monitor for every iMCU row it reads and every
+// jpeg_read_scanlines() call, so it is where the decode budget is polled. A
+// decode over budget leaves through the error manager's longjmp, like any
+// other libjpeg error.
+struct BudgetProgress {
+  // Must stay the first member, libjpeg only knows about this part.
+  jpeg_progress_mgr pub;
+  jsquash::DecodeBudget* budget;
+};
+
+void PollBudget(j_common_ptr cinfo) {
+  auto* progress = reinterpret_cast<BudgetProgress*>(cinfo->progress);
+  if (!progress->budget->Poll()) {
+    longjmp(reinterpret_cast<jsquash::JpegErrorManager*>(cinfo->err)->jump, 1);
+  }
+}
+
+// Checks the size in the header read by `cinfo` against the budget, counting
+// `frame_bytes` for the decoded image and, for progressive files, the
+// coefficients libjpeg keeps for the whole image while it reads every scan.
+bool CheckJpegHeader(const jpeg_decompress_struct& cinfo,
+                     double frame_bytes,
+                     jsquash::DecodeBudget* budget) {
+  double bytes = frame_bytes;
+  if (cinfo.progressive_mode) {
+    bytes += static_cast<double>(cinfo.image_width) * cinfo.image_height * cinfo.num_components *
+             sizeof(JCOEF);
+  }
+  return budget->CheckImage(cinfo.image_width, cinfo.image_height, 1, bytes);
+}
+
+// `frame` belongs to the caller, so a longjmp back to the setjmp() below
+// leaks nothing, see jpeg_error.h.
+bool DecodeJpeg(const uint8_t* data, size_t size, jsquash::DecodeBudget* budget, Frame* frame) {
+  jpeg_decompress_struct cinfo;
+  jsquash::JpegErrorManager jerr;
+  cinfo.err = jsquash::JpegStdError(&jerr);
+  BudgetProgress progress = {{PollBudget, 0, 0, 0, 0}, budget};
+  if (setjmp(jerr.jump)) {
+    // Corrupt or truncated data, or over budget. The module stays usable for
+    // the next call.
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  cinfo.progress = &progress.pub;
+
+  jpeg_mem_src(&cinfo, data, size);
+  jpeg_read_header(&cinfo, TRUE);
+  if (!CheckJpegHeader(cinfo, 4.0 * cinfo.image_width * cinfo.image_height, budget)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  cinfo.out_color_space = JCS_EXT_RGBA;
+  jpeg_start_decompress(&cinfo);
+
+  bool ok = frame->Allocate(cinfo.output_width, cinfo.output_height);
+  while (ok && cinfo.output_scanline < cinfo.output_height) {
+    uint8_t* row = frame->pixels.get() + cinfo.output_scanline * frame->stride();
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+
+  if (ok) {
+    jpeg_finish_decompress(&cinfo);
+  }
+  jpeg_destroy_decompress(&cinfo);
+  return ok;
+}
+
+bool DecodeWebp(const uint8_t* data, size_t size, jsquash::DecodeBudget* budget, Frame* frame) {
+  int width, height;
+  if (!WebPGetInfo(data, size, &width, &height) ||
+      !budget->CheckImage(width, height, 1, 4.0 * width * height) ||
+      !frame->Allocate(width, height)) {
+    return false;
+  }
+  return WebPDecodeRGBAInto(data, size, frame->pixels.get(), frame->size(), frame->stride()) !=
+         nullptr;
+}
+
+bool DecodeAvif(const uint8_t* data, size_t size, jsquash::DecodeBudget* budget, Frame* frame) {
+  AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  // Parsing reads the container only, which gives the size and the frame
+  // count before any AV1 data is decoded.
+  if (!decoder || avifDecoderSetIOMemory(decoder.get(), data, size) != AVIF_RESULT_OK ||
+      avifDecoderParse(decoder.get()) != AVIF_RESULT_OK ||
+      !budget->CheckImage(decoder->image->width, decoder->image->height, decoder->imageCount,
+                          4.0 * decoder->image->width * decoder->image->height) ||
+      avifDecoderNextImage(decoder.get()) != AVIF_RESULT_OK || !budget->Check()) {
+    return false;
+  }
+  // Owned by the decoder.
+  const avifImage* image = decoder->image;
+
+  if (!frame->Allocate(image->width, image->height)) {
+    return false;
+  }
+
+  // Convert straight into the frame rather than a libavif owned buffer.
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults(&rgb, image);
+  rgb.depth = 8;
+  rgb.format = AVIF_RGB_FORMAT_RGBA;
+  rgb.pixels = frame->pixels.get();
+  rgb.rowBytes = frame->stride();
+  return avifImageYUVToRGB(image, &rgb) == AVIF_RESULT_OK;
+}
+
+bool DecodeQoi(const uint8_t* data, size_t size, jsquash::DecodeBudget* budget, Frame* frame) {
+  // qoi_decode() reads the header and decodes in one call, so the size is
+  // checked from the header ("qoif", then big endian width and height) first.
+  if (size >= 12) {
+    const uint32_t width = (uint32_t(data[4]) << 24) | (uint32_t(data[5]) << 16) |
+                           (uint32_t(data[6]) << 8) | data[7];
+    const uint32_t height = (uint32_t(data[8]) << 24) | (uint32_t(data[9]) << 16) |
+                            (uint32_t(data[10]) << 8) | data[11];
+    if (!budget->CheckImage(width, height, 1, 4.0 * width * height)) {
+      return false;
+    }
+  }
+  qoi_desc desc;
+  void* rgba = qoi_decode(data, size, &desc, 4);
+  if (rgba == nullptr) {
+    return false;
+  }
+  frame->pixels.reset(static_cast<uint8_t*>(rgba));
+  frame->width = desc.width;
+  frame->height = desc.height;
+  return true;
+}
+
+bool Decode(const std::string& input, jsquash::DecodeBudget* budget, Frame* frame) {
+  const auto data = reinterpret_cast<const uint8_t*>(input.data());
+  switch (SniffFormat(data, input.size())) {
+    case InputFormat::Jpeg:
+      return DecodeJpeg(data, input.size(), budget, frame);
+    case InputFormat::Webp:
+      return DecodeWebp(data, input.size(), budget, frame);
+    case InputFormat::Avif:
+      return DecodeAvif(data, input.size(), budget, frame);
+    case InputFormat::Qoi:
+      return DecodeQoi(data, input.size(), budget, frame);
+    default:
+      return false;
+  }
+}
+
+jsquash::ResampleRect SourceCrop(int src_width,
+                                 int src_height,
+                                 int width,
+                                 int height,
+                                 const std::string& fit_method) {
+  if (fit_method == "contain") {
+    return jsquash::ContainCrop(src_width, src_height, width, height);
+  }
+  return {0, 0, src_width, src_height};
+}
+
+jsquash::ResampleOptions GetResampleOptions(const TranscodeOptions& options) {
+  jsquash::ResampleOptions resample_options;
+  resample_options.filter = options.method;
+  resample_options.premultiply = options.premultiply;
+  return resample_options;
+}
+
+bool Resize(Frame* frame, const TranscodeOptions& options) {
+  int width = options.width;
+  int height = options.height;
+  jsquash::FitSize(frame->width, frame->height, &width, &height);
+
+  const jsquash::ResampleRect crop =
+      SourceCrop(frame->width, frame->height, width, height, options.fitMethod);
+
+  if (width == frame->width && height == frame->height && crop.width == frame->width &&
+      crop.height == frame->height) {
+    return true;
+  }
+
+  Frame resized;
+  if (!resized.Allocate(width, height)) {
+    return false;
+  }
+
+  if (!jsquash::ResampleRGBA8(frame->pixels.get(), frame->stride(), crop, resized.pixels.get(),
+                              width, height, GetResampleOptions(options))) {
+    return false;
+  }
+
+  // Drop the full size frame before the encoder allocates its own buffers.
+  *frame = std::move(resized);
+  return true;
+}
+
+// The argument set_quality_ratings() takes. Built before setjmp(), as a
+// longjmp back to it would not free the string.
+std::string JpegQualityRatings(const MozJpegOptions& opts) {
+  std::string quality = std::to_string(opts.quality);
+  if (opts.separate_chroma_quality && opts.color_space == JCS_YCbCr) {
+    quality += "," + std::to_string(opts.chroma_quality);
+  }
+  return quality;
+}
+
+void SetJpegCompressOptions(jpeg_compress_struct* cinfo,
+                            int width,
+                            int height,
+                            const MozJpegOptions& opts,
+                            const std::string& quality) {
+  cinfo->image_width = width;
+  cinfo->image_height = height;
+  cinfo->input_components = 4;
+  cinfo->in_color_space = JCS_EXT_RGBA;
+  jpeg_set_defaults(cinfo);
+
+  jpeg_set_colorspace(cinfo, (J_COLOR_SPACE)opts.color_space);
+
+  if (opts.quant_table != -1) {
+    jpeg_c_set_int_param(cinfo, JINT_BASE_QUANT_TBL_IDX, opts.quant_table);
+  }
+
+  cinfo->optimize_coding = opts.optimize_coding;
+
+  if (opts.arithmetic) {
+    cinfo->arith_code = TRUE;
+    cinfo->optimize_coding = FALSE;
+  }
+
+  cinfo->smoothing_factor = opts.smoothing;
+
+  jpeg_c_set_bool_param(cinfo, JBOOLEAN_USE_SCANS_IN_TRELLIS, opts.trellis_multipass);
+  jpeg_c_set_bool_param(cinfo, JBOOLEAN_TRELLIS_EOB_OPT, opts.trellis_opt_zero);
+  jpeg_c_set_bool_param(cinfo, JBOOLEAN_TRELLIS_Q_OPT, opts.trellis_opt_table);
+  jpeg_c_set_int_param(cinfo, JINT_TRELLIS_NUM_LOOPS, opts.trellis_loops);
+  jpeg_c_set_int_param(cinfo, JINT_DC_SCAN_OPT_MODE, 0);
+
+  set_quality_ratings(cinfo, const_cast<char*>(quality.c_str()), opts.baseline);
+
+  if (!opts.auto_subsample && opts.color_space == JCS_YCbCr) {
+    cinfo->comp_info[0].h_samp_factor = opts.chroma_subsample;
+    cinfo->comp_info[0].v_samp_factor = opts.chroma_subsample;
+
+    if (opts.chroma_subsample > 2) {
+      jpeg_c_set_int_param(cinfo, JINT_DC_SCAN_OPT_MODE, 1);
+    }
+  }
+
+  if (!opts.baseline && opts.progressive) {
+    jpeg_simple_progression(cinfo);
+  } else {
+    cinfo->num_scans = 0;
+    cinfo->scan_info = NULL;
+  }
+}
+
+val EncodeJpeg(const Frame& frame, const MozJpegOptions& opts) {
+  jpeg_compress_struct cinfo;
+  jsquash::JpegErrorManager jerr;
+  cinfo.err = jsquash::JpegStdError(&jerr);
+  const std::string quality = JpegQualityRatings(opts);
+  uint8_t* output = nullptr;
+  unsigned long size = 0;
+  if (setjmp(jerr.jump)) {
+    // Unsupported options, for example. The module stays usable.
+    jpeg_destroy_compress(&cinfo);
+    free(output);
+    return val::null();
+  }
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &output, &size);
+
+  SetJpegCompressOptions(&cinfo, frame.width, frame.height, opts, quality);
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = frame.pixels.get() + cinfo.next_scanline * frame.stride();
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+
+  auto js_result = Uint8Array.new_(typed_memory_view(size, output));
+  jpeg_destroy_compress(&cinfo);
+  free(output);
+  return js_result;
+}
+
+// Largest power of two IDCT scale that still leaves at least `width` x
+// `height` pixels in the crop, so the resampler never upscales what libjpeg
+// already shrank.
+unsigned int JpegScaleDenom(const jsquash::ResampleRect& crop, int width, int height) {
+  unsigned int denom = 8;
+  while (denom > 1 && (crop.width / static_cast<int>(denom) < width ||
+                       crop.height / static_cast<int>(denom) < height)) {
+    denom /= 2;
+  }
+  return denom;
+}
+
+// JPEG -> JPEG without ever holding a full frame: every decoded scanline is
+// pushed through a RowResampler and each finished output row is handed to the
+// encoder straight away. Memory use is a handful of rows on each side, plus
+// the coefficient buffers libjpeg keeps for progressive input and for
+// progressive / optimised / trellis output, which scale with the compressed
+// image and not with RGBA pixels.
+val TranscodeJpegStreaming(const std::string& input,
+                           const TranscodeOptions& options,
+                           jsquash::DecodeBudget* budget) {
+  // Zeroed so that destroying an object that was never created is a no-op.
+  jpeg_decompress_struct dinfo = {};
+  jpeg_compress_struct cinfo = {};
+  // Shared by both objects, so a corrupt input, unsupported encoder options
+  // and the budget all jump back to the one setjmp() below.
+  jsquash::JpegErrorManager jerr;
+  dinfo.err = jsquash::JpegStdError(&jerr);
+  cinfo.err = &jerr.pub;
+  BudgetProgress progress = {{PollBudget, 0, 0, 0, 0}, budget};
+  // Everything that lives across libjpeg calls, see jpeg_error.h.
+  const std::string quality = JpegQualityRatings(options.jpeg);
+  uint8_t* output = nullptr;
+  unsigned long size = 0;
+  std::vector<uint8_t> row;
+  std::unique_ptr<jsquash::RowResampler> resampler;
+  if (setjmp(jerr.jump)) {
+    jpeg_destroy_decompress(&dinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(output);
+    return budget->exceeded() ? budget->Abort() : val::null();
+  }
+  jpeg_create_decompress(&dinfo);
+  jpeg_create_compress(&cinfo);
+  dinfo.progress = &progress.pub;
+
+  jpeg_mem_src(&dinfo, reinterpret_cast<const uint8_t*>(input.data()), input.size());
+  jpeg_read_header(&dinfo, TRUE);
+  if (!CheckJpegHeader(dinfo, 0, budget)) {
+    jpeg_destroy_decompress(&dinfo);
+    jpeg_destroy_compress(&cinfo);
+    return budget->Abort();
+  }
+  dinfo.out_color_space = JCS_EXT_RGBA;
+
+  int width = options.width;
+  int height = options.height;
+  jsquash::FitSize(dinfo.image_width, dinfo.image_height, &width, &height);
+
+  // Let the IDCT do the bulk of a large downscale, it skips most of the
+  // decoding work as well as the resampling work.
+  dinfo.scale_num = 1;
+  dinfo.scale_denom = JpegScaleDenom(
+      SourceCrop(dinfo.image_width, dinfo.image_height, width, height, options.fitMethod), width,
+      height);
+  jpeg_start_decompress(&dinfo);
+
+  const jsquash::ResampleRect crop =
+      SourceCrop(dinfo.output_width, dinfo.output_height, width, height, options.fitMethod);
+  const bool passthrough = crop.width == width && crop.height == height &&
+                           crop.width == static_cast<int>(dinfo.output_width) &&
+                           crop.height == static_cast<int>(dinfo.output_height);
+
+  jpeg_mem_dest(&cinfo, &output, &size);
+  SetJpegCompressOptions(&cinfo, width, height, options.jpeg, quality);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  row.resize(static_cast<size_t>(dinfo.output_width) * 4);
+  JSAMPROW row_pointer = row.data();
+  if (passthrough) {
+    while (dinfo.output_scanline < dinfo.output_height) {
+      jpeg_read_scanlines(&dinfo, &row_pointer, 1);
+      jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+    }
+  } else {
+    resampler = std::make_unique<jsquash::RowResampler>(crop, width, height,
+                                                        GetResampleOptions(options));
+    if (!resampler->valid()) {
+      jpeg_destroy_decompress(&dinfo);
+      jpeg_destroy_compress(&cinfo);
+      free(output);
+      return val::null();
+    }
+    while (dinfo.output_scanline < dinfo.output_height && !resampler->done()) {
+      jpeg_read_scanlines(&dinfo, &row_pointer, 1);
+      resampler->PushRow(row.data(), [&cinfo](const uint8_t* out, int) {
+        JSAMPROW out_pointer = const_cast<uint8_t*>(out);
+        jpeg_write_scanlines(&cinfo, &out_pointer, 1);
+      });
+    }
+  }
+  // Rows below a contain crop are never read, destroying aborts the decode.
+  jpeg_destroy_decompress(&dinfo);
+
+  jpeg_finish_compress(&cinfo);
+  auto js_result = Uint8Array.new_(typed_memory_view(size, output));
+  jpeg_destroy_compress(&cinfo);
+  free(output);
+  return js_result;
+}
+
+val EncodeWebp(const Frame& frame, WebPConfig config) {
+  WebPPicture pic;
+  WebPMemoryWriter wrt;
+
+  if (!WebPPictureInit(&pic)) {
+    return val::null();
+  }
+
+  config.qmax = 100;
+
+  pic.use_argb = config.lossless || config.use_sharp_yuv || config.preprocessing > 0;
+  pic.width = frame.width;
+  pic.height = frame.height;
+  pic.writer = WebPMemoryWrite;
+  pic.custom_ptr = &wrt;
+
+  WebPMemoryWriterInit(&wrt);
+
+  const int ok = WebPPictureImportRGBA(&pic, frame.pixels.get(), frame.stride()) &&
+                 WebPEncode(&config, &pic);
+  WebPPictureFree(&pic);
+  val js_result = ok ? Uint8Array.new_(typed_memory_view(wrt.size, wrt.mem)) : val::null();
+  WebPMemoryWriterClear(&wrt);
+  return js_result;
+}
+
+val EncodeAvif(const Frame& frame, const AvifOptions& options) {
+  avifPixelFormat format;
+  switch (options.subsample) {
+    case 0:
+      format = AVIF_PIXEL_FORMAT_YUV400;
+      break;
+    case 2:
+      format = AVIF_PIXEL_FORMAT_YUV422;
+      break;
+    case 3:
+      format = AVIF_PIXEL_FORMAT_YUV444;
+      break;
+    default:
+      format = AVIF_PIXEL_FORMAT_YUV420;
+      break;
+  }
+
+  const bool lossless = options.quality == AVIF_QUALITY_LOSSLESS &&
+                        (options.qualityAlpha == -1 ||
+                         options.qualityAlpha == AVIF_QUALITY_LOSSLESS) &&
+                        format == AVIF_PIXEL_FORMAT_YUV444;
+
+  AvifImagePtr image(avifImageCreate(frame.width, frame.height, 8, format), avifImageDestroy);
+  if (!image) {
+    return val::null();
+  }
+  image->matrixCoefficients =
+      lossless ? AVIF_MATRIX_COEFFICIENTS_IDENTITY : AVIF_MATRIX_COEFFICIENTS_BT601;
+
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults(&rgb, image.get());
+  rgb.depth = 8;
+  rgb.pixels = frame.pixels.get();
+  rgb.rowBytes = frame.stride();
+  if (avifImageRGBToYUV(image.get(), &rgb) != AVIF_RESULT_OK) {
+    return val::null();
+  }
+
+  AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  if (!encoder) {
+    return val::null();
+  }
+
+  if (lossless) {
+    encoder->quality = AVIF_QUALITY_LOSSLESS;
+    encoder->qualityAlpha = AVIF_QUALITY_LOSSLESS;
+  } else {
+    encoder->quality = options.quality;
+    encoder->qualityAlpha = options.qualityAlpha == -1 ? options.quality : options.qualityAlpha;
+
+    if (avifEncoderSetCodecSpecificOption(encoder.get(), "sharpness",
+                                          std::to_string(options.sharpness).c_str()) !=
+        AVIF_RESULT_OK) {
+      return val::null();
+    }
+    if ((options.tune == 2 || (options.tune == 0 && options.quality >= 50)) &&
+        avifEncoderSetCodecSpecificOption(encoder.get(), "tune", "ssim") != AVIF_RESULT_OK) {
+      return val::null();
+    }
+    if (options.chromaDeltaQ &&
+        avifEncoderSetCodecSpecificOption(encoder.get(), "color:enable-chroma-deltaq", "1") !=
+            AVIF_RESULT_OK) {
+      return val::null();
+    }
+    if (avifEncoderSetCodecSpecificOption(encoder.get(), "color:denoise-noise-level",
+                                          std::to_string(options.denoiseLevel).c_str()) !=
+        AVIF_RESULT_OK) {
+      return val::null();
+    }
+  }
+
+  encoder->maxThreads = 1;
+  encoder->tileRowsLog2 = options.tileRowsLog2;
+  encoder->tileColsLog2 = options.tileColsLog2;
+  encoder->speed = options.speed;
+
+  avifRWData output = AVIF_DATA_EMPTY;
+  auto js_result = val::null();
+  if (avifEncoderWrite(encoder.get(), image.get(), &output) == AVIF_RESULT_OK) {
+    js_result = Uint8Array.new_(typed_memory_view(output.size, output.data));
+  }
+  avifRWDataFree(&output);
+  return js_result;
+}
+
+val EncodeQoi(const Frame& frame) {
+  qoi_desc desc;
+  desc.width = frame.width;
+  desc.height = frame.height;
+  desc.channels = 4;
+  desc.colorspace = QOI_SRGB;
+
+  int size;
+  void* encoded = qoi_encode(frame.pixels.get(), &desc, &size);
+  if (encoded == nullptr) {
+    return val::null();
+  }
+  auto js_result = Uint8Array.new_(typed_memory_view(size, static_cast<uint8_t*>(encoded)));
+  free(encoded);
+  return js_result;
+}
+
+// Returns the name of the limit as a string when `limits` stop the decode.
+// Encoding isn't limited.
+val transcode(std::string input, TranscodeOptions options, jsquash::DecodeLimits limits) {
+  jsquash::DecodeBudget budget(limits);
+  const auto data = reinterpret_cast<const uint8_t*>(input.data());
+  if (options.format == "jpeg" && SniffFormat(data, input.size()) == InputFormat::Jpeg) {
+    return TranscodeJpegStreaming(input, options, &budget);
+  }
+
+  Frame frame;
+  if (!Decode(input, &budget, &frame)) {
+    return budget.exceeded() ? budget.Abort() : val::null();
+  }
+  if (!budget.Check()) {
+    return budget.Abort();
+  }
+
+  // The encoded input is no longer needed, release it before resizing.
+  std::string().swap(input);
+
+  if (!Resize(&frame, options)) {
+    return val::null();
+  }
+
+  if (options.format == "jpeg") {
+    return EncodeJpeg(frame, options.jpeg);
+  }
+  if (options.format == "webp") {
+    return EncodeWebp(frame, options.webp);
+  }
+  if (options.format == "avif") {
+    return EncodeAvif(frame, options.avif);
+  }
+  if (options.format == "qoi") {
+    return EncodeQoi(frame);
+  }
+  return val::null();
+}
+
+EMSCRIPTEN_BINDINGS(my_module) {
+  jsquash::RegisterDecodeLimits();
+  value_object<MozJpegOptions>("MozJpegOptions")
+      .field("quality", &MozJpegOptions::quality)
+      .field("baseline", &MozJpegOptions::baseline)
+      .field("arithmetic", &MozJpegOptions::arithmetic)
+      .field("progressive", &MozJpegOptions::progressive)
+      .field("optimize_coding", &MozJpegOptions::optimize_coding)
+      .field("smoothing", &MozJpegOptions::smoothing)
+      .field("color_space", &MozJpegOptions::color_space)
+      .field("quant_table", &MozJpegOptions::quant_table)
+      .field("trellis_multipass", &MozJpegOptions::trellis_multipass)
+      .field("trellis_opt_zero", &MozJpegOptions::trellis_opt_zero)
+      .field("trellis_opt_table", &MozJpegOptions::trellis_opt_table)
+      .field("trellis_loops", &MozJpegOptions::trellis_loops)
+      .field("chroma_subsample", &MozJpegOptions::chroma_subsample)
+      .field("auto_subsample", &MozJpegOptions::auto_subsample)
+      .field("separate_chroma_quality", &MozJpegOptions::separate_chroma_quality)
+      .field("chroma_quality", &MozJpegOptions::chroma_quality);
+
+  value_object<WebPConfig>("WebPConfig")
+      .field("lossless", &WebPConfig::lossless)
+      .field("quality", &WebPConfig::quality)
+      .field("method", &WebPConfig::method)
+      .field("image_hint", &WebPConfig::image_hint)
+      .field("target_size", &WebPConfig::target_size)
+      .field("target_PSNR", &WebPConfig::target_PSNR)
+      .field("segments", &WebPConfig::segments)
+      .field("sns_strength", &WebPConfig::sns_strength)
+      .field("filter_strength", &WebPConfig::filter_strength)
+      .field("filter_sharpness", &WebPConfig::filter_sharpness)
+      .field("filter_type", &WebPConfig::filter_type)
+      .field("autofilter", &WebPConfig::autofilter)
+      .field("alpha_compression", &WebPConfig::alpha_compression)
+      .field("alpha_filtering", &WebPConfig::alpha_filtering)
+      .field("alpha_quality", &WebPConfig::alpha_quality)
+      .field("pass", &WebPConfig::pass)
+      .field("show_compressed", &WebPConfig::show_compressed)
+      .field("preprocessing", &WebPConfig::preprocessing)
+      .field("partitions", &WebPConfig::partitions)
+      .field("partition_limit", &WebPConfig::partition_limit)
+      .field("emulate_jpeg_size", &WebPConfig::emulate_jpeg_size)
+      .field("low_memory", &WebPConfig::low_memory)
+      .field("near_lossless", &WebPConfig::near_lossless)
+      .field("exact", &WebPConfig::exact)
+      .field("use_delta_palette", &WebPConfig::use_delta_palette)
+      .field("use_sharp_yuv", &WebPConfig::use_sharp_yuv);
+
+  value_object<AvifOptions>("AvifOptions")
+      .field("quality", &AvifOptions::quality)
+      .field("qualityAlpha", &AvifOptions::qualityAlpha)
+      .field("tileRowsLog2", &AvifOptions::tileRowsLog2)
+      .field("tileColsLog2", &AvifOptions::tileColsLog2)
+      .field("speed", &AvifOptions::speed)
+      .field("chromaDeltaQ", &AvifOptions::chromaDeltaQ)
+      .field("sharpness", &AvifOptions::sharpness)
+      .field("tune", &AvifOptions::tune)
+      .field("denoiseLevel", &AvifOptions::denoiseLevel)
+      .field("subsample", &AvifOptions::subsample);
+
+  value_object<TranscodeOptions>("TranscodeOptions")
+      .field("format", &TranscodeOptions::format)
+      .field("width", &TranscodeOptions::width)
+      .field("height", &TranscodeOptions::height)
+      .field("fitMethod", &TranscodeOptions::fitMethod)
+      .field("method", &TranscodeOptions::method)
+      .field("premultiply", &TranscodeOptions::premultiply)
+      .field("jpeg", &TranscodeOptions::jpeg)
+      .field("webp", &TranscodeOptions::webp)
+      .field("avif", &TranscodeOptions::avif);
+
+  function("transcode", &transcode);
+}
@@ -0,0 +1,113 @@
+export const enum MozJpegColorSpace {
+  GRAYSCALE = 1,
+  RGB,
+  YCbCr,
+}
+
+export interface JpegEncodeOptions {
+  quality: number;
+  baseline: boolean;
+  arithmetic: boolean;
+  progressive: boolean;
+  optimize_coding: boolean;
+  smoothing: number;
+  color_space: MozJpegColorSpace;
+  quant_table: number;
+  trellis_multipass: boolean;
+  trellis_opt_zero: boolean;
+  trellis_opt_table: boolean;
+  trellis_loops: number;
+  auto_subsample: boolean;
+  chroma_subsample: number;
+  separate_chroma_quality: boolean;
+  chroma_quality: number;
+}
+
+export interface WebPEncodeOptions {
+  quality: number;
+  target_size: number;
+  target_PSNR: number;
+  method: number;
+  sns_strength: number;
+  filter_strength: number;
+  filter_sharpness: number;
+  filter_type: number;
+  partitions: number;
+  segments: number;
+  pass: number;
+  show_compressed: number;
+  preprocessing: number;
+  autofilter: number;
+  partition_limit: number;
+  alpha_compression: number;
+  alpha_filtering: number;
+  alpha_quality: number;
+  lossless: number;
+  exact: number;
+  image_hint: number;
+  emulate_jpeg_size: number;
+  low_memory: number;
+  near_lossless: number;
+  use_delta_palette: number;
+  use_sharp_yuv: number;
+}
+
+export const enum AVIFTune {
+  auto,
+  psnr,
+  ssim,
+}
+
+export interface AvifEncodeOptions {
+  quality: number;
+  qualityAlpha: number;
+  denoiseLevel: number;
+  tileRowsLog2: number;
+  tileColsLog2: number;
+  speed: number;
+  subsample: number;
+  chromaDeltaQ: boolean;
+  sharpness: number;
+  tune: AVIFTune;
+}
+
+export const enum ResizeMethod {
+  triangle,
+  catrom,
+  mitchell,
+  lanczos3,
+}
+
+export interface TranscodeOptions {
+  format: 'jpeg' | 'webp' | 'avif' | 'qoi';
+  width: number;
+  height: number;
+  fitMethod: 'stretch' | 'contain';
+  method: ResizeMethod;
+  premultiply: boolean;
+  jpeg: JpegEncodeOptions;
+  webp: WebPEncodeOptions;
+  avif: AvifEncodeOptions;
+}
+
+export interface DecodeLimits {
+  maxPixels: number;
+  maxFrames: number;
+  maxMemory: number;
+  timeLimit: number;
+}
+
+// What a transcode stopped by its limits returns.
+export type DecodeLimit = keyof DecodeLimits;
+
+export interface TranscodeModule extends EmscriptenWasm.Module {
+  transcode(
+    data: BufferSource,
+    options: TranscodeOptions,
+    limits: DecodeLimits,
+  ): Uint8Array | DecodeLimit | null;
+}
+
+declare var moduleFactory: EmscriptenWasm.ModuleFactory<TranscodeModule>;
+
+export default moduleFactory;
@@ -0,0 +1,3 @@
+export { default as transcode } from './transcode.js';
+export { DecodeLimitError } from './utils.js';
+export type { DecodeLimits } from './meta.js';
@@ -0,0 +1,128 @@
+import {
+  AVIFTune,
+  MozJpegColorSpace,
+  ResizeMethod,
+} from './codec/transcode.js';
+import type {
+  AvifEncodeOptions,
+  JpegEncodeOptions,
+  WebPEncodeOptions,
+} from './codec/transcode.js';
+
+export { AVIFTune, MozJpegColorSpace };
+export type { AvifEncodeOptions, JpegEncodeOptions, WebPEncodeOptions };
+
+export type OutputFormat = 'jpeg' | 'webp' | 'avif' | 'qoi';
+
+export type ResizeMethods = 'triangle' | 'catrom' | 'mitchell' | 'lanczos3';
+
+export const resizeMethods: Record<ResizeMethods, ResizeMethod> = {
+  triangle: ResizeMethod.triangle,
+  catrom: ResizeMethod.catrom,
+  mitchell: ResizeMethod.mitchell,
+  lanczos3: ResizeMethod.lanczos3,
+};
+
+/**
+ * Limits on what decoding the input may cost, for untrusted input. Each is
+ * checked against the header before any pixels are decoded, then again as the
+ * decode runs, and a transcode over one rejects with a `DecodeLimitError`
+ * naming it. Unset or 0 means no limit.
+ */
+export type DecodeLimits = {
+  // Largest width * height of the image.
+  maxPixels?: number;
+  // Most frames an animation or image sequence may declare.
+  maxFrames?: number;
+  // Most bytes the decode may have allocated at once.
+  maxMemory?: number;
+  // Milliseconds the decode may take.
+  timeLimit?: number;
+};
+
+export interface TranscodeOptions {
+  format: OutputFormat;
+  // Output size. Leave both unset to keep the source size, or set only one to
+  // scale while keeping the aspect ratio.
+  width?: number;
+  height?: number;
+  fitMethod: 'stretch' | 'contain';
+  method: ResizeMethods;
+  premultiply: boolean;
+  jpeg: Partial<JpegEncodeOptions>;
+  webp: Partial<WebPEncodeOptions>;
+  avif: Partial<AvifEncodeOptions>;
+  limits?: DecodeLimits;
+}
+
+// Same as the defaults in @jsquash/jpeg, @jsquash/webp and @jsquash/avif.
+export const defaultJpegOptions: JpegEncodeOptions = {
+  quality: 75,
+  baseline: false,
+  arithmetic: false,
+  progressive: true,
+  optimize_coding: true,
+  smoothing: 0,
+  color_space: MozJpegColorSpace.YCbCr,
+  quant_table: 3,
+  trellis_multipass: false,
+  trellis_opt_zero: false,
+  trellis_opt_table: false,
+  trellis_loops: 1,
+  auto_subsample: true,
+  chroma_subsample: 2,
+  separate_chroma_quality: false,
+  chroma_quality: 75,
+};
+
+export const defaultWebPOptions: WebPEncodeOptions = {
+  quality: 75,
+  target_size: 0,
+  target_PSNR: 0,
+  method: 4,
+  sns_strength: 50,
+  filter_strength: 60,
+  filter_sharpness: 0,
+  filter_type: 1,
+  partitions: 0,
+  segments: 4,
+  pass: 1,
+  show_compressed: 0,
+  preprocessing: 0,
+  autofilter: 0,
+  partition_limit: 0,
+  alpha_compression: 1,
+  alpha_filtering: 1,
+  alpha_quality: 100,
+  lossless: 0,
+  exact: 0,
+  image_hint: 0,
+  emulate_jpeg_size: 0,
+  low_memory: 0,
+  near_lossless: 100,
+  use_delta_palette: 0,
+  use_sharp_yuv: 0,
+};
+
+export const defaultAvifOptions: AvifEncodeOptions = {
+  quality: 50,
+  qualityAlpha: -1,
+  denoiseLevel: 0,
+  tileColsLog2: 0,
+  tileRowsLog2: 0,
+  speed: 6,
+  subsample: 1,
+  chromaDeltaQ: false,
+  sharpness: 0,
+  tune: AVIFTune.auto,
+};
+
+export const defaultOptions: TranscodeOptions = {
+  format: 'webp',
+  fitMethod: 'stretch',
+  method: 'lanczos3',
+  premultiply: true,
+  jpeg: defaultJpegOptions,
+  webp: defaultWebPOptions,
+  avif: defaultAvifOptions,
+};
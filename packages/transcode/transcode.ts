@@ -0,0 +1,80 @@
+import type { TranscodeModule } from './codec/transcode.js';
+import type { TranscodeOptions } from './meta.js';
+
+import transcode_wasm from './codec/transcode.js';
+import {
+  defaultOptions,
+  defaultJpegOptions,
+  defaultWebPOptions,
+  defaultAvifOptions,
+  resizeMethods,
+} from './meta.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+} from './utils.js';
+
+let emscriptenModule: Promise<TranscodeModule>;
+
+export async function init(
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+): Promise<void>;
+export async function init(
+  module?: WebAssembly.Module,
+  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+): Promise<void> {
+  let actualModule: WebAssembly.Module | undefined = module;
+  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
+    moduleOptionOverrides;
+
+  // If only one argument is provided and it's not a WebAssembly.Module
+  if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
+    actualModule = undefined;
+    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+  }
+
+  emscriptenModule = initEmscriptenModule(
+    transcode_wasm,
+    actualModule,
+    actualOptions,
+  );
+}
+
+/**
+ * Decodes a JPEG, WebP, AVIF or QOI image, optionally resizes it and encodes
+ * it to `options.format`. The decoded pixels stay inside the wasm module for
+ * the whole pipeline.
+ */
+export default async function transcode(
+  buffer: ArrayBuffer,
+  options: Partial<TranscodeOptions> = {},
+): Promise<ArrayBuffer> {
+  if (!emscriptenModule) init();
+
+  const module = await emscriptenModule;
+  const _options = { ...defaultOptions, ...options };
+  const result = module.transcode(
+    buffer,
+    {
+      format: _options.format,
+      width: _options.width ?? 0,
+      height: _options.height ?? 0,
+      fitMethod: _options.fitMethod,
+      method: resizeMethods[_options.method],
+      premultiply: _options.premultiply,
+      jpeg: { ...defaultJpegOptions, ...options.jpeg },
+      webp: { ...defaultWebPOptions, ...options.webp },
+      avif: { ...defaultAvifOptions, ...options.avif },
+    },
+    getDecodeLimits(_options.limits),
+  );
+
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) {
+    throw new Error('Transcoding error.');
+  }
+
+  // wasm can't run on SharedArrayBuffers, so we hard-cast to ArrayBuffer.
+  return result.buffer as ArrayBuffer;
+}
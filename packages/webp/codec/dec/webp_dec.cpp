@@ -1,29 +1,202 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <string>
 #include "emscripten/bind.h"
 #include "emscripten/val.h"
 #include "src/webp/decode.h"
 #include "src/webp/demux.h"
 
+#include "color_profile.h"
+#include "decode_limits.h"
+#include "decode_resize.h"
+#include "embind_export.h"
+#include "image_analysis.h"
+#include "image_size.h"
+#include "image_view.h"
+#include "premultiply.h"
+
 using namespace emscripten;
 
+namespace {
+
 int version() {
   return WebPGetDecoderVersion();
 }
 
-thread_local const val Uint8ClampedArray = val::global("Uint8ClampedArray");
-thread_local const val ImageData = val::global("ImageData");
-
-val decode(std::string buffer) {
-  int width, height;
-  std::unique_ptr<uint8_t[]> rgba(
-      WebPDecodeRGBA((const uint8_t*)buffer.c_str(), buffer.size(), &width, &height));
-  return rgba ? ImageData.new_(
-                    Uint8ClampedArray.new_(typed_memory_view(width * height * 4, rgba.get())),
-                    width, height)
-              : val::null();
+// libwebp has no progress hook for decodes, but its incremental decoder
+// returns whenever it runs out of input. Handing it the file in slices of this
+// size gives the budget a point to be checked between them.
+constexpr size_t kDecodeSliceSize = 64 * 1024;
+
+// Finds the ICC profile of an extended file, which libwebp leaves to the
+// caller. It is in the ICCP chunk, which can only come straight after the
+// VP8X chunk that starts the file. Returns false when there is none.
+bool FindIccProfile(const std::string& buffer, const uint8_t** icc, size_t* icc_size) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+  // The RIFF header, then chunks of a FourCC, a little endian size and the
+  // chunk data, padded to an even size.
+  constexpr size_t kRiffHeaderSize = 12;
+  constexpr size_t kChunkHeaderSize = 8;
+  auto chunk_size = [data](size_t offset) {
+    return static_cast<size_t>(data[offset + 4]) | data[offset + 5] << 8 |
+           data[offset + 6] << 16 | static_cast<size_t>(data[offset + 7]) << 24;
+  };
+  if (buffer.size() < kRiffHeaderSize + kChunkHeaderSize ||
+      memcmp(data + kRiffHeaderSize, "VP8X", 4) != 0) {
+    return false;
+  }
+  const size_t vp8x_size = chunk_size(kRiffHeaderSize);
+  if (vp8x_size > buffer.size()) {
+    return false;
+  }
+  const size_t offset = kRiffHeaderSize + kChunkHeaderSize + vp8x_size + (vp8x_size & 1);
+  if (offset > buffer.size() - kChunkHeaderSize || memcmp(data + offset, "ICCP", 4) != 0) {
+    return false;
+  }
+  const size_t size = chunk_size(offset);
+  if (size > buffer.size() - offset - kChunkHeaderSize) {
+    return false;
+  }
+  *icc = data + offset + kChunkHeaderSize;
+  *icc_size = size;
+  return true;
+}
+
+// Decodes the whole frame into `rgba`, which holds `width` x `height` tightly
+// packed RGBA8 pixels. The rows each slice completed go through `converter`
+// and then, when it is set, `analyzer` while they are still in cache. With
+// `premultiply`, libwebp writes premultiplied pixels itself, or the rows are
+// premultiplied after `converter` and `analyzer` have read them straight.
+bool DecodeInSlices(const std::string& buffer, int width, uint8_t* rgba, size_t size,
+                    jsquash::DecodeBudget* budget, const jsquash::ColorConverter& converter,
+                    jsquash::ImageAnalyzer* analyzer, bool premultiply) {
+  WebPDecoderConfig config;
+  if (!WebPInitDecoderConfig(&config)) {
+    return false;
+  }
+  const bool process_rows = converter.active() || analyzer;
+  config.output.colorspace = premultiply && !process_rows ? MODE_rgbA : MODE_RGBA;
+  config.output.is_external_memory = 1;
+  config.output.u.RGBA.rgba = rgba;
+  config.output.u.RGBA.stride = width * 4;
+  config.output.u.RGBA.size = size;
+  std::unique_ptr<WebPIDecoder, decltype(&WebPIDelete)> idec(WebPIDecode(nullptr, 0, &config),
+                                                             WebPIDelete);
+  if (!idec) {
+    return false;
+  }
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+  const size_t stride = static_cast<size_t>(width) * 4;
+  size_t available = 0;
+  int done_rows = 0;
+  while (available < buffer.size()) {
+    available = std::min(buffer.size(), available + kDecodeSliceSize);
+    const VP8StatusCode status = WebPIUpdate(idec.get(), data, available);
+    int decoded_rows;
+    if (process_rows && WebPIDecGetRGB(idec.get(), &decoded_rows, nullptr, nullptr, nullptr)) {
+      uint8_t* rows = rgba + done_rows * stride;
+      converter.ConvertRows(rows, stride, width, decoded_rows - done_rows);
+      if (analyzer) {
+        analyzer->AddRows(rows, stride, decoded_rows - done_rows);
+      }
+      if (premultiply) {
+        jsquash::PremultiplyRows(rows, stride, width, decoded_rows - done_rows);
+      }
+      done_rows = decoded_rows;
+    }
+    if (status == VP8_STATUS_OK) {
+      return true;
+    }
+    if (status != VP8_STATUS_SUSPENDED || !budget->Check()) {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Writes into `output` instead of a new ImageData when it is set, see
+// jsquash::WriteImageData(). Returns the name of the limit as a string when
+// `limits` stop the decode. Converts from the ICC profile as `color` asks, see
+// jsquash::ColorConverter. With `analyze`, returns {image, analysis}, see
+// jsquash::ImageAnalyzer. With `premultiplied`, returns colour premultiplied
+// by alpha.
+val decode(std::string buffer,
+           jsquash::DecodeResizeOptions resize,
+           jsquash::DecodeLimits limits,
+           jsquash::ColorConversion color,
+           bool premultiplied,
+           bool analyze,
+           val output) {
+  WebPBitstreamFeatures features;
+  if (WebPGetFeatures(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(),
+                      &features) != VP8_STATUS_OK) {
+    return val::null();
+  }
+  const int width = features.width;
+  const int height = features.height;
+  // Opaque images are the same either way.
+  premultiplied = premultiplied && features.has_alpha;
+
+  // libwebp's still image decoder rejects animations, so there is one frame.
+  jsquash::DecodeBudget budget(limits);
+  if (!budget.CheckImage(width, height, 1, 4.0 * width * height)) {
+    return budget.Abort();
+  }
+
+  size_t rgba_size, size;
+  jsquash::DecodeResizer resizer(width, height, resize);
+  if (!resizer.valid() || !jsquash::ComputeRGBA8Size(width, height, &rgba_size) ||
+      !jsquash::ComputeRGBA8Size(resizer.width(), resizer.height(), &size)) {
+    return val::null();
+  }
+
+  const uint8_t* icc = nullptr;
+  size_t icc_size = 0;
+  FindIccProfile(buffer, &icc, &icc_size);
+  jsquash::ColorConverter converter;
+  if (!converter.Init(color, icc, icc_size)) {
+    return val::null();
+  }
+
+  std::unique_ptr<jsquash::ImageAnalyzer> analyzer;
+  if (analyze) {
+    analyzer = std::make_unique<jsquash::ImageAnalyzer>(width, height);
+  }
+  std::unique_ptr<uint8_t[]> rgba(new uint8_t[rgba_size]);
+  // The resizer reads straight alpha, so resized images are premultiplied
+  // after it, at their smaller size.
+  if (!DecodeInSlices(buffer, width, rgba.get(), rgba_size, &budget, converter, analyzer.get(),
+                      premultiplied && !resizer.active())) {
+    return budget.exceeded() ? budget.Abort() : val::null();
+  }
+  if (!resizer.active()) {
+    val result = jsquash::WriteImageData(rgba.get(), width, height, output);
+    return analyzer ? analyzer->Attach(result) : result;
+  }
+
+  // libwebp only decodes whole frames, so resample from its buffer. This still
+  // saves copying the full size frame out to JS and into a resize module.
+  std::unique_ptr<uint8_t[]> resized(new uint8_t[size]);
+  const size_t stride = static_cast<size_t>(width) * 4;
+  for (int y = 0; y < height; y++) {
+    resizer.PushRow(rgba.get() + y * stride, resized.get());
+  }
+  if (premultiplied) {
+    jsquash::PremultiplyRows(resized.get(), static_cast<size_t>(resizer.width()) * 4,
+                             resizer.width(), resizer.height());
+  }
+  val result = jsquash::WriteImageData(resized.get(), resizer.width(), resizer.height(), output);
+  return analyzer ? analyzer->Attach(result) : result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
-  function("decode", &decode);
-  function("version", &version);
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(webp_dec) {
+  jsquash::RegisterDecodeResizeOptions();
+  jsquash::RegisterDecodeLimits();
+  jsquash::RegisterColorConversion();
+  function(JSQUASH_EXPORT("decode"), &decode);
+  function(JSQUASH_EXPORT("version"), &version);
 }
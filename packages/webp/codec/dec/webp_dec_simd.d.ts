@@ -0,0 +1 @@
+export { default } from './webp_dec.js';
@@ -2,19 +2,50 @@
 #include <emscripten/val.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 #include "src/webp/encode.h"
 
+#include "deadline.h"
+#include "embind_export.h"
+#include "image_size.h"
+#include "premultiply.h"
+#include "resize_pyramid.h"
+
 using namespace emscripten;
 
+namespace {
+
 int version() {
   return WebPGetEncoderVersion();
 }
 
 thread_local const val Uint8Array = val::global("Uint8Array");
 
-val encode(std::string img, int width, int height, WebPConfig config) {
-  auto img_in = (uint8_t*)img.c_str();
+// libwebp calls this between encoding passes and rows. Returning 0 aborts the
+// encode with VP8_ENC_ERROR_USER_ABORT.
+int CheckDeadline(int percent, const WebPPicture* picture) {
+  return !static_cast<const jsquash::Deadline*>(picture->user_data)->expired();
+}
+
+// `stride` is the distance between the starts of two rows of `img` in bytes.
+// `premultiplied` marks colour in `img` as premultiplied by alpha.
+val encode(std::string img,
+           int width,
+           int height,
+           uint32_t stride,
+           WebPConfig config,
+           double time_limit,
+           bool premultiplied) {
+  auto img_in = (const uint8_t*)img.c_str();
+
+  size_t size;
+  if (width <= 0 || height <= 0 ||
+      !jsquash::ComputeStridedSize(height, static_cast<size_t>(width) * 4, stride, &size) ||
+      img.size() < size) {
+    return val::null();
+  }
 
   // A lot of this is duplicated from Encode in picture_enc.c
   WebPPicture pic;
@@ -36,16 +67,157 @@ val encode(std::string img, int width, int height, WebPConfig config) {
   pic.writer = WebPMemoryWrite;
   pic.custom_ptr = &wrt;
 
+  jsquash::Deadline deadline(time_limit);
+  if (deadline.active()) {
+    pic.progress_hook = CheckDeadline;
+    pic.user_data = &deadline;
+  }
+
+  // WebP only stores straight alpha, and libwebp only imports it.
+  std::vector<uint8_t> straight;
+  if (premultiplied) {
+    img_in = jsquash::UnpremultiplyRows(img_in, width, stride, height, &straight);
+    stride = static_cast<uint32_t>(width) * 4;
+  }
+
   WebPMemoryWriterInit(&wrt);
 
-  ok = WebPPictureImportRGBA(&pic, img_in, width * 4) && WebPEncode(&config, &pic);
+  ok = WebPPictureImportRGBA(&pic, img_in, stride) && WebPEncode(&config, &pic);
+  const bool aborted = pic.error_code == VP8_ENC_ERROR_USER_ABORT;
   WebPPictureFree(&pic);
-  val js_result = ok ? Uint8Array.new_(typed_memory_view(wrt.size, wrt.mem)) : val::null();
+  val js_result = ok ? Uint8Array.new_(typed_memory_view(wrt.size, wrt.mem))
+                     : aborted ? val::undefined() : val::null();
   WebPMemoryWriterClear(&wrt);
   return js_result;
 }
 
-EMSCRIPTEN_BINDINGS(my_module) {
+// One output of encodeVariants(). A width or height of 0 keeps the source size,
+// or preserves the aspect ratio when only the other side is given.
+struct EncodeVariant {
+  int width;
+  int height;
+  WebPConfig options;
+};
+
+// How WebPEncode would convert an RGBA import for a config. Variants of the
+// same size that need the same conversion share one converted picture.
+enum Conversion { CONVERT_ARGB, CONVERT_YUV, CONVERT_SHARP_YUV, CONVERT_DITHERED_YUV };
+
+Conversion ConversionFor(const WebPConfig& config) {
+  if (config.lossless) return CONVERT_ARGB;
+  if (config.use_sharp_yuv) return CONVERT_SHARP_YUV;
+  if (config.preprocessing & 4) return CONVERT_DITHERED_YUV;
+  return CONVERT_YUV;
+}
+
+struct SharedPicture {
+  int width;
+  int height;
+  Conversion conversion;
+  WebPPicture picture;
+};
+
+// Encodes one RGBA image at several sizes and settings. Every size is
+// resampled once, from the smallest larger size already made, and converted
+// to YUV (or ARGB for lossless) once; variants that only differ in encoder
+// settings start from a copy of that picture.
+val encodeVariants(std::string img,
+                   int width,
+                   int height,
+                   val variants,
+                   jsquash::ResizePyramidOptions resize_options) {
+  size_t size;
+  if (width <= 0 || height <= 0 || !jsquash::ComputeRGBA8Size(width, height, &size) ||
+      img.size() < size) {
+    return val::null();
+  }
+
+  std::vector<EncodeVariant> list = vecFromJSArray<EncodeVariant>(variants);
+  for (auto& variant : list) {
+    jsquash::FitSize(width, height, &variant.width, &variant.height);
+  }
+
+  // Largest first, so smaller sizes can be resampled from larger ones.
+  std::vector<size_t> order(list.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return static_cast<int64_t>(list[a].width) * list[a].height >
+           static_cast<int64_t>(list[b].width) * list[b].height;
+  });
+
+  jsquash::ResizePyramid pyramid(reinterpret_cast<const uint8_t*>(img.data()), width, height,
+                                 resize_options);
+  std::vector<SharedPicture> shared;
+  std::vector<size_t> pictures(list.size());
+  bool ok = true;
+  for (size_t i : order) {
+    const EncodeVariant& variant = list[i];
+    const Conversion conversion = ConversionFor(variant.options);
+    auto found = std::find_if(shared.begin(), shared.end(), [&](const SharedPicture& p) {
+      return p.width == variant.width && p.height == variant.height &&
+             p.conversion == conversion;
+    });
+    if (found == shared.end()) {
+      const auto level = pyramid.Get(variant.width, variant.height);
+      ok = level.data != nullptr;
+      if (!ok) break;
+      shared.push_back({level.width, level.height, conversion, {}});
+      WebPPicture& pic = shared.back().picture;
+      ok = WebPPictureInit(&pic);
+      if (!ok) break;
+      pic.use_argb = 1;
+      pic.width = level.width;
+      pic.height = level.height;
+      ok = WebPPictureImportRGBA(&pic, level.data, level.width * 4);
+      // Same conversions as WebPEncode does for an ARGB picture.
+      if (ok && conversion == CONVERT_YUV) {
+        ok = WebPPictureARGBToYUVA(&pic, WEBP_YUV420);
+      } else if (ok && conversion == CONVERT_SHARP_YUV) {
+        ok = WebPPictureSharpARGBToYUVA(&pic);
+      } else if (ok && conversion == CONVERT_DITHERED_YUV) {
+        ok = WebPPictureARGBToYUVADithered(&pic, WEBP_YUV420, 1.f);
+      }
+      if (!ok) break;
+      found = shared.end() - 1;
+    }
+    pictures[i] = found - shared.begin();
+  }
+
+  val js_result = ok ? val::array() : val::null();
+  for (size_t i = 0; ok && i < list.size(); ++i) {
+    WebPConfig config = list[i].options;
+    // Allow quality to go higher than 0.
+    config.qmax = 100;
+
+    // WebPEncode cleans up transparent areas in place, so every variant works
+    // on its own copy.
+    WebPPicture pic;
+    WebPMemoryWriter wrt;
+    WebPMemoryWriterInit(&wrt);
+    ok = WebPPictureCopy(&shared[pictures[i]].picture, &pic);
+    if (ok) {
+      pic.writer = WebPMemoryWrite;
+      pic.custom_ptr = &wrt;
+      ok = WebPEncode(&config, &pic);
+    }
+    WebPPictureFree(&pic);
+    if (ok) {
+      js_result.call<void>("push", Uint8Array.new_(typed_memory_view(wrt.size, wrt.mem)));
+    }
+    WebPMemoryWriterClear(&wrt);
+  }
+
+  for (auto& picture : shared) {
+    WebPPictureFree(&picture.picture);
+  }
+  return ok ? js_result : val::null();
+}
+
+}  // namespace
+
+EMSCRIPTEN_BINDINGS(webp_enc) {
   enum_<WebPImageHint>("WebPImageHint")
       .value("WEBP_HINT_DEFAULT", WebPImageHint::WEBP_HINT_DEFAULT)
       .value("WEBP_HINT_PICTURE", WebPImageHint::WEBP_HINT_PICTURE)
@@ -80,6 +252,14 @@ EMSCRIPTEN_BINDINGS(my_module) {
       .field("use_delta_palette", &WebPConfig::use_delta_palette)
       .field("use_sharp_yuv", &WebPConfig::use_sharp_yuv);
 
-  function("version", &version);
-  function("encode", &encode);
+  value_object<EncodeVariant>("EncodeVariant")
+      .field("width", &EncodeVariant::width)
+      .field("height", &EncodeVariant::height)
+      .field("options", &EncodeVariant::options);
+
+  jsquash::RegisterResizePyramidOptions();
+
+  function(JSQUASH_EXPORT("version"), &version);
+  function(JSQUASH_EXPORT("encode"), &encode);
+  function(JSQUASH_EXPORT("encodeVariants"), &encodeVariants);
 }
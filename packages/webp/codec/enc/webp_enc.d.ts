@@ -28,13 +28,36 @@ export interface EncodeOptions {
   use_sharp_yuv: number;
 }
 
+export interface EncodeVariant {
+  width: number;
+  height: number;
+  options: EncodeOptions;
+}
+
+export interface ResizePyramidOptions {
+  fitMethod: 'stretch' | 'contain';
+  method: number;
+  premultiply: boolean;
+  linearRGB: boolean;
+}
+
 export interface WebPModule extends EmscriptenWasm.Module {
   encode(
     data: BufferSource,
     width: number,
     height: number,
+    stride: number,
     options: EncodeOptions,
-  ): Uint8Array | null;
+    timeLimit: number,
+    premultiplied: boolean,
+  ): Uint8Array | null | undefined;
+  encodeVariants(
+    data: BufferSource,
+    width: number,
+    height: number,
+    variants: EncodeVariant[],
+    resize: ResizePyramidOptions,
+  ): Uint8Array[] | null;
 }
 
 declare var moduleFactory: EmscriptenWasm.ModuleFactory<WebPModule>;
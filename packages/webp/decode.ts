@@ -15,42 +15,172 @@
  * Notice: I (Jamie Sinclair) have modified this file to accept an ArrayBuffer instead of typed array
  * and manually allow instantiation of the Wasm Module.
  */
-import type { WebPModule } from './codec/dec/webp_dec.js';
+import type {
+  ColorConversion,
+  DecodeResizeOptions,
+  WebPModule,
+} from './codec/dec/webp_dec.js';
+import type { DecodeOptions, DecodeTarget, ImageAnalysis } from './meta.js';
 
-import webp_dec from './codec/dec/webp_dec.js';
-import { initEmscriptenModule } from './utils.js';
+import { defaultDecodeOptions, resizeMethods } from './meta.js';
+import {
+  DecodeLimitError,
+  getDecodeLimits,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
+import { simd } from 'wasm-feature-detect';
 
 let emscriptenModule: Promise<WebPModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: WebPModule) => Promise<WebPModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<WebPModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<void> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
+
+  const load = async () => {
+    let webpDecoder;
+    if (await simd()) {
+      webpDecoder = await import('./codec/dec/webp_dec_simd.js');
+    } else {
+      webpDecoder = await import('./codec/dec/webp_dec.js');
+    }
+    return initEmscriptenModule(
+      webpDecoder.default,
+      actualModule,
+      emscriptenOptions,
+    );
+  };
+  // Assigned synchronously so a decode() straight after init() reuses it.
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
+}
+
+function getResizeOptions(options: DecodeOptions): DecodeResizeOptions {
+  return {
+    width: options.width ?? 0,
+    height: options.height ?? 0,
+    fitMethod: options.fitMethod,
+    method: resizeMethods.indexOf(options.method),
+    premultiply: options.premultiply,
+    linearRGB: options.linearRGB,
+  };
+}
+
+function getColorConversion(
+  options: Pick<DecodeOptions, 'ignoreColorProfile' | 'targetColorProfile'>,
+): ColorConversion {
+  return {
+    convert: !options.ignoreColorProfile,
+    targetProfile: options.targetColorProfile ?? '',
+  };
+}
+
+export default async function decode(
+  buffer: ArrayBuffer,
+  options: Partial<DecodeOptions> = {},
+): Promise<ImageData> {
+  if (!emscriptenModule) init();
+
+  const _options = { ...defaultDecodeOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getColorConversion(_options),
+    !!_options.premultipliedAlpha,
+    false,
+    undefined,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
+}
+
+/**
+ * Decodes like `decode`, and also returns statistics gathered from the
+ * decoded rows while they are still in cache: the histogram, the mean and
+ * dominant colour, a perceptual hash and a ThumbHash placeholder. This saves
+ * walking the whole image again in JS.
+ */
+export async function decodeAndAnalyze(
+  buffer: ArrayBuffer,
+  options: Partial<DecodeOptions> = {},
+): Promise<{ image: ImageData; analysis: ImageAnalysis }> {
+  if (!emscriptenModule) init();
 
-  emscriptenModule = initEmscriptenModule(
-    webp_dec,
-    actualModule,
-    actualOptions,
+  const _options = { ...defaultDecodeOptions, ...options };
+  const module = await emscriptenModule;
+  const result = module.decode(
+    buffer,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getColorConversion(_options),
+    !!_options.premultipliedAlpha,
+    true,
+    undefined,
   );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
+  if (!result) throw new Error('Decoding error');
+  return result;
 }
 
-export default async function decode(buffer: ArrayBuffer): Promise<ImageData> {
+/**
+ * Decodes straight into a region of a larger buffer, such as a tile of an
+ * atlas, instead of a new ImageData. Resolves to the size of the decoded
+ * image, which must fit in the region.
+ */
+export async function decodeInto(
+  buffer: ArrayBuffer,
+  target: DecodeTarget,
+  options: Partial<DecodeOptions> = {},
+): Promise<{ width: number; height: number }> {
   if (!emscriptenModule) init();
 
+  const _options = { ...defaultDecodeOptions, ...options };
   const module = await emscriptenModule;
-  const result = module.decode(buffer);
+  const result = module.decode(
+    buffer,
+    getResizeOptions(_options),
+    getDecodeLimits(_options.limits),
+    getColorConversion(_options),
+    !!_options.premultipliedAlpha,
+    false,
+    { data: target.data.subarray(target.offset ?? 0), stride: target.stride },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+  if (typeof result === 'string') throw new DecodeLimitError(result);
   if (!result) throw new Error('Decoding error');
   return result;
 }
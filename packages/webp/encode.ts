@@ -18,60 +18,140 @@
  * Also manually allow instantiation of the Wasm Module.
  */
 import type { WebPModule } from './codec/enc/webp_enc.js';
-import type { EncodeOptions } from './meta.js';
+import type {
+  EncodeOptions,
+  EncodeInputOptions,
+  EncodeTimeLimit,
+  EncodeVariant,
+  ImageDataView,
+  VariantResizeOptions,
+} from './meta.js';
 
-import { defaultOptions } from './meta.js';
-import { initEmscriptenModule } from './utils.js';
+import {
+  defaultDecodeOptions,
+  defaultOptions,
+  resizeMethods,
+} from './meta.js';
+import {
+  getImageRows,
+  initEmscriptenModule,
+  recycleModule,
+} from './utils.js';
+import type { InitOptions } from './utils.js';
 import { simd } from 'wasm-feature-detect';
 
 let emscriptenModule: Promise<WebPModule>;
+// Swaps in a fresh module once a call has grown the heap past maxHeapSize.
+// Unset while using a module from useModule(), which this package didn't make.
+let recycle:
+  | ((module: WebPModule) => Promise<WebPModule> | undefined)
+  | undefined;
+
+/**
+ * Uses an already instantiated module, such as a codec of the module that
+ * `@jsquash/combined` shares between formats, instead of loading this
+ * package's own build.
+ */
+export function useModule(module: Promise<WebPModule>): void {
+  emscriptenModule = module;
+  recycle = undefined;
+}
 
 export async function init(
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<WebPModule>;
 export async function init(
   module?: WebAssembly.Module,
-  moduleOptionOverrides?: Partial<EmscriptenWasm.ModuleOpts>,
+  moduleOptionOverrides?: InitOptions,
 ): Promise<WebPModule> {
   let actualModule: WebAssembly.Module | undefined = module;
-  let actualOptions: Partial<EmscriptenWasm.ModuleOpts> | undefined =
-    moduleOptionOverrides;
+  let actualOptions: InitOptions | undefined = moduleOptionOverrides;
 
   // If only one argument is provided and it's not a WebAssembly.Module
   if (arguments.length === 1 && !(module instanceof WebAssembly.Module)) {
     actualModule = undefined;
-    actualOptions = module as unknown as Partial<EmscriptenWasm.ModuleOpts>;
+    actualOptions = module as unknown as InitOptions;
   }
+  const { maxHeapSize, ...emscriptenOptions } = actualOptions ?? {};
 
+  let webpEncoder;
   if (await simd()) {
-    const webpEncoder = await import('./codec/enc/webp_enc_simd.js');
-    emscriptenModule = initEmscriptenModule(
-      webpEncoder.default,
-      actualModule,
-      actualOptions,
-    );
-    return emscriptenModule;
+    webpEncoder = await import('./codec/enc/webp_enc_simd.js');
+  } else {
+    webpEncoder = await import('./codec/enc/webp_enc.js');
   }
-  const webpEncoder = await import('./codec/enc/webp_enc.js');
-  emscriptenModule = initEmscriptenModule(
-    webpEncoder.default,
-    actualModule,
-    actualOptions,
-  );
+  const moduleFactory = webpEncoder.default;
+  const load = () =>
+    initEmscriptenModule(moduleFactory, actualModule, emscriptenOptions);
+  emscriptenModule = load();
+  recycle = (module) => recycleModule(module, maxHeapSize, load);
   return emscriptenModule;
 }
 
 export default async function encode(
-  data: ImageData,
-  options: Partial<EncodeOptions> = {},
+  data: ImageData | ImageDataView,
+  options: Partial<EncodeOptions> & EncodeTimeLimit & EncodeInputOptions = {},
 ): Promise<ArrayBuffer> {
   if (!emscriptenModule) emscriptenModule = init();
 
-  const _options: EncodeOptions = { ...defaultOptions, ...options };
+  const {
+    timeLimit = 0,
+    premultipliedAlpha = false,
+    ...encodeOptions
+  } = options;
+  const _options: EncodeOptions = { ...defaultOptions, ...encodeOptions };
   const module = await emscriptenModule;
-  const result = module.encode(data.data, data.width, data.height, _options);
+  const { rows, stride } = getImageRows(data);
+  const result = module.encode(
+    rows,
+    data.width,
+    data.height,
+    stride,
+    _options,
+    timeLimit,
+    premultipliedAlpha,
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
 
+  if (result === undefined) throw new Error('Encoding time limit exceeded.');
   if (!result) throw new Error('Encoding error.');
 
   return result.buffer;
 }
+
+/**
+ * Encodes one image at several sizes and settings, e.g. the widths of a srcset.
+ * Each size is resized and converted to YUV once, and variants of the same size
+ * share that work. Resolves to one buffer per variant, in order.
+ */
+export async function encodeVariants(
+  data: ImageData,
+  variants: EncodeVariant[],
+  resizeOptions: Partial<VariantResizeOptions> = {},
+): Promise<ArrayBuffer[]> {
+  if (!emscriptenModule) emscriptenModule = init();
+
+  const _resizeOptions = { ...defaultDecodeOptions, ...resizeOptions };
+  const module = await emscriptenModule;
+  const result = module.encodeVariants(
+    data.data,
+    data.width,
+    data.height,
+    variants.map(({ width = 0, height = 0, ...options }) => ({
+      width,
+      height,
+      options: { ...defaultOptions, ...options },
+    })),
+    {
+      fitMethod: _resizeOptions.fitMethod,
+      method: resizeMethods.indexOf(_resizeOptions.method),
+      premultiply: _resizeOptions.premultiply,
+      linearRGB: _resizeOptions.linearRGB,
+    },
+  );
+  emscriptenModule = recycle?.(module) ?? emscriptenModule;
+
+  if (!result) throw new Error('Encoding error.');
+
+  return result.map((output) => output.buffer);
+}
@@ -1,2 +1,14 @@
-export { default as encode } from './encode.js';
-export { default as decode } from './decode.js';
+export { default as encode, encodeVariants } from './encode.js';
+export {
+  default as decode,
+  decodeAndAnalyze,
+  decodeInto,
+} from './decode.js';
+export type {
+  DecodeLimits,
+  DecodeTarget,
+  ImageAnalysis,
+  ImageDataView,
+} from './meta.js';
+export { DecodeLimitError, getRecycleStats } from './utils.js';
+export type { InitOptions, RecycleStats } from './utils.js';
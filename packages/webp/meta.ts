@@ -14,6 +14,119 @@ import type { EncodeOptions } from './codec/enc/webp_enc.js';
 
 export { EncodeOptions };
 
+export type EncodeVariant = Partial<EncodeOptions> & {
+  // Output size. Set only one of them to keep the aspect ratio, or neither to
+  // keep the source size.
+  width?: number;
+  height?: number;
+};
+
+export type EncodeTimeLimit = {
+  // Milliseconds the encode may take before it is aborted. 0 means no limit.
+  timeLimit?: number;
+};
+
+export type EncodeInputOptions = {
+  // Colour of the input is premultiplied by alpha, as in a canvas or a GPU
+  // texture. WebP stores straight alpha, so it is unpremultiplied first.
+  premultipliedAlpha?: boolean;
+};
+
+export type ResizeMethod = 'triangle' | 'catrom' | 'mitchell' | 'lanczos3';
+
+/** Resize methods by index, as in @jsquash/resize */
+export const resizeMethods: ResizeMethod[] = [
+  'triangle',
+  'catrom',
+  'mitchell',
+  'lanczos3',
+];
+
+export type DecodeOptions = {
+  // Output size. Set only one of them to keep the aspect ratio.
+  width?: number;
+  height?: number;
+  method: ResizeMethod;
+  fitMethod: 'stretch' | 'contain';
+  premultiply: boolean;
+  linearRGB: boolean;
+  limits?: DecodeLimits;
+  // Keep the samples as stored instead of converting them from the image's
+  // colour profile to sRGB.
+  ignoreColorProfile?: boolean;
+  // ICC profile to convert to instead of sRGB, such as the display's.
+  targetColorProfile?: Uint8Array;
+  // Return colour premultiplied by alpha, ready to composite or to upload as a
+  // premultiplied texture.
+  premultipliedAlpha?: boolean;
+};
+
+// How encodeVariants() resizes the source for each variant.
+export type VariantResizeOptions = Omit<
+  DecodeOptions,
+  'width' | 'height' | 'limits'
+>;
+
+/**
+ * RGBA pixels stored as a region of a larger buffer, such as a crop of a
+ * canvas. `offset` is the index in `data` of the region's first sample and
+ * `stride` the number of samples between the starts of two rows. They default
+ * to `0` and `width * 4`, so an `ImageData` is a valid `ImageDataView`.
+ */
+export type ImageDataView = {
+  data: Uint8ClampedArray;
+  width: number;
+  height: number;
+  stride?: number;
+  offset?: number;
+};
+
+/**
+ * Limits on what one decode may cost, for untrusted input. Each is checked
+ * against the header before any pixels are decoded, then again as the decode
+ * runs, and a decode over one rejects with a `DecodeLimitError` naming it.
+ * Unset or 0 means no limit.
+ */
+export type DecodeLimits = {
+  // Largest width * height of the image.
+  maxPixels?: number;
+  // Most frames an animation or image sequence may declare.
+  maxFrames?: number;
+  // Most bytes the decode may have allocated at once.
+  maxMemory?: number;
+  // Milliseconds the decode may take.
+  timeLimit?: number;
+};
+
+/**
+ * Statistics of the decoded image that `decodeAndAnalyze()` gathers from its
+ * rows as they are decoded, before any resize.
+ */
+export type ImageAnalysis = {
+  // 1024 bins: 256 each for R, G, B and A.
+  histogram: Uint32Array;
+  // Alpha weighted mean colour, and the mean alpha.
+  meanColor: { r: number; g: number; b: number; a: number };
+  // Most common colour of the mostly opaque pixels.
+  dominantColor: { r: number; g: number; b: number };
+  // 64-bit DCT hash as 16 hex digits. Similar images differ in few bits.
+  perceptualHash: string;
+  // ThumbHash placeholder, see https://github.com/evanw/thumbhash.
+  thumbHash: Uint8Array;
+};
+
+/**
+ * Where `decodeInto()` writes the decoded pixels: a region of a larger RGBA
+ * buffer, such as a tile of an atlas. The region is as large as the decoded
+ * (and resized) image; `offset` is the index of its first sample and `stride`
+ * the number of samples between the starts of two rows.
+ */
+export type DecodeTarget = {
+  data: Uint8ClampedArray | Uint8Array;
+  stride: number;
+  offset?: number;
+};
+
 export const label = 'WebP';
 export const mimeType = 'image/webp';
 export const extension = 'webp';
@@ -47,3 +160,11 @@ export const defaultOptions: EncodeOptions = {
   use_delta_palette: 0,
   use_sharp_yuv: 0,
 };
+
+// Same defaults as @jsquash/resize.
+export const defaultDecodeOptions: DecodeOptions = {
+  method: 'lanczos3',
+  fitMethod: 'stretch',
+  premultiply: true,
+  linearRGB: true,
+};
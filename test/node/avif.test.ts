@@ -1,8 +1,14 @@
 import test from 'ava';
 import { importWasmModule, getFixturesImage } from './utils.js';
 
-import decode, { init as initDecode } from '@jsquash/avif/decode.js';
-import encode, { init as initEncode } from '@jsquash/avif/encode.js';
+import decode, {
+  decodePreview,
+  init as initDecode,
+} from '@jsquash/avif/decode.js';
+import encode, {
+  encodeVariants,
+  init as initEncode,
+} from '@jsquash/avif/encode.js';
 
 test('can successfully decode image', async (t) => {
   const [testImage, decodeWasmModule] = await Promise.all([
@@ -66,6 +72,17 @@ test('can successfully decode 12-bit image', async (t) => {
   t.true(data.data.some((value) => value > 1023));
 });
 
+test('tone mapping leaves SDR images as they are', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test-10bit.avif'),
+    importWasmModule('node_modules/@jsquash/avif/codec/dec/avif_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const expected = await decode(testImage);
+  const data = await decode(testImage, { sdrTarget: true });
+  t.deepEqual(data?.data, expected?.data);
+});
+
 test('can successfully decode 12-bit image to 10-bit precision', async (t) => {
   const [testImage, decodeWasmModule] = await Promise.all([
     getFixturesImage('test-12bit.avif'),
@@ -242,6 +259,32 @@ test('throws error when encoding 12-bit image with non-Uint16Array data', async
   );
 });
 
+test('can encode and decode a grid image', async (t) => {
+  const [encodeWasmModule, decodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/avif/codec/enc/avif_enc.wasm'),
+    importWasmModule('node_modules/@jsquash/avif/codec/dec/avif_dec.wasm'),
+  ]);
+  await initEncode(encodeWasmModule);
+  initDecode(decodeWasmModule);
+
+  const encodedData = await encode(
+    {
+      data: new Uint8ClampedArray(4 * 150 * 100).fill(128),
+      height: 100,
+      width: 150,
+      colorSpace: 'srgb' as const,
+    },
+    { gridCellSize: 64 },
+  );
+  const decodedData = await decode(encodedData);
+  if (!decodedData) {
+    t.fail('Failed to decode image');
+    return;
+  }
+  t.is(decodedData.width, 150);
+  t.is(decodedData.height, 100);
+});
+
 test('can successfully encode and decode lossless image', async (t) => {
   const [encodeWasmModule, decodeWasmModule] = await Promise.all([
     importWasmModule('node_modules/@jsquash/avif/codec/enc/avif_enc.wasm'),
@@ -380,3 +423,87 @@ test('throws error for invalid bitDepth setting', async (t) => {
   }
   t.is(error.message, 'Invalid bit depth. Supported values are 8, 10, or 12.');
 });
+
+test('can encode several variants at once', async (t) => {
+  const [encodeWasmModule, decodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/avif/codec/enc/avif_enc.wasm'),
+    importWasmModule('node_modules/@jsquash/avif/codec/dec/avif_dec.wasm'),
+  ]);
+  await initEncode(encodeWasmModule);
+  initDecode(decodeWasmModule);
+
+  const outputs = await encodeVariants(
+    {
+      data: new Uint8ClampedArray(4 * 120 * 80).fill(128),
+      height: 80,
+      width: 120,
+      colorSpace: 'srgb' as const,
+    },
+    [{ width: 30 }, { quality: 50 }, { width: 60, quality: 50 }],
+  );
+  t.is(outputs.length, 3);
+  const sizes: number[][] = [];
+  for (const output of outputs) {
+    const decodedData = await decode(output);
+    if (!decodedData) {
+      t.fail('Failed to decode image');
+      return;
+    }
+    sizes.push([decodedData.width, decodedData.height]);
+  }
+  t.deepEqual(sizes, [
+    [30, 20],
+    [120, 80],
+    [60, 40],
+  ]);
+});
+
+test('encodes variants of pixels that start part way into a buffer', async (t) => {
+  const encodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/avif/codec/enc/avif_enc.wasm',
+  );
+  await initEncode(encodeWasmModule);
+
+  const buffer = new ArrayBuffer(4 * 60 * 40 + 64);
+  const data = new Uint8ClampedArray(buffer, 64, 4 * 60 * 40).fill(128);
+  const [output] = await encodeVariants(
+    { data, height: 40, width: 60, colorSpace: 'srgb' as const },
+    [{ width: 30 }],
+  );
+  t.assert(output instanceof ArrayBuffer);
+
+  await t.throwsAsync(
+    encodeVariants(
+      { data: data.subarray(4), height: 40, width: 60, colorSpace: 'srgb' },
+      [{ width: 30 }],
+    ),
+    { message: 'Encoding error.' },
+  );
+});
+
+test('can embed and decode a thumbnail', async (t) => {
+  const [encodeWasmModule, decodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/avif/codec/enc/avif_enc.wasm'),
+    importWasmModule('node_modules/@jsquash/avif/codec/dec/avif_dec.wasm'),
+  ]);
+  await initEncode(encodeWasmModule);
+  initDecode(decodeWasmModule);
+
+  const image = {
+    data: new Uint8ClampedArray(4 * 120 * 80).fill(128),
+    height: 80,
+    width: 120,
+    colorSpace: 'srgb' as const,
+  };
+  const output = await encode(image, { thumbnailSize: 32 });
+  const decodedData = await decode(output);
+  const preview = await decodePreview(output);
+  if (!decodedData || !preview) {
+    t.fail('Failed to decode image');
+    return;
+  }
+  t.deepEqual([decodedData.width, decodedData.height], [120, 80]);
+  t.deepEqual([preview.width, preview.height], [32, 21]);
+
+  t.is(await decodePreview(await encode(image)), null);
+});
@@ -0,0 +1,66 @@
+import test from 'ava';
+import { promises as fs } from 'node:fs';
+import { importWasmModule, getFixturesImage } from './utils.js';
+
+import {
+  clearModuleCache,
+  createEncodeCache,
+  loadWasmModule,
+  moduleCacheStats,
+} from '@jsquash/cache';
+import decode, { init as initDecode } from '@jsquash/jpeg/decode.js';
+import encode, { init as initEncode } from '@jsquash/jpeg/encode.js';
+
+test('serves repeated encodes from the cache', async (t) => {
+  const [testImage, decodeWasmModule, encodeWasmModule] = await Promise.all([
+    getFixturesImage('test.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/enc/mozjpeg_enc.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  initEncode(encodeWasmModule);
+  const imageData = await decode(testImage);
+
+  const cache = createEncodeCache();
+  const cachedEncode = cache.wrap('jpeg', encode);
+  const first = await cachedEncode(imageData, { quality: 50, baseline: true });
+  const second = await cachedEncode(imageData, { baseline: true, quality: 50 });
+  await cachedEncode(imageData, { quality: 60 });
+
+  t.deepEqual(new Uint8Array(first), new Uint8Array(second));
+  t.not(first, second);
+  t.like(cache.stats(), { hits: 1, misses: 2, entries: 2 });
+});
+
+test('evicts the least recently used results beyond maxBytes', async (t) => {
+  const cache = createEncodeCache({ maxBytes: 250 });
+  const fakeEncode = async (image: ImageData) =>
+    new ArrayBuffer(image.width * 10);
+  const cachedEncode = cache.wrap('fake', fakeEncode);
+  const image = (width: number) =>
+    ({ data: new Uint8ClampedArray(width * 4), width, height: 1 }) as ImageData;
+
+  await cachedEncode(image(10));
+  await cachedEncode(image(11));
+  await cachedEncode(image(10));
+  await cachedEncode(image(12));
+
+  t.like(cache.stats(), { hits: 1, misses: 3, evictions: 1, entries: 2 });
+  await cachedEncode(image(10));
+  t.is(cache.stats().hits, 2);
+});
+
+test('compiles each wasm binary once', async (t) => {
+  const path = 'node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm';
+  clearModuleCache();
+  const first = await loadWasmModule(path);
+  const second = await loadWasmModule(path);
+  const fromBytes = await loadWasmModule(await fs.readFile(path));
+  t.is(first, second);
+  t.is(first, fromBytes);
+  t.deepEqual(moduleCacheStats(), { hits: 2, compiles: 1, modules: 1 });
+
+  const testImage = await getFixturesImage('test.jpeg');
+  await initDecode(first);
+  t.is((await decode(testImage)).width, 50);
+});
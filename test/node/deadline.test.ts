@@ -0,0 +1,57 @@
+import test from 'ava';
+import { importWasmModule, getFixturesImage } from './utils.js';
+
+import { createDeadlineEncoder } from '@jsquash/deadline';
+import decode, { init as initDecode } from '@jsquash/webp/decode.js';
+import encode, { init as initEncode } from '@jsquash/webp/encode.js';
+
+test('encodes within a generous budget at the slowest method', async (t) => {
+  const [testImage, decodeWasmModule, encodeWasmModule] = await Promise.all([
+    getFixturesImage('test.webp'),
+    importWasmModule('node_modules/@jsquash/webp/codec/dec/webp_dec.wasm'),
+    importWasmModule('node_modules/@jsquash/webp/codec/enc/webp_enc.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  await initEncode(encodeWasmModule);
+  const imageData = await decode(testImage);
+
+  const encoder = createDeadlineEncoder('webp', encode);
+  const result = await encoder.encode(imageData, 60000, { quality: 50 });
+
+  t.assert(result.buffer instanceof ArrayBuffer);
+  t.is(result.effort, 6);
+  t.is(result.attempts.length, 1);
+});
+
+test('falls back to a faster effort when an encode hits its time limit', async (t) => {
+  const costs = [300, 200, 120, 80, 50, 30, 20];
+  const fakeEncode = async (
+    _image: ImageData,
+    options: { method?: number; timeLimit?: number } = {},
+  ) => {
+    const cost = costs[6 - options.method!];
+    const limit = options.timeLimit ?? 0;
+    if (limit > 0 && limit < cost) {
+      await new Promise((resolve) => setTimeout(resolve, limit));
+      throw new Error('Encoding time limit exceeded.');
+    }
+    await new Promise((resolve) => setTimeout(resolve, cost));
+    return new ArrayBuffer(options.method! + 1);
+  };
+  // A model that thinks this machine is 10x faster than it is.
+  const encoder = createDeadlineEncoder('webp', fakeEncode, {
+    model: { machineFactor: 0.1, msPerMegapixel: costs.map(() => null) },
+  });
+  const image = {
+    data: new Uint8ClampedArray(4),
+    width: 1000,
+    height: 1000,
+  } as ImageData;
+
+  const result = await encoder.encode(image, 150);
+
+  t.is(result.attempts.length, 2);
+  t.true(result.attempts[0].aborted);
+  t.is(result.effort, result.attempts[1].effort);
+  t.true(result.effort < result.attempts[0].effort);
+});
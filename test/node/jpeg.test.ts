@@ -1,8 +1,13 @@
 import test from 'ava';
 import { importWasmModule, getFixturesImage } from './utils.js';
 
-import decode, { init as initDecode } from '@jsquash/jpeg/decode.js';
+import decode, {
+  decodeInto,
+  decodeThumbnail,
+  init as initDecode,
+} from '@jsquash/jpeg/decode.js';
 import encode, { init as initEncode } from '@jsquash/jpeg/encode.js';
+import { DecodeLimitError } from '@jsquash/jpeg';
 
 test('can successfully decode image', async (t) => {
   const [testImage, decodeWasmModule] = await Promise.all([
@@ -64,6 +69,159 @@ test('[regression] should correctly decode pixel data for jpeg with orientation
   t.is(data.data[2], 0);
 });
 
+test('can resize while decoding', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const data = await decode(testImage, { width: 20 });
+  t.is(data.width, 20);
+  t.is(data.height, 20);
+  t.is(data.data.length, 4 * 20 * 20);
+});
+
+test('resizes to the rotated size when preserveOrientation is true', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('exif-rotated-270.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const data = await decode(testImage, {
+    preserveOrientation: true,
+    width: 15,
+  });
+  t.is(data.width, 15);
+  t.is(data.height, 50);
+  t.is(data.data.length, 4 * 15 * 50);
+});
+
+test('decodes the embedded EXIF thumbnail', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('exif-thumbnail.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  // The full image is 30x100 once rotated, the thumbnail is 50x50.
+  const data = await decodeThumbnail(testImage);
+  t.is(data.width, 50);
+  t.is(data.height, 50);
+  t.is(data.data.length, 4 * 50 * 50);
+});
+
+test('falls back to a scaled decode without an EXIF thumbnail', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('exif-rotated-90.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const smallest = await decodeThumbnail(testImage);
+  t.is(smallest.width, 4);
+  t.is(smallest.height, 13);
+  const atLeast30 = await decodeThumbnail(testImage, { minSize: 30 });
+  t.is(atLeast30.width, 15);
+  t.is(atLeast30.height, 50);
+});
+
+test('applies the decode limits to the EXIF thumbnail', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('exif-thumbnail.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  // The thumbnail's SOF2 header declares 65535x65535 pixels instead of 50x50.
+  const bomb = new Uint8Array(testImage.slice(0));
+  const sof = bomb.findIndex((v, i) => v === 0xff && bomb[i + 1] === 0xc2);
+  bomb.set([0xff, 0xff, 0xff, 0xff], sof + 5);
+
+  const error = await t.throwsAsync(
+    () =>
+      decodeThumbnail(bomb.buffer, { limits: { maxPixels: 4096 * 4096 } }),
+    { instanceOf: DecodeLimitError },
+  );
+  t.is(error?.limit, 'maxPixels');
+});
+
+test('keeps decoding after corrupt input', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const notAJpeg = new Uint8Array(1000).fill(0x78).buffer;
+  const headerOnly = testImage.slice(0, 2);
+  const empty = new ArrayBuffer(0);
+
+  // Every corrupt input used to exit() the module, so the next call failed.
+  for (let i = 0; i < 100; i++) {
+    const corrupt = [notAJpeg, headerOnly, empty][i % 3];
+    await t.throwsAsync(() => decode(corrupt), { message: 'Decoding error' });
+    await t.throwsAsync(() => decodeThumbnail(corrupt), {
+      message: 'Decoding error',
+    });
+    const data = await decode(testImage);
+    t.is(data.width, 50);
+  }
+});
+
+test('rejects images over the decode limits', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const tooManyPixels = await t.throwsAsync(
+    () => decode(testImage, { limits: { maxPixels: 50 * 50 - 1 } }),
+    { instanceOf: DecodeLimitError },
+  );
+  t.is(tooManyPixels?.limit, 'maxPixels');
+  const tooMuchMemory = await t.throwsAsync(
+    () => decodeThumbnail(testImage, { limits: { maxMemory: 1000 } }),
+    { instanceOf: DecodeLimitError },
+  );
+  t.is(tooMuchMemory?.limit, 'maxMemory');
+
+  const data = await decode(testImage, {
+    limits: { maxPixels: 50 * 50, maxMemory: 1 << 20, timeLimit: 10_000 },
+  });
+  t.is(data.width, 50);
+});
+
+test('decodes into a region of a larger buffer', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const expected = await decode(testImage);
+  const atlas = new Uint8ClampedArray(4 * 64 * 64);
+  const size = await decodeInto(testImage, {
+    data: atlas,
+    stride: 4 * 64,
+    offset: 4 * (8 * 64 + 4),
+  });
+  t.deepEqual(size, { width: 50, height: 50 });
+  for (let y = 0; y < 50; y++) {
+    const row = expected.data.subarray(4 * 50 * y, 4 * 50 * (y + 1));
+    const dst = 4 * ((8 + y) * 64 + 4);
+    t.deepEqual(atlas.subarray(dst, dst + 4 * 50), row);
+  }
+});
+
+test('leaves untagged images as stored and rejects unusable target profiles', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.jpeg'),
+    importWasmModule('node_modules/@jsquash/jpeg/codec/dec/mozjpeg_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const managed = await decode(testImage);
+  const asStored = await decode(testImage, { ignoreColorProfile: true });
+  t.deepEqual(managed.data, asStored.data);
+  await t.throwsAsync(() =>
+    decode(testImage, { targetColorProfile: new Uint8Array(16) }),
+  );
+});
+
 test('can successfully encode image', async (t) => {
   const encodeWasmModule = await importWasmModule(
     'node_modules/@jsquash/jpeg/codec/enc/mozjpeg_enc.wasm',
@@ -77,3 +235,22 @@ test('can successfully encode image', async (t) => {
   });
   t.assert(data instanceof ArrayBuffer);
 });
+
+test('keeps encoding after invalid options', async (t) => {
+  const encodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/jpeg/codec/enc/mozjpeg_enc.wasm',
+  );
+  await initEncode(encodeWasmModule);
+  const image = {
+    data: new Uint8ClampedArray(4 * 50 * 50),
+    height: 50,
+    width: 50,
+    colorSpace: 'srgb' as const,
+  };
+  // libjpeg rejects sampling factors above 4.
+  await t.throwsAsync(
+    () => encode(image, { auto_subsample: false, chroma_subsample: 5 }),
+    { message: 'Encoding error.' },
+  );
+  t.assert((await encode(image)) instanceof ArrayBuffer);
+});
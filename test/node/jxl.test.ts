@@ -145,6 +145,32 @@ test('can successfully encode and decode lossless image', async (t) => {
   );
 });
 
+test('can encode and decode a fast lossless image', async (t) => {
+  const [encodeWasmModule, decodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/jxl/codec/enc/jxl_enc.wasm'),
+    importWasmModule('node_modules/@jsquash/jxl/codec/dec/jxl_dec.wasm'),
+  ]);
+  await initEncode(encodeWasmModule);
+  initDecode(decodeWasmModule);
+
+  const originalImageData = {
+    width: 300,
+    height: 20,
+    data: new Uint8ClampedArray(4 * 300 * 20),
+    colorSpace: 'srgb' as const,
+  };
+  for (let i = 0; i < originalImageData.data.length; i++) {
+    originalImageData.data[i] = (i * 3 + 7) % 256;
+  }
+
+  const encodedData = await encode(originalImageData, { fastLossless: true });
+  const decodedData = await decode(encodedData);
+
+  t.is(decodedData.width, originalImageData.width);
+  t.is(decodedData.height, originalImageData.height);
+  t.deepEqual(decodedData.data, originalImageData.data);
+});
+
 test('encodes lossless even with conflicting quality option', async (t) => {
   const [encodeWasmModule, decodeWasmModule] = await Promise.all([
     importWasmModule('node_modules/@jsquash/jxl/codec/enc/jxl_enc.wasm'),
@@ -1,8 +1,12 @@
 import test from 'ava';
 import { importWasmModule, getFixturesImage } from './utils.js';
 
-import decode, { init as initDecode } from '@jsquash/qoi/decode.js';
+import decode, {
+  decodeInto,
+  init as initDecode,
+} from '@jsquash/qoi/decode.js';
 import encode, { init as initEncode } from '@jsquash/qoi/encode.js';
+import { DecodeLimitError, getRecycleStats } from '@jsquash/qoi';
 
 test('can successfully decode image', async (t) => {
   const [testImage, decodeWasmModule] = await Promise.all([
@@ -16,6 +20,27 @@ test('can successfully decode image', async (t) => {
   t.is(data.data.length, 4 * 50 * 50);
 });
 
+test('rejects a header declaring more pixels than maxPixels', async (t) => {
+  const decodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/qoi/codec/dec/qoi_dec.wasm',
+  );
+  initDecode(decodeWasmModule);
+  // A 22 byte file declaring 65535x65535 RGBA pixels.
+  const bomb = new Uint8Array(22);
+  const header = new DataView(bomb.buffer);
+  bomb.set([0x71, 0x6f, 0x69, 0x66]); // "qoif"
+  header.setUint32(4, 65535);
+  header.setUint32(8, 65535);
+  bomb.set([4, 0], 12);
+  bomb.set([0, 0, 0, 0, 0, 0, 0, 1], 14);
+
+  const error = await t.throwsAsync(
+    () => decode(bomb.buffer, { limits: { maxPixels: 4096 * 4096 } }),
+    { instanceOf: DecodeLimitError },
+  );
+  t.is(error?.limit, 'maxPixels');
+});
+
 test('can successfully encode image', async (t) => {
   const encodeWasmModule = await importWasmModule(
     'node_modules/@jsquash/qoi/codec/enc/qoi_enc.wasm',
@@ -29,3 +54,152 @@ test('can successfully encode image', async (t) => {
   });
   t.assert(data instanceof ArrayBuffer);
 });
+
+test('throws when the pixel data is smaller than the image size', async (t) => {
+  const encodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/qoi/codec/enc/qoi_enc.wasm',
+  );
+  await initEncode(encodeWasmModule);
+  await t.throwsAsync(
+    encode({
+      data: new Uint8ClampedArray(4 * 50 * 49),
+      height: 50,
+      width: 50,
+      colorSpace: 'srgb' as const,
+    }),
+    { message: 'Encoding error.' },
+  );
+});
+
+test('throws for invalid image data when decoding', async (t) => {
+  const decodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/qoi/codec/dec/qoi_dec.wasm',
+  );
+  initDecode(decodeWasmModule);
+  await t.throwsAsync(decode(new ArrayBuffer(32)), {
+    message: 'Decoding error',
+  });
+});
+
+test('round trips a region of a larger buffer', async (t) => {
+  const [decodeWasmModule, encodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/qoi/codec/dec/qoi_dec.wasm'),
+    importWasmModule('node_modules/@jsquash/qoi/codec/enc/qoi_enc.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  await initEncode(encodeWasmModule);
+
+  // A 20x10 crop at (5, 3) of a 40x30 frame.
+  const frame = new Uint8ClampedArray(4 * 40 * 30);
+  for (let i = 0; i < frame.length; i++) frame[i] = (i * 37) % 251;
+  const encoded = await encode({
+    data: frame,
+    width: 20,
+    height: 10,
+    stride: 4 * 40,
+    offset: 4 * (3 * 40 + 5),
+  });
+
+  // Decoded into (10, 12) of a 32x32 atlas.
+  const atlas = new Uint8ClampedArray(4 * 32 * 32);
+  const size = await decodeInto(encoded, {
+    data: atlas,
+    stride: 4 * 32,
+    offset: 4 * (12 * 32 + 10),
+  });
+  t.deepEqual(size, { width: 20, height: 10 });
+  for (let y = 0; y < 10; y++) {
+    const src = 4 * ((3 + y) * 40 + 5);
+    const dst = 4 * ((12 + y) * 32 + 10);
+    t.deepEqual(
+      atlas.subarray(dst, dst + 4 * 20),
+      frame.subarray(src, src + 4 * 20),
+    );
+  }
+  // Nothing outside the region is written.
+  t.true(atlas.subarray(0, 4 * (12 * 32 + 10)).every((v) => v === 0));
+
+  await t.throwsAsync(
+    decodeInto(encoded, { data: atlas, stride: 4 * 32, offset: 4 * 25 * 32 }),
+    { message: 'Decoding error' },
+  );
+});
+
+test('converts between straight and premultiplied alpha', async (t) => {
+  const [decodeWasmModule, encodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/qoi/codec/dec/qoi_dec.wasm'),
+    importWasmModule('node_modules/@jsquash/qoi/codec/enc/qoi_enc.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  await initEncode(encodeWasmModule);
+
+  // Opaque, half transparent and fully transparent.
+  const straight = new Uint8ClampedArray([
+    200, 100, 50, 255, 200, 100, 50, 128, 200, 100, 50, 0,
+  ]);
+  const premultiplied = new Uint8ClampedArray([
+    200, 100, 50, 255, 100, 50, 25, 128, 0, 0, 0, 0,
+  ]);
+  const encoded = await encode({ data: straight, width: 3, height: 1 });
+  const decoded = await decode(encoded, { premultipliedAlpha: true });
+  t.deepEqual(decoded.data, premultiplied);
+
+  const reencoded = await encode(
+    { data: premultiplied, width: 3, height: 1 },
+    { premultipliedAlpha: true },
+  );
+  const roundTripped = await decode(reencoded, { premultipliedAlpha: true });
+  t.deepEqual(roundTripped.data, premultiplied);
+});
+
+// Serial, so no other test re-initialises the encoder in between.
+test.serial('recycles the module after a call grows its heap', async (t) => {
+  const encodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/qoi/codec/enc/qoi_enc.wasm',
+  );
+  await initEncode(encodeWasmModule, { maxHeapSize: 32 * 1024 * 1024 });
+  const before = getRecycleStats();
+
+  // 64 MB of pixels, far more than the 16 MB the module starts with.
+  await encode({
+    data: new Uint8ClampedArray(4 * 4096 * 4096),
+    width: 4096,
+    height: 4096,
+  });
+  // Runs on the fresh instance.
+  const data = await encode({
+    data: new Uint8ClampedArray(4 * 50 * 50),
+    width: 50,
+    height: 50,
+  });
+  t.assert(data instanceof ArrayBuffer);
+
+  const after = getRecycleStats();
+  t.is(after.recycles - before.recycles, 1);
+  t.true(after.reclaimedBytes - before.reclaimedBytes > 32 * 1024 * 1024);
+});
+
+test.serial('recycles once when concurrent calls share a module', async (t) => {
+  const encodeWasmModule = await importWasmModule(
+    'node_modules/@jsquash/qoi/codec/enc/qoi_enc.wasm',
+  );
+  await initEncode(encodeWasmModule, { maxHeapSize: 32 * 1024 * 1024 });
+  const before = getRecycleStats();
+
+  // Both calls run on the same instance and find its heap too large.
+  const large = {
+    data: new Uint8ClampedArray(4 * 4096 * 4096),
+    width: 4096,
+    height: 4096,
+  };
+  await Promise.all([encode(large), encode(large)]);
+  // Waits for the fresh instance, which the stats are counted against.
+  await encode({
+    data: new Uint8ClampedArray(4 * 50 * 50),
+    width: 50,
+    height: 50,
+  });
+
+  const after = getRecycleStats();
+  t.is(after.recycles - before.recycles, 1);
+});
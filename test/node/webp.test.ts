@@ -1,8 +1,14 @@
 import test from 'ava';
 import { importWasmModule, getFixturesImage } from './utils.js';
 
-import decode, { init as initDecode } from '@jsquash/webp/decode.js';
-import encode, { init as initEncode } from '@jsquash/webp/encode.js';
+import decode, {
+  decodeAndAnalyze,
+  init as initDecode,
+} from '@jsquash/webp/decode.js';
+import encode, {
+  encodeVariants,
+  init as initEncode,
+} from '@jsquash/webp/encode.js';
 
 test('can successfully decode image', async (t) => {
   const [testImage, decodeWasmModule] = await Promise.all([
@@ -16,6 +22,37 @@ test('can successfully decode image', async (t) => {
   t.is(data.data.length, 4 * 50 * 50);
 });
 
+test('can resize while decoding', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.webp'),
+    importWasmModule('node_modules/@jsquash/webp/codec/dec/webp_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const data = await decode(testImage, { width: 25, height: 10 });
+  t.is(data.width, 25);
+  t.is(data.height, 10);
+  t.is(data.data.length, 4 * 25 * 10);
+});
+
+test('can analyze the image while decoding', async (t) => {
+  const [testImage, decodeWasmModule] = await Promise.all([
+    getFixturesImage('test.webp'),
+    importWasmModule('node_modules/@jsquash/webp/codec/dec/webp_dec.wasm'),
+  ]);
+  initDecode(decodeWasmModule);
+  const { image, analysis } = await decodeAndAnalyze(testImage);
+  t.is(image.width, 50);
+  t.is(image.height, 50);
+  t.is(analysis.histogram.length, 1024);
+  // Each channel's histogram counts every pixel once.
+  t.is(
+    analysis.histogram.slice(0, 256).reduce((sum, count) => sum + count, 0),
+    50 * 50,
+  );
+  t.regex(analysis.perceptualHash, /^[0-9a-f]{16}$/);
+  t.assert(analysis.thumbHash instanceof Uint8Array);
+});
+
 test('can successfully encode image', async (t) => {
   const encodeWasmModule = await importWasmModule(
     'node_modules/@jsquash/webp/codec/enc/webp_enc.wasm',
@@ -29,3 +66,33 @@ test('can successfully encode image', async (t) => {
   });
   t.assert(data instanceof ArrayBuffer);
 });
+
+test('can encode several variants at once', async (t) => {
+  const [encodeWasmModule, decodeWasmModule] = await Promise.all([
+    importWasmModule('node_modules/@jsquash/webp/codec/enc/webp_enc.wasm'),
+    importWasmModule('node_modules/@jsquash/webp/codec/dec/webp_dec.wasm'),
+  ]);
+  await initEncode(encodeWasmModule);
+  initDecode(decodeWasmModule);
+
+  const outputs = await encodeVariants(
+    {
+      data: new Uint8ClampedArray(4 * 120 * 80).fill(128),
+      height: 80,
+      width: 120,
+      colorSpace: 'srgb' as const,
+    },
+    [{ width: 30 }, { quality: 75 }, { width: 60, quality: 75 }],
+  );
+  t.is(outputs.length, 3);
+  const sizes: number[][] = [];
+  for (const output of outputs) {
+    const decodedData = await decode(output);
+    sizes.push([decodedData.width, decodedData.height]);
+  }
+  t.deepEqual(sizes, [
+    [30, 20],
+    [120, 80],
+    [60, 40],
+  ]);
+});
@@ -11,8 +11,12 @@ fi
 
 BUILD_DIR=$(pwd)
 SCRIPTDIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+# Mount the whole repository so codec Makefiles can reach codec-common/ and
+# sibling packages' codec sources, then run make from the codec directory.
+REPO_ROOT="$( cd "$SCRIPTDIR/.." && pwd )"
+BUILD_SUBDIR=${BUILD_DIR#$REPO_ROOT/}
 echo "EMSDK_VERSION: $EMSDK_VERSION"
 echo "BUILD_DIR: $BUILD_DIR"
 echo "SCRIPTDIR: $SCRIPTDIR"
 docker build --build-arg EMSDK_VERSION=$EMSDK_VERSION --build-arg DEFAULT_CFLAGS="$DEFAULT_CFLAGS" -t jsquash-cpp-build - < $SCRIPTDIR/cpp.Dockerfile
-docker run --rm -v $BUILD_DIR:/src jsquash-cpp-build "$@"
+docker run --rm -v $REPO_ROOT:/src -w /src/$BUILD_SUBDIR jsquash-cpp-build "$@"
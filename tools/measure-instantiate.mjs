@@ -0,0 +1,93 @@
+#!/usr/bin/env node
+// Measures how long the C++ codec modules take to start in Node: compiling
+// the wasm, and instantiating it from an already compiled module. The second
+// number includes static constructors and embind registration, which is what
+// -s EVAL_CTORS=1 reduces.
+//
+// Usage, from the repository root after building the codecs:
+//   node tools/measure-instantiate.mjs [codec.js ...] [--runs=N]
+// With no files, every single-threaded codec in packages/*/codec is measured.
+// Each codec's .wasm is read from next to its .js.
+
+import { promises as fs } from 'node:fs';
+import path from 'node:path';
+import { fileURLToPath, pathToFileURL } from 'node:url';
+import { performance } from 'node:perf_hooks';
+
+const root = path.resolve(path.dirname(fileURLToPath(import.meta.url)), '..');
+
+const defaultCodecs = [
+  'packages/avif/codec/dec/avif_dec.js',
+  'packages/avif/codec/enc/avif_enc.js',
+  'packages/jpeg/codec/dec/mozjpeg_dec.js',
+  'packages/jpeg/codec/enc/mozjpeg_enc.js',
+  'packages/jxl/codec/dec/jxl_dec.js',
+  'packages/jxl/codec/enc/jxl_enc.js',
+  'packages/qoi/codec/dec/qoi_dec.js',
+  'packages/qoi/codec/enc/qoi_enc.js',
+  'packages/webp/codec/dec/webp_dec.js',
+  'packages/webp/codec/enc/webp_enc.js',
+];
+
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  const middle = sorted.length >> 1;
+  return sorted.length % 2
+    ? sorted[middle]
+    : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+async function measure(codecPath, runs) {
+  const jsPath = path.resolve(root, codecPath);
+  const wasm = await fs.readFile(jsPath.replace(/\.js$/, '.wasm'));
+  const { default: moduleFactory } = await import(pathToFileURL(jsPath).href);
+
+  const compileTimes = [];
+  let wasmModule;
+  for (let i = 0; i < runs; i++) {
+    const start = performance.now();
+    wasmModule = await WebAssembly.compile(wasm);
+    compileTimes.push(performance.now() - start);
+  }
+
+  // The same options the package wrappers pass in initEmscriptenModule().
+  const instantiateTimes = [];
+  for (let i = 0; i < runs; i++) {
+    const start = performance.now();
+    await moduleFactory({
+      noInitialRun: true,
+      instantiateWasm(imports, callback) {
+        const instance = new WebAssembly.Instance(wasmModule, imports);
+        callback(instance);
+        return instance.exports;
+      },
+    });
+    instantiateTimes.push(performance.now() - start);
+  }
+
+  return {
+    codec: path.relative(root, jsPath),
+    size: `${(wasm.byteLength / 1024).toFixed(0)} KiB`,
+    // V8 reuses code from earlier compiles of the same bytes, so the first
+    // compile is the cold-start cost and the median is the cached one.
+    'first compile (ms)': compileTimes[0].toFixed(2),
+    'compile (ms)': median(compileTimes).toFixed(2),
+    'instantiate (ms)': median(instantiateTimes).toFixed(2),
+  };
+}
+
+const args = process.argv.slice(2);
+const runsArg = args.find((arg) => arg.startsWith('--runs='));
+const runs = runsArg ? Number(runsArg.slice('--runs='.length)) : 20;
+const codecs = args.filter((arg) => !arg.startsWith('--'));
+
+const results = [];
+for (const codec of codecs.length ? codecs : defaultCodecs) {
+  try {
+    results.push(await measure(codec, runs));
+  } catch (error) {
+    console.error(`${codec}: ${error.message}`);
+  }
+}
+console.log(`Median of ${runs} runs, Node ${process.version}`);
+console.table(results);